@@ -0,0 +1,218 @@
+#include <cstdio>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <sys/stat.h>
+#ifdef WIN64
+#include <windows.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+#include "utils/platform.h"
+#include "utils/alu.h"
+#include "processing/Config.h"
+#include "specCache.h"
+
+#define STRINGIFY2(x) #x
+#define STRINGIFY(x) STRINGIFY2(x)
+
+#define SPEC_CACHE_MAGIC    "SPECSCC1"
+#define SPEC_CACHE_SUFFIX   ".specc"
+
+static std::string                        g_cacheFileName;   // set while a specification is compiled for the cache
+static std::string                        g_cacheSpec;
+static std::string                        g_cacheTokens;
+static std::map<std::string,std::string>  g_literalLookups;
+
+/*
+ * Identifies this build of specs. Whatever the build, the executable file
+ * itself changes when specs is rebuilt, so its size and time are part of it
+ * where it can be found.
+ */
+static std::string getBuildIdentity()
+{
+	std::string ret = SPEC_CACHE_MAGIC;
+#ifdef GITTAG
+	ret += " " STRINGIFY(GITTAG);
+#endif
+	ret += " " __DATE__ " " __TIME__;
+
+	std::string exeName;
+#if defined(WIN64)
+	char buf[MAX_PATH];
+	DWORD len = GetModuleFileNameA(NULL, buf, sizeof(buf));
+	if (len > 0 && len < sizeof(buf)) exeName.assign(buf, len);
+#elif defined(__APPLE__)
+	char buf[4096];
+	uint32_t len = sizeof(buf);
+	if (0 == _NSGetExecutablePath(buf, &len)) exeName = buf;
+#elif defined(__linux__)
+	exeName = "/proc/self/exe";
+#endif
+	struct stat st;
+	if (!exeName.empty() && 0 == stat(exeName.c_str(), &st)) {
+		ret += " " + std::to_string(st.st_size) + " " + std::to_string(st.st_mtime);
+	}
+	return ret;
+}
+
+// FNV-1a
+static uint64_t specCacheHash(const std::string& s, uint64_t hash = 14695981039346656037ULL)
+{
+	for (unsigned char c : s) {
+		hash = (hash ^ c) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+static bool readCacheFile(const std::string& fileName, std::string& contents)
+{
+	FILE* f = fopen(fileName.c_str(), "rb");
+	if (!f) return false;
+	char buf[65536];
+	size_t got;
+	while ((got = fread(buf, 1, sizeof(buf), f)) > 0) {
+		contents.append(buf, got);
+	}
+	bool bRead = (0 == ferror(f));
+	fclose(f);
+	return bRead;
+}
+
+/*
+ * Uses the cache file if it was written by this build for the same text, and
+ * every configured literal that the specification looked up still has the
+ * same value.
+ */
+static bool loadCachedSpec(const std::string& fileName, const std::string& buildIdentity,
+		const std::string& spec, std::vector<Token>& tokens)
+{
+	std::string contents;
+	if (!readCacheFile(fileName, contents)) return false;
+
+	serialReader r(contents);
+	std::string magic, savedIdentity, savedSpec, savedTokens;
+	bool bLocalWhiteSpace;
+	uint64_t countLiterals;
+	if (!r.getString(magic) || magic != SPEC_CACHE_MAGIC
+			|| !r.getString(savedIdentity) || savedIdentity != buildIdentity
+			|| !r.getString(savedSpec) || savedSpec != spec
+			|| !r.getBool(bLocalWhiteSpace) || bLocalWhiteSpace != g_bLocalWhiteSpace
+			|| !r.getInt(countLiterals)) {
+		return false;
+	}
+
+	for (uint64_t i = 0 ; i < countLiterals ; i++) {
+		std::string key, value;
+		if (!r.getString(key) || !r.getString(value) || configSpecLiteralGet(key) != value) {
+			return false;
+		}
+	}
+
+	if (!r.getString(savedTokens)) return false;
+	serialReader tokenReader(savedTokens);
+	if (!loadTokenList(tokens, tokenReader) || !aluLoadCompiledExpressions(r)) {
+		tokens.clear();
+		return false;
+	}
+	return true;
+}
+
+std::vector<Token> specCacheGetTokens(std::string& fileName)
+{
+	// The plus directives run every time, and may set literals that the specification uses
+	std::string spec = readSpecFile(fileName);
+
+	static std::string cacheOption = "specCache";
+	static std::string none = "";
+	std::string dir = g_specCache.empty() ? configSpecLiteralGetWithDefault(cacheOption, none) : g_specCache;
+
+	std::vector<Token> tokens;
+	if (dir.empty() || g_bDebugAluCompile) {
+		tokens = parseTokensSplit(spec.c_str());
+		normalizeTokenList(&tokens);
+		return tokens;
+	}
+
+	std::string buildIdentity = getBuildIdentity();
+	char hashStr[17];
+	snprintf(hashStr, sizeof(hashStr), "%016llx", (unsigned long long)(specCacheHash(spec, specCacheHash(buildIdentity))));
+	std::string cacheFileName = dir + PATHSEP + hashStr + SPEC_CACHE_SUFFIX;
+
+	if (loadCachedSpec(cacheFileName, buildIdentity, spec, tokens)) {
+		if (g_bVerbose) {
+			std::cerr << "Spec cache: Read " << tokens.size() << " tokens from " << cacheFileName << std::endl;
+		}
+		return tokens;
+	}
+
+	// Compile it, noting what it depends on
+	g_literalLookups.clear();
+	configSpecLiteralLogLookups(&g_literalLookups);
+	aluRecordCompiledExpressions();
+
+	tokens = parseTokensSplit(spec.c_str());
+	normalizeTokenList(&tokens);
+
+	serialWriter w;
+	saveTokenList(tokens, w);
+	g_cacheTokens.swap(w.data());
+	g_cacheSpec.swap(spec);
+	g_cacheFileName = cacheFileName;
+	return tokens;
+}
+
+// Saving the compiled specification is only an optimization, so failing to do so
+// is only a warning
+void specCacheSave()
+{
+	if (g_cacheFileName.empty()) return;
+	configSpecLiteralLogLookups(nullptr);
+
+	serialWriter w;
+	w.putString(SPEC_CACHE_MAGIC);
+	w.putString(getBuildIdentity());
+	w.putString(g_cacheSpec);
+	w.putBool(g_bLocalWhiteSpace);
+	w.putInt(g_literalLookups.size());
+	for (auto& entry : g_literalLookups) {
+		w.putString(entry.first);
+		w.putString(entry.second);
+	}
+	w.putString(g_cacheTokens);
+	aluSaveCompiledExpressions(w);
+
+#ifdef WIN64
+	std::string tempFileName = g_cacheFileName + ".tmp" + std::to_string(_getpid());
+#else
+	std::string tempFileName = g_cacheFileName + ".tmp" + std::to_string(getpid());
+#endif
+	std::error_code ec;
+	std::filesystem::create_directories(std::filesystem::path(g_cacheFileName).parent_path(), ec);
+	FILE* f = fopen(tempFileName.c_str(), "wb");
+	bool bWritten = false;
+	if (f) {
+		std::string& contents = w.data();
+		bWritten = contents.length() == fwrite(contents.data(), 1, contents.length(), f);
+		bWritten = (0 == fclose(f)) && bWritten;
+#ifdef WIN64
+		if (bWritten) remove(g_cacheFileName.c_str());
+#endif
+		if (!bWritten || 0 != rename(tempFileName.c_str(), g_cacheFileName.c_str())) {
+			remove(tempFileName.c_str());
+			bWritten = false;
+		}
+	}
+
+	if (!bWritten) {
+		std::cerr << "Spec cache: Could not write " << g_cacheFileName << std::endl;
+	} else if (g_bVerbose) {
+		std::cerr << "Spec cache: Wrote " << g_cacheFileName << std::endl;
+	}
+	g_cacheFileName.clear();
+}
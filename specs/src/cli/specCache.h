@@ -0,0 +1,22 @@
+#ifndef SPECS2016__CLI__SPEC_CACHE__H
+#define SPECS2016__CLI__SPEC_CACHE__H
+
+#include <string>
+#include <vector>
+#include "tokens.h"
+
+/*
+ * The compiled specification cache. With --spec-cache DIR, or the configured
+ * literal specCache, a specification file that was compiled before is not
+ * parsed again. Its normalized tokens and its expressions in RPN are read from
+ * a file in that directory, named for the text of the specification and the
+ * build of specs that wrote it.
+ */
+
+// Reads a specification file and returns its normalized tokens, from the cache if it can
+std::vector<Token> specCacheGetTokens(std::string& fileName);
+
+// Once the specification has compiled, saves it unless it was read from the cache
+void specCacheSave();
+
+#endif
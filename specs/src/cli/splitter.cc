@@ -191,7 +191,7 @@ static void openSpecFile(std::ifstream& theFile, std::string& fileName)
 	if (spath) free(spath);
 }
 
-std::vector<Token> parseTokensFile(std::string& fileName)
+std::string readSpecFile(std::string& fileName)
 {
 	std::ifstream specFile;
 	openSpecFile(specFile, fileName);
@@ -216,13 +216,19 @@ std::vector<Token> parseTokensFile(std::string& fileName)
 				spec += removeComment(line);
 			}
 		}
-		return parseTokensSplit(spec.c_str());
+		return spec;
 	} else {
 		std::string err = "Spec file not found: " + fileName;
 		MYTHROW(err);
 	}
 }
 
+std::vector<Token> parseTokensFile(std::string& fileName)
+{
+	std::string spec = readSpecFile(fileName);
+	return parseTokensSplit(spec.c_str());
+}
+
 static bool isPotentiallyASpecificationName(const char* _s)
 {
 	if (_s[0]=='.' || _s[0]=='_') return false;
@@ -1,6 +1,11 @@
 #include <string.h>
 #include <regex>
 #include <cctype>
+#include <algorithm>
+#include <iterator>
+#include <climits>
+#include <cerrno>
+#include <cstdlib>
 #include "utils/platform.h"
 #include "tokens.h"
 #include "processing/Config.h"
@@ -13,8 +18,6 @@ extern std::string conv_X2CH(std::string& s);
 
 Token dummyToken(TokenListType__DUMMY, nullptr, "", 0, std::string("dummyToken"));
 
-std::vector<Token> parseTokensSplit(const char* arg);
-
 class TokenFieldRangeSimple : public TokenFieldRange {
 	public:
 		TokenFieldRangeSimple(int _from, int _to) {m_first = _from; m_last = _to; m_idx = _from; bIsSingleNumber = false;}
@@ -171,12 +174,31 @@ std::string& Token::HelpIdentify()
 }
 
 /* Helper functions */
+
+/*
+ * Like std::stol, but returns false instead of throwing if there is no number
+ * or it is out of range. Most tokens are not numbers, and the first exception
+ * that a run throws costs more than parsing the whole specification.
+ */
+static bool parseLong(const std::string& s, long int& l, size_t* pPos = nullptr)
+{
+	const char* pStart = s.c_str();
+	char* pEnd;
+	errno = 0;
+	l = strtol(pStart, &pEnd, 10);
+	if (pEnd==pStart || errno==ERANGE) {
+		return false;
+	}
+	if (pPos) {
+		*pPos = size_t(pEnd - pStart);
+	}
+	return true;
+}
+
 static PTokenFieldRange parseAsSingleNumber(std::string s)
 {
 	long int l;
-	try {
-		l = std::stol(s);
-	} catch(std::invalid_argument& e) {
+	if (!parseLong(s, l)) {
 		return nullptr;
 	}
 	if (l==0 || s!=std::to_string(l)) {
@@ -193,9 +215,7 @@ static PTokenFieldRange parseAsFromToRange(std::string s)
 	size_t posOfHyphen;
 	bool   bRealHyphen; // rather than semicolon or colon
 	long int _from, _to;
-	try {
-		_from = std::stol(s, &posOfHyphen);
-	} catch(std::invalid_argument& e) {
+	if (!parseLong(s, _from, &posOfHyphen)) {
 		return nullptr;
 	}
 	if (_from==0 || s.substr(0,posOfHyphen)!=std::to_string(_from)
@@ -205,8 +225,7 @@ static PTokenFieldRange parseAsFromToRange(std::string s)
 
 	bRealHyphen = (s[posOfHyphen]=='-');
 
-	try {
-		_to = std::stol(s.substr(posOfHyphen+1));
+	if (parseLong(s.substr(posOfHyphen+1), _to)) {
 		if (_to==0 || s.substr(posOfHyphen+1)!=std::to_string(_to)) {
 			return nullptr;
 		}
@@ -215,7 +234,7 @@ static PTokenFieldRange parseAsFromToRange(std::string s)
 				return nullptr;
 			}
 		}
-	} catch (std::invalid_argument& e) {
+	} else {
 		if (s.substr(posOfHyphen+1)=="*") {
 			_to = LAST_POS_END;
 		} else {
@@ -230,17 +249,13 @@ static PTokenFieldRange parseAsFromLenRange(std::string s)
 {
 	size_t posOfDot;
 	long int _from, _to, _len;
-	try {
-		_from = std::stol(s, &posOfDot);
-	} catch(std::invalid_argument& e) {
+	if (!parseLong(s, _from, &posOfDot)) {
 		return nullptr;
 	}
 	if (_from==0 || s.substr(0,posOfDot)!=std::to_string(_from) || s[posOfDot]!='.') {
 		return nullptr;
 	}
-	try {
-		_len = std::stol(s.substr(posOfDot+1));
-	} catch (std::invalid_argument& e) {
+	if (!parseLong(s.substr(posOfDot+1), _len)) {
 		return nullptr;
 	}
 	if (_len<=0 || s.substr(posOfDot+1)!=std::to_string(_len)) {
@@ -318,6 +333,7 @@ void parseSingleToken(std::vector<Token> *pVec, std::string arg, int argidx)
 	SIMPLETOKEN(printonly, PRINTONLY);
 	SIMPLETOKEN(eof, EOF);
 	SIMPLETOKEN(keep, KEEP);
+	SIMPLETOKEN(groupby, GROUPBY);
 	SIMPLETOKEN(strip, STRIP);
 	SIMPLETOKEN(left, LEFT);
 	SIMPLETOKEN(right, RIGHT);
@@ -428,16 +444,11 @@ void parseSingleToken(std::vector<Token> *pVec, std::string arg, int argidx)
 		if (firstdot!=std::string::npos) {
 			nwnf = arg.substr(0,firstdot);
 			std::string fieldLength = arg.substr(firstdot+1);
-			try {
-				int lFieldLength = std::stoi(fieldLength);
-				if (lFieldLength > 0 && std::to_string(lFieldLength)==fieldLength) {
-					pSimpleRange = std::make_shared<TokenFieldRangeSimple>(1,lFieldLength);
-				} else {
-					goto CONT1;
-				}
-			} catch (std::invalid_argument& e) {
-				goto CONT1;
-			} catch (std::out_of_range& e) {
+			long int lFieldLength;
+			if (parseLong(fieldLength, lFieldLength) && lFieldLength > 0 && lFieldLength <= INT_MAX
+					&& std::to_string(lFieldLength)==fieldLength) {
+				pSimpleRange = std::make_shared<TokenFieldRangeSimple>(1,int(lFieldLength));
+			} else {
 				goto CONT1;
 			}
 		}
@@ -470,7 +481,8 @@ CONT1:
 	}
 
 	/* Check for hex literal */
-	if ((arg[0]=='x') && (arg.length() > 1) && (1==arg.length() % 2)) {
+	if ((arg[0]=='x') && (arg.length() > 1) && (1==arg.length() % 2)
+			&& std::all_of(arg.begin()+1, arg.end(), [](char c) { return 0!=isxdigit((unsigned char)c); })) {
 		try {
 			std::string hexLiteral = arg.substr(1);
 			std::string literal = conv_X2CH(hexLiteral);
@@ -619,9 +631,18 @@ void normalizeTokenList(std::vector<Token> *tokList)
 	if (tokList->size()==0) return;
 	bool bMayAccumulateConditions;
 
-	for (size_t i=0; i<tokList->size()-1; i++) {
-		Token& tok = tokList->at(i);
-		Token& nextTok = tokList->at(i+1);
+	// The tokens that are not yet normalized, in reverse order. Consuming the
+	// token that follows the current one is then a pop_back() rather than an
+	// erase from the middle of the list, which made long specifications slow.
+	std::vector<Token> pending(std::make_move_iterator(tokList->rbegin()), std::make_move_iterator(tokList->rend()));
+	tokList->clear();
+	tokList->reserve(pending.size());
+
+	while (pending.size() > 1) {
+		tokList->push_back(std::move(pending.back()));
+		pending.pop_back();
+		Token& tok = tokList->back();
+		Token& nextTok = pending.back();
 		bMayAccumulateConditions = false;
 		switch (tok.Type()) {
 		case TokenListType__WORDRANGE:
@@ -632,7 +653,7 @@ void normalizeTokenList(std::vector<Token> *tokList)
 					MYTHROW(err);
 				}
 				tok.setRange(nextTok.Range());
-				tokList->erase(tokList->begin()+(i+1));
+				pending.pop_back();
 			}
 			break;
 		case TokenListType__WORDSEPARATOR:
@@ -654,7 +675,7 @@ void normalizeTokenList(std::vector<Token> *tokList)
 						MYTHROW(err);
 					}
 					tok.setLiteral(getLiteral(nextTok));
-					tokList->erase(tokList->begin()+(i+1));
+					pending.pop_back();
 				} else if (nextTok.Type()==TokenListType__RANGE) {
 					PTokenFieldRange pRange = nextTok.Range();
 					if (!pRange->isSingleNumber()) {
@@ -667,7 +688,7 @@ void normalizeTokenList(std::vector<Token> *tokList)
 						MYTHROW(err);
 					}
 					tok.setLiteral(std::to_string(num));
-					tokList->erase(tokList->begin()+(i+1));
+					pending.pop_back();
 				} else {
 					std::string err = "Bad word/field separator <"+nextTok.Orig()+"> at index "+std::to_string(nextTok.argIndex())+". Must be single character.";
 					MYTHROW(err);
@@ -680,10 +701,10 @@ void normalizeTokenList(std::vector<Token> *tokList)
 			if (tok.Literal()=="") {
 				if (mayBeFieldIdentifier(nextTok)) {
 					tok.setLiteral(getLiteral(nextTok));
-					tokList->erase(tokList->begin()+(i+1));
+					pending.pop_back();
 				} else if (TokenListType__PRINTONLY == tok.Type() && TokenListType__EOF == nextTok.Type()) {
 					tok.setLiteral("EOF");
-					tokList->erase(tokList->begin()+(i+1));
+					pending.pop_back();
 				} else {
 					std::string err = "Bad field identifier <"+nextTok.Orig()+"> for <" +
 							tok.Orig() + "> at index "+std::to_string(nextTok.argIndex());
@@ -708,23 +729,20 @@ void normalizeTokenList(std::vector<Token> *tokList)
 				if (TokenListType__GROUPSTART == nextTok.Type()) {
 					std::string expression = "(";
 					do {
-						tokList->erase(tokList->begin()+(i+1));
-						nextTok = tokList->at(i+1);
-						expression += getLiteral(nextTok);
-					} while (TokenListType__GROUPEND != nextTok.Type());
+						pending.pop_back();
+						MYASSERT(!pending.empty());
+						expression += getLiteral(pending.back());
+					} while (TokenListType__GROUPEND != pending.back().Type());
 					expression += ")";
-					tokList->erase(tokList->begin()+(i+1));
+					pending.pop_back();
 					tok.setLiteral(expression);
 				} else {
 					do {
 						if (!tok.Literal().empty())
 							tok.appendLiteral(' ');
-						tok.appendLiteral(getLiteral(nextTok));
-						tokList->erase(tokList->begin()+(i+1));
-						if (i+1 < tokList->size()) {
-							nextTok = tokList->at(i+1);
-						} 
-					} while (bMayAccumulateConditions && (i+1 < tokList->size()) && (TokenListType__LITERAL == nextTok.Type()));
+						tok.appendLiteral(getLiteral(pending.back()));
+						pending.pop_back();
+					} while (bMayAccumulateConditions && !pending.empty() && (TokenListType__LITERAL == pending.back().Type()));
 				}
 			}
 			break;
@@ -762,7 +780,7 @@ void normalizeTokenList(std::vector<Token> *tokList)
 						" with content <" + nextTok.Orig() + "> following SELECT";
 					MYTHROW(err);
 				}
-				tokList->erase(tokList->begin()+(i+1));
+				pending.pop_back();
 			}
 			break;
 		}
@@ -796,18 +814,19 @@ void normalizeTokenList(std::vector<Token> *tokList)
 						" with content <" + nextTok.Orig() + "> following OUTSTREAM";
 					MYTHROW(err);
 				}
-				tokList->erase(tokList->begin()+(i+1));
+				pending.pop_back();
 			}
 			break;
 		}
 		case TokenListType__BREAK:  // next token must be a literal one-letter
+		case TokenListType__GROUPBY:
 		{
 			if (tok.Literal()=="") {
 				if (mayBeFieldIdentifier(nextTok)) {
 					tok.setLiteral(getLiteral(nextTok));
-					tokList->erase(tokList->begin()+(i+1));
+					pending.pop_back();
 				} else {
-					std::string err = "Bad field identifier <"+nextTok.Orig()+"> for BREAK at index "+std::to_string(nextTok.argIndex());
+					std::string err = "Bad field identifier <"+nextTok.Orig()+"> for "+TokenListType__2str(tok.Type())+" at index "+std::to_string(nextTok.argIndex());
 					MYTHROW(err);
 				}
 			}
@@ -827,7 +846,7 @@ void normalizeTokenList(std::vector<Token> *tokList)
 					MYTHROW(err);
 				}
 				nextTok.deallocDynamic();
-				tokList->erase(tokList->begin()+(i+1));
+				pending.pop_back();
 			}
 			break;
 		}
@@ -843,7 +862,7 @@ void normalizeTokenList(std::vector<Token> *tokList)
 			if (nextTok.Literal().length() == 0) {
 				if (mayBeNamedString(nextTok.Orig())) {
 					tok.setLiteral(nextTok.Orig());
-					tokList->erase(tokList->begin()+(i+1));
+					pending.pop_back();
 				} else {
 					std::string err = "Bad name <"+nextTok.Orig()+"> follows REQUIRES at index "+std::to_string(nextTok.argIndex());
 					MYTHROW(err);
@@ -851,7 +870,7 @@ void normalizeTokenList(std::vector<Token> *tokList)
 			} else { // literal exists
 				if (mayBeNamedString(nextTok.Literal())) {
 					tok.setLiteral(nextTok.Literal());
-					tokList->erase(tokList->begin()+(i+1));
+					pending.pop_back();
 				} else {
 					std::string err = "Bad name <"+nextTok.Orig()+"> follows REQUIRES at index "+std::to_string(nextTok.argIndex());
 					MYTHROW(err);
@@ -863,5 +882,52 @@ void normalizeTokenList(std::vector<Token> *tokList)
 			break;
 		}
 	}
+
+	if (!pending.empty()) {
+		tokList->push_back(std::move(pending.back()));
+	}
+}
+
+
+void saveTokenList(std::vector<Token>& tokList, serialWriter& w)
+{
+	w.putInt(tokList.size());
+	for (Token& tok : tokList) {
+		w.putInt(uint64_t(tok.Type()));
+		PTokenFieldRange pRange = tok.Range();
+		w.putBool(pRange != nullptr);
+		if (pRange) {
+			MYASSERT(pRange->isSimpleRange());
+			w.putInt(uint64_t(int64_t(pRange->getSimpleFirst())));
+			w.putInt(uint64_t(int64_t(pRange->getSimpleLast())));
+			w.putBool(pRange->isSingleNumber());
+		}
+		w.putString(tok.Literal());
+		w.putInt(uint64_t(int64_t(tok.argIndex())));
+		w.putString(tok.Orig());
+	}
 }
 
+bool loadTokenList(std::vector<Token>& tokList, serialReader& r)
+{
+	uint64_t count;
+	if (!r.getInt(count)) return false;
+	tokList.reserve(size_t(count));
+	for (uint64_t i = 0 ; i < count ; i++) {
+		uint64_t type, argIndex;
+		bool bHasRange;
+		std::string literal, orig;
+		PTokenFieldRangeSimple pRange = nullptr;
+		if (!r.getInt(type) || type >= TokenListType__COUNT_ITEMS || !r.getBool(bHasRange)) return false;
+		if (bHasRange) {
+			uint64_t first, last;
+			bool bSingleNumber;
+			if (!r.getInt(first) || !r.getInt(last) || !r.getBool(bSingleNumber)) return false;
+			pRange = std::make_shared<TokenFieldRangeSimple>(int(int64_t(first)), int(int64_t(last)));
+			if (bSingleNumber) pRange->setSingleNumber();
+		}
+		if (!r.getString(literal) || !r.getInt(argIndex) || !r.getString(orig)) return false;
+		tokList.push_back(Token(TokenListTypes(type), pRange, literal, int(int64_t(argIndex)), orig));
+	}
+	return true;
+}
@@ -5,6 +5,7 @@
 #include <vector>
 #include <memory>
 #include "utils/ErrorReporting.h"
+#include "utils/serialBuffer.h"
 
 //
 // The TOKEN_TYPE_LIST X-macro
@@ -22,6 +23,7 @@
 	X(PRINTONLY,      false, true)  \
 	X(EOF,            false, false) \
 	X(KEEP,           false, false) \
+	X(GROUPBY,        false, true)  \
 	X(READ,           false, false) \
 	X(READSTOP,       false, false) \
 	X(WRITE,          false, false) \
@@ -146,10 +148,19 @@ extern Token dummyToken;
 
 std::vector<Token> parseTokens(int argc, char** argv);
 
+std::vector<Token> parseTokensSplit(const char* arg);
+
+// Runs the plus directives of a specification file, and returns the rest without comments
+std::string readSpecFile(std::string& fileName);
+
 std::vector<Token> parseTokensFile(std::string& fileName);
 
 void normalizeTokenList(std::vector<Token> *tokList);
 
+// The compact form of a normalized token list, for the compiled specification cache
+void saveTokenList(std::vector<Token>& tokList, serialWriter& w);
+bool loadTokenList(std::vector<Token>& tokList, serialReader& r);
+
 bool dumpSpecificationsList(std::string specName = "");
 
 #endif
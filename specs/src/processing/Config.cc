@@ -4,6 +4,7 @@
  */
 
 #include <map>
+#include <vector>
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
@@ -31,12 +32,19 @@ CONFIG_PARAMS
 extern unsigned int g_WhileGuardLimit;
 
 static std::map<std::string,std::string> ExternalLiterals;
+static bool g_bConfigurationFileDeferred = false;
+static std::vector<std::pair<std::string,std::string>> DeferredLiterals;   // with --fast-start, until one is needed
+static std::map<std::string,std::string>* g_pLiteralLookupLog = nullptr;
+static std::string FullSpecPath;          // depends on the literals, so it is forgotten with them
+static bool FullSpecPathKnown = false;
 
-static void useKeyValue(std::string& key, std::string& value)
+static void useKeyValue(std::string& key, std::string& value, bool bApplySettings, bool bKeepLiterals)
 {
 	if (':'==key.at(key.length() - 1)) {
 		key = key.substr(0,key.length() - 1);
-		if (key == "timezone") {
+		if (!bApplySettings) {
+			// only the literal is kept
+		} else if (key == "timezone") {
 			specTimeSetTimeZone(value);
 		} else if (key == "locale") {
 			if (value=="global") value = "";
@@ -47,7 +55,9 @@ static void useKeyValue(std::string& key, std::string& value)
 		} else if (key == "while-guard-limit") {
 			g_WhileGuardLimit = std::stoul(value);
 		}
-		if (ExternalLiterals.find(key) == ExternalLiterals.end()) {
+		if (!bKeepLiterals) {
+			DeferredLiterals.emplace_back(key, value);
+		} else if (ExternalLiterals.find(key) == ExternalLiterals.end()) {
 			ExternalLiterals[key] = value;
 		}
 	}
@@ -138,8 +148,20 @@ static std::string getTerminalRowsAndColumns(bool bGetRows)
 
 }
 
-void readConfigurationFile()
+static void addBuiltInLiterals()
 {
+#ifdef GITTAG
+	ExternalLiterals["version"] = STRINGIFY(GITTAG);
+#endif
+#ifdef LITERAL_PLATFORM
+	ExternalLiterals["platform"] = STRINGIFY(LITERAL_PLATFORM);
+#endif
+	ExternalLiterals["python"] = pythonInterfaceEnabled() ? "Enabled" : "Disabled";
+}
+
+void readConfigurationFile(bool bApplySettings, bool bKeepLiterals)
+{
+	g_bConfigurationFileDeferred = false;
 	std::string line;
 	unsigned int lineCounter = 0;
 	std::string configFileName = getConfigFileName();
@@ -184,40 +206,68 @@ void readConfigurationFile()
 				value = line.substr(idx2, idx-idx2);
 			}
 
-			useKeyValue(key, value);
+			useKeyValue(key, value, bApplySettings, bKeepLiterals);
 		}
 	} else {
 	}
 
-	// Some built-in stuff
-#ifdef GITTAG
-	ExternalLiterals["version"] = STRINGIFY(GITTAG);
-#endif
-#ifdef LITERAL_PLATFORM
-	ExternalLiterals["platform"] = STRINGIFY(LITERAL_PLATFORM);
-#endif
-	ExternalLiterals["python"] = pythonInterfaceEnabled() ? "Enabled" : "Disabled";
-	if (0==ExternalLiterals.count("cols")) {
-		ExternalLiterals["cols"] = getTerminalRowsAndColumns(false);
+	if (bKeepLiterals) {
+		addBuiltInLiterals();
+	}
+}
+
+void deferConfigurationFile()
+{
+	DeferredLiterals.clear();
+	readConfigurationFile(true, false);
+	g_bConfigurationFileDeferred = true;
+}
+
+// Keeps the configured literals that deferConfigurationFile set aside
+static void keepDeferredLiterals()
+{
+	g_bConfigurationFileDeferred = false;
+	for (auto& kv : DeferredLiterals) {
+		ExternalLiterals.emplace(kv.first, kv.second);   // --set and earlier lines win
+	}
+	DeferredLiterals.clear();
+	addBuiltInLiterals();
+}
+
+// The terminal size is looked up only if the rows or cols literals are used
+static std::string& configSpecLiteralLookup(std::string& key)
+{
+	if (g_bConfigurationFileDeferred) {
+		keepDeferredLiterals();
+	}
+	std::string& value = ExternalLiterals[key];
+	if (value.empty()) {
+		if (key == "cols") {
+			value = getTerminalRowsAndColumns(false);
+		} else if (key == "rows") {
+			value = getTerminalRowsAndColumns(true);
+		}
 	}
-	if (0==ExternalLiterals.count("rows")) {
-		ExternalLiterals["rows"] = getTerminalRowsAndColumns(true);
+	if (g_pLiteralLookupLog) {
+		g_pLiteralLookupLog->emplace(key, value);
 	}
+	return value;
 }
 
 bool configSpecLiteralExists(std::string& key)
 {
-	return !ExternalLiterals[key].empty();
+	return !configSpecLiteralLookup(key).empty();
 }
 
 std::string& configSpecLiteralGet(std::string& key)
 {
-	return ExternalLiterals[key];
+	return configSpecLiteralLookup(key);
 }
 
 std::string& configSpecLiteralGetWithDefault(std::string& key, std::string& _default)
 {
-	return ExternalLiterals[key].empty() ? _default : ExternalLiterals[key];
+	std::string& value = configSpecLiteralLookup(key);
+	return value.empty() ? _default : value;
 }
 
 void configSpecLiteralSet(std::string& key, std::string& value)
@@ -225,6 +275,26 @@ void configSpecLiteralSet(std::string& key, std::string& value)
 	ExternalLiterals[key] = value;
 }
 
+void configSpecLiteralLogLookups(std::map<std::string,std::string>* pLog)
+{
+	g_pLiteralLookupLog = pLog;
+}
+
+void configSpecLiteralForgetAll()
+{
+	ExternalLiterals.clear();
+	DeferredLiterals.clear();
+	g_bConfigurationFileDeferred = false;
+	FullSpecPathKnown = false;
+}
+
+void configResetSwitches()
+{
+#define X(nm,typ,defval,ssw,cliswitch,oval) g_##nm = defval;
+	CONFIG_PARAMS
+#undef X
+}
+
 bool anyNonPrimaryInputStreamDefined()
 {
 	static bool ret = false;
@@ -261,21 +331,23 @@ bool inputStreamIsDefined(int i)
 
 const char* getFullSpecPath()
 {
-	static std::string res("");
-	static bool ran_once = false;
+	std::string& res = FullSpecPath;
 
-	if (!ran_once) {
+	if (!FullSpecPathKnown) {
 		static std::string pathConfigString("SPECSPATH");
+		res.clear();
 
 		// add the path from the environment variable
 		char* envpath = getenv(pathConfigString.c_str());
 		if (envpath && envpath[0]) {
+			envpath = strdup(envpath);
 			char* onePath = strtok(envpath, PATH_LIST_SEPARATOR);
 			while (onePath) {
 				if (res.length()>0) res += PATH_LIST_SEPARATOR;
 				res += onePath;
 				onePath = strtok(nullptr, PATH_LIST_SEPARATOR);
 			}
+			free(envpath);
 		}
 
 		// Also add from the configuration string
@@ -302,7 +374,7 @@ const char* getFullSpecPath()
 			res += "specs";
 		}
 
-		ran_once = true;
+		FullSpecPathKnown = true;
 	}
 
 	return res.c_str();
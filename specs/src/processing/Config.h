@@ -2,6 +2,7 @@
 #define SPECS2016__PROCESSING__CONFIG__H
 
 #include <string>
+#include <map>
 
 // For the ssw parameter, use zero (0) for the short switch if none is needed
 #define CONFIG_PARAMS  \
@@ -20,6 +21,9 @@
 	X(bDebugAluCompile,             bool,         false,  0,debug-alu-comp,     true)       \
 	X(bDebugAluRun,                 bool,         false,  0,debug-alu-run,      true)       \
 	X(bNoWhileGuard,                bool,         false,  0,no-while-guard,     true)       \
+	X(bFastStart,                   bool,         false,  0,fast-start,         true)       \
+	X(specCache,                    std::string,  "",     0,spec-cache,         NEXTARG)    \
+	X(serverSocket,                 std::string,  "",     0,server,             NEXTARG)    \
 	X(configurationFile,            std::string,  "",     c,config,             NEXTARG)    \
 	X(timeZone,                     std::string,  "",     0,timezone,           NEXTARG)    \
 	X(recfm,                        std::string,  "",     0,recfm,              NEXTARG)    \
@@ -29,6 +33,7 @@
 	X(regexSyntaxType,              std::string,  "",     0,regexType,          NEXTARG)    \
 	X(pythonFuncs,                  std::string,  "auto", 0,pythonFuncs,        NEXTARG)    \
 	X(pythonErr,                    std::string,  "",     0,pythonErr,          NEXTARG)    \
+	X(pythonWorkers,                int,          0,      0,pythonWorkers,std::stoi(NEXTARG))    \
 	X(help,                         std::string,  "",     0,help,               NEXTARG)    \
 	X(info,                         bool,         false,  0,info,               true)       \
 	X(incmd,                        std::string,  "",     C,incmd,              NEXTARG)    \
@@ -60,7 +65,14 @@ CONFIG_PARAMS
 #define EXTERNAL_FUNC_ERR_ZERO    "zero"
 #define EXTERNAL_FUNC_ERR_NULLSTR "nullstr"
 
-void readConfigurationFile();
+// The specs server reads the file without applying settings such as timezone:,
+// so that they do not carry over into its requests. Without bKeepLiterals, the
+// configured literals are set aside for deferConfigurationFile.
+void readConfigurationFile(bool bApplySettings = true, bool bKeepLiterals = true);
+
+// With --fast-start, settings such as timezone: are applied at startup, but the
+// configured literals are set aside, and added only when one of them is first needed
+void deferConfigurationFile();
 
 bool configSpecLiteralExists(std::string& key);
 
@@ -70,6 +82,19 @@ std::string& configSpecLiteralGetWithDefault(std::string& key, std::string& _def
 
 void configSpecLiteralSet(std::string& key, std::string& value);
 
+// Notes the value of every configured literal that is looked up, or stops noting
+// them if pLog is nullptr. The compiled specification cache uses this to know
+// which literals a specification depends on.
+void configSpecLiteralLogLookups(std::map<std::string,std::string>* pLog);
+
+// Forgets the configured literals, so that a request to the specs server reads
+// the configuration file afresh and its --set switches apply as in a direct run
+void configSpecLiteralForgetAll();
+
+// Sets every switch back to its default, so that a request to the specs server
+// does not inherit the server's switches
+void configResetSwitches();
+
 bool anyNonPrimaryInputStreamDefined();
 
 bool inputStreamIsDefined(int i);
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cctype>
 #include <unordered_set>
 #include "Config.h"
@@ -7,6 +8,10 @@
 
 #define EMPTY_FIELD_MARKER  999999999
 
+#define NO_ACTIVE_GROUP  size_t(-1)
+
+extern ALUCounters g_counters;
+
 // helper functions
 
 /*
@@ -16,6 +21,19 @@
 #define IS_UPPERCASE(x) ((x)>='A' && (x)<='Z')
 #define IS_LOWERCASE(x) ((x)>='a' && (x)<='z')
 
+// Maps a field identifier to its slot, or -1 if it's not a letter
+static inline int fieldIdentifierSlot(char id)
+{
+	if (IS_LOWERCASE(id)) return id - 'a';
+	if (IS_UPPERCASE(id)) return id - 'A' + 26;
+	return -1;
+}
+
+static inline char fieldIdentifierFromSlot(int slot)
+{
+	return (slot < 26) ? char('a' + slot) : char('A' + slot - 26);
+}
+
 bool breakLevelGE(char c1, char c2)
 {
 	if (!c2) return true;
@@ -47,6 +65,7 @@ void ProcessingState::Reset()
 	m_fieldSeparator = DEFAULT_FIELDSEPARATOR;
 	m_fieldCount = -1;
 	m_wordCount = -1;
+	m_recordCache.clear();
 	m_CycleCounter = 0;
 	m_ExtraReads = 0;
 	m_inputStation = STATION_FIRST;
@@ -63,6 +82,7 @@ ProcessingState::ProcessingState()
 	m_bEOF = false;
 	m_outputIndex = 1;
 	m_Writers = nullptr;
+	fieldIdentifiersInit();
 }
 
 ProcessingState::ProcessingState(ProcessingState& ps)
@@ -85,6 +105,7 @@ ProcessingState::ProcessingState(ProcessingState& ps)
 	m_bEOF = false;
 	m_outputIndex = 1;
 	m_Writers = nullptr;
+	fieldIdentifiersInit();
 }
 
 ProcessingState::ProcessingState(ProcessingState* pPS)
@@ -107,6 +128,20 @@ ProcessingState::ProcessingState(ProcessingState* pPS)
 	m_bEOF = false;
 	m_outputIndex = 1;
 	m_Writers = nullptr;
+	fieldIdentifiersInit();
+}
+
+void ProcessingState::fieldIdentifiersInit()
+{
+	m_fieldIdentifierGeneration = 1;
+	for (int i=0; i<FIELD_IDENTIFIER_SLOTS; i++) {
+		m_fieldIdentifierGen[i] = 0;
+		m_groupSlotUsed[i] = false;
+	}
+	m_groupByKey = 0;
+	m_activeGroup = NO_ACTIVE_GROUP;
+	m_activeGroupGen = 0;
+	m_groupCursor = 0;
 }
 
 ProcessingState::~ProcessingState()
@@ -127,15 +162,21 @@ void ProcessingState::setString(PSpecString ps, bool bResetState)
 	m_ps = ps;
 	m_wordCount = -1;
 	m_fieldCount = -1;
+	recordCacheClear();
 	if (bResetState) {
 		fieldIdentifierClear();
 		resetBreaks();
+		// Each record selects its group again when it sets the key
+		if (m_groupByKey) {
+			groupActivate(NO_ACTIVE_GROUP);
+		}
 	}
 }
 
 void ProcessingState::setStringInPlace(PSpecString ps)
 {
 	m_ps = ps;
+	recordCacheClear();
 }
 
 void ProcessingState::setFirst()
@@ -144,6 +185,7 @@ void ProcessingState::setFirst()
 		m_inputStation = STATION_FIRST;
 		m_wordCount = -1;
 		m_fieldCount = -1;
+		recordCacheClear();
 	}
 }
 
@@ -153,6 +195,7 @@ void ProcessingState::setSecond()
 		m_inputStation = STATION_SECOND;
 		m_wordCount = -1;
 		m_fieldCount = -1;
+		recordCacheClear();
 	}
 }
 
@@ -163,6 +206,7 @@ void ProcessingState::setStream(int inputStreamIndex)
 	if (inputStreamIndex != m_inputStream) {
 		m_wordCount = -1;
 		m_fieldCount = -1;
+		recordCacheClear();
 		m_inputStream = inputStreamIndex;
 		m_inputStreamChanged = true;
 	}
@@ -192,6 +236,7 @@ PSpecString ProcessingState::extractCurrentRecord()
 {
 	PSpecString ret = m_ps;
 	m_ps = std::make_shared<std::string>(); // empty string
+	recordCacheClear();
 	return ret;
 }
 
@@ -247,6 +292,7 @@ void ProcessingState::alterFieldSeparator(const std::string& sep)
 {
 	m_fieldSeparator = sep;
 	m_fieldCount = -1;
+	recordCacheClear();
 }
 
 std::string& ProcessingState::getFieldSeparator()
@@ -259,6 +305,21 @@ void ProcessingState::alterWordSeparator(const std::string& sep)
 	m_wordSeparator = sep;
 	m_wordSeparatorLocal = false;
 	m_wordCount = -1;
+	recordCacheClear();
+}
+
+PValue ProcessingState::recordCacheGet(recordCacheFunc func, ALUInt arg1, ALUInt arg2)
+{
+	auto it = m_recordCache.find(recordCacheKey(func, arg1, arg2));
+	if (it==m_recordCache.end()) {
+		return nullptr;
+	}
+	return it->second;
+}
+
+void ProcessingState::recordCacheSet(recordCacheFunc func, ALUInt arg1, ALUInt arg2, PValue val)
+{
+	m_recordCache[recordCacheKey(func, arg1, arg2)] = val;
 }
 
 std::string& ProcessingState::getWordSeparator()
@@ -386,71 +447,185 @@ PSpecString ProcessingState::getFromTo(int from, int to)
 
 void ProcessingState::fieldIdentifierClear()
 {
-	m_fieldIdentifiers.clear();
+	m_fieldIdentifierGeneration++;
 }
 
 void ProcessingState::fieldIdentifierStatsClear()
 {
-	m_fiStatistics.clear();
-	m_freqMaps.clear();
+	for (int i=0; i<FIELD_IDENTIFIER_SLOTS; i++) {
+		m_fiStatistics[i] = nullptr;
+		m_freqMaps[i] = nullptr;
+	}
 }
 
 void ProcessingState::breakValuesClear()
 {
-	m_breakValues.clear();
+	for (int i=0; i<FIELD_IDENTIFIER_SLOTS; i++) {
+		m_breakValues[i] = nullptr;
+	}
 }
 
 void ProcessingState::fieldIdentifierSet(char id, PSpecString ps)
 {
 	static std::unordered_set<char> redefined_ids;
 	static std::string sWarnOff("NO_WARN_REDEFINED_FID");
-	if (m_fieldIdentifiers[id]!=nullptr && !configSpecLiteralExists(sWarnOff) && redefined_ids.end()==redefined_ids.find(id)) {
+	int slot = fieldIdentifierSlot(id);
+	MYASSERT(slot >= 0);
+	if (m_fieldIdentifierGen[slot]==m_fieldIdentifierGeneration && !configSpecLiteralExists(sWarnOff) && redefined_ids.end()==redefined_ids.find(id)) {
 		redefined_ids.insert(id);
 		std::cerr << "WARNING: Field Identifier <" << id << "> redefined.\n";
 	}
 
-	m_fieldIdentifiers[id] = std::make_shared<std::string>(*ps);
+	// The value is shared, not copied. Callers must not modify it in place afterwards.
+	m_fieldIdentifiers[slot] = ps;
+	m_fieldIdentifierGen[slot] = m_fieldIdentifierGeneration;
+
+	if (!m_groupByKey) {
+		fieldIdentifierAccumulate(slot, id, ps);
+	} else if (id == m_groupByKey) {
+		auto it = m_groupIndex.find(*ps);
+		if (it == m_groupIndex.end()) {
+			it = m_groupIndex.emplace(*ps, m_groups.size()).first;
+			m_groups.emplace_back();
+		}
+		bool bFirstKeyInRecord = (m_activeGroupGen != m_fieldIdentifierGeneration);
+		groupActivate(it->second);
+		m_activeGroupGen = m_fieldIdentifierGeneration;
+
+		if (bFirstKeyInRecord) {
+			// Field identifiers defined earlier in this record waited for the group to be known
+			for (int i=0; i<FIELD_IDENTIFIER_SLOTS; i++) {
+				if (m_fieldIdentifierGen[i]==m_fieldIdentifierGeneration) {
+					fieldIdentifierAccumulate(i, fieldIdentifierFromSlot(i), m_fieldIdentifiers[i]);
+				}
+			}
+		} else {
+			// The other field identifiers of this record have already been counted
+			fieldIdentifierAccumulate(slot, id, ps);
+		}
+	} else if (m_activeGroupGen==m_fieldIdentifierGeneration) {
+		fieldIdentifierAccumulate(slot, id, ps);
+	}
+
+	if (m_breakValues[slot] && (*ps == *m_breakValues[slot])) return;
+
+	m_breakValues[slot] = ps;
+	if (breakLevelGE(id, m_breakLevel)) {
+		m_breakLevel = id;
+	}
+}
+
+void ProcessingState::fieldIdentifierAccumulate(int slot, char id, PSpecString ps)
+{
+	if (m_groupByKey && !m_groupSlotUsed[slot]) {
+		m_groupSlotUsed[slot] = true;
+		m_groupSlots.push_back(slot);
+	}
 
 	// Count the statistics of this field value.
 	if (ALUFUNC_STATISTICAL & AluFunction::functionTypes()) {
-		if (m_fiStatistics[id]==nullptr) {
-			m_fiStatistics[id] = std::make_shared<AluValueStats>(id);
+		if (m_fiStatistics[slot]==nullptr) {
+			m_fiStatistics[slot] = std::make_shared<AluValueStats>(id);
 		} else {
-			m_fiStatistics[id]->AddValue(id);
+			m_fiStatistics[slot]->AddValue(id);
 		}
 	}
 
 	if (ALUFUNC_FREQUENCY & AluFunction::functionTypes()) {
-		std::string s(ps->data(), ps->length());
-		if (m_freqMaps[id]==nullptr) {
-			m_freqMaps[id] = std::make_shared<frequencyMap>();
+		if (m_freqMaps[slot]==nullptr) {
+			m_freqMaps[slot] = makeFrequencyMap(id);
 		}
 
-		m_freqMaps[id]->note(s);
+		m_freqMaps[slot]->note(*ps);
 	}
+}
 
-	if (m_breakValues[id] && (*ps == *m_breakValues[id])) return;
+/*
+ * Exchanges the data of a group with the one in the state. While a group is
+ * active, its own storage holds the data that was there before.
+ */
+void ProcessingState::groupSwap(size_t idx)
+{
+	groupByGroup& grp = m_groups[idx];
+	grp.statistics.resize(m_groupSlots.size());
+	grp.freqMaps.resize(m_groupSlots.size());
+	for (size_t i=0; i<m_groupSlots.size(); i++) {
+		std::swap(m_fiStatistics[m_groupSlots[i]], grp.statistics[i]);
+		std::swap(m_freqMaps[m_groupSlots[i]], grp.freqMaps[i]);
+	}
+	grp.counters.swap(g_counters);
+}
 
-	m_breakValues[id] = std::make_shared<std::string>(*ps);
-	if (breakLevelGE(id, m_breakLevel)) {
-		m_breakLevel = id;
+void ProcessingState::groupActivate(size_t idx)
+{
+	if (idx == m_activeGroup) return;
+	if (m_activeGroup != NO_ACTIVE_GROUP) {
+		groupSwap(m_activeGroup);
+	}
+	m_activeGroup = idx;
+	if (idx != NO_ACTIVE_GROUP) {
+		groupSwap(idx);
+	}
+}
+
+/*
+ * In group-by mode the counters belong to the active group. A record that
+ * has not set the key yet has no group, so it cannot change them.
+ */
+void ProcessingState::checkCounterUpdate()
+{
+	if (m_groupByKey && m_activeGroup == NO_ACTIVE_GROUP && !isRunOut()) {
+		std::string err = std::string("Counters cannot be changed before the GROUPBY key field identifier ")
+				+ m_groupByKey + " is set in the record";
+		MYTHROW(err);
 	}
 }
 
+/*
+ * Prepares the run-out cycle of the next group in the order of the keys: its
+ * data is made active, the key field identifier is set, and the break on it
+ * is established. Returns false after the last group.
+ */
+bool ProcessingState::selectNextGroup()
+{
+	if (0 == m_groupCursor) {
+		m_groupOrder.clear();
+		m_groupOrder.reserve(m_groupIndex.size());
+		for (auto& kv : m_groupIndex) {
+			m_groupOrder.push_back(std::make_pair(std::string_view(kv.first), kv.second));
+		}
+		std::sort(m_groupOrder.begin(), m_groupOrder.end());
+	}
+
+	if (m_groupCursor >= m_groupOrder.size()) {
+		groupActivate(NO_ACTIVE_GROUP);
+		return false;
+	}
+
+	auto& grp = m_groupOrder[m_groupCursor++];
+	groupActivate(grp.second);
+
+	fieldIdentifierClear();
+	int slot = fieldIdentifierSlot(m_groupByKey);
+	m_fieldIdentifiers[slot] = std::make_shared<std::string>(grp.first);
+	m_fieldIdentifierGen[slot] = m_fieldIdentifierGeneration;
+	m_breakLevel = m_groupByKey;
+	return true;
+}
+
 PSpecString ProcessingState::fieldIdentifierGet(char id)
 {
-	PSpecString ret = m_fieldIdentifiers[id];
-	if (!ret) {
+	if (!fieldIdentifierIsSet(id)) {
 		std::string err = std::string("Field Identifier <") + id + "> not defined.";
 		MYTHROW(err);
 	}
-	return ret;
+	return m_fieldIdentifiers[fieldIdentifierSlot(id)];
 }
 
 bool ProcessingState::fieldIdentifierIsSet(char id)
 {
-	auto search = m_fieldIdentifiers.find(id);
-	return (search != m_fieldIdentifiers.end());
+	int slot = fieldIdentifierSlot(id);
+	return (slot >= 0) && (m_fieldIdentifierGen[slot]==m_fieldIdentifierGeneration);
 }
 
 void ProcessingState::resetBreaks()
@@ -465,15 +640,20 @@ bool ProcessingState::breakEstablished(char id)
 
 PAluValueStats ProcessingState::valueStatistics(char id)
 {
-	return m_fiStatistics[id];
+	int slot = fieldIdentifierSlot(id);
+	return (slot >= 0) ? m_fiStatistics[slot] : nullptr;
 }
 
 PFrequencyMap ProcessingState::getFrequencyMap(char id)
 {
-	if (m_freqMaps[id]==nullptr) {
-		m_freqMaps[id] = std::make_shared<frequencyMap>();
+	int slot = fieldIdentifierSlot(id);
+	if (slot < 0) {
+		return std::make_shared<frequencyMap>();
 	}
-	return m_freqMaps[id];
+	if (m_freqMaps[slot]==nullptr) {
+		m_freqMaps[slot] = makeFrequencyMap(id);
+	}
+	return m_freqMaps[slot];
 }
 
 bool ProcessingState::runningOutLoop()
@@ -564,6 +744,9 @@ void ProcessingState::observeEndIf()
 
 bool ProcessingState::printSuppressed(char printRule)
 {
+	// In group-by mode, output is only written in the run-out cycles of the groups
+	if (isGroupBy() && !isRunOut()) return true;
+
 	switch (printRule) {
 	case PRINTONLY_PRINTALL:  return false;
 	case PRINTONLY_EOF:       return !m_bEOF;
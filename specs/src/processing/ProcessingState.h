@@ -4,6 +4,8 @@
 #include <vector>
 #include <stack>
 #include <map>
+#include <tuple>
+#include <unordered_map>
 #include "processing/Writer.h"
 #include "utils/alu.h"
 #include "utils/aluFunctions.h"
@@ -19,6 +21,9 @@
 
 #define LOOP_CONDITION_FALSE (-5)
 
+// Field identifiers are a-z and A-Z
+#define FIELD_IDENTIFIER_SLOTS  52
+
 #define PRINTONLY_PRINTALL  '\0'
 #define PRINTONLY_EOF       '_'
 
@@ -31,8 +36,8 @@ public:
 	void    Reset();
 
 	void    setPadChar(char c) {m_pad = c;}
-	void    setWSChars(const std::string& c) {m_wordSeparator = c; m_wordSeparatorLocal = c.empty(); m_wordCount=-1;}
-	void    setFSChars(const std::string& c) {m_fieldSeparator = c; m_fieldCount=-1;}
+	void    setWSChars(const std::string& c) {m_wordSeparator = c; m_wordSeparatorLocal = c.empty(); m_wordCount=-1; recordCacheClear();}
+	void    setFSChars(const std::string& c) {m_fieldSeparator = c; m_fieldCount=-1; recordCacheClear();}
 
 	char    getPadChar() { return m_pad;            }
 	std::string& getWSChars()  { return m_wordSeparator;  }
@@ -73,6 +78,10 @@ public:
 
 	void breakValuesClear();
 	void resetBreaks();
+	void setGroupBy(char id)     { m_groupByKey = id; }
+	bool isGroupBy()             { return m_groupByKey != 0; }
+	bool selectNextGroup();
+	void checkCounterUpdate();
 	bool needToEvaluate();
 	bool runningOutLoop();
 	void setCondition(bool isTrue);
@@ -101,6 +110,8 @@ public:
 	bool shouldWrite()           { return !m_bNoWrite; }
 	bool printSuppressed(char printRule);
 	void setEOF()                { m_bEOF = true;      }
+	virtual PValue recordCacheGet(recordCacheFunc func, ALUInt arg1, ALUInt arg2);
+	virtual void   recordCacheSet(recordCacheFunc func, ALUInt arg1, ALUInt arg2, PValue val);
 private:
 	enum extremeBool {
 		bFalse,
@@ -123,10 +134,36 @@ private:
 	std::vector<int> m_fieldEnd;
 	void identifyWords();
 	void identifyFields();
-	std::map<char,PSpecString> m_fieldIdentifiers;
-	std::map<char,PAluValueStats> m_fiStatistics;
-	std::map<char,PSpecString> m_breakValues;
-	std::map<char,PFrequencyMap> m_freqMaps;
+	void recordCacheClear() { if (!m_recordCache.empty()) m_recordCache.clear(); }
+	typedef std::tuple<recordCacheFunc,ALUInt,ALUInt> recordCacheKey;
+	std::map<recordCacheKey,PValue> m_recordCache;  // memoized builtins for the current record
+	void fieldIdentifiersInit();
+	// Field identifiers are valid only if their generation is current, so clearing them is O(1)
+	PSpecString    m_fieldIdentifiers[FIELD_IDENTIFIER_SLOTS];
+	uint64_t       m_fieldIdentifierGen[FIELD_IDENTIFIER_SLOTS];
+	uint64_t       m_fieldIdentifierGeneration;
+	PAluValueStats m_fiStatistics[FIELD_IDENTIFIER_SLOTS];
+	PSpecString    m_breakValues[FIELD_IDENTIFIER_SLOTS];
+	PFrequencyMap  m_freqMaps[FIELD_IDENTIFIER_SLOTS];
+	void fieldIdentifierAccumulate(int slot, char id, PSpecString ps);
+	// Hashed group-by: the statistics, frequency maps and counters of each group are
+	// swapped in while it is active, so the rest of the code sees only one group
+	struct groupByGroup {
+		std::vector<PAluValueStats> statistics;  // indexed like m_groupSlots
+		std::vector<PFrequencyMap>  freqMaps;
+		ALUCounters                 counters;
+	};
+	void groupSwap(size_t idx);
+	void groupActivate(size_t idx);
+	char                m_groupByKey;
+	std::unordered_map<std::string, size_t> m_groupIndex;
+	std::vector<groupByGroup> m_groups;
+	std::vector<int>    m_groupSlots;     // the field identifier slots that have per-group data
+	bool                m_groupSlotUsed[FIELD_IDENTIFIER_SLOTS];
+	size_t              m_activeGroup;
+	uint64_t            m_activeGroupGen; // field identifier generation in which the group was selected
+	std::vector<std::pair<std::string_view, size_t>> m_groupOrder;
+	size_t              m_groupCursor;
 	char m_breakLevel;
 	std::stack<extremeBool> m_Conditions;
 	std::stack<int> m_Loops;    // The unsigned int holds the number of the token where the while was
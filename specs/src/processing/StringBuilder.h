@@ -17,6 +17,7 @@ public:
 	void           insertNextField(PSpecString str);
 	void           setPadChar(char c)     {m_pad = c;}
 	size_t         pos()                  {return m_pos;}
+	void           restore(PSpecString str, size_t pos) {mp_str = str; m_pos = pos;}   // undo GetStringUnsafe
 private:
 	PSpecString     mp_str;
 	size_t          m_pos; // for Next, NextWord, NextField
@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <string.h>
+#include "utils/platform.h"
+#include "conversionKernels.h"
+
+#ifdef CONVERSION_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * The portable kernels work from lookup tables. The SSSE3 and AVX2 kernels
+ * handle 16 or 32 bytes at a time, and leave the remainder to the portable
+ * kernels. The tables and the choice of kernels are made once, on first use.
+ */
+
+static char          hexPairs[256 * 2];
+static signed char   hexValues[256];       // -1 for a character that is not a hex digit
+static char          binaryOctets[256 * 8];
+static char          upperChars[256];
+static char          lowerChars[256];
+static char          rot13Chars[256];
+static bool          bAsciiCase;           // toupper and tolower change only the ASCII letters
+
+static void initTables()
+{
+	static const char hexchars[] = "0123456789abcdef";
+	bAsciiCase = true;
+	for (unsigned int i = 0; i < 256; i++) {
+		hexPairs[i * 2] = hexchars[i >> 4];
+		hexPairs[i * 2 + 1] = hexchars[i & 0xf];
+
+		if (i >= '0' && i <= '9') {
+			hexValues[i] = (signed char)(i - '0');
+		} else if (i >= 'A' && i <= 'F') {
+			hexValues[i] = (signed char)(i - 'A' + 10);
+		} else if (i >= 'a' && i <= 'f') {
+			hexValues[i] = (signed char)(i - 'a' + 10);
+		} else {
+			hexValues[i] = -1;
+		}
+
+		for (unsigned int j = 0; j < 8; j++) {
+			binaryOctets[i * 8 + j] = (i & (0x80 >> j)) ? '1' : '0';
+		}
+
+		// The conversions have always passed a char to toupper and tolower, so do the same
+		char c = char(i);
+		upperChars[i] = char(toupper(c));
+		lowerChars[i] = char(tolower(c));
+		char asciiUpper = (i >= 'a' && i <= 'z') ? char(i - 32) : c;
+		char asciiLower = (i >= 'A' && i <= 'Z') ? char(i + 32) : c;
+		if (upperChars[i] != asciiUpper || lowerChars[i] != asciiLower) {
+			bAsciiCase = false;
+		}
+
+		if ((i >= 'A' && i <= 'M') || (i >= 'a' && i <= 'm')) {
+			rot13Chars[i] = char(i + 13);
+		} else if ((i >= 'N' && i <= 'Z') || (i >= 'n' && i <= 'z')) {
+			rot13Chars[i] = char(i - 13);
+		} else {
+			rot13Chars[i] = c;
+		}
+	}
+}
+
+/*
+ * Portable kernels
+ */
+static void portable_c2x(const char* src, size_t len, char* dst)
+{
+	for (size_t i = 0; i < len; i++) {
+		memcpy(dst + i * 2, hexPairs + (unsigned char)(src[i]) * 2, 2);
+	}
+}
+
+static bool portable_x2c(const char* src, size_t len, char* dst)
+{
+	for (size_t i = 0; i < len; i += 2) {
+		signed char hi = hexValues[(unsigned char)(src[i])];
+		signed char lo = hexValues[(unsigned char)(src[i + 1])];
+		if (hi < 0 || lo < 0) return false;
+		*dst++ = char((hi << 4) | lo);
+	}
+	return true;
+}
+
+static void portable_c2b(const char* src, size_t len, char* dst)
+{
+	for (size_t i = 0; i < len; i++) {
+		memcpy(dst + i * 8, binaryOctets + (unsigned char)(src[i]) * 8, 8);
+	}
+}
+
+// A last group of fewer than eight digits is right-aligned in its byte
+static bool portable_b2c(const char* src, size_t len, char* dst)
+{
+	for (size_t i = 0; i < len; i += 8) {
+		size_t end = std::min(len, i + 8);
+		unsigned char c = 0;
+		for (size_t j = i; j < end; j++) {
+			c <<= 1;
+			switch (src[j]) {
+			case '1': c += 1;  break;
+			case '0': break;
+			default: return false;
+			}
+		}
+		*dst++ = char(c);
+	}
+	return true;
+}
+
+static void portable_ucase(const char* src, size_t len, char* dst)
+{
+	for (size_t i = 0; i < len; i++) {
+		dst[i] = upperChars[(unsigned char)(src[i])];
+	}
+}
+
+static void portable_lcase(const char* src, size_t len, char* dst)
+{
+	for (size_t i = 0; i < len; i++) {
+		dst[i] = lowerChars[(unsigned char)(src[i])];
+	}
+}
+
+static void portable_rot13(const char* src, size_t len, char* dst)
+{
+	for (size_t i = 0; i < len; i++) {
+		dst[i] = rot13Chars[(unsigned char)(src[i])];
+	}
+}
+
+static void portable_bswap(const char* src, size_t len, char* dst)
+{
+	std::reverse_copy(src, src + len, dst);
+}
+
+#ifdef CONVERSION_KERNELS_X86
+/*
+ * SSSE3 kernels
+ */
+#define SSSE3_FUNC  __attribute__((target("ssse3")))
+#define AVX2_FUNC   __attribute__((target("avx2")))
+
+SSSE3_FUNC static void ssse3_c2x(const char* src, size_t len, char* dst)
+{
+	const __m128i digits = _mm_setr_epi8('0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f');
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	size_t i = 0;
+	for ( ; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+		__m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(v, nibble));
+		_mm_storeu_si128((__m128i*)(dst + i * 2), _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i*)(dst + i * 2 + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+	portable_c2x(src + i, len - i, dst + i * 2);
+}
+
+// Converts 16 hex digits to their values. Returns a mask with a bit set for each valid digit.
+SSSE3_FUNC static inline __m128i ssse3_hexValues(__m128i v, int& validMask)
+{
+	__m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+	__m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+	__m128i letter = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	__m128i isLetter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+	validMask = _mm_movemask_epi8(_mm_or_si128(isDigit, isLetter));
+	return _mm_or_si128(_mm_and_si128(isDigit, digit),
+			_mm_and_si128(isLetter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+SSSE3_FUNC static bool ssse3_x2c(const char* src, size_t len, char* dst)
+{
+	const __m128i weights = _mm_set1_epi16(0x0110);   // 16 for the high digit, 1 for the low
+	size_t i = 0;
+	for ( ; i + 32 <= len; i += 32) {
+		int valid1, valid2;
+		__m128i v1 = ssse3_hexValues(_mm_loadu_si128((const __m128i*)(src + i)), valid1);
+		__m128i v2 = ssse3_hexValues(_mm_loadu_si128((const __m128i*)(src + i + 16)), valid2);
+		if ((valid1 & valid2) != 0xffff) return false;
+		__m128i bytes = _mm_packus_epi16(_mm_maddubs_epi16(v1, weights), _mm_maddubs_epi16(v2, weights));
+		_mm_storeu_si128((__m128i*)(dst + i / 2), bytes);
+	}
+	return portable_x2c(src + i, len - i, dst + i / 2);
+}
+
+SSSE3_FUNC static void ssse3_c2b(const char* src, size_t len, char* dst)
+{
+	const __m128i bits = _mm_setr_epi8(-128,64,32,16,8,4,2,1,-128,64,32,16,8,4,2,1);
+	const __m128i zeros = _mm_set1_epi8('0');
+	size_t i = 0;
+	for ( ; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		for (int j = 0; j < 8; j++) {
+			// spread bytes 2j and 2j+1 over eight lanes each
+			__m128i spread = _mm_shuffle_epi8(v, _mm_setr_epi8(
+					char(2*j), char(2*j), char(2*j), char(2*j), char(2*j), char(2*j), char(2*j), char(2*j),
+					char(2*j+1), char(2*j+1), char(2*j+1), char(2*j+1), char(2*j+1), char(2*j+1), char(2*j+1), char(2*j+1)));
+			__m128i isSet = _mm_cmpeq_epi8(_mm_and_si128(spread, bits), bits);
+			_mm_storeu_si128((__m128i*)(dst + i * 8 + j * 16), _mm_sub_epi8(zeros, isSet));
+		}
+	}
+	portable_c2b(src + i, len - i, dst + i * 8);
+}
+
+SSSE3_FUNC static bool ssse3_b2c(const char* src, size_t len, char* dst)
+{
+	// the first digit of each group is its highest bit, so reverse the groups for movemask
+	const __m128i reverseGroups = _mm_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8);
+	const __m128i zeros = _mm_set1_epi8('0');
+	const __m128i ones = _mm_set1_epi8(1);
+	size_t i = 0;
+	for ( ; i + 16 <= len; i += 16) {
+		__m128i v = _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(src + i)), zeros);
+		if (0xffff != _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, ones), v))) return false;
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_shuffle_epi8(v, reverseGroups), ones));
+		dst[i / 8] = char(mask & 0xff);
+		dst[i / 8 + 1] = char(mask >> 8);
+	}
+	return portable_b2c(src + i, len - i, dst + i / 8);
+}
+
+// Adds `delta` to the bytes that are between `first` and `first + count - 1`
+#define CASE_KERNEL(name, portable, first, delta)                                   \
+SSSE3_FUNC static void ssse3_##name(const char* src, size_t len, char* dst)          \
+{                                                                                    \
+	const __m128i start = _mm_set1_epi8(first);                                      \
+	const __m128i last = _mm_set1_epi8(25);                                          \
+	const __m128i change = _mm_set1_epi8(delta);                                     \
+	size_t i = 0;                                                                    \
+	for ( ; i + 16 <= len; i += 16) {                                                \
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));                      \
+		__m128i idx = _mm_sub_epi8(v, start);                                        \
+		__m128i in = _mm_cmpeq_epi8(_mm_min_epu8(idx, last), idx);                   \
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi8(v, _mm_and_si128(in, change))); \
+	}                                                                                \
+	portable(src + i, len - i, dst + i);                                             \
+}                                                                                    \
+AVX2_FUNC static void avx2_##name(const char* src, size_t len, char* dst)            \
+{                                                                                    \
+	const __m256i start = _mm256_set1_epi8(first);                                   \
+	const __m256i last = _mm256_set1_epi8(25);                                       \
+	const __m256i change = _mm256_set1_epi8(delta);                                  \
+	size_t i = 0;                                                                    \
+	for ( ; i + 32 <= len; i += 32) {                                                \
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + i));                   \
+		__m256i idx = _mm256_sub_epi8(v, start);                                     \
+		__m256i in = _mm256_cmpeq_epi8(_mm256_min_epu8(idx, last), idx);             \
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_add_epi8(v, _mm256_and_si256(in, change))); \
+	}                                                                                \
+	ssse3_##name(src + i, len - i, dst + i);                                         \
+}
+
+CASE_KERNEL(ucase, portable_ucase, 'a', -32)
+CASE_KERNEL(lcase, portable_lcase, 'A', 32)
+
+SSSE3_FUNC static void ssse3_rot13(const char* src, size_t len, char* dst)
+{
+	size_t i = 0;
+	for ( ; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i idx = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+		__m128i isLetter = _mm_cmpeq_epi8(_mm_min_epu8(idx, _mm_set1_epi8(25)), idx);
+		__m128i firstHalf = _mm_cmpeq_epi8(_mm_min_epu8(idx, _mm_set1_epi8(12)), idx);
+		__m128i delta = _mm_or_si128(_mm_and_si128(firstHalf, _mm_set1_epi8(13)),
+				_mm_andnot_si128(firstHalf, _mm_set1_epi8(-13)));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi8(v, _mm_and_si128(isLetter, delta)));
+	}
+	portable_rot13(src + i, len - i, dst + i);
+}
+
+SSSE3_FUNC static void ssse3_bswap(const char* src, size_t len, char* dst)
+{
+	const __m128i reverse = _mm_setr_epi8(15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0);
+	size_t i = 0;
+	for ( ; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + len - i - 16));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(v, reverse));
+	}
+	portable_bswap(src, len - i, dst + i);
+}
+
+/*
+ * AVX2 kernels. The shuffles and packs work within each 128-bit lane, so
+ * the results are put back in order with a permute.
+ */
+AVX2_FUNC static void avx2_c2x(const char* src, size_t len, char* dst)
+{
+	const __m256i digits = _mm256_setr_epi8('0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f',
+			'0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f');
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	size_t i = 0;
+	for ( ; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+		__m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(v, nibble));
+		__m256i first = _mm256_unpacklo_epi8(hi, lo);    // bytes 0-7 and 16-23
+		__m256i second = _mm256_unpackhi_epi8(hi, lo);   // bytes 8-15 and 24-31
+		_mm256_storeu_si256((__m256i*)(dst + i * 2), _mm256_permute2x128_si256(first, second, 0x20));
+		_mm256_storeu_si256((__m256i*)(dst + i * 2 + 32), _mm256_permute2x128_si256(first, second, 0x31));
+	}
+	ssse3_c2x(src + i, len - i, dst + i * 2);
+}
+
+AVX2_FUNC static inline __m256i avx2_hexValues(__m256i v, unsigned int& validMask)
+{
+	__m256i digit = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+	__m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+	__m256i letter = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+	__m256i isLetter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+	validMask = unsigned(_mm256_movemask_epi8(_mm256_or_si256(isDigit, isLetter)));
+	return _mm256_or_si256(_mm256_and_si256(isDigit, digit),
+			_mm256_and_si256(isLetter, _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+}
+
+AVX2_FUNC static bool avx2_x2c(const char* src, size_t len, char* dst)
+{
+	const __m256i weights = _mm256_set1_epi16(0x0110);
+	size_t i = 0;
+	for ( ; i + 64 <= len; i += 64) {
+		unsigned int valid1, valid2;
+		__m256i v1 = avx2_hexValues(_mm256_loadu_si256((const __m256i*)(src + i)), valid1);
+		__m256i v2 = avx2_hexValues(_mm256_loadu_si256((const __m256i*)(src + i + 32)), valid2);
+		if ((valid1 & valid2) != 0xffffffff) return false;
+		__m256i bytes = _mm256_packus_epi16(_mm256_maddubs_epi16(v1, weights), _mm256_maddubs_epi16(v2, weights));
+		_mm256_storeu_si256((__m256i*)(dst + i / 2), _mm256_permute4x64_epi64(bytes, 0xd8));
+	}
+	return ssse3_x2c(src + i, len - i, dst + i / 2);
+}
+#endif
+
+static conversionKernels kernelsByLevel[conversionKernelLevel__COUNT];
+static bool kernelsSupported[conversionKernelLevel__COUNT];
+static conversionKernelLevel bestLevel;
+
+static bool initKernels()
+{
+	initTables();
+
+	kernelsByLevel[conversionKernelLevel__portable] = {portable_c2x, portable_x2c, portable_c2b, portable_b2c,
+			portable_ucase, portable_lcase, portable_rot13, portable_bswap};
+	kernelsSupported[conversionKernelLevel__portable] = true;
+	bestLevel = conversionKernelLevel__portable;
+
+#ifdef CONVERSION_KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3")) {
+		kernelsByLevel[conversionKernelLevel__SSSE3] = {ssse3_c2x, ssse3_x2c, ssse3_c2b, ssse3_b2c,
+				ssse3_ucase, ssse3_lcase, ssse3_rot13, ssse3_bswap};
+		kernelsSupported[conversionKernelLevel__SSSE3] = true;
+		bestLevel = conversionKernelLevel__SSSE3;
+
+		if (__builtin_cpu_supports("avx2")) {
+			kernelsByLevel[conversionKernelLevel__AVX2] = {avx2_c2x, avx2_x2c, ssse3_c2b, ssse3_b2c,
+					avx2_ucase, avx2_lcase, ssse3_rot13, ssse3_bswap};
+			kernelsSupported[conversionKernelLevel__AVX2] = true;
+			bestLevel = conversionKernelLevel__AVX2;
+		}
+	}
+
+	// The vector case conversions only know the ASCII letters
+	if (!bAsciiCase) {
+		for (auto& kernels : kernelsByLevel) {
+			kernels.ucase = portable_ucase;
+			kernels.lcase = portable_lcase;
+		}
+	}
+#endif
+
+	return true;
+}
+
+static void ensureKernels()
+{
+	static bool bInitialized = initKernels();
+	SUPPRESS_UNUSED_WARNING(bInitialized);
+}
+
+const conversionKernels& getConversionKernels()
+{
+	ensureKernels();
+	return kernelsByLevel[bestLevel];
+}
+
+const conversionKernels* getConversionKernels(conversionKernelLevel level)
+{
+	ensureKernels();
+	if (level >= conversionKernelLevel__COUNT || !kernelsSupported[level]) {
+		return nullptr;
+	}
+	return &kernelsByLevel[level];
+}
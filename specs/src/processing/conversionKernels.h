@@ -0,0 +1,47 @@
+#ifndef SPECS2016__PROCESSING__CONVERSION_KERNELS__H
+#define SPECS2016__PROCESSING__CONVERSION_KERNELS__H
+
+#include <cstddef>
+
+/*
+ * The byte-level work of the character conversions. Each kernel reads len
+ * bytes from src and writes the result to dst, which the caller has sized:
+ *
+ *   c2x    2 * len bytes
+ *   x2c    len / 2 bytes - len must be even
+ *   c2b    8 * len bytes
+ *   b2c    (len + 7) / 8 bytes
+ *   ucase, lcase, rot13, bswap   len bytes
+ *
+ * x2c and b2c return false if the source has a character that is not a hex
+ * or binary digit. ucase, lcase, and rot13 may convert in place (src == dst);
+ * the others may not.
+ */
+typedef void (*conversionKernel)(const char* src, size_t len, char* dst);
+typedef bool (*checkedConversionKernel)(const char* src, size_t len, char* dst);
+
+struct conversionKernels {
+	conversionKernel         c2x;
+	checkedConversionKernel  x2c;
+	conversionKernel         c2b;
+	checkedConversionKernel  b2c;
+	conversionKernel         ucase;
+	conversionKernel         lcase;
+	conversionKernel         rot13;
+	conversionKernel         bswap;
+};
+
+enum conversionKernelLevel {
+	conversionKernelLevel__portable,
+	conversionKernelLevel__SSSE3,
+	conversionKernelLevel__AVX2,
+	conversionKernelLevel__COUNT
+};
+
+// The best kernels that this CPU supports
+const conversionKernels& getConversionKernels();
+
+// The kernels of a specific level, or nullptr if this CPU or build does not support it
+const conversionKernels* getConversionKernels(conversionKernelLevel level);
+
+#endif
@@ -1,10 +1,12 @@
 #include <string.h>
+#include <algorithm>
 #include <stdexcept>
 #include <sstream>
 #include <iomanip>
 #include "utils/platform.h"
 #include "utils/ErrorReporting.h"
 #include "conversions.h"
+#include "conversionKernels.h"
 #include "utils/SpecString.h"
 #include "utils/TimeUtils.h"
 
@@ -13,97 +15,38 @@ static std::string conv_identity(std::string& s) {
 }
 
 static std::string conv_ROT13(std::string& s) {
-	std::string ret;
-	ret.resize(s.length());
-	for (size_t i=0; i<s.length(); i++) {
-		if ((s[i]>='A' && s[i]<='M') || (s[i]>='a' && s[i]<='m')) {
-			ret[i] = s[i] + 13;
-		} else if ((s[i]>='N' && s[i]<='Z') || (s[i]>='n' && s[i]<='z')) {
-			ret[i] = s[i] - 13;
-		} else {
-			ret[i] = s[i];
-		}
-	}
+	std::string ret(s.length(), '\0');
+	getConversionKernels().rot13(s.data(), s.length(), &ret[0]);
 	return ret;
 }
 
 static std::string conv_C2B(std::string& s) {
-	std::string ret;
-	ret.resize(s.length()*8);
-	for (size_t i=0; i<s.length(); i++) {
-		unsigned char c = (unsigned char)s[i];
-		for (int j=0; j<8; j++) {
-			ret[i*8+j] = (c>=128) ? '1' : '0';
-			c <<= 1;
-		}
-	}
-
+	std::string ret(s.length()*8, '\0');
+	getConversionKernels().c2b(s.data(), s.length(), &ret[0]);
 	return ret;
 }
 
 std::string conv_C2X(std::string& s) {
-	static char hexchars[]="0123456789abcdef";
-	std::string ret;
-	ret.resize(s.length()*2);
-	for (size_t i=0; i<s.length(); i++) {
-		unsigned char c = (unsigned char)s[i];
-		ret[i*2] = hexchars[c>>4];
-		ret[i*2+1] = hexchars[c%16];
-	}
-
+	std::string ret(s.length()*2, '\0');
+	getConversionKernels().c2x(s.data(), s.length(), &ret[0]);
 	return ret;
 }
 
 static std::string conv_B2C(std::string& s) {
-	std::string ret;
-	ret.resize((s.length()+7)/8);
-	unsigned char c = 0;
-	for (size_t i=0; i<s.length(); i++) {
-		c <<= 1;
-		switch (s[i]) {
-		case '1': c += 1;  break;
-		case '0': break;
-		default: CONVERSION_EXCEPTION(s, "Binary", "Char");
-		}
-
-		if (7==i%8 || i==(s.length() - 1)) {
-			ret[i/8] = char(c);
-			c = 0;
-		}
+	std::string ret((s.length()+7)/8, '\0');
+	if (!getConversionKernels().b2c(s.data(), s.length(), &ret[0])) {
+		CONVERSION_EXCEPTION(s, "Binary", "Char");
 	}
 	return ret;
 }
 
 std::string conv_X2CH(std::string& s) {
-	std::string ret;
 	if (1==s.length() % 2) {
 		CONVERSION_EXCEPTION(s, "Hex", "Char");
 	}
-
-	const char* pc = s.c_str();
-	for (size_t i=0; i < s.length(); i+=2) {
-		char c;
-		if (*pc>='0' && *pc<='9') {
-			c = *pc-'0';
-		} else if (*pc>='A' && *pc<='F') {
-			c = *pc - 'A' + 10;
-		} else if (*pc>='a' && *pc<='f') {
-			c = *pc - 'a' + 10;
-		} else {
-			CONVERSION_EXCEPTION(s, "Hex", "Char");
-		}
-		c <<= 4; pc++;
-		if (*pc>='0' && *pc<='9') {
-			c += (*pc-'0');
-		} else if (*pc>='A' && *pc<='F') {
-			c += (*pc - 'A' + 10);
-		} else if (*pc>='a' && *pc<='f') {
-			c += (*pc - 'a' + 10);
-		} else {
-			CONVERSION_EXCEPTION(s, "Hex", "Char");
-		}
-
-		ret += c;  pc++;
+	std::string ret(s.length()/2, '\0');
+	if (!getConversionKernels().x2c(s.data(), s.length(), &ret[0])) {
+		CONVERSION_EXCEPTION(s, "Hex", "Char");
 	}
 	return ret;
 }
@@ -141,25 +84,20 @@ std::string conv_X2D(std::string& s) {
 }
 
 std::string conv_BSWAP(std::string& s) {
-	std::string ret(s.size(), 0);
-	const char* sStart = s.c_str();
-	char* retPtr = (char*)(ret.c_str());
-	char* sIt = (char*)(sStart + s.size());
-	while (sIt >= sStart) {
-		*retPtr++ = *(--sIt);
-	}
+	std::string ret(s.length(), '\0');
+	getConversionKernels().bswap(s.data(), s.length(), &ret[0]);
 	return ret;
 }
 
 std::string conv_LCASE(std::string& s) {
-	std::string ret(s);
-	for (auto & c : ret) c = tolower(c);
+	std::string ret(s.length(), '\0');
+	getConversionKernels().lcase(s.data(), s.length(), &ret[0]);
 	return ret;
 }
 
 std::string conv_UCASE(std::string& s) {
-	std::string ret(s);
-	for (auto & c : ret) c = toupper(c);
+	std::string ret(s.length(), '\0');
+	getConversionKernels().ucase(s.data(), s.length(), &ret[0]);
 	return ret;
 }
 
@@ -167,28 +105,28 @@ static std::string conv_ti2f(std::string& s, std::string& parm)
 {
 	if (s.length()!=8) return std::string();
 	int64_t internal = *((int64_t*)(s.c_str()));
-	PSpecString pRet = specTimeConvertToPrintable(internal, parm);
-	std::string ret = std::string(pRet->data());
+	std::string ret;
+	specTimeGetFormat(parm).format(internal, ret);
 	return ret;
 }
 
 static std::string conv_tf2i(std::string& s, std::string& parm)
 {
-	int64_t ret = specTimeConvertFromPrintable(s,parm);
+	int64_t ret = specTimeGetFormat(parm).parse(s);
 	return std::string(((char*)(&ret)), sizeof(int64_t));
 }
 
 static std::string conv_s2tf(std::string& s, std::string& parm)
 {
 	int64_t internal = int64_t(std::stold(s) * MICROSECONDS_PER_SECOND + 0.5);
-	PSpecString pRet = specTimeConvertToPrintable(internal, parm);
-	std::string ret = std::string(pRet->data());
+	std::string ret;
+	specTimeGetFormat(parm).format(internal, ret);
 	return ret;
 }
 
 static std::string conv_tf2s(std::string& s, std::string& parm)
 {
-	int64_t tm = specTimeConvertFromPrintable(s,parm);
+	int64_t tm = specTimeGetFormat(parm).parse(s);
 	long double seconds;
 	if (0 == (tm % MICROSECONDS_PER_SECOND)) {
 		seconds = (long double)(tm / MICROSECONDS_PER_SECOND);
@@ -201,14 +139,14 @@ static std::string conv_tf2s(std::string& s, std::string& parm)
 static std::string conv_mcs2tf(std::string& s, std::string& parm)
 {
 	int64_t internal = int64_t(std::stold(s) + 0.5);
-	PSpecString pRet = specTimeConvertToPrintable(internal, parm);
-	std::string ret = std::string(pRet->data());
+	std::string ret;
+	specTimeGetFormat(parm).format(internal, ret);
 	return ret;
 }
 
 static std::string conv_tf2mcs(std::string& s, std::string& parm)
 {
-	int64_t tm = specTimeConvertFromPrintable(s,parm);
+	int64_t tm = specTimeGetFormat(parm).parse(s);
 	return std::to_string(tm);
 }
 
@@ -238,3 +176,42 @@ std::string stringConvert(std::string& source, StringConversions conv, std::stri
 		return err;  // to appease the compiler
 	}
 }
+
+bool isLengthPreservingConversion(StringConversions conv)
+{
+	switch (conv) {
+	case StringConversion__identity:
+	case StringConversion__ROT13:
+	case StringConversion__LCASE:
+	case StringConversion__UCASE:
+	case StringConversion__BSWAP:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void stringConvertInPlace(std::string& s, StringConversions conv)
+{
+	if (s.empty()) return;
+	char* p = &s[0];
+	switch (conv) {
+	case StringConversion__identity:
+		break;
+	case StringConversion__ROT13:
+		getConversionKernels().rot13(p, s.length(), p);
+		break;
+	case StringConversion__LCASE:
+		getConversionKernels().lcase(p, s.length(), p);
+		break;
+	case StringConversion__UCASE:
+		getConversionKernels().ucase(p, s.length(), p);
+		break;
+	case StringConversion__BSWAP:
+		std::reverse(s.begin(), s.end());
+		break;
+	default:
+		std::string err = "Bad in-place conversion: " + StringConversion__2str(conv);
+		MYTHROW(err);
+	}
+}
@@ -61,6 +61,10 @@ static inline bool isParametrizedConversion(StringConversions conv)
 #undef Y
 
 std::string stringConvert(std::string& source, StringConversions conv, std::string& param);
+
+// Conversions whose result is as long as the source can also be done in place
+bool isLengthPreservingConversion(StringConversions conv);
+void stringConvertInPlace(std::string& s, StringConversions conv);
 StringConversions getConversionByName(std::string& s);
 
 #endif
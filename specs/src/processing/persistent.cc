@@ -1,33 +1,232 @@
 #include <map>
+#include <unordered_map>
+#include <vector>
+#include <string_view>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
+#include <string.h>
+#include <cstdio>
+#ifdef WIN64
+#include <process.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "utils/ErrorReporting.h"
+#include "utils/mappedFile.h"
 #include "Config.h"
 #include "persistent.h"
 
-static std::map<std::string,std::string> PersistentVariables;
+/*
+ * The persistence file is binary: a header, the records sorted by key, and an
+ * index with the offset of each record. A lookup is a binary search in the
+ * memory-mapped file, so nothing is parsed when specs starts.
+ *
+ * Changes made during the run are kept in memory. At the end they are merged
+ * into the file as it is then, and the result replaces it atomically with a
+ * rename. Another specs that has the old file mapped keeps reading it
+ * unchanged, and a lock file makes concurrent writers take turns, so that
+ * each one merges its own changes into the previous one's result. The lock file
+ * is never removed, because a writer that is waiting for it may already have it
+ * open.
+ *
+ * Files in the older text format - alternating lines of key and value - are
+ * still read, and are converted on the first save.
+ */
+
+#define PERSISTENT_MAGIC       "SPECSPV1"
+#define PERSISTENT_MAGIC_LEN   8
+
+struct persistentHeader {
+	char      magic[PERSISTENT_MAGIC_LEN];
+	uint64_t  count;
+	uint64_t  indexOffset;
+};
+
+// Each record is the key length and value length as uint32_t, the key, and the value
+#define PERSISTENT_RECORD_HEADER   (2 * sizeof(uint32_t))
+
+class persistentFile {
+public:
+	persistentFile()   { m_pData = nullptr; m_count = 0; m_indexOffset = 0; }
+	void             open(const std::string& fileName);
+	void             close();
+	size_t           count()  { return m_bLegacy ? m_legacy.size() : m_count; }
+	std::string_view key(size_t i);
+	std::string_view value(size_t i);
+	bool             find(std::string_view key, std::string_view& value);
+private:
+	void             corrupt();
+	size_t           recordOffset(size_t i);
+	mappedFile       m_file;
+	const char*      m_pData;
+	size_t           m_count;
+	size_t           m_indexOffset;
+	bool             m_bLegacy = false;
+	std::string      m_fileName;
+	std::vector<std::pair<std::string,std::string>> m_legacy;  // sorted by key
+};
+
+void persistentFile::close()
+{
+	m_file.close();
+	m_pData = nullptr;
+	m_count = 0;
+	m_bLegacy = false;
+	m_legacy.clear();
+}
+
+void persistentFile::corrupt()
+{
+	std::string err = "Persistence file " + m_fileName + " is corrupt";
+	MYTHROW(err);
+}
+
+void persistentFile::open(const std::string& fileName)
+{
+	close();
+	m_fileName = fileName;
+
+	if (!m_file.open(fileName)) return;
+	m_pData = m_file.data();
+	size_t size = m_file.size();
+
+	if (size >= sizeof(persistentHeader) && 0 == memcmp(m_pData, PERSISTENT_MAGIC, PERSISTENT_MAGIC_LEN)) {
+		persistentHeader hdr;
+		memcpy(&hdr, m_pData, sizeof(hdr));
+		if (hdr.indexOffset < sizeof(hdr) || hdr.indexOffset > size
+				|| hdr.count > (size - hdr.indexOffset) / sizeof(uint64_t)) {
+			corrupt();
+		}
+		m_count = size_t(hdr.count);
+		m_indexOffset = size_t(hdr.indexOffset);
+		return;
+	}
+
+	// The text format
+	m_file.close();
+	m_pData = nullptr;
+	std::ifstream f(fileName);
+	std::map<std::string,std::string> vars;
+	std::string theKey, theValue;
+	while (getline(f, theKey)) {
+		if (getline(f, theValue)) {
+			vars[theKey] = theValue;
+		}
+	}
+	m_legacy.assign(vars.begin(), vars.end());
+	m_bLegacy = true;
+}
+
+size_t persistentFile::recordOffset(size_t i)
+{
+	uint64_t offset;
+	memcpy(&offset, m_pData + m_indexOffset + i * sizeof(uint64_t), sizeof(offset));
+	if (offset < sizeof(persistentHeader) || offset + PERSISTENT_RECORD_HEADER > m_indexOffset) {
+		corrupt();
+	}
+	uint32_t lens[2];
+	memcpy(lens, m_pData + offset, sizeof(lens));
+	if (uint64_t(lens[0]) + lens[1] > m_indexOffset - offset - PERSISTENT_RECORD_HEADER) {
+		corrupt();
+	}
+	return size_t(offset);
+}
+
+std::string_view persistentFile::key(size_t i)
+{
+	if (m_bLegacy) return m_legacy[i].first;
+	size_t offset = recordOffset(i);
+	uint32_t keyLen;
+	memcpy(&keyLen, m_pData + offset, sizeof(keyLen));
+	return std::string_view(m_pData + offset + PERSISTENT_RECORD_HEADER, keyLen);
+}
+
+std::string_view persistentFile::value(size_t i)
+{
+	if (m_bLegacy) return m_legacy[i].second;
+	size_t offset = recordOffset(i);
+	uint32_t lens[2];
+	memcpy(lens, m_pData + offset, sizeof(lens));
+	return std::string_view(m_pData + offset + PERSISTENT_RECORD_HEADER + lens[0], lens[1]);
+}
+
+bool persistentFile::find(std::string_view k, std::string_view& v)
+{
+	size_t lo = 0;
+	size_t hi = count();
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = key(mid).compare(k);
+		if (0 == cmp) {
+			v = value(mid);
+			return true;
+		}
+		if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return false;
+}
+
+// A change made during this run. A cleared variable has an empty value.
+struct persistentChange {
+	std::string  value;
+	bool         bCleared;
+};
+
+static persistentFile PersistentFile;
+static std::map<std::string,persistentChange> PersistentChanges;
+static std::unordered_map<std::string,std::string> PersistentValues;  // values read from the file
 static bool g_bPersistentVariablesAreDirty = false;
+static bool g_bPersistentFileWanted = false;   // the file is opened when a variable is first read
 
 std::string& persistentVarGet(std::string& key)
 {
-	return PersistentVariables[key];
+	auto it = PersistentChanges.find(key);
+	if (it != PersistentChanges.end()) {
+		return it->second.value;
+	}
+
+	auto cached = PersistentValues.find(key);
+	if (cached != PersistentValues.end()) {
+		return cached->second;
+	}
+
+	if (g_bPersistentFileWanted) {
+		PersistentFile.open(getPersistneceFileName());
+		g_bPersistentFileWanted = false;
+	}
+
+	std::string_view value;
+	std::string& ret = PersistentValues[key];
+	if (PersistentFile.find(key, value)) {
+		ret.assign(value.data(), value.size());
+	}
+	return ret;
 }
 
 bool         persistentVarDefined(std::string& key)
 {
-	return !PersistentVariables[key].empty();
+	return !persistentVarGet(key).empty();
 }
 
 void         persistentVarSet(std::string& key, std::string& value)
 {
-	PersistentVariables[key] = value;
+	PersistentChanges[key] = {value, false};
 	g_bPersistentVariablesAreDirty = true;
 }
 
 void         persistentVarClear(std::string& key)
 {
 	if (persistentVarDefined(key)) {
-		PersistentVariables.erase(key);
+		PersistentChanges[key] = {std::string(), true};
 		g_bPersistentVariablesAreDirty = true;
 	}
 }
@@ -35,33 +234,123 @@ void         persistentVarClear(std::string& key)
 
 void persistentVarLoad()
 {
-	std::string theKey, theValue;
-	std::string persistenceFileName = getPersistneceFileName();
-	std::ifstream persistenceFile(persistenceFileName);
-	if (persistenceFile.is_open()) {
-		while (getline(persistenceFile, theKey)) {
-			if (getline(persistenceFile, theValue)) {
-				persistentVarSet(theKey, theValue);
+	g_bPersistentFileWanted = true;
+}
+
+static void appendRecord(std::string& buf, std::vector<uint64_t>& offsets, std::string_view key, std::string_view value)
+{
+	// An empty value means the variable is not defined
+	if (value.empty()) return;
+
+	MYASSERT(key.size() <= UINT32_MAX && value.size() <= UINT32_MAX);
+	uint32_t lens[2] = {uint32_t(key.size()), uint32_t(value.size())};
+	offsets.push_back(uint64_t(buf.size()));
+	buf.append((const char*)lens, sizeof(lens));
+	buf.append(key.data(), key.size());
+	buf.append(value.data(), value.size());
+}
+
+/*
+ * Merges the changes of this run into the current content of the file, and
+ * writes the result into a temporary file that then replaces it.
+ */
+static void persistentVarCommit(const std::string& persistenceFileName)
+{
+	persistentFile current;
+	current.open(persistenceFileName);
+
+	std::string buf(sizeof(persistentHeader), '\0');
+	std::vector<uint64_t> offsets;
+	size_t i = 0;
+	auto it = PersistentChanges.begin();
+	while (i < current.count() || it != PersistentChanges.end()) {
+		int cmp;
+		if (i == current.count()) {
+			cmp = 1;
+		} else if (it == PersistentChanges.end()) {
+			cmp = -1;
+		} else {
+			cmp = current.key(i).compare(it->first);
+		}
+
+		if (cmp < 0) {
+			appendRecord(buf, offsets, current.key(i), current.value(i));
+			i++;
+		} else {
+			if (!it->second.bCleared) {
+				appendRecord(buf, offsets, it->first, it->second.value);
 			}
+			if (0 == cmp) i++;
+			it++;
 		}
 	}
 
-	// Since we have just read the variables, mark them as not dirty.
-	g_bPersistentVariablesAreDirty = false;
+	while (0 != buf.size() % sizeof(uint64_t)) {
+		buf += '\0';
+	}
+	persistentHeader hdr;
+	memcpy(hdr.magic, PERSISTENT_MAGIC, PERSISTENT_MAGIC_LEN);
+	hdr.count = offsets.size();
+	hdr.indexOffset = buf.size();
+	memcpy(&buf[0], &hdr, sizeof(hdr));
+	buf.append((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+
+#ifdef WIN64
+	std::string tempFileName = persistenceFileName + ".tmp" + std::to_string(_getpid());
+#else
+	std::string tempFileName = persistenceFileName + ".tmp" + std::to_string(getpid());
+#endif
+	FILE* f = fopen(tempFileName.c_str(), "wb");
+	MYASSERT_WITH_MSG(f != nullptr, "Cannot open persistence file for write");
+	bool bWritten = (buf.size() == fwrite(buf.data(), 1, buf.size(), f)) && (0 == fflush(f));
+#ifndef WIN64
+	bWritten = bWritten && (0 == fsync(fileno(f)));
+	// The new file gets the permissions of the one it replaces
+	struct stat st;
+	if (bWritten && 0 == stat(persistenceFileName.c_str(), &st)) {
+		bWritten = (0 == fchmod(fileno(f), st.st_mode & 07777));
+	}
+#endif
+	bWritten = (0 == fclose(f)) && bWritten;
+#ifdef WIN64
+	// rename does not replace an existing file on Windows
+	if (bWritten) remove(persistenceFileName.c_str());
+#endif
+	if (!bWritten || 0 != rename(tempFileName.c_str(), persistenceFileName.c_str())) {
+		remove(tempFileName.c_str());
+		MYTHROW("Cannot write the persistence file");
+	}
 }
 
 void persistentVarSaveIfNeeded()
 {
 	if (g_bPersistentVariablesAreDirty) {
 		std::string persistenceFileName = getPersistneceFileName();
-		std::ofstream persistenceFile(persistenceFileName);
-		MYASSERT_WITH_MSG(persistenceFile.is_open(), "Cannot open persistence file for write");
 
-		for (auto it = PersistentVariables.begin() ; it != PersistentVariables.end() ; it++) {
-			persistenceFile << it->first << "\n" << it->second << "\n";
+#ifdef WIN64
+		persistentVarCommit(persistenceFileName);
+#else
+		std::string lockFileName = persistenceFileName + ".lock";
+		int lockFd = open(lockFileName.c_str(), O_RDWR | O_CREAT, 0600);
+		MYASSERT_WITH_MSG(lockFd >= 0, "Cannot open the persistence lock file");
+		int rc;
+		do {
+			rc = flock(lockFd, LOCK_EX);
+		} while (rc != 0 && errno == EINTR);
+		if (rc != 0) {
+			std::string err = "Cannot lock " + lockFileName + ": " + strerror(errno);
+			close(lockFd);
+			MYTHROW(err);
 		}
+		try {
+			persistentVarCommit(persistenceFileName);
+		} catch (...) {
+			close(lockFd);
+			throw;
+		}
+		close(lockFd);
+#endif
 
 		g_bPersistentVariablesAreDirty = false;
 	}
 }
-
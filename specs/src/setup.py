@@ -158,7 +158,7 @@ LIBOBJS = $(CCSRC:.cc=.{})
 TESTOBJS = $(TESTSRC:.cc=.{})
 
 #default goal
-some: directories $(EXE_DIR)/specs $(EXE_DIR)/specs-autocomplete
+some: directories $(EXE_DIR)/specs $(EXE_DIR)/specs-autocomplete $(EXE_DIR)/specs-client
 
 all: directories $(TEST_EXES)
 
@@ -194,19 +194,25 @@ directories: $(EXE_DIR)
 $(EXE_DIR):
 	$(MKDIR_C) $@
 	
-$(EXE_DIR)/%: test/%.{} $(LIBOBJS)
-	$(LINKER) {}$@{} {} $^ $(CONDLINK)
+$(EXE_DIR)/%: test/%.{0} $(LIBOBJS)
+	$(LINKER) {1}$@{2} {3} $^ $(CONDLINK)
+
+# The client only talks to the server, so it is linked on its own to start quickly
+$(EXE_DIR)/specs-client: test/specs-client.{0}
+	$(LINKER) {1}$@{2} $^ {4}
 		
-install_mac: $(EXE_DIR)/specs specs.1.gz
+install_mac: $(EXE_DIR)/specs $(EXE_DIR)/specs-client specs.1.gz
 	cp $(EXE_DIR)/specs /usr/local/bin/
+	cp $(EXE_DIR)/specs-client /usr/local/bin/
 	/bin/rm */*.d
 	$(MKDIR_C) /usr/local/share/man/man1
 	cp specs.1.gz /usr/local/share/man/man1/
 	/bin/rm specs.1.gz
 
-install_linux: $(EXE_DIR)/specs specs.1.gz
+install_linux: $(EXE_DIR)/specs $(EXE_DIR)/specs-client specs.1.gz
 	cp $(EXE_DIR)/specs /usr/local/bin/
 	cp $(EXE_DIR)/specs-autocomplete /usr/local/bin/
+	cp $(EXE_DIR)/specs-client /usr/local/bin/
 	/bin/rm */*.d
 	$(MKDIR_C) /usr/local/share/man/man1
 	cp specs.1.gz /usr/local/share/man/man1/
@@ -274,6 +280,8 @@ parser.add_argument("--os_version", dest="osversion", action="store", default=""
 					help="OS version to link against. Available only in Mac OS")
 parser.add_argument("--python", dest="pyprefix", action="store", default="",
                     help="Python prefix to use. 'python' is the default, optional if unspecified; 'no' means no.  Examples: 'python', 'python2', 'python3.7', 'no'")
+parser.add_argument("--regex", dest="regex", action="store", default="auto",
+                    help="Regular expression engine. 'auto' (the default) uses RE2 if available; 're2' requires it; 'std' uses only std::regex")
 args = parser.parse_args()
 
 compiler = args.compiler.upper()
@@ -283,6 +291,7 @@ osversion = args.osversion if sys.platform=="darwin" else ""
 use_cached_depends = args.ucd
 avoid_cryptographic_random = args.nocrypt
 python_prefix = args.pyprefix
+regex_engine = args.regex.lower()
 
 # default for use_cached_depends depends on the choice of compiler
 if use_cached_depends is None:
@@ -489,6 +498,37 @@ else:
 	sys.stdout.write("Internal error.\n")
 	exit(-4)
 cleanup_after_compile()
+
+# Test if the RE2 regular expression engine is available
+CFG_re2 = False
+re2_ldflags = "-lre2"
+if regex_engine not in ["auto", "re2", "std"]:
+	sys.stderr.write("Invalid regular expression engine: {}. Options: auto, re2, std\n".format(regex_engine))
+	exit(-4)
+if regex_engine=="std" or compiler=="VS":
+	sys.stdout.write("Testing RE2 support...Not configured\n")
+else:
+	if 0==run_the_cmd("pkg-config --libs re2"):
+		with open("xx.txt", "r") as flags:
+			re2_ldflags = flags.read().strip()
+	test_re2_cmd = "{} {} -o xx.exe xx.cc {}".format(cxx,cppflags_test,re2_ldflags)
+	with open("xx.cc", "w") as testfile:
+		testfile.write('#include <re2/re2.h>\n')
+		testfile.write('int main(int argc, char** argv) {\n')
+		testfile.write('    RE2 re("(sub)([^ ]*)");\n')
+		testfile.write('    return RE2::PartialMatch("this subject", re) ? 0 : -4;\n')
+		testfile.write('}\n')
+	sys.stdout.write("Testing RE2 support...")
+	test_re2_run_cmd = "./xx.exe" if platform!="NT" else "xx.exe"
+	if 0==run_the_cmd(test_re2_cmd) and 0==run_the_cmd(test_re2_run_cmd):
+		sys.stdout.write("Supported\n")
+		CFG_re2 = True
+	elif regex_engine=="re2":
+		sys.stdout.write("Not supported.  Aborting...\n")
+		exit(-4)
+	else:
+		sys.stdout.write("Not supported -- using std::regex\n")
+	cleanup_after_compile()
 	
 # Test if the environment supports a Spanish locale
 test_spanish_locale_cmd = "{} {} -o xx.exe xx.cc".format(cxx,cppflags_test)
@@ -664,6 +704,10 @@ else:
 if CFG_regex_grammars:
 	condcomp = condcomp + "{}REGEX_GRAMMARS".format(def_prefix)
 
+if CFG_re2:
+	condcomp = condcomp + "{}REGEX_BACKEND_RE2".format(def_prefix)
+	condlink = condlink + " " + re2_ldflags
+
 if osversion != "":
 	condlink = condlink + " -mmacosx-version-min={}".format(osversion)
 
@@ -679,13 +723,13 @@ with open("Makefile", "w") as makefile:
 	
 	if compiler=="VS":
 		body1fmt = body1.format("obj","obj")
-		body2fmt = body2.format("obj","/OUT:",".exe","advapi32.lib")
+		body2fmt = body2.format("obj","/OUT:",".exe","advapi32.lib","")
 	elif compiler=="CLANG":
 		body1fmt = body1.format("o","o")
-		body2fmt = body2.format("o", "-o ", "", "-pthread")
+		body2fmt = body2.format("o", "-o ", "", "-pthread", "")
 	else:
 		body1fmt = body1.format("o","o")
-		body2fmt = body2.format("o", "-o ", "", "-pthread")
+		body2fmt = body2.format("o", "-o ", "", "-pthread", "-static-libstdc++ -static-libgcc")
 	
 	makefile.write("{}\n".format(body1fmt))
 	if use_cached_depends:
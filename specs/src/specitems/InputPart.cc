@@ -202,22 +202,7 @@ PSpecString IDPart::getStr(ProcessingState& pState)
 
 ExpressionPart::ExpressionPart(std::string& _expr)
 {
-	AluVec infixExpression;
-	MYASSERT(parseAluExpression(_expr, infixExpression));
-	if (expressionIsAssignment(infixExpression)) {
-		PUnit aUnit = infixExpression[0];
-		auto pCounterUnit = std::dynamic_pointer_cast<AluUnitCounter>(aUnit);
-		MYASSERT(nullptr != pCounterUnit);
-		m_counter = pCounterUnit->getKey();
-		m_assnOp = std::dynamic_pointer_cast<AluAssnOperator>(infixExpression[1]);
-		MYASSERT(nullptr != m_assnOp);
-		infixExpression.erase(infixExpression.begin(), infixExpression.begin()+2);
-		m_isAssignment = true;
-	} else {
-		m_isAssignment = false;
-	}
-
-	MYASSERT(convertAluVecToPostfix(infixExpression, m_RPNExpr, true));
+	m_isAssignment = compileAluExpression(_expr, m_RPNExpr, &m_counter, &m_assnOp);
 	m_rawExpression = _expr;
 }
 
@@ -234,6 +219,7 @@ PSpecString ExpressionPart::getStr(ProcessingState& pState)
 {
 	PValue res;
 	if (m_isAssignment) {
+		pState.checkCounterUpdate();
 		ALUPerformAssignment(m_counter, m_assnOp, m_RPNExpr, &g_counters);
 		res = g_counters.getPointer(m_counter);
 	} else {
@@ -247,3 +233,20 @@ bool ExpressionPart::readsLines()
 {
 	return AluExpressionReadsLines(m_RPNExpr);
 }
+
+PExternalFunctionRec ExpressionPart::batchableCall()
+{
+	if (m_isAssignment) return nullptr;
+	PExternalFunctionRec pFunc = expressionExternalCall(m_RPNExpr);
+	if (pFunc && pFunc->IsBatchable()) {
+		return pFunc;
+	}
+	return nullptr;
+}
+
+void ExpressionPart::queueBatchCall()
+{
+	std::vector<PValue> args;
+	evaluateCallArguments(m_RPNExpr, &g_counters, args);
+	expressionExternalCall(m_RPNExpr)->QueueCall(args);
+}
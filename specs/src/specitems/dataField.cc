@@ -1,3 +1,5 @@
+#include <iostream>
+#include <sstream>
 #include "utils/platform.h"
 #include "utils/ErrorReporting.h"
 #include "processing/Config.h"
@@ -5,6 +7,21 @@
 
 extern ALUCounters g_counters;
 
+// How often an output field was converted or resized in place, or had to be copied first
+static uint64_t fieldsChangedInPlace = 0;
+static uint64_t fieldsCopiedToChange = 0;
+
+void dumpDataFieldStats()
+{
+	if (fieldsChangedInPlace + fieldsCopiedToChange > 0) {
+		std::ostringstream oss;
+		oss << "Output field stats:\n";
+		oss << "\tConverted or resized in place: " << fieldsChangedInPlace << "\n";
+		oss << "\tCopied to be converted or resized: " << fieldsCopiedToChange << "\n";
+		std::cerr << oss.str();
+	}
+}
+
 #define GET_NEXT_TOKEN_NO_ADVANCE {           \
 		if (index>=tokenVec.size()) {         \
 			token = dummyToken;               \
@@ -33,6 +50,8 @@ DataField::DataField()
 	m_conversion = StringConversion__identity;
 	m_alignment = outputAlignmentLeft;
 	m_conversionParam = "";
+	m_pBatchPart = nullptr;
+	m_bCallDeferred = false;
 }
 
 DataField::~DataField() {
@@ -357,30 +376,20 @@ void DataField::parse(std::vector<Token> &tokenVec, unsigned int& index)
 
 void DataField::interpretComposedOutputPlacement(std::string& outputPlacement)
 {
-	AluVec outputPlacementExpression;
-	AluVec infixExpression;
+	AluVec* parts[] = {&m_outputStartExpression, &m_outputWidthExpression, &m_outputAlignmentExpression};
 
 	m_outStart = POS_SPECIAL_VALUE_COMPOSED;
 	m_maxLength = 0;
 	m_alignment = outputAlignmentLeft;
 
-	MYASSERT(parseAluExpression(outputPlacement, outputPlacementExpression));
-	MYASSERT(breakAluVecByComma(outputPlacementExpression, infixExpression));
-	MYASSERT(convertAluVecToPostfix(infixExpression, m_outputStartExpression, true));
-
-	if (outputPlacementExpression.empty()) return;
-
-	m_maxLength = POS_SPECIAL_VALUE_COMPOSED;
-	MYASSERT(breakAluVecByComma(outputPlacementExpression, infixExpression));
-	MYASSERT(convertAluVecToPostfix(infixExpression, m_outputWidthExpression, true));
+	size_t countParts = compileAluExpressionList(outputPlacement, parts, sizeof(parts) / sizeof(parts[0]));
 
-	if (outputPlacementExpression.empty()) return;
-
-	m_alignment = outputAlignmentComposed;
-	MYASSERT(breakAluVecByComma(outputPlacementExpression, infixExpression));
-	MYASSERT(convertAluVecToPostfix(infixExpression, m_outputAlignmentExpression, true));
-
-	MYASSERT(outputPlacementExpression.empty());
+	if (countParts > 1) {
+		m_maxLength = POS_SPECIAL_VALUE_COMPOSED;
+	}
+	if (countParts > 2) {
+		m_alignment = outputAlignmentComposed;
+	}
 }
 
 std::string DataField::Debug() {
@@ -445,12 +454,60 @@ void DataField::stripString(PSpecString &pOrig)
 	pOrig = std::make_shared<std::string>(s, len);
 }
 
+/*
+ * Method: batchableCall
+ *
+ * Description: finds whether this field's external function call could be
+ *              queued, so that the calls of many records go to Python at once.
+ *
+ * Returns:
+ *   - the function, or nullptr if this field cannot be completed later. That
+ *     requires that its value is just the call, that it sets no field
+ *     identifier, and that where it goes does not depend on the record.
+ */
+PExternalFunctionRec DataField::batchableCall()
+{
+	if (m_label || m_tailLabel) return nullptr;
+	if (m_outStart==LAST_POS_END || m_outStart==POS_SPECIAL_VALUE_COMPOSED) return nullptr;
+	if (m_maxLength==POS_SPECIAL_VALUE_COMPOSED || m_alignment==outputAlignmentComposed) return nullptr;
+
+	PExpressionPart pExpr = std::dynamic_pointer_cast<ExpressionPart>(m_InputPart);
+	if (!pExpr) return nullptr;
+
+	return pExpr->batchableCall();
+}
+
+// Lets this field queue its external function call instead of making it
+PExternalFunctionRec DataField::enableBatching()
+{
+	PExternalFunctionRec pFunc = batchableCall();
+	if (pFunc) {
+		m_pBatchPart = std::dynamic_pointer_cast<ExpressionPart>(m_InputPart);
+	}
+	return pFunc;
+}
+
+bool DataField::takeDeferredCall()
+{
+	bool ret = m_bCallDeferred;
+	m_bCallDeferred = false;
+	return ret;
+}
+
+ApplyRet DataField::completeDeferredCall(ProcessingState& pState, StringBuilder* pSB, PValue result, char padChar)
+{
+	return placeOutput(pState, pSB, std::make_shared<std::string>(result->getStr()), padChar);
+}
+
 ApplyRet DataField::apply(ProcessingState& pState, StringBuilder* pSB)
 {
-	bool bWritingWasDone = false;
-	PValue pComposedStartingPosition = nullptr;
+	if (m_pBatchPart) {
+		m_pBatchPart->queueBatchCall();
+		m_bCallDeferred = true;
+		return ApplyRet__Continue;
+	}
+
 	PSpecString pInput = m_InputPart->getStr(pState);
-	size_t outputWidth = m_maxLength;
 
 	if (!pInput) pInput = std::make_shared<std::string>();
 
@@ -462,14 +519,32 @@ ApplyRet DataField::apply(ProcessingState& pState, StringBuilder* pSB)
 		}
 	}
 
+	return placeOutput(pState, pSB, std::move(pInput), pState.getPadChar());
+}
+
+ApplyRet DataField::placeOutput(ProcessingState& pState, StringBuilder* pSB, PSpecString pInput, char padChar)
+{
+	bool bWritingWasDone = false;
+	PValue pComposedStartingPosition = nullptr;
+	size_t outputWidth = m_maxLength;
+
 	if (m_strip) {
 		stripString(pInput);
 	}
 
 	if (m_conversion) {
-		std::string currentString(pInput->data(), pInput->length());
-		std::string convertedString = stringConvert(currentString, m_conversion, m_conversionParam);
-		pInput = std::make_shared<std::string>(convertedString);
+		if (isLengthPreservingConversion(m_conversion)) {
+			// Don't change a string that someone else also holds
+			if (pInput.use_count() > 1) {
+				pInput = std::make_shared<std::string>(*pInput);
+				fieldsCopiedToChange++;
+			} else {
+				fieldsChangedInPlace++;
+			}
+			stringConvertInPlace(*pInput, m_conversion);
+		} else {
+			pInput = std::make_shared<std::string>(stringConvert(*pInput, m_conversion, m_conversionParam));
+		}
 	}
 
 	// truncate or expand if necessary
@@ -502,8 +577,15 @@ ApplyRet DataField::apply(ProcessingState& pState, StringBuilder* pSB)
 	}
 
 	if (outputWidth>0 && pInput->length()!=outputWidth) {
+		// The string may also be the value of the field identifier; resize a copy of it
+		if (pInput.use_count() > 1) {
+			pInput = std::make_shared<std::string>(*pInput);
+			fieldsCopiedToChange++;
+		} else {
+			fieldsChangedInPlace++;
+		}
 		if (m_alignment != outputAlignmentComposed) {
-			SpecString_Resize(pInput, outputWidth, pState.getPadChar(), m_alignment, ellipsisSpecNone);
+			SpecString_Resize(pInput, outputWidth, padChar, m_alignment, ellipsisSpecNone);
 		} else {
 			outputAlignment al = outputAlignmentLeft;
 			ellipsisSpec es = ellipsisSpecNone;
@@ -538,7 +620,7 @@ ApplyRet DataField::apply(ProcessingState& pState, StringBuilder* pSB)
 				}
 			}
 
-			SpecString_Resize(pInput, outputWidth, pState.getPadChar(), al, es);
+			SpecString_Resize(pInput, outputWidth, padChar, al, es);
 		}
 	}
 
@@ -550,7 +632,7 @@ ApplyRet DataField::apply(ProcessingState& pState, StringBuilder* pSB)
 		goto FINISH;
 	}
 
-	pSB->setPadChar(pState.getPadChar());
+	pSB->setPadChar(padChar);
 
 	if (m_outStart==POS_SPECIAL_VALUE_NEXT) {
 		pSB->insertNext(pInput);
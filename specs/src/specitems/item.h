@@ -23,6 +23,8 @@ public:
 typedef std::shared_ptr<InputPart> PPart;
 static std::string emptyString;
 
+void dumpDataFieldStats();
+
 class LiteralPart : public InputPart {
 public:
 	LiteralPart(std::string& s) {m_Str = s;}
@@ -151,6 +153,8 @@ public:
 	virtual PSpecString getStr(ProcessingState& pState);
 	virtual bool        readsLines();
 	virtual bool        forcesRunoutCycle() {return expressionForcesRunoutCycle(m_RPNExpr);}
+	PExternalFunctionRec batchableCall();   // the function, if the expression is just a call with a batch form
+	void                 queueBatchCall();
 private:
 	AluVec m_RPNExpr;
 	bool   m_isAssignment;
@@ -209,7 +213,12 @@ public:
 	virtual ApplyRet apply(ProcessingState& pState, StringBuilder* pSB);
 	virtual bool readsLines();
 	virtual bool forcesRunoutCycle() {return m_InputPart ? m_InputPart->forcesRunoutCycle() : false;}
+	PExternalFunctionRec batchableCall();
+	PExternalFunctionRec enableBatching();
+	bool     takeDeferredCall();
+	ApplyRet completeDeferredCall(ProcessingState& pState, StringBuilder* pSB, PValue result, char padChar);
 private:
+	ApplyRet placeOutput(ProcessingState& pState, StringBuilder* pSB, PSpecString pInput, char padChar);
 	PPart getInputPart(std::vector<Token> &tokenVec, unsigned int& index, const std::string& _wordSep=emptyString, const std::string& _fieldSep=emptyString);
 	PSubstringPart getSubstringPart(std::vector<Token> &tokenVec, unsigned int& index);
 	void stripString(PSpecString &pOrig);
@@ -226,6 +235,8 @@ private:
 	AluVec            m_outputStartExpression;
 	AluVec            m_outputWidthExpression;
 	AluVec            m_outputAlignmentExpression;
+	PExpressionPart   m_pBatchPart;     // set when the call is queued rather than made
+	bool              m_bCallDeferred;
 };
 
 typedef std::shared_ptr<DataField> PDataField;
@@ -304,7 +315,7 @@ public:
 	virtual bool readsLines();
 	virtual bool forcesRunoutCycle() { return expressionForcesRunoutCycle(m_RPNExpression);}
 private:
-	bool        evaluate();
+	bool        evaluate(ProcessingState& pState);
 	std::string m_rawExpression;
 	AluVec      m_RPNExpression;
 	predicate   m_pred;
@@ -23,6 +23,10 @@ itemGroup::itemGroup()
 	bNeedRunoutCycle = false;
 	bNeedRunoutCycleFromStart = false;
 	bFoundSelectSecond = false;
+	m_groupByKey = 0;
+	m_pBatchField = nullptr;
+	m_pBatchFunc = nullptr;
+	m_batchSize = 0;
 }
 
 itemGroup::~itemGroup()
@@ -61,13 +65,10 @@ bool CheckValiditySetStatement(std::string& setSpec)
 {
 	ALUCounterKey k;
 	AluAssnOperator assOp;
-	AluVec aVec, rpnVec;
+	AluVec rpnVec;
 
-	if (false==parseAluStatement(setSpec, k, &assOp, aVec)) {
-		return false;
-	}
-
-	return convertAluVecToPostfix(aVec, rpnVec, true);
+	compileAluStatement(setSpec, k, &assOp, rpnVec);
+	return true;
 }
 
 static void Strip(std::string& s)
@@ -405,6 +406,13 @@ void itemGroup::Compile(std::vector<Token> &tokenVec, unsigned int& index)
 			index++;
 			break;
 		}
+		case TokenListType__GROUPBY:
+		{
+			MYASSERT_WITH_MSG(m_items.empty(), "GROUPBY instruction is only valid before the first specification item");
+			m_groupByKey = tokenVec[index].Literal()[0];
+			index++;
+			break;
+		}
 		default:
 			std::string err = std::string("Unhandled token type ")
 				+ TokenListType__2str(tokenVec[index].Type())
@@ -442,6 +450,10 @@ void itemGroup::Compile(std::vector<Token> &tokenVec, unsigned int& index)
 		}
 	} while (bAddedMissingPredicate);
 
+	if (m_groupByKey && !bNeedRunoutCycle) {
+		MYTHROW("GROUPBY requires an EOF unit: the output is produced in the run-out cycle of each group");
+	}
+
 	if (predicateStackIdx > 0) {
 		predicateStackIdx--;
 		std::string err = "Predicate " + predicateStack[predicateStackIdx].pred->Debug() +
@@ -583,12 +595,30 @@ void itemGroup::process(StringBuilder& sb, ProcessingState& pState, Reader& rd,
 	PSpecString ps;
 	unsigned int readerCounter = 1;  // we only got 1.
 
+	pState.setGroupBy(m_groupByKey);
+	setupBatching();
+
 	while ((ps=rd.get(tmr, readerCounter))) {
 		pState.setString(ps);
 		pState.setFirst();
 		pState.incrementCycleCounter();
 
-		if (processDo(sb,pState, &rd, tmr, readerCounter)) {
+		bool bSomethingWasDone;
+		try {
+			bSomethingWasDone = processDo(sb,pState, &rd, tmr, readerCounter);
+		} catch (...) {
+			// Records that were held for the batch precede the one that failed
+			try {
+				flushBatch(sb, pState, tmr);
+			} catch (...) {}
+			throw;
+		}
+		if (m_pBatchField) {
+			holdRecord(sb, pState, bSomethingWasDone, tmr);
+			if (m_pending.size() >= m_batchSize) {
+				flushBatch(sb, pState, tmr);
+			}
+		} else if (bSomethingWasDone) {
 			bool bPrintSuppressed = pState.printSuppressed(g_printonly_rule);
 			if (bPrintSuppressed && g_keep_suppressed_record) {
 				pState.resetNoWrite();
@@ -608,6 +638,8 @@ void itemGroup::process(StringBuilder& sb, ProcessingState& pState, Reader& rd,
 		pState.setActiveWriter(1);
 	}
 
+	flushBatch(sb, pState, tmr);
+
 	MYASSERT(readerCounter==0);
 	pState.setEOF();
 
@@ -619,13 +651,141 @@ void itemGroup::process(StringBuilder& sb, ProcessingState& pState, Reader& rd,
 	// run-out cycle
 	pState.setString(nullptr);
 	pState.setFirst();
-	if (processDo(sb, pState, &rd, tmr, readerCounter)) {
+	if (pState.isGroupBy()) {
+		// One run-out cycle for each group, in the order of the keys
+		while (pState.selectNextGroup()) {
+			if (processDo(sb, pState, &rd, tmr, readerCounter)) {
+				pState.getCurrentWriter()->Write(sb.GetString(), tmr);
+			}
+		}
+	} else if (processDo(sb, pState, &rd, tmr, readerCounter)) {
 		pState.getCurrentWriter()->Write(sb.GetString(), tmr);
 	}
 
 	tmr.changeClass(timeClassDraining);
 }
 
+/*
+ * Method: setupBatching
+ *
+ * Description: When the last item prints a call to an external function that
+ *              has a batch form, the calls of many records are made together.
+ *              Each record is held after the other items have been applied,
+ *              and completed and written when the batch returns.
+ *
+ *              This is only done where holding the record cannot change the
+ *              result: no item may read or write records out of order, and
+ *              there is no run-out cycle that could see the held records.
+ */
+void itemGroup::setupBatching()
+{
+	static std::string batchOption = "pythonBatch";
+	static std::string batchDefault = "256";
+
+	m_pBatchField = nullptr;
+	m_pBatchFunc = nullptr;
+	m_pending.clear();
+
+	if (m_groupByKey || bNeedRunoutCycle || g_keep_suppressed_record) return;
+
+	PDataField pField = nullptr;
+	for (PItem pItem : m_items) {
+		PTokenItem pTok = std::dynamic_pointer_cast<TokenItem>(pItem);
+		if (pTok) {
+			switch (pTok->getToken()->Type()) {
+			case TokenListType__WRITE:
+			case TokenListType__READ:
+			case TokenListType__READSTOP:
+			case TokenListType__EOF:
+			case TokenListType__UNREAD:
+			case TokenListType__REDO:
+			case TokenListType__ABEND:
+				return;
+			default:
+				break;
+			}
+		}
+		PConditionItem pCond = std::dynamic_pointer_cast<ConditionItem>(pItem);
+		if (pCond && ConditionItem::PRED_ENDIF == pCond->pred()) {
+			continue;   // leaving a condition does not touch the record
+		}
+		pField = std::dynamic_pointer_cast<DataField>(pItem);
+	}
+
+	if (!pField || !pField->batchableCall()) return;
+
+	try {
+		m_batchSize = std::stoul(configSpecLiteralGetWithDefault(batchOption, batchDefault));
+	} catch (std::logic_error&) {
+		std::string err = "Invalid value for configured literal " + batchOption;
+		MYTHROW(err);
+	}
+	if (m_batchSize < 2) return;
+
+	m_pBatchFunc = pField->enableBatching();
+	m_pBatchField = pField;
+}
+
+void itemGroup::holdRecord(StringBuilder& sb, ProcessingState& pState, bool bSomethingWasDone, classifyingTimer& tmr)
+{
+	pendingRecord rec;
+	rec.bDeferred = m_pBatchField->takeDeferredCall();
+	rec.bWrite = false;
+	if (bSomethingWasDone || rec.bDeferred) {
+		if (!pState.printSuppressed(g_printonly_rule) && pState.shouldWrite()) {
+			rec.bWrite = true;
+		} else {
+			pState.resetNoWrite();
+		}
+	}
+
+	// Nothing to wait for - write it now if it is not behind other records
+	if (!rec.bDeferred && m_pending.empty()) {
+		if (rec.bWrite) {
+			pState.getCurrentWriter()->Write(sb.GetString(), tmr);
+		}
+		return;
+	}
+
+	rec.pos = sb.pos();
+	rec.output = sb.GetStringUnsafe();
+	rec.padChar = pState.getPadChar();
+	rec.pWriter = pState.getCurrentWriter();
+	m_pending.push_back(rec);
+}
+
+void itemGroup::flushBatch(StringBuilder& sb, ProcessingState& pState, classifyingTimer& tmr)
+{
+	if (m_pending.empty()) return;
+
+	std::vector<PValue> results;
+	try {
+		m_pBatchFunc->CallBatch(results);
+	} catch (...) {
+		// Write the records before the call that failed
+		writePending(sb, pState, tmr, results);
+		throw;
+	}
+	writePending(sb, pState, tmr, results);
+}
+
+void itemGroup::writePending(StringBuilder& sb, ProcessingState& pState, classifyingTimer& tmr, std::vector<PValue>& results)
+{
+	size_t resultIdx = 0;
+	for (pendingRecord& rec : m_pending) {
+		if (rec.bDeferred) {
+			if (resultIdx >= results.size()) break;
+			sb.restore(rec.output, rec.pos);
+			m_pBatchField->completeDeferredCall(pState, &sb, results[resultIdx++], rec.padChar);
+			rec.output = sb.GetString();
+		}
+		if (rec.bWrite) {
+			rec.pWriter->Write(rec.output ? rec.output : std::make_shared<std::string>(), tmr);
+		}
+	}
+	m_pending.clear();
+}
+
 bool itemGroup::readsLines()
 {
 	bool bInRedo[MAX_DEPTH_CONDITION_STATEMENTS];
@@ -738,9 +898,7 @@ bool TokenItem::readsLines() {
 SetItem::SetItem(std::string& _statement)
 {
 	m_rawExpression = _statement;
-	AluVec expr;
-	MYASSERT(parseAluStatement(_statement, m_key, &m_oper, expr));
-	MYASSERT(convertAluVecToPostfix(expr, m_RPNExpression, true));
+	compileAluStatement(_statement, m_key, &m_oper, m_RPNExpression);
 }
 
 SetItem::~SetItem()
@@ -749,6 +907,7 @@ SetItem::~SetItem()
 
 ApplyRet SetItem::apply(ProcessingState& pState, StringBuilder* pSB)
 {
+	pState.checkCounterUpdate();
 	auto pAss = std::make_shared<AluAssnOperator>(m_oper);
 	ALUPerformAssignment(m_key, pAss, m_RPNExpression, &g_counters);
 	return ApplyRet__Continue;
@@ -764,9 +923,7 @@ SkipItem::SkipItem(std::string& _statement, bool bIsUntil)
 	m_rawExpression = _statement;
 	m_bIsUntil = bIsUntil;
 	m_bSatisfied = false;
-	AluVec expr;
-	MYASSERT(parseAluExpression(_statement, expr));
-	MYASSERT(convertAluVecToPostfix(expr, m_RPNExpression, true));
+	compileAluExpression(_statement, m_RPNExpression);
 }
 
 SkipItem::~SkipItem()
@@ -800,22 +957,7 @@ ConditionItem::ConditionItem(std::string& _statement)
 {
 	m_pred = PRED_IF;
 	m_rawExpression = _statement;
-	AluVec expr;
-	MYASSERT(parseAluExpression(_statement, expr));
-	if (expressionIsAssignment(expr)) {
-		PUnit aUnit = expr[0];
-		auto pCounterUnit = std::dynamic_pointer_cast<AluUnitCounter>(aUnit);
-		MYASSERT(nullptr != pCounterUnit);
-		m_counter = pCounterUnit->getKey();
-		aUnit = nullptr;
-		m_assnOp = std::dynamic_pointer_cast<AluAssnOperator>(expr[1]);
-		MYASSERT(nullptr != m_assnOp);
-		expr.erase(expr.begin(), expr.begin()+2);
-		m_isAssignment = true;
-	} else {
-		m_isAssignment = false;
-	}
-	MYASSERT(convertAluVecToPostfix(expr, m_RPNExpression, true));
+	m_isAssignment = compileAluExpression(_statement, m_RPNExpression, &m_counter, &m_assnOp);
 }
 
 ConditionItem::ConditionItem(ConditionItem::predicate _p) : m_counter(0), m_assnOp(nullptr)
@@ -886,10 +1028,11 @@ void ConditionItem::setAssert()
 	m_pred = PRED_ASSERT;
 }
 
-bool ConditionItem::evaluate()
+bool ConditionItem::evaluate(ProcessingState& pState)
 {
 	bool ret;
 	if (m_isAssignment) {
+		pState.checkCounterUpdate();
 		ALUPerformAssignment(m_counter, m_assnOp, m_RPNExpression, &g_counters);
 		ret = g_counters.getPointer(m_counter)->getBool();
 	} else {
@@ -920,14 +1063,14 @@ ApplyRet ConditionItem::apply(ProcessingState& pState, StringBuilder* pSB)
 	switch (m_pred) {
 	case PRED_IF: {
 		if (pState.needToEvaluate()) {
-			pState.setCondition(evaluate());
+			pState.setCondition(evaluate(pState));
 		} else {
 			pState.observeIf();
 		}
 		break;
 	}
 	case PRED_ASSERT: {
-		if (pState.needToEvaluate() && !evaluate()) {
+		if (pState.needToEvaluate() && !evaluate(pState)) {
 			std::string err = "ASSERTION failed: " + m_rawExpression;
 			MYABEND(err);
 		}
@@ -942,7 +1085,7 @@ ApplyRet ConditionItem::apply(ProcessingState& pState, StringBuilder* pSB)
 		bool bNeedToEvaluate;
 		pState.observeElseIf(bNeedToEvaluate);
 		if (bNeedToEvaluate) {
-			pState.setCondition(evaluate());
+			pState.setCondition(evaluate(pState));
 		}
 		break;
 	}
@@ -951,7 +1094,7 @@ ApplyRet ConditionItem::apply(ProcessingState& pState, StringBuilder* pSB)
 		break;
 	case PRED_WHILE: {
 		if (pState.needToEvaluate()) {
-			if (evaluate()) {
+			if (evaluate(pState)) {
 				ret = ApplyRet__EnterLoop;
 				if (whileGuardCount > int(g_WhileGuardLimit)) {
 					std::string err = "Potentially endless while-loop detected in Token "
@@ -20,15 +20,35 @@ public:
 	void process(StringBuilder& sb, ProcessingState& pState, Reader& rd, classifyingTimer& tmr);
 	void setRegularRunAtEOF()  { bFoundSelectSecond = true; bNeedRunoutCycle = true; }
 	bool needRunoutCycle()     { return bNeedRunoutCycle;   }
+	char groupByKey()          { return m_groupByKey;       }
 	std::string Debug();
 	bool readsLines();
 private:
 	bool bNeedRunoutCycle;
 	bool bNeedRunoutCycleFromStart;
 	bool bFoundSelectSecond;
+	char m_groupByKey;
 	void addItem(PItem pItem);
 	void addItemBeforeEof(PItem pItem, size_t start);
+	void setupBatching();
+	void holdRecord(StringBuilder& sb, ProcessingState& pState, bool bSomethingWasDone, classifyingTimer& tmr);
+	void flushBatch(StringBuilder& sb, ProcessingState& pState, classifyingTimer& tmr);
+	void writePending(StringBuilder& sb, ProcessingState& pState, classifyingTimer& tmr, std::vector<PValue>& results);
 	std::vector<PItem> m_items;
+
+	// Records waiting for the batched call of the last item
+	struct pendingRecord {
+		PSpecString  output;
+		size_t       pos;
+		char         padChar;
+		PWriter      pWriter;
+		bool         bWrite;
+		bool         bDeferred;
+	};
+	PDataField                 m_pBatchField;
+	PExternalFunctionRec       m_pBatchFunc;
+	size_t                     m_batchSize;
+	std::vector<pendingRecord> m_pending;
 };
 
 #endif
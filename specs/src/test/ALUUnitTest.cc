@@ -690,7 +690,8 @@ int runALUUnitTests4(unsigned int onlyTest)
 	VERIFY_RPN("(a+b)*c","FI(a);FI(b);BOP(+);FI(c);BOP(*)");
 	VERIFY_RPN("2<3","Number(2);Number(3);BOP(<)");
 	VERIFY_RPN("a>b","FI(a);FI(b);BOP(>)");
-	VERIFY_RPN("a>b & b>c","FI(a);FI(b);BOP(>);FI(b);FI(c);BOP(>);BOP(&)");
+	VERIFY_RPN("a>b & b>c","FI(a);FI(b);BOP(>);JMP(&,8);FI(b);FI(c);BOP(>);BOP(&)");
+	VERIFY_RPN("a | b & c","FI(a);JMP(|,7);FI(b);JMP(&,6);FI(c);BOP(&);BOP(|)");
 
 	// Issue #37
 	VERIFY_RPN("tf2mcs(wordrange(1,2),'%d')", "Number(1);Number(2);FUNC(wordrange);Literal(%d);FUNC(tf2mcs)");
@@ -718,6 +719,23 @@ int runALUUnitTests5(unsigned int onlyTest)
 	VERIFY_EXPR_RES("1.1*1.1", "1.21");
 	VERIFY_EXPR_RES("pow(1.1,2)", "1.21");
 	VERIFY_EXPR_RES("1/0", "NaN");
+	VERIFY_EXPR_RES("0 & 1/0", "0");      // short-circuit skips the right-hand operand
+	VERIFY_EXPR_RES("1 | 1/0", "1");
+	VERIFY_EXPR_RES("1 & 1/0", "NaN");
+	VERIFY_EXPR_RES("1/0 | 1", "NaN");    // NaN on the left does not short-circuit
+	VERIFY_EXPR_RES("(0 & 1/0) + 5", "5");
+	VERIFY_EXPR_RES("7+8", "15");         // Int-Int fast path
+	VERIFY_EXPR_RES("7/2", "3.5");
+	VERIFY_EXPR_RES("8/2", "4");
+	VERIFY_EXPR_RES("8/0", "NaN");
+	VERIFY_EXPR_RES("1.5+2", "3.5");      // Float-Float fast path
+	VERIFY_EXPR_RES("1.5*2 = 3", "1");
+	VERIFY_EXPR_RES("length('abc')*2 < 7", "1");
+	VERIFY_EXPR_RES("3 = '3.0'", "1");
+	VERIFY_EXPR_RES("'abc' < 'abd'", "1");  // Str-Str fast path
+	VERIFY_EXPR_RES("'abc' = 'ABC'", "0");
+	VERIFY_EXPR_RES("'10' < '9'", "0");     // numeric strings are still compared as numbers
+	VERIFY_EXPR_RES("-(2+3)*1.5", "-7.5");
 	VERIFY_EXPR_RES("(1/0)+5", "NaN");
 	VERIFY_EXPR_RES("#17", "0");  // initial value of all counters
 
@@ -815,6 +833,10 @@ int runALUUnitTests6(unsigned int onlyTest)
 	VERIFY_EXPR_RES("range(44,48)", "");
 	VERIFY_EXPR_RES("@@", "The\tquick brown\tfox jumps\tover the\tlazy dog");
 	VERIFY_EXPR_RES("record()", "The\tquick brown\tfox jumps\tover the\tlazy dog");
+	// Results are memoized per record, so repeated calls return the same value
+	VERIFY_EXPR_RES("word(2) || '-' || word(2)", "quick-quick");
+	VERIFY_EXPR_RES("length(@@) + length(@@)", "86");
+	VERIFY_EXPR_RES("fieldrange(2,3) = range(5,25)", "1");
 	return 0;
 }
 
@@ -1381,6 +1403,15 @@ int runALUUnitTests14(unsigned int onlyTest)
 	VERIFY_EXPR_RES("rsearch(,'black')", "0");
 	VERIFY_EXPR_RES("rreplace(s,'\\\\b(sub)([^ ]*)','sub-$2')","There is a sub-sequence in the string");
 	VERIFY_EXPR_RES("rreplace(s,'\\\\b(sub)([^ ]*)','$2')","There is a sequence in the string");
+	VERIFY_EXPR_RES("rreplace(s,'(i)(s)','$2$1$$')","There si$ a subsequence in the string");
+	VERIFY_EXPR_RES("rreplace(s,'(i)(s)','[$&]','first_only')","There [is] a subsequence in the string");
+	VERIFY_EXPR_RES("rreplace(s,'sub','<$`>','no_copy')","<There is a >");
+	VERIFY_EXPR_RES("rreplace('aXbX','X*','-')","-a--b--");
+	VERIFY_EXPR_RES("rsearch('abcabc','(abc)\\\\1')", "1");    // back-references
+	VERIFY_EXPR_RES("rsearch('file.txt','\\\\w+(?=\\\\.txt)')", "1");   // lookahead
+	VERIFY_EXPR_RES("rmatch('a\rb','a.b')", "0");
+	VERIFY_EXPR_RES("rsearch(s,'sub'||'seq')", "1");    // dynamic pattern
+	VERIFY_EXPR_RES("rreplace(s,'s'||'ub','-','first_only')","There is a -sequence in the string");
 
 	/* regular expression variations */
 	tg.set('t', "It's just a jump to the left\nAnd then a step to the right\n");
@@ -137,6 +137,8 @@ PSpecString runTestOnExample(const char* _specList, const char* _example)
 		goto end;
 	}
 
+	ps.setGroupBy(ig.groupByKey());
+
 	try {
 		if (ig.readsLines() || !ig.needRunoutCycle()) {
 			do {
@@ -180,15 +182,19 @@ PSpecString runTestOnExample(const char* _specList, const char* _example)
 		ps.setString(nullptr);
 		ps.setFirst();
 		try {
-			ig.processDo(sb, ps, nullptr, tmr, readerCounter);
-			PSpecString pWritten = pwr1->getString();
-			PSpecString pOut = sb.GetStringUnsafe();
-			if (pWritten) {
-				if (result) *result = *result + '\n' + *pWritten;
-				else result = pWritten;
+			// In group-by mode there is a run-out cycle for each group
+			while (!ps.isGroupBy() || ps.selectNextGroup()) {
+				ig.processDo(sb, ps, nullptr, tmr, readerCounter);
+				PSpecString pWritten = pwr1->getString();
+				PSpecString pOut = sb.GetStringUnsafe();
+				if (pWritten) {
+					if (result) *result = *result + '\n' + *pWritten;
+					else result = pWritten;
+				}
+				if (result) *result = *result + '\n' + *pOut;
+				else result = pOut;
+				if (!ps.isGroupBy()) break;
 			}
-			if (result) *result = *result + '\n' + *pOut;
-			else result = pOut;
 		} catch (SpecsException& e) {
 			result = std::make_shared<std::string>(e.what(true));
 			goto end;
@@ -741,6 +747,43 @@ int main(int argc, char** argv)
     spec = "SUBSTR WS / WORD 3 of FS i FIELD 2";
 	VERIFY2(spec, "The Epic: 1/Jan/1970 at midnight", "1970 at m"); // Test #186
 
+	spec = "a: WORD 1 . EOF print 'median(a)' 1 print 'percentile(a,25)' NW print 'percentile(a,100)' NW";
+	VERIFY2(spec, "5\n1\n4\n2\n3", "3 1.75 5"); // Test #187
+
+	spec = "print 'countocc(ab)' 1 print 'countocc(abc)' NW print 'countocc(cabc)' NW print 'countocc(abc,xyz)' NW";
+	VERIFY2(spec, "abcabc\nabc", "1 1 1 1\n2 2 1 2"); // Test #188
+
+	spec = "a: WORD 1 . EOF print 'fmap_dump(a,csv,cd,0,2)' 1";
+	VERIFY2(spec, "b\na\nc\na\nb\na\nd", "a,3\nb,2\n"); // Test #189
+
+	spec = "groupby k  k: w1 .  v: w2 .  set '#0+=v'  EOF  ID k 1  print 'sum(v)' nw  print '#0' nw  print 'fmap_nelem(v)' nw";
+	VERIFY2(spec, "b 1\na 2\nb 3\nc 4\na 2", "a 4 4 1\nb 4 4 2\nc 4 4 1"); // Test #190
+
+	spec = "groupby k  v: w2 .  k: w1 .  EOF  ID k 1  print 'average(v)' nw";
+	VERIFY2(spec, "b 1\na 2\nb 3", "a 2\nb 2"); // Test #191
+
+	// Compiled time formats: composite conversions, and input that is not laid out exactly as the format
+	VERIFY2("1-* tf2mcs '%D %T' a: ID a mcs2tf '%F|%e|%j|%R' 1", "11/23/18 14:43:43", "2018-11-23|23|327|14:43"); // Test #192
+	VERIFY2("1-* tf2mcs '%Y-%m-%d %H:%M:%S' a: ID a mcs2tf '%Y-%m-%dT%H:%M:%S' 1", "2018-1-5  3:4:5", "2018-01-05T03:04:05"); // Test #193
+
+	// Local time computed from the cached time zone offsets: leap days, and a century that is not a leap year
+	VERIFY2("1-* tf2mcs '%Y-%m-%d %H:%M:%S' a: ID a mcs2tf '%a %F %T %j %z' 1", "2024-02-29 12:00:00\n2100-03-01 00:00:00", "Thu 2024-02-29 12:00:00 060 +0200\nMon 2100-03-01 00:00:00 060 +0200"); // Test #194
+
+	// Character conversions of records long enough for the vector kernels
+	VERIFY("1-* C2X 1", "54686520717569636b2062726f776e20666f78206a756d706564206f766572207468652020206c617a7920646f67"); // Test #195
+	VERIFY("1-* C2X 1 REDO 1-* X2CH 1", "The quick brown fox jumped over the   lazy dog"); // Test #196
+	VERIFY("1-* C2B 1 REDO 1-* B2C 1", "The quick brown fox jumped over the   lazy dog"); // Test #197
+	VERIFY("1-* ucase 1", "THE QUICK BROWN FOX JUMPED OVER THE   LAZY DOG"); // Test #198
+	VERIFY("1-* rot13 1", "Gur dhvpx oebja sbk whzcrq bire gur   ynml qbt"); // Test #199
+
+	// Group-by counters: the groups' totals differ, and counters cannot change before the key is set
+	spec = "groupby k  k: w1 .  v: w2 .  set '#0+=v'  EOF  ID k 1  print '#0' nw";
+	VERIFY2(spec, "b 1\na 2\nb 3\nc 4\na 5", "a 7\nb 4\nc 4"); // Test #200
+	spec = "groupby k  v: w2 .  set '#0+=v'  k: w1 .  EOF  ID k 1  print '#0' nw";
+	VERIFY2(spec, "b 1\na 2", "Counters cannot be changed before the GROUPBY key field identifier k is set in the record"); // Test #201
+	spec = "groupby k  k: w1 .  v: w2 .  k: w1 .  EOF  ID k 1  print 'sum(v)' nw  print 'fmap_nelem(k)' nw";
+	VERIFY2(spec, "a 1\nb 2\na 3", "a 4 1\nb 2 1"); // Test #202
+
 	if (errorCount) {
 		std::cout << '\n' << errorCount << '/' << testCount << " tests failed.\n";
 		std::cout << "Failed tests: ";
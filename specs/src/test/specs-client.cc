@@ -0,0 +1,154 @@
+/*
+ * specs-client sends its arguments, standard streams, working directory and
+ * environment to the specs server named by the SPECS_SERVER environment
+ * variable, and exits with the status of the request. If no server is
+ * listening there, it runs specs directly instead.
+ *
+ * It is linked without the rest of specs, so that it starts quickly.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "utils/platform.h"
+#include "utils/serialBuffer.h"
+#include "utils/specsServer.h"
+
+#ifdef SPECS_SERVER
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+extern char** environ;
+
+static bool sendAll(int fd, const char* p, size_t len)
+{
+	while (len > 0) {
+		ssize_t written = write(fd, p, len);
+		if (written < 0 && errno == EINTR) continue;
+		if (written <= 0) return false;
+		p += written;
+		len -= size_t(written);
+	}
+	return true;
+}
+
+static bool receiveAll(int fd, char* p, size_t len)
+{
+	while (len > 0) {
+		ssize_t got = read(fd, p, len);
+		if (got < 0 && errno == EINTR) continue;
+		if (got <= 0) return false;
+		p += got;
+		len -= size_t(got);
+	}
+	return true;
+}
+
+// Returns false if the request could not be sent, so that specs should run directly
+static bool runOnServer(const char* path, int argc, char** argv, int& rc)
+{
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof(addr.sun_path)) return false;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path, strlen(path));
+
+	char* cwd = getcwd(nullptr, 0);
+	if (!cwd) return false;
+
+	serialWriter wr;
+	wr.putString(SPECS_SERVER_MAGIC);
+	wr.putString(cwd);
+	free(cwd);
+	mode_t mask = umask(0);
+	umask(mask);
+	wr.putInt(mask);
+	wr.putInt(argc);
+	for (int i = 0 ; i < argc ; i++) {
+		wr.putString(argv[i]);
+	}
+	uint64_t envCount = 0;
+	for (char** ppVar = environ ; *ppVar ; ppVar++) {
+		envCount++;
+	}
+	wr.putInt(envCount);
+	for (char** ppVar = environ ; *ppVar ; ppVar++) {
+		wr.putString(*ppVar);
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return false;
+	if (0 != connect(fd, (struct sockaddr*)&addr, sizeof(addr))) {
+		close(fd);
+		return false;
+	}
+
+	// The length goes with the standard streams
+	uint64_t len = wr.data().length();
+	struct iovec iov;
+	iov.iov_base = &len;
+	iov.iov_len = sizeof(len);
+	union {
+		struct cmsghdr hdr;
+		char           buf[CMSG_SPACE(sizeof(int) * SPECS_SERVER_FD_COUNT)];
+	} control;
+	memset(&control, 0, sizeof(control));
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	struct cmsghdr* pHdr = CMSG_FIRSTHDR(&msg);
+	pHdr->cmsg_level = SOL_SOCKET;
+	pHdr->cmsg_type = SCM_RIGHTS;
+	pHdr->cmsg_len = CMSG_LEN(sizeof(int) * SPECS_SERVER_FD_COUNT);
+	int fds[SPECS_SERVER_FD_COUNT] = {0, 1, 2};
+	memcpy(CMSG_DATA(pHdr), fds, sizeof(fds));
+
+	ssize_t sent;
+	do {
+		sent = sendmsg(fd, &msg, 0);
+	} while (sent < 0 && errno == EINTR);
+	if (sent != ssize_t(sizeof(len))) {   // for example, one of the standard streams is closed
+		close(fd);
+		return false;
+	}
+
+	uint64_t status;
+	if (!sendAll(fd, wr.data().data(), wr.data().length()) ||
+			!receiveAll(fd, (char*)(&status), sizeof(status))) {
+		fprintf(stderr, "specs-client: The specs server at %s ended the request unexpectedly\n", path);
+		status = uint64_t(-4);
+	}
+	close(fd);
+	rc = int(status);
+	return true;
+}
+#endif
+
+int main(int argc, char** argv)
+{
+#ifdef SPECS_SERVER
+	const char* path = getenv(SPECS_SERVER_ENV_VAR);
+	int rc;
+	if (path && *path && runOnServer(path, argc, argv, rc)) {
+		return rc;
+	}
+
+	// No server: the specs next to this program, or else the one on the PATH
+	std::string self(argv[0]);
+	auto slashPos = self.rfind('/');
+	std::string specsPath = (std::string::npos == slashPos) ? "specs" : self.substr(0, slashPos + 1) + "specs";
+	argv[0] = &specsPath[0];
+	execvp(specsPath.c_str(), argv);
+	fprintf(stderr, "specs-client: Cannot run %s: %s\n", specsPath.c_str(), strerror(errno));
+	return -4;
+#else
+	fprintf(stderr, "specs-client: The specs server is not supported on this platform\n");
+	return -4;
+#endif
+}
@@ -4,6 +4,7 @@
 #include <string.h>
 #include "utils/platform.h"
 #include "cli/tokens.h"
+#include "cli/specCache.h"
 #include "processing/Config.h"
 #include "processing/persistent.h"
 #include "specitems/specItems.h"
@@ -14,7 +15,9 @@
 #include "utils/ErrorReporting.h"
 #include "utils/PythonIntf.h"
 #include "utils/aluRegex.h"
+#include "utils/countTable.h"
 #include "utils/directives.h"
+#include "utils/specsServer.h"
 
 extern int g_stop_stream;
 extern char g_printonly_rule;
@@ -103,6 +106,7 @@ CONTINUE:
 		std::cerr << "\tCompiler version: " << __VERSION__ << "\n";
 		std::cerr << "\tHigh/low watermark for queues: " << QUEUE_HIGH_WM << " / " << QUEUE_LOW_WM << "\n";
 		std::cerr << "\tRandom Provider: " << RandomProvider << "\n";
+		std::cerr << "\tRegular expression engine: " << regexEngineName() << "\n";
 #define STRINGIFY2(x) #x
 #define STRINGIFY(x) STRINGIFY2(x)
 #ifdef GITTAG
@@ -161,26 +165,79 @@ CONTINUE:
 	return true;
 }
 
+static int usage(const char* programName)
+{
+	std::cerr << "Usage: " << programName << " (switches & arguments)\n\n";
+#ifndef WIN64
+	std::cerr << "For more information, type 'man specs'\n";
+#endif
+	return -4;
+}
+
 int main (int argc, char** argv)
 {
 	classifyingTimer timer;
 	bool conciseExceptions = true;
 
+	g_startupTimer.start();
+
 	if (argc==1) { // Called without parameters
-		std::cerr << "Usage: " << argv[0] << " (switches & arguments)\n\n";
-#ifndef WIN64
-		std::cerr << "For more information, type 'man specs'\n";
-#endif
-		return -4;
+		return usage(argv[0]);
 	}
 	
 	if (!parseSwitches(argc, argv)) { // also skips the program name
 		return -4;
 	}
 
-	readConfigurationFile();
-	persistentVarLoad();
+#ifdef SPECS_SERVER
+	std::vector<std::string> requestArgs;
+	std::vector<char*> requestArgv;
+	if (g_serverSocket != "") {
+		readConfigurationFile(false);
+		try {
+			if (EXTERNAL_FUNC_ON == g_pythonFuncs) {
+				pythonPreload(getFullSpecPath());
+			}
+			if (!specsServerListen(g_serverSocket, requestArgs)) {
+				return 0;
+			}
+		} catch (const SpecsException& e) {
+			std::cerr << "Error: " << e.what(!g_bVerbose) << "\n";
+			return -4;
+		}
+
+		// This is the process for one request. It starts from the same switches as a direct run.
+		g_startupTimer.start();
+		configResetSwitches();
+		configSpecLiteralForgetAll();
+		for (auto& arg : requestArgs) {
+			requestArgv.push_back(&arg[0]);
+		}
+		requestArgv.push_back(nullptr);
+		argc = int(requestArgs.size());
+		argv = requestArgv.data();
+		if (argc==1) {
+			return usage(argv[0]);
+		}
+		if (!parseSwitches(argc, argv)) {
+			return -4;
+		}
+		if (g_serverSocket != "") {
+			std::cerr << "Error: A request to the specs server cannot start another server\n";
+			return -4;
+		}
+	}
+#endif
+
+	g_startupTimer.changePhase("Reading the configuration file");
+	if (g_bFastStart) {
+		deferConfigurationFile();
+	} else {
+		readConfigurationFile();
+	}
+	persistentVarLoad();   // opens the file only when a variable is first read
 
+	g_startupTimer.changePhase("Setting the time zone and regex type");
 	if (g_timeZone != "") {
 		specTimeSetTimeZone(g_timeZone);
 	}
@@ -208,7 +265,8 @@ int main (int argc, char** argv)
 		}
 	}
 
-	if (EXTERNAL_FUNC_ON == g_pythonFuncs) {
+	if (EXTERNAL_FUNC_ON == g_pythonFuncs && !p_gExternalFunctions->IsInitialized()) {
+		g_startupTimer.changePhase("Loading Python functions");
 		try {
 			p_gExternalFunctions->Initialize(getFullSpecPath());
 		} catch (const SpecsException& e) {
@@ -223,14 +281,14 @@ int main (int argc, char** argv)
 
 	std::vector<Token> vec;
 
+	g_startupTimer.changePhase("Parsing the specification");
 	try {
 		if (g_specFile != "") {
-			vec = parseTokensFile(g_specFile);
+			vec = specCacheGetTokens(g_specFile);
 		} else {
 			vec = parseTokens(argc, argv);
+			normalizeTokenList(&vec);
 		}
-
-		normalizeTokenList(&vec);
 	} catch (const SpecsException& e) {
 		std::cerr << "Error reading specification tokens: " << e.what(conciseExceptions) << "\n";
 		exit (0);
@@ -247,6 +305,7 @@ int main (int argc, char** argv)
 	// memset(pWrtrs, 0, sizeof(void*) * (1 + MAX_INPUT_STREAMS));
 
 	unsigned int index = 0;
+	g_startupTimer.changePhase("Compiling the specification");
 	try {
 		ig.Compile(vec, index);
 	}  catch (const SpecsException& e) {
@@ -262,6 +321,8 @@ int main (int argc, char** argv)
 		exit (0);
 	}
 
+	specCacheSave();
+
 	// After the compilation, the token vector contents are no longer necessary
 	for (size_t i=0; i<vec.size(); i++) vec[i].deallocDynamic();
 	vec.clear();
@@ -283,6 +344,7 @@ int main (int argc, char** argv)
 	clockValue timeAtStart = specTimeGetTOD();
 	std::clock_t clockAtStart = clock();
 
+	g_startupTimer.changePhase("Opening the input and output");
 	if (!g_outputFile.empty() && g_bShellCmd)  {  // These should not both be specified
 		std::cerr << "Error: Cannot specify both --shell and --outfile\n";
 		exit(0);
@@ -366,6 +428,7 @@ int main (int argc, char** argv)
 
 		pRd->Begin();
 
+		g_startupTimer.stop();
 		timer.changeClass(timeClassProcessing);
 
 		try {
@@ -398,6 +461,7 @@ int main (int argc, char** argv)
 			pRd->endCollectingTimeData();
 		}
 	} else {
+		g_startupTimer.stop();
 		try {
 			unsigned int readerCount = 0;
 			ig.setRegularRunAtEOF();
@@ -456,6 +520,7 @@ int main (int argc, char** argv)
 		std::cerr << "CPU Time: " << std::floor(duration) << "." <<
 				std::setfill('0') << std::setw(6) <<
 				u_int64_t((duration-std::floor(duration)+0.5) * 1000000) << " seconds.\n";
+		g_startupTimer.dump();
 		timer.dump("Main Thread");
 		if (g_bThreaded) {
 			if (pRd) {
@@ -473,6 +538,9 @@ int main (int argc, char** argv)
 		}
 
 		dumpRegexStats();
+		dumpPythonStats();
+		dumpCountTableStats();
+		dumpDataFieldStats();
 	}
 
 	persistentVarSaveIfNeeded();
@@ -8,10 +8,22 @@
 #include "ErrorReporting.h"
 #include "aluFunctions.h"
 #include "processing/Config.h"
+#include "utils/lruCache.h"
+#include "utils/workerChannel.h"
+#include <map>
 #include <vector>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <sys/stat.h>
+#if defined(PYTHON_WORKER_POOL) || defined(SPECS_SERVER)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#ifdef WIN64
+#include <process.h>
+#endif
 
 // Some defines for compatibility
 #ifdef PYTHON_VER_3
@@ -31,6 +43,164 @@ enum externalFunctionErrorHandling {
 
 externalFunctionErrorHandling g_errorHandling = externalFunctionError__Throw;
 
+static bool g_bForkedFromServer = false;   // the interpreter was started by the specs server
+
+uint64_t pythonPureCalls = 0;
+uint64_t pythonPureHits = 0;
+uint64_t pythonPureFunctions = 0;
+uint64_t pythonWorkerCalls = 0;
+uint64_t pythonWorkerBatches = 0;
+
+class PythonFuncRec;
+
+// Starts Python for functions that were read from the saved function table
+static void loadPythonFunctions();
+
+/*
+ * Runs batches of calls in worker processes. The workers are forked once the
+ * local functions have been loaded, so each has its own interpreter and its
+ * own GIL. The calls of a batch are split evenly between them.
+ *
+ * Arguments and results travel in a compact form: a tag character followed
+ * by a 64-bit integer, a double, or a 32-bit length and the bytes of a string.
+ */
+class PythonWorkerPool {
+public:
+	bool   active()   { return !m_channels.empty(); }
+	size_t size()     { return m_channels.size(); }
+	void   start(size_t count, std::vector<PythonFuncRec*>& functions);
+	void   stop();
+	bool   run(PythonFuncRec& func, std::string& calls, std::vector<size_t>& offsets, std::vector<PValue>& results);
+#ifdef PYTHON_WORKER_POOL
+private:
+	void   workerLoop(workerChannel& channel);
+	std::vector<std::unique_ptr<workerChannel>> m_channels;
+	std::vector<pid_t>                          m_pids;
+	std::vector<PythonFuncRec*>                 m_functions;
+#else
+private:
+	std::vector<int>                            m_channels;   // always empty
+#endif
+};
+
+static PythonWorkerPool g_workerPool;
+
+static void appendUint32(std::string& s, uint32_t u)
+{
+	s.append((char*)(&u), sizeof(u));
+}
+
+static uint32_t readUint32(const char*& p)
+{
+	uint32_t u;
+	memcpy(&u, p, sizeof(u));
+	p += sizeof(u);
+	return u;
+}
+
+static void appendTagged(std::string& s, char tag, const std::string& str)
+{
+	s += tag;
+	appendUint32(s, uint32_t(str.length()));
+	s += str;
+}
+
+static std::string readTaggedString(const char*& p)
+{
+	uint32_t len = readUint32(p);
+	std::string ret(p, len);
+	p += len;
+	return ret;
+}
+
+static void appendInt(std::string& s, char tag, int64_t i)
+{
+	s += tag;
+	s.append((char*)(&i), sizeof(i));
+}
+
+static int64_t readInt(const char*& p)
+{
+	int64_t i;
+	memcpy(&i, p, sizeof(i));
+	p += sizeof(i);
+	return i;
+}
+
+static void appendDouble(std::string& s, double d)
+{
+	s += 'f';
+	s.append((char*)(&d), sizeof(d));
+}
+
+static double readDouble(const char*& p)
+{
+	double d;
+	memcpy(&d, p, sizeof(d));
+	p += sizeof(d);
+	return d;
+}
+
+// The current Python exception as the interpreter would print it
+static std::string exceptionText()
+{
+	std::string ret;
+	PyObject *pType, *pValue, *pTraceback;
+	PyErr_Fetch(&pType, &pValue, &pTraceback);
+	if (!pType) return ret;
+	PyErr_NormalizeException(&pType, &pValue, &pTraceback);
+	PyObject* pTracebackMod = PyImport_ImportModule("traceback");
+	PyObject* pLines = pTracebackMod ? PyObject_CallMethod(pTracebackMod, "format_exception", "OOO",
+			pType, pValue ? pValue : Py_None, pTraceback ? pTraceback : Py_None) : nullptr;
+	PyObject* pSeq = pLines ? PySequence_Fast(pLines, "") : nullptr;
+	if (pSeq) {
+		for (Py_ssize_t i = 0 ; i < PySequence_Fast_GET_SIZE(pSeq) ; i++) {
+			PyObject* pLine = PySequence_Fast_GET_ITEM(pSeq, i);
+			if (PyUnicode_Check(pLine)) {
+				PyObject* pBytes = PyUnicode_AsUTF8String(pLine);
+				if (pBytes) {
+					ret += PyBytes_AS_STRING(pBytes);
+					Py_DECREF(pBytes);
+				}
+			} else if (PyString_Check(pLine)) {
+				ret += PyString_AS_STRING(pLine);
+			}
+		}
+	}
+	Py_XDECREF(pSeq);
+	Py_XDECREF(pLines);
+	Py_XDECREF(pTracebackMod);
+	Py_XDECREF(pType);
+	Py_XDECREF(pValue);
+	Py_XDECREF(pTraceback);
+	PyErr_Clear();
+	while (!ret.empty() && '\n' == ret.back()) {
+		ret.pop_back();
+	}
+	return ret;
+}
+
+// The value of a failed call according to the error handling setting. The text
+// of the Python exception, if there is one, is part of the error that is thrown.
+static PValue errorValue(const std::string& text = "")
+{
+	switch (g_errorHandling) {
+	case externalFunctionError__NaN:
+		return mkValue0();
+	case externalFunctionError__NullStr:
+		return mkValue("");
+	case externalFunctionError__Zero:
+		return mkValue(ALUInt(0));
+	default:
+		break;
+	}
+	if (text.empty()) {
+		MYTHROW("Error in external function");
+	}
+	std::string err = "Error in external function\n" + text;
+	MYTHROW(err);
+}
+
 class PythonFuncArg {
 public:
 	PythonFuncArg(char* name) : m_name(name), m_default(counterType__None) {}
@@ -64,13 +234,17 @@ public:
 
 class PythonFuncRec : public ExternalFunctionRec {
 public:
-	PythonFuncRec(std::string& _name, PyObject* _pFunc) : m_name(_name), m_pFuncPtr(_pFunc), m_pTuple(nullptr) {
-		Py_INCREF(m_pFuncPtr);
+	// _pFunc is nullptr for a function read from the saved function table
+	PythonFuncRec(std::string& _name, PyObject* _pFunc) : m_name(_name), m_pFuncPtr(_pFunc), m_pTuple(nullptr),
+			m_pBatchFuncPtr(nullptr), m_pBatchList(nullptr), m_bBatchForm(false), m_bPure(false), m_pCache(nullptr), m_poolIndex(0) {
+		Py_XINCREF(m_pFuncPtr);
 	}
 	
 	virtual ~PythonFuncRec() {
-		Py_DECREF(m_pFuncPtr);
+		Py_XDECREF(m_pFuncPtr);
 		ResetArgs();
+		Py_XDECREF(m_pBatchFuncPtr);
+		Py_XDECREF(m_pBatchList);
 	}
 
 	void addArg(char* name) {
@@ -97,25 +271,135 @@ public:
 		return m_pFuncPtr;
 	}
 
+	const std::string& getName() {
+		return m_name;
+	}
+
 	void ResetArgs() {
 		if (m_pTuple) {
 			Py_DECREF(m_pTuple);
 			m_pTuple = nullptr;
 		}
+		m_argValues.assign(m_argValues.size(), nullptr);
 	}
 
 	void setDoc(const char* cstr) { m_doc = cstr; }
 
+	void ensureLoaded() {
+		if (!m_pFuncPtr) {
+			loadPythonFunctions();
+		}
+	}
+
 	void setArgValue(size_t idx, PValue pValue) {
-		PyObject* pValObj;
+		ensureLoaded();
 		size_t argCount = GetArgCount();
 
 		MYASSERT(idx < argCount);
 
+		// A pure function keeps the values, and converts them only if they are not in the cache
+		if (m_pCache) {
+			m_argValues[idx] = pValue;
+			return;
+		}
+
+		setTupleItem(idx, pValue);
+	}
+
+	void setTupleItem(size_t idx, PValue pValue) {
 		if (!m_pTuple) {
+			size_t argCount = GetArgCount();
 			m_pTuple = PyTuple_New(argCount);
 		}
 
+		PyTuple_SetItem(m_pTuple, idx, makeArg(idx, pValue));
+	}
+
+	// Pure functions: results are cached by the values of the arguments
+	void setPure(size_t cacheSize) {
+		m_bPure = true;
+		if (cacheSize >= 2) {
+			m_argValues.assign(GetArgCount(), nullptr);
+			m_pCache = std::make_shared<lruCache<std::string, ALUValue>>(cacheSize*2/3, cacheSize);
+		}
+	}
+
+	bool IsPure() {
+		return m_bPure;
+	}
+
+	bool IsCached() {
+		return nullptr != m_pCache;
+	}
+
+	static std::string cacheKey(std::vector<PValue>& args) {
+		std::string ret;
+		for (PValue& pValue : args) {
+			if (!pValue) {
+				ret += 'd';   // the default
+				continue;
+			}
+			switch (pValue->getType()) {
+			case counterType__Int:
+				ret += 'i' + std::to_string(pValue->getInt());
+				break;
+			case counterType__Float: {
+				double f = double(pValue->getFloat());   // as it is passed to Python
+				ret += 'f';
+				ret.append((char*)(&f), sizeof(f));
+				break;
+			}
+			case counterType__Str: {
+				const std::string& str = pValue->getStr();
+				ret += 's' + std::to_string(str.length()) + ':';
+				ret += str;
+				break;
+			}
+			default:
+				ret += 'n';
+			}
+		}
+		return ret;
+	}
+
+	PValue cacheLookup(std::string& key) {
+		pythonPureCalls++;
+		std::shared_ptr<ALUValue> pCached = m_pCache->get(key);
+		if (!pCached) return nullptr;
+		pythonPureHits++;
+		return std::make_shared<ALUValue>(*pCached);
+	}
+
+	void cacheStore(std::string& key, PValue pValue) {
+		if (!m_pCache->get(key)) {
+			m_pCache->set(key, std::make_shared<ALUValue>(*pValue));
+		}
+	}
+
+	PyObject* makeArg(size_t idx, PValue pValue) {
+		PyObject* pValObj;
+		pValue = argValue(idx, pValue);
+
+		switch (pValue->getType()) {
+		case counterType__Int:
+			pValObj = PyLong_FromLongLong(pValue->getInt());
+			break;
+		case counterType__Float:
+			pValObj = PyFloat_FromDouble(pValue->getFloat());
+			break;
+		case counterType__Str:
+			pValObj = PyUnicode_FromString(pValue->getStr().c_str());
+			break;
+		default:
+			pValObj = Py_None;
+			Py_INCREF(Py_None);
+		}
+
+		return pValObj;
+	}
+
+	// The value passed for an argument - the default if none was given
+	PValue argValue(size_t idx, PValue pValue) {
 		if (!pValue) {   // NULL passed - use default or None
 			ALUValue v;
 			PythonFuncArg& arg = m_args[idx];
@@ -135,85 +419,494 @@ public:
 			}
 			pValue = std::make_shared<ALUValue>(v);
 		}
+		return pValue;
+	}
 
+	// Worker pool: the compact form of arguments and results
+	static void appendArg(std::string& s, PValue pValue) {
 		switch (pValue->getType()) {
 		case counterType__Int:
-			pValObj = PyLong_FromLongLong(pValue->getInt());
+			appendInt(s, 'i', pValue->getInt());
 			break;
 		case counterType__Float:
-			pValObj = PyFloat_FromDouble(pValue->getFloat());
+			appendDouble(s, double(pValue->getFloat()));
 			break;
 		case counterType__Str:
-			pValObj = PyUnicode_FromString(pValue->getStr().c_str());
+			appendTagged(s, 's', pValue->getStr());
 			break;
 		default:
-			pValObj = Py_None;
+			s += 'n';
+		}
+	}
+
+	static PyObject* readArg(const char*& p) {
+		switch (*p++) {
+		case 'i':
+			return PyLong_FromLongLong(readInt(p));
+		case 'f':
+			return PyFloat_FromDouble(readDouble(p));
+		case 's':
+			return PyUnicode_FromString(readTaggedString(p).c_str());
+		default:
 			Py_INCREF(Py_None);
+			return Py_None;
+		}
+	}
+
+	// Like convertResult, for a result that was returned in a worker
+	void appendResult(std::string& s, PyObject* pResult) {
+		if (PyLong_Check(pResult)) {
+			appendInt(s, 'i', PyLong_AsLong(pResult));
+		} else if (PyInt_Check(pResult)) {
+			appendInt(s, 'i', PyInt_AsLong(pResult));
+		} else if (PyFloat_Check(pResult)) {
+			appendDouble(s, PyFloat_AsDouble(pResult));
+		} else if (PyUnicode_Check(pResult)) {
+			PyObject* pDefBytes = PyUnicode_AsASCIIString(pResult);
+			if (pDefBytes) {
+				appendTagged(s, 's', PyBytes_AS_STRING(pDefBytes));
+				Py_DECREF(pDefBytes);
+			} else {
+				appendWorkerError(s);
+			}
+		} else if (PyString_Check(pResult)) {
+			appendTagged(s, 's', PyString_AS_STRING(pResult));
+		} else if (Py_None == pResult){
+			s += 'n';
+		} else {
+			PyObject* pRepr = PyObject_Repr(pResult);
+			appendTagged(s, 't', PyString_AS_STRING(pRepr));
+			Py_DECREF(pRepr);
+		}
+	}
+
+	// The error is followed by the traceback, so that the parent can report it
+	void appendWorkerError(std::string& s) {
+		std::string text;
+		if (externalFunctionError__Throw == g_errorHandling) {
+			text = exceptionText();
+		}
+		PyErr_Clear();
+		appendTagged(s, 'e', text);
+	}
+
+	// Returns false if the result is the error value
+	bool readResult(const char*& p, std::vector<PValue>& results) {
+		switch (*p++) {
+		case 'i':
+			results.push_back(mkValue(ALUInt(readInt(p))));
+			return true;
+		case 'f':
+			results.push_back(mkValue(ALUFloat(readDouble(p))));
+			return true;
+		case 's':
+			results.push_back(mkValue(readTaggedString(p)));
+			return true;
+		case 'n':
+			results.push_back(mkValue0());  // NaN
+			return true;
+		case 't': {
+			std::string err = "Invalid return type from function " + m_name + ": " + readTaggedString(p);
+			MYTHROW(err);
+		}
+		default:
+			results.push_back(errorValue(readTaggedString(p)));
+			return false;
+		}
+	}
+
+	// In a worker process: make the calls and put the results in the reply
+	void runInWorker(const char* p, uint32_t count, std::string& reply) {
+		size_t argCount = GetArgCount();
+		PyObject* pList = PyList_New(count);
+		for (uint32_t i = 0 ; i < count ; i++) {
+			PyObject* pTuple = PyTuple_New(argCount);
+			for (size_t j = 0 ; j < argCount ; j++) {
+				PyTuple_SetItem(pTuple, j, readArg(p));
+			}
+			PyList_SetItem(pList, i, pTuple);
+		}
+
+		if (!m_pBatchFuncPtr) {
+			appendUint32(reply, 0);
+			for (uint32_t i = 0 ; i < count ; i++) {
+				PyObject* pResult = PyObject_CallObject(m_pFuncPtr, PyList_GetItem(pList, i));
+				if (pResult) {
+					appendResult(reply, pResult);
+					Py_DECREF(pResult);
+				} else {
+					appendWorkerError(reply);
+				}
+			}
+			Py_DECREF(pList);
+			return;
+		}
+
+		PyObject* pResult = PyObject_CallFunctionObjArgs(m_pBatchFuncPtr, pList, NULL);
+		Py_DECREF(pList);
+		PyObject* pSeq = pResult ? PySequence_Fast(pResult, "") : nullptr;
+		if (pResult && (!pSeq || PySequence_Fast_GET_SIZE(pSeq) != Py_ssize_t(count))) {
+			PyErr_Clear();
+			appendUint32(reply, 1);   // the batch form returned the wrong number of results
+		} else if (!pResult) {
+			appendUint32(reply, 0);
+			appendWorkerError(reply);
+			for (uint32_t i = 1 ; i < count ; i++) {
+				appendTagged(reply, 'e', "");
+			}
+		} else {
+			appendUint32(reply, 0);
+			for (uint32_t i = 0 ; i < count ; i++) {
+				appendResult(reply, PySequence_Fast_GET_ITEM(pSeq, i));
+			}
 		}
+		Py_XDECREF(pSeq);
+		Py_XDECREF(pResult);
+	}
 
-		PyTuple_SetItem(m_pTuple, idx, pValObj);
+	std::string batchSizeError(size_t count) {
+		return "Batch form of function " + m_name + " did not return a list of " +
+				std::to_string(count) + " results";
 	}
 
 	PValue Call() {
+		ensureLoaded();
 		PValue pRet = nullptr;
+		std::string key;
+
+		if (m_pCache) {
+			key = cacheKey(m_argValues);
+			pRet = cacheLookup(key);
+			if (pRet) return pRet;
+			for (size_t i=0 ; i<GetArgCount() ; i++) {
+				setTupleItem(i, m_argValues[i]);
+			}
+		}
 
 		// Check that all values were passed, complete those that haven't
 		for (size_t i=0 ; i<GetArgCount() ; i++) {
-			if (nullptr==PyTuple_GetItem(m_pTuple, i)) {
-				setArgValue(i, PValue(nullptr));
+			if (nullptr==m_pTuple || nullptr==PyTuple_GetItem(m_pTuple, i)) {
+				setTupleItem(i, PValue(nullptr));
 			}
 		}
 
 		PyObject* pResult = PyObject_CallObject(m_pFuncPtr, m_pTuple);
 		if (pResult) {
-			if (PyLong_Check(pResult)) {
-				pRet = mkValue(ALUInt(PyLong_AsLong(pResult)));
-			} else if (PyInt_Check(pResult)) {
-				pRet = mkValue(ALUInt(PyInt_AsLong(pResult)));
-			} else if (PyFloat_Check(pResult)) {
-				pRet = mkValue(ALUFloat(PyFloat_AsDouble(pResult)));
-			} else if (PyUnicode_Check(pResult)) {
-				PyObject* pDefBytes = PyUnicode_AsASCIIString(pResult);
-				pRet = mkValue(PyBytes_AS_STRING(pDefBytes));
-			} else if (PyString_Check(pResult)) {
-				pRet = mkValue(PyString_AS_STRING(pResult));
-			} else if (Py_None == pResult){
-				pRet = mkValue0();  // NaN
-			} else {
-				PyObject* pRepr = PyObject_Repr(pResult);
-				std::string err = "Invalid return type from function ";
-				err += m_name + ": ";
-				err += PyString_AS_STRING(pRepr);
-				Py_DECREF(pRepr);
+			try {
+				pRet = convertResult(pResult);
+			} catch (...) {
 				Py_DECREF(pResult);
-				MYTHROW(err);
+				throw;
 			}
 			Py_DECREF(pResult);
-		} else {
-			if (PyErr_Occurred()) {
-				switch (g_errorHandling) {
-				case externalFunctionError__NaN:
-					pRet = mkValue0();
-					break;
-				case externalFunctionError__NullStr:
-					pRet = mkValue("");
-					break;
-				case externalFunctionError__Zero:
-					pRet = mkValue(ALUInt(0));
-					break;
-				default:
-					if (g_bVerbose) {
-						PyErr_Print();
-					}
-					MYTHROW("Error in external function");
-				}
+			if (m_pCache) {
+				cacheStore(key, pRet);
 			}
-			else pRet = mkValue0(); // NaN
+		} else {
+			pRet = errorResult();
 		}
 
 		return pRet;
 	}
 
+	// Converts a value returned from Python. Does not release it.
+	PValue convertResult(PyObject* pResult) {
+		PValue pRet;
+		if (PyLong_Check(pResult)) {
+			pRet = mkValue(ALUInt(PyLong_AsLong(pResult)));
+		} else if (PyInt_Check(pResult)) {
+			pRet = mkValue(ALUInt(PyInt_AsLong(pResult)));
+		} else if (PyFloat_Check(pResult)) {
+			pRet = mkValue(ALUFloat(PyFloat_AsDouble(pResult)));
+		} else if (PyUnicode_Check(pResult)) {
+			PyObject* pDefBytes = PyUnicode_AsASCIIString(pResult);
+			pRet = mkValue(PyBytes_AS_STRING(pDefBytes));
+			Py_DECREF(pDefBytes);
+		} else if (PyString_Check(pResult)) {
+			pRet = mkValue(PyString_AS_STRING(pResult));
+		} else if (Py_None == pResult){
+			pRet = mkValue0();  // NaN
+		} else {
+			PyObject* pRepr = PyObject_Repr(pResult);
+			std::string err = "Invalid return type from function ";
+			err += m_name + ": ";
+			err += PyString_AS_STRING(pRepr);
+			Py_DECREF(pRepr);
+			MYTHROW(err);
+		}
+		return pRet;
+	}
+
+	// The value of a call that failed, according to the error handling setting
+	PValue errorResult() {
+		PValue pRet;
+		if (PyErr_Occurred()) {
+			std::string text;
+			if (externalFunctionError__Throw == g_errorHandling) {
+				text = exceptionText();
+			}
+			PyErr_Clear();
+			pRet = errorValue(text);
+		}
+		else pRet = mkValue0(); // NaN
+		return pRet;
+	}
+
+	void setBatchFunc(PyObject* pBatchFunc) {
+		Py_INCREF(pBatchFunc);
+		m_pBatchFuncPtr = pBatchFunc;
+		m_bBatchForm = true;
+	}
+
+	void setBatchForm() { m_bBatchForm = true; }
+
+	// In the worker processes, a pure function is batched just like one with a batch form
+	bool IsBatchable() {
+		return m_bBatchForm || (m_bPure && g_workerPool.active());
+	}
+
+	bool canRunInWorkers() {
+		return m_bBatchForm || m_bPure;
+	}
+
+	// Takes the Python objects of a function that was read from the saved function
+	// table. Returns false if the loaded function does not match the table.
+	bool bind(PythonFuncRec& loaded) {
+		if (loaded.m_bBatchForm != m_bBatchForm || loaded.m_bPure != m_bPure) return false;
+		if (loaded.getStr() != getStr()) return false;
+		m_pFuncPtr = loaded.m_pFuncPtr;
+		Py_INCREF(m_pFuncPtr);
+		m_pBatchFuncPtr = loaded.m_pBatchFuncPtr;
+		Py_XINCREF(m_pBatchFuncPtr);
+		return true;
+	}
+
+	void writeTable(std::ostream& os) {
+		writeTableString(os, m_name);
+		os << ' ' << (m_bBatchForm ? 'b' : '-') << (m_bPure ? 'p' : '-') << ' ' << m_args.size() << ' ';
+		writeTableString(os, m_doc);
+		os << '\n';
+		for (auto& arg : m_args) {
+			writeTableString(os, arg.m_name);
+			switch (arg.m_default) {
+			case counterType__Str:
+				os << " s ";
+				writeTableString(os, arg.m_defStr);
+				break;
+			case counterType__Int:
+				os << " i " << arg.m_defInt;
+				break;
+			case counterType__Float:
+				os << " f " << std::setprecision(17) << arg.m_defFloat;
+				break;
+			default:
+				os << " -";
+			}
+			os << '\n';
+		}
+	}
+
+	// Returns nullptr if the table is not valid
+	static std::shared_ptr<PythonFuncRec> readTable(std::istream& is, size_t pureCacheSize) {
+		std::string name, doc, flags;
+		size_t argCount;
+		if (!readTableString(is, name) || !(is >> flags >> argCount) || flags.length() != 2 ||
+				argCount > MAX_FUNC_OPERANDS || !readTableString(is, doc)) {
+			return nullptr;
+		}
+		auto pFuncRec = std::make_shared<PythonFuncRec>(name, nullptr);
+		for (size_t i = 0 ; i < argCount ; i++) {
+			std::string argName, defStr;
+			char type;
+			long defInt;
+			double defFloat;
+			if (!readTableString(is, argName) || !(is >> type)) return nullptr;
+			switch (type) {
+			case 's':
+				if (!readTableString(is, defStr)) return nullptr;
+				pFuncRec->addArg(&argName[0], &defStr[0]);
+				break;
+			case 'i':
+				if (!(is >> defInt)) return nullptr;
+				pFuncRec->addArg(&argName[0], defInt);
+				break;
+			case 'f':
+				if (!(is >> defFloat)) return nullptr;
+				pFuncRec->addArg(&argName[0], defFloat);
+				break;
+			case '-':
+				pFuncRec->addArg(&argName[0]);
+				break;
+			default:
+				return nullptr;
+			}
+		}
+		pFuncRec->setDoc(doc.c_str());
+		if ('b' == flags[0]) {
+			pFuncRec->setBatchForm();
+		}
+		if ('p' == flags[1]) {
+			pFuncRec->setPure(pureCacheSize);
+		}
+		return pFuncRec;
+	}
+
+	// Strings in the table are written as their length, a colon, and the bytes
+	static void writeTableString(std::ostream& os, const std::string& str) {
+		os << str.length() << ':' << str;
+	}
+
+	static bool readTableString(std::istream& is, std::string& str) {
+		size_t len;
+		if (!(is >> len) || is.get() != ':') return false;
+		str.resize(len);
+		return len == 0 || is.read(&str[0], std::streamsize(len));
+	}
+
+	void setPoolIndex(uint32_t idx) { m_poolIndex = idx; }
+	uint32_t poolIndex()            { return m_poolIndex; }
+
+	void QueueCall(std::vector<PValue>& args) {
+		MYASSERT(IsBatchable());
+		ensureLoaded();
+		size_t argCount = GetArgCount();
+		MYASSERT(args.size() <= argCount);
+
+		if (m_pCache) {
+			args.resize(argCount);
+			std::string key = cacheKey(args);
+			PValue pCached = cacheLookup(key);
+			m_batchCached.push_back(pCached);
+			if (pCached) return;
+			// The same arguments earlier in this batch
+			auto it = m_batchKeys.find(key);
+			if (it != m_batchKeys.end()) {
+				pythonPureHits++;
+				m_batchSlots.push_back(it->second);
+				return;
+			}
+			size_t slot = m_batchKeys.size();
+			m_batchKeys[key] = slot;
+			m_batchSlots.push_back(slot);
+		}
+		if (g_workerPool.active()) {
+			m_poolOffsets.push_back(m_poolCalls.length());
+			for (size_t i = 0 ; i < argCount ; i++) {
+				appendArg(m_poolCalls, argValue(i, (i < args.size()) ? args[i] : PValue(nullptr)));
+			}
+			return;
+		}
+
+		if (!m_pBatchList) {
+			m_pBatchList = PyList_New(0);
+			MYASSERT_NOT_NULL(m_pBatchList);
+		}
+		PyObject* pTuple = PyTuple_New(argCount);
+		for (size_t i = 0 ; i < argCount ; i++) {
+			PyTuple_SetItem(pTuple, i, makeArg(i, (i < args.size()) ? args[i] : PValue(nullptr)));
+		}
+		PyList_Append(m_pBatchList, pTuple);
+		Py_DECREF(pTuple);
+	}
+
+	void CallBatch(std::vector<PValue>& results) {
+		if (!m_pCache) {
+			callBatchFunction(results);
+			return;
+		}
+
+		// Merge the results from Python with those that were found in the cache
+		std::vector<PValue> cached;
+		std::vector<size_t> slots;
+		std::map<std::string, size_t> keys;
+		std::vector<PValue> computed;
+		cached.swap(m_batchCached);
+		slots.swap(m_batchSlots);
+		keys.swap(m_batchKeys);
+		bool bSucceeded;
+		try {
+			bSucceeded = callBatchFunction(computed);
+		} catch (...) {
+			// Keep the results of the calls before the one that failed
+			mergeResults(cached, slots, computed, results);
+			throw;
+		}
+		MYASSERT(computed.size() == keys.size());
+
+		if (bSucceeded) {
+			for (auto& entry : keys) {
+				std::string key = entry.first;
+				cacheStore(key, computed[entry.second]);
+			}
+		}
+
+		mergeResults(cached, slots, computed, results);
+	}
+
+	// Stops at the first call whose result was not computed
+	static void mergeResults(std::vector<PValue>& cached, std::vector<size_t>& slots,
+			std::vector<PValue>& computed, std::vector<PValue>& results) {
+		results.clear();
+		results.reserve(cached.size());
+		size_t slotIdx = 0;
+		for (PValue& pCached : cached) {
+			if (pCached) {
+				results.push_back(pCached);
+			} else {
+				MYASSERT(slotIdx < slots.size());
+				if (slots[slotIdx] >= computed.size()) break;
+				results.push_back(std::make_shared<ALUValue>(*computed[slots[slotIdx++]]));
+			}
+		}
+	}
+
+	// Returns false if the batch form failed and the results are the error value
+	bool callBatchFunction(std::vector<PValue>& results) {
+		results.clear();
+		if (g_workerPool.active()) {
+			if (m_poolOffsets.empty()) return true;
+			std::string calls;
+			std::vector<size_t> offsets;
+			calls.swap(m_poolCalls);
+			offsets.swap(m_poolOffsets);
+			return g_workerPool.run(*this, calls, offsets, results);
+		}
+		if (!m_pBatchList) return true;
+		PyObject* pList = m_pBatchList;
+		m_pBatchList = nullptr;
+		Py_ssize_t count = PyList_Size(pList);
+
+		PyObject* pResult = PyObject_CallFunctionObjArgs(m_pBatchFuncPtr, pList, NULL);
+		Py_DECREF(pList);
+		if (!pResult) {
+			PValue pErr = errorResult();
+			results.assign(size_t(count), pErr);
+			return false;
+		}
+
+		PyObject* pSeq = PySequence_Fast(pResult, "");
+		if (!pSeq || PySequence_Fast_GET_SIZE(pSeq) != count) {
+			Py_XDECREF(pSeq);
+			Py_DECREF(pResult);
+			PyErr_Clear();
+			std::string err = batchSizeError(size_t(count));
+			MYTHROW(err);
+		}
+		results.reserve(size_t(count));
+		try {
+			for (Py_ssize_t i = 0 ; i < count ; i++) {
+				results.push_back(convertResult(PySequence_Fast_GET_ITEM(pSeq, i)));
+			}
+		} catch (...) {
+			Py_DECREF(pSeq);
+			Py_DECREF(pResult);
+			throw;
+		}
+		Py_DECREF(pSeq);
+		Py_DECREF(pResult);
+		return true;
+	}
+
 	std::string getStr() {
 		std::ostringstream strm;
 		strm << m_name << " (";
@@ -227,6 +920,12 @@ public:
 			strm << arg.getStr();
 		}
 		strm << ")";
+		if (IsPure()) {
+			strm << " [pure]";
+		}
+		if (IsBatchable()) {
+			strm << " [batch]";
+		}
 		if (m_doc.length() > 0) {
 			if (m_doc.find("\n") != std::string::npos) {
 				strm << " :\n" << m_doc << "\n";
@@ -242,15 +941,222 @@ private:
 	std::vector<PythonFuncArg> m_args;
 	PyObject*                  m_pTuple;
 	std::string                m_doc;
+	PyObject*                  m_pBatchFuncPtr;   // the specs_batch attribute of the function
+	PyObject*                  m_pBatchList;      // argument tuples of the queued calls
+	bool                       m_bBatchForm;      // known before the function is loaded
+	bool                       m_bPure;
+	std::vector<PValue>        m_argValues;       // for a pure function, the arguments of the next call
+	std::shared_ptr<lruCache<std::string, ALUValue>> m_pCache;
+	std::vector<PValue>        m_batchCached;     // for each queued call, the cached result or nullptr
+	std::vector<size_t>        m_batchSlots;      // for each queued call that was not cached, its tuple in the list
+	std::map<std::string, size_t> m_batchKeys;    // the arguments of each tuple in the list
+	uint32_t                   m_poolIndex;
+	std::string                m_poolCalls;       // the queued calls in compact form, for the workers
+	std::vector<size_t>        m_poolOffsets;     // where each call begins in m_poolCalls
 };
 
 typedef std::shared_ptr<PythonFuncRec> PPythonFuncRec;
 
+#ifdef PYTHON_WORKER_POOL
+
+void PythonWorkerPool::start(size_t count, std::vector<PythonFuncRec*>& functions)
+{
+	m_functions = functions;
+	for (size_t i = 0 ; i < count ; i++) {
+		auto pChannel = std::make_unique<workerChannel>();
+		pChannel->create();
+#ifdef PYTHON_VER_2
+		pid_t pid = fork();
+		if (0 == pid) {
+			PyOS_AfterFork();
+#else
+		PyOS_BeforeFork();
+		pid_t pid = fork();
+		if (0 == pid) {
+			PyOS_AfterFork_Child();
+#endif
+			// The worker keeps only its own channel
+			for (auto& pOther : m_channels) {
+				pOther->close();
+			}
+			pChannel->becomeWorker();
+			try {
+				workerLoop(*pChannel);
+			} catch (...) {
+				_exit(1);
+			}
+			_exit(0);
+		}
+#ifndef PYTHON_VER_2
+		PyOS_AfterFork_Parent();
+#endif
+		if (pid < 0) {
+			std::string err = std::string("Cannot start a Python worker process: ") + strerror(errno);
+			MYTHROW(err);
+		}
+		pChannel->becomeParent();
+		m_channels.push_back(std::move(pChannel));
+		m_pids.push_back(pid);
+	}
+	if (g_bVerbose) {
+		std::cerr << "Python Interface: Started " << count << " worker processes" << std::endl;
+	}
+}
+
+void PythonWorkerPool::stop()
+{
+	// Closing the channel tells the worker to exit
+	for (auto& pChannel : m_channels) {
+		pChannel->close();
+	}
+	for (pid_t pid : m_pids) {
+		waitpid(pid, nullptr, 0);
+	}
+	m_channels.clear();
+	m_pids.clear();
+}
+
+void PythonWorkerPool::workerLoop(workerChannel& channel)
+{
+	std::string_view msg;
+	std::string reply;
+	while (channel.receive(msg)) {
+		const char* p = msg.data();
+		uint32_t funcIdx = readUint32(p);
+		uint32_t count = readUint32(p);
+		MYASSERT(funcIdx < m_functions.size());
+		reply.clear();
+		m_functions[funcIdx]->runInWorker(p, count, reply);
+		channel.send(reply);
+	}
+}
+
+bool PythonWorkerPool::run(PythonFuncRec& func, std::string& calls, std::vector<size_t>& offsets, std::vector<PValue>& results)
+{
+	size_t count = offsets.size();
+	size_t workers = std::min(m_channels.size(), count);
+	std::vector<size_t> counts(workers);
+	std::string msg;
+
+	size_t first = 0;
+	for (size_t w = 0 ; w < workers ; w++) {
+		size_t n = (count - first) / (workers - w);
+		size_t from = offsets[first];
+		size_t to = (first + n < count) ? offsets[first + n] : calls.length();
+		msg.clear();
+		appendUint32(msg, func.poolIndex());
+		appendUint32(msg, uint32_t(n));
+		msg.append(calls, from, to - from);
+		m_channels[w]->send(msg);
+		counts[w] = n;
+		first += n;
+	}
+
+	// Collect all the replies before looking at any of them, so that an error
+	// does not leave a reply behind in a channel
+	std::vector<std::string_view> replies(workers);
+	bool bAllReceived = true;
+	for (size_t w = 0 ; w < workers ; w++) {
+		bAllReceived = m_channels[w]->receive(replies[w]) && bAllReceived;
+	}
+	if (!bAllReceived) {
+		MYTHROW("A Python worker process has ended unexpectedly");
+	}
+
+	pythonWorkerBatches++;
+	pythonWorkerCalls += count;
+
+	for (size_t w = 0 ; w < workers ; w++) {
+		const char* p = replies[w].data();
+		if (0 != readUint32(p)) {
+			std::string err = func.batchSizeError(count);
+			MYTHROW(err);
+		}
+	}
+
+	bool bSucceeded = true;
+	results.reserve(count);
+	for (size_t w = 0 ; w < workers ; w++) {
+		const char* p = replies[w].data() + sizeof(uint32_t);
+		for (size_t i = 0 ; i < counts[w] ; i++) {
+			bSucceeded = func.readResult(p, results) && bSucceeded;
+		}
+	}
+	return bSucceeded;
+}
+
+#else  // PYTHON_WORKER_POOL
+
+void PythonWorkerPool::start(size_t count, std::vector<PythonFuncRec*>& functions)
+{
+	MYTHROW("Python worker processes are not supported on this platform");
+}
+
+void PythonWorkerPool::stop()
+{
+}
+
+bool PythonWorkerPool::run(PythonFuncRec& func, std::string& calls, std::vector<size_t>& offsets, std::vector<PValue>& results)
+{
+	return false;
+}
+
+#endif  // PYTHON_WORKER_POOL
+
+/*
+ * Reading the functions from localfuncs.py means starting Python and inspecting
+ * each function, which takes longer than many short runs of specs. So the list
+ * of functions is saved in a file next to localfuncs.py, and later runs read
+ * it from there. Python is then started only when one of the functions is
+ * called. The saved table is used only while localfuncs.py has the same size,
+ * time, and hash as when the table was written.
+ */
+#define PYTHON_FUNC_TABLE_MAGIC    "SPECSPF1"
+#define PYTHON_FUNC_TABLE_SUFFIX   ".specsfuncs"
+
+struct localFuncsFingerprint {
+	uint64_t size;
+	int64_t  time;
+	uint64_t hash;
+};
+
+// FNV-1a of the file's contents
+static bool getLocalFuncsFingerprint(const std::string& fileName, localFuncsFingerprint& fp)
+{
+	struct stat st;
+	if (0 != stat(fileName.c_str(), &st)) return false;
+	std::ifstream is(fileName, std::ios::binary);
+	if (!is) return false;
+	fp.size = uint64_t(st.st_size);
+	fp.time = int64_t(st.st_mtime);
+	fp.hash = 14695981039346656037ULL;
+	char buf[4096];
+	while (is.read(buf, sizeof(buf)) || is.gcount() > 0) {
+		for (std::streamsize i = 0 ; i < is.gcount() ; i++) {
+			fp.hash = (fp.hash ^ (unsigned char)(buf[i])) * 1099511628211ULL;
+		}
+	}
+	return true;
+}
+
+static std::string localFuncsFileName(const std::string& path)
+{
+	return path + PATHSEP + "localfuncs.py";
+}
+
 class PythonFunctionCollection : public ExternalFunctionCollection {
 public:
-	PythonFunctionCollection() : m_Initialized(false) {}
+	PythonFunctionCollection() : m_Initialized(false), m_Loaded(false), m_LocalMod(nullptr), m_pureCacheSize(0),
+			m_bPreloaded(false), m_bPreloadFound(false) {}
 
 	~PythonFunctionCollection() {
+		g_workerPool.stop();
+		if (Py_IsInitialized() && g_bForkedFromServer) {
+			// Finalizing the interpreter in every request would cost more than the rest of it,
+			// so only what the local functions can notice is done: exit functions and flushing
+			PyRun_SimpleString("import atexit, sys\natexit._run_exitfuncs()\nsys.stdout.flush()\nsys.stderr.flush()\n");
+			return;
+		}
 		if (Py_IsInitialized()) {
 			m_Functions.clear();
 #ifdef PYTHON_VER_3
@@ -271,14 +1177,141 @@ public:
 		static std::string disableOption = "pythonDisable";
 		static std::string zero = "0";
 		if ("1" == configSpecLiteralGetWithDefault(disableOption, zero)) {
+			forgetPreload();
+			m_Initialized = true;
+			return;
+		}
+
+		static std::string cacheOption = "pythonPureCache";
+		static std::string cacheDefault = "10000";
+		size_t pureCacheSize;
+		try {
+			pureCacheSize = std::stoul(configSpecLiteralGetWithDefault(cacheOption, cacheDefault));
+		} catch (std::logic_error&) {
+			std::string err = "Invalid value for configured literal " + cacheOption;
+			MYTHROW(err);
+		}
+
+		std::string path = (_path) ? _path : "";
+		if (m_bPreloaded && matchesPreload(path, pureCacheSize)) {
+			m_bPreloaded = false;
+			m_Initialized = true;
+			return;
+		}
+		forgetPreload();
+
+		m_pureCacheSize = pureCacheSize;
+		m_path = path;
+
+		// The worker processes are forked from a loaded interpreter, so they need it at once
+		static std::string tableOption = "pythonFuncTable";
+		static std::string one = "1";
+		bool bUseTable = !m_path.empty() && g_pythonWorkers <= 0 &&
+				"0" != configSpecLiteralGetWithDefault(tableOption, one);
+		localFuncsFingerprint fp;
+		if (bUseTable) {
+			m_tableFileName = localFuncsFileName(m_path);
+			bUseTable = getLocalFuncsFingerprint(m_tableFileName, fp);
+			m_tableFileName += PYTHON_FUNC_TABLE_SUFFIX;
+		}
+
+		if (bUseTable && readFunctionTable(fp)) {
+			if (g_bVerbose) {
+				std::cerr << "Python Interface: Read " << m_Functions.size() << " functions from " << m_tableFileName << std::endl;
+			}
 			m_Initialized = true;
 			return;
 		}
+
+		load();
+		m_Initialized = true;
+
+		if (bUseTable && m_LocalMod) {
+			writeFunctionTable(fp);
+		}
+	}
+
+	// In the specs server: the functions are loaded before any request, and the
+	// fingerprint of localfuncs.py is kept so that a request can tell if it changed
+	void preload(const char* _path) {
+		std::string path = (_path) ? _path : "";
+		m_bPreloadFound = getLocalFuncsFingerprint(localFuncsFileName(path), m_preloadFp);
+		Initialize(_path);
+		// No functions means that Python is disabled or there is nothing to load
+		if (CountFunctions() > 0) {
+			ensureLoaded();
+		}
+	}
+
+	// In a request forked from the server: the preloaded functions are checked
+	// when the request initializes the functions, after it has read its own settings
+	void afterFork() {
+		if (m_Initialized) {
+			m_bPreloaded = true;
+			m_Initialized = false;
+		}
+	}
+
+	// The request would load the same functions as the server did
+	bool matchesPreload(const std::string& path, size_t pureCacheSize) {
+		if (path != m_path || pureCacheSize != m_pureCacheSize || g_pythonWorkers > 0) return false;
+		localFuncsFingerprint fp;
+		bool bFound = getLocalFuncsFingerprint(localFuncsFileName(path), fp);
+		if (bFound != m_bPreloadFound) return false;
+		return !bFound || (fp.size == m_preloadFp.size && fp.time == m_preloadFp.time && fp.hash == m_preloadFp.hash);
+	}
+
+	// Drops the preloaded functions, so that Initialize loads them again. The
+	// interpreter stays, but it forgets the old module and the old path.
+	void forgetPreload() {
+		if (!m_bPreloaded) return;
+		m_bPreloaded = false;
+		if (g_bVerbose) {
+			std::cerr << "Python Interface: Reloading the local functions preloaded by the server" << std::endl;
+		}
+		m_Functions.clear();
+		if (m_LocalMod) {
+			Py_DECREF(m_LocalMod);
+			m_LocalMod = nullptr;
+			PyDict_DelItemString(PyImport_GetModuleDict(), "localfuncs");
+			PyErr_Clear();
+		}
+#ifdef PYTHON_VER_3
+		if (m_Loaded && !m_path.empty()) {
+			PyObject* pSysMod = PyImport_ImportModule("sys");
+			MYASSERT_NOT_NULL(pSysMod);
+			PyObject* pPath = PyObject_GetAttrString(pSysMod, "path");
+			MYASSERT_NOT_NULL(pPath);
+			PyObject* pPathElement = PyUnicode_FromString(m_path.c_str());
+			Py_ssize_t idx = PySequence_Index(pPath, pPathElement);
+			if (idx >= 0) {
+				PySequence_DelItem(pPath, idx);
+			}
+			PyErr_Clear();
+			Py_DECREF(pPathElement);
+			Py_DECREF(pPath);
+			Py_DECREF(pSysMod);
+		}
+		if (m_Loaded) {
+			PyRun_SimpleString("import importlib\nimportlib.invalidate_caches()\n");
+		}
+#endif
+		m_Loaded = false;
+	}
+
+	// Starts Python and loads the local functions. Functions that were read from the
+	// saved table are bound to the loaded ones.
+	void load() {
+		m_Loaded = true;
+		std::map<std::string,PPythonFuncRec> fromTable;
+		fromTable.swap(m_Functions);
+
 		// Initialize Python environment
 		Py_Initialize();
 
 		// update the python path
-		if (_path && _path[0]) {
+		if (!m_path.empty()) {
+			const char* _path = m_path.c_str();
 #ifdef PYTHON_VER_3
 			PyObject* pSysMod = PyImport_ImportModule("sys");
 			MYASSERT_NOT_NULL(pSysMod);
@@ -303,6 +1336,18 @@ public:
 		PyObject* pInspectMod = PyImport_ImportModule("inspect");
 		MYASSERT_NOT_NULL(pInspectMod);
 
+		// The specs_pure decorator marks functions whose results can be cached
+#ifdef PYTHON_VER_2
+		PyRun_SimpleString("import __builtin__ as _specs_builtins\n"
+#else
+		PyRun_SimpleString("import builtins as _specs_builtins\n"
+#endif
+				"def _specs_pure(f):\n"
+				"\tf.specs_pure = True\n"
+				"\treturn f\n"
+				"_specs_builtins.specs_pure = _specs_pure\n"
+				"del _specs_builtins, _specs_pure\n");
+
 		// load the local functions at localfuncs.py
 		m_LocalMod = PyImport_ImportModule("localfuncs");
 		if (!m_LocalMod) {
@@ -313,7 +1358,9 @@ public:
 				}
 				PyErr_Clear();
 				
-				m_Initialized = true;
+				if (!fromTable.empty()) {
+					MYTHROW("Local functions not found");
+				}
 				return;
 			} else {
 				if (g_bVerbose) {
@@ -406,6 +1453,7 @@ public:
 						} else if (PyUnicode_Check(pDef)) {
 							PyObject* pDefBytes = PyUnicode_AsASCIIString(pDef);
 							pFuncRec->addArg(pArgName, PyBytes_AS_STRING(pDefBytes));
+							Py_DECREF(pDefBytes);
 						} else if (PyString_Check(pDef)) {
 							pFuncRec->addArg(pArgName, PyString_AS_STRING(pDef));
 						} else {
@@ -425,6 +1473,20 @@ public:
 				m_Functions[funcName] = pFuncRec;
 				Py_DECREF(pTuple);
 
+				PyObject* pBatchFunc = PyObject_GetAttrString(pFunc, "specs_batch");
+				if (pBatchFunc && PyCallable_Check(pBatchFunc)) {
+					pFuncRec->setBatchFunc(pBatchFunc);
+				}
+				Py_XDECREF(pBatchFunc);
+				PyErr_Clear();
+
+				PyObject* pPure = PyObject_GetAttrString(pFunc, "specs_pure");
+				if (pPure && PyObject_IsTrue(pPure) > 0) {
+					pFuncRec->setPure(m_pureCacheSize);
+				}
+				Py_XDECREF(pPure);
+				PyErr_Clear();
+
 				PyObject* pDoc = PyObject_GetAttrString(pFunc, "__doc__");
 				if (pDoc != nullptr && pDoc != Py_None) {
 					if (PyObject_Length(pDoc) >= 0) {
@@ -449,11 +1511,41 @@ public:
 			std::cerr << "Python Interface: Loaded" << std::endl;
 		}
 
-		m_Initialized = true;
-
 		// release the functions from inspect module
 		Py_DECREF(pArgSpecFunc);
 		Py_DECREF(pInspectMod);
+
+		// The specification was parsed with the saved functions, so those must stay
+		for (auto& entry : fromTable) {
+			auto it = m_Functions.find(entry.first);
+			if (it == m_Functions.end() || !entry.second->bind(*it->second)) {
+				remove(m_tableFileName.c_str());
+				std::string err = "Python function " + entry.first + " has changed since it was saved in " + m_tableFileName;
+				MYTHROW(err);
+			}
+			it->second = entry.second;
+		}
+
+		pythonPureFunctions = 0;
+		for (auto& entry : m_Functions) {
+			if (entry.second->IsCached()) {
+				pythonPureFunctions++;
+			}
+		}
+
+		// Functions with a batch form and pure functions can run in worker processes
+		if (g_pythonWorkers > 0) {
+			std::vector<PythonFuncRec*> poolFunctions;
+			for (auto& entry : m_Functions) {
+				if (entry.second->canRunInWorkers()) {
+					entry.second->setPoolIndex(uint32_t(poolFunctions.size()));
+					poolFunctions.push_back(entry.second.get());
+				}
+			}
+			if (!poolFunctions.empty()) {
+				g_workerPool.start(size_t(g_pythonWorkers), poolFunctions);
+			}
+		}
 	}
 	virtual void SetErrorHandling(std::string& smethod) {
 		if (0 == strcasecmp(smethod.c_str(), EXTERNAL_FUNC_ERR_THROW)) {
@@ -472,6 +1564,60 @@ public:
 	virtual bool IsInitialized() {
 		return m_Initialized;
 	}
+
+	void ensureLoaded() {
+		if (!m_Loaded) {
+			load();
+		}
+	}
+
+	bool readFunctionTable(localFuncsFingerprint& fp) {
+		std::ifstream is(m_tableFileName, std::ios::binary);
+		if (!is) return false;
+
+		std::string magic;
+		localFuncsFingerprint saved;
+		size_t count;
+		if (!(is >> magic >> saved.size >> saved.time >> saved.hash >> count) || magic != PYTHON_FUNC_TABLE_MAGIC ||
+				saved.size != fp.size || saved.time != fp.time || saved.hash != fp.hash) {
+			return false;
+		}
+
+		std::map<std::string,PPythonFuncRec> functions;
+		for (size_t i = 0 ; i < count ; i++) {
+			PPythonFuncRec pFuncRec = PythonFuncRec::readTable(is, m_pureCacheSize);
+			if (!pFuncRec) return false;
+			functions[pFuncRec->getName()] = pFuncRec;
+		}
+		m_Functions.swap(functions);
+		return true;
+	}
+
+	// Saving the table is only an optimization, so failing to do so is not an error
+	void writeFunctionTable(localFuncsFingerprint& fp) {
+		std::ostringstream os;
+		os << PYTHON_FUNC_TABLE_MAGIC << ' ' << fp.size << ' ' << fp.time << ' ' << fp.hash << ' ' << m_Functions.size() << '\n';
+		for (auto& entry : m_Functions) {
+			entry.second->writeTable(os);
+		}
+
+#ifdef WIN64
+		std::string tempFileName = m_tableFileName + ".tmp" + std::to_string(_getpid());
+#else
+		std::string tempFileName = m_tableFileName + ".tmp" + std::to_string(getpid());
+#endif
+		FILE* f = fopen(tempFileName.c_str(), "wb");
+		if (!f) return;
+		std::string contents = os.str();
+		bool bWritten = contents.length() == fwrite(contents.data(), 1, contents.length(), f);
+		bWritten = (0 == fclose(f)) && bWritten;
+#ifdef WIN64
+		if (bWritten) remove(m_tableFileName.c_str());
+#endif
+		if (!bWritten || 0 != rename(tempFileName.c_str(), m_tableFileName.c_str())) {
+			remove(tempFileName.c_str());
+		}
+	}
 	virtual size_t CountFunctions() {
 		return m_Functions.size();
 	}
@@ -502,8 +1648,15 @@ public:
 
 private:
 	std::map<std::string,PPythonFuncRec> m_Functions;
-	bool                                 m_Initialized;
+	bool                                 m_Initialized;   // the functions are known
+	bool                                 m_Loaded;        // Python was started
 	PyObject*                            m_LocalMod;
+	std::string                          m_path;
+	std::string                          m_tableFileName;
+	size_t                               m_pureCacheSize;
+	bool                                 m_bPreloaded;    // loaded by the server, not yet checked by the request
+	bool                                 m_bPreloadFound; // localfuncs.py existed when the server loaded it
+	localFuncsFingerprint                m_preloadFp;
 };
 
 bool pythonInterfaceEnabled()
@@ -511,18 +1664,104 @@ bool pythonInterfaceEnabled()
 	return true;
 }
 
+void dumpPythonStats()
+{
+	if (pythonPureCalls + pythonWorkerCalls > 0) {
+		std::ostringstream oss;
+		oss.setf( std::ios::fixed, std:: ios::floatfield );
+		oss.precision(3);
+
+		oss << "Python Function stats:\n";
+		if (pythonPureCalls > 0) {
+			oss << "\tCalls to pure functions: " << pythonPureCalls << " (" << pythonPureFunctions << " functions)\n";
+			double percentage = double(100 * pythonPureHits) / double(pythonPureCalls);
+			oss << "\tResult Cache Hits: " << percentage << "%\n";
+		}
+		if (pythonWorkerCalls > 0) {
+			oss << "\tCalls run in " << g_workerPool.size() << " worker processes: " << pythonWorkerCalls
+					<< " in " << pythonWorkerBatches << " batches\n";
+		}
+
+		std::cerr << oss.str();
+	}
+}
+
 static PythonFunctionCollection gFunctionCollection;
 
+static void loadPythonFunctions()
+{
+	gFunctionCollection.ensureLoaded();
+}
+
 ExternalFunctionCollection* p_gExternalFunctions = &gFunctionCollection;
 
+void pythonPreload(const char* path)
+{
+	// Each request starts its own worker processes
+	g_pythonWorkers = 0;
+	if (!gFunctionCollection.IsInitialized()) {
+		gFunctionCollection.preload(path);
+	}
+}
+
+#ifdef SPECS_SERVER
+int pythonAwareFork()
+{
+	if (!Py_IsInitialized()) {
+		pid_t pid = fork();
+		if (0 == pid) {
+			gFunctionCollection.afterFork();
+		}
+		return pid;
+	}
+#ifdef PYTHON_VER_2
+	pid_t pid = fork();
+	if (0 == pid) {
+		PyOS_AfterFork();
+	}
+#else
+	PyOS_BeforeFork();
+	pid_t pid = fork();
+	if (0 == pid) {
+		PyOS_AfterFork_Child();
+	} else {
+		PyOS_AfterFork_Parent();
+	}
+#endif
+	if (0 == pid) {
+		g_bForkedFromServer = true;
+		gFunctionCollection.afterFork();
+	}
+	return pid;
+}
+#endif
+
 
 #else  // SPECS_NO_PYTHON
 #include "PythonIntf.h"
+#ifdef SPECS_SERVER
+#include <unistd.h>
+#endif
 
 bool pythonInterfaceEnabled()
 {
 	return false;
 }
 
+void dumpPythonStats()
+{
+}
+
+void pythonPreload(const char* path)
+{
+}
+
+#ifdef SPECS_SERVER
+int pythonAwareFork()
+{
+	return fork();
+}
+#endif
+
 #endif
 
@@ -2,16 +2,37 @@
 #define SPECS2016__PYTHON__INTF__H
 
 #include <memory>
+#include <vector>
 #include "utils/aluValue.h"
+#include "utils/platform.h"
 
 bool pythonInterfaceEnabled();
 
+void dumpPythonStats();
+
+// Starts Python and loads the local functions ahead of the first specification,
+// so that the processes forked by the specs server find them ready
+void pythonPreload(const char* path);
+
+#ifdef SPECS_SERVER
+// Like fork(), but keeps a running Python interpreter usable in both processes.
+// The child process leaves the interpreter to the server and does not finalize it.
+int pythonAwareFork();
+#endif
+
 class ExternalFunctionRec {
 public:
 	virtual size_t    GetArgCount() = 0;
 	virtual void      ResetArgs() = 0;
 	virtual void      setArgValue(size_t idx, PValue pValue) = 0;
 	virtual PValue    Call() = 0;
+
+	// A function with a batch form can be called once for the arguments of many records
+	virtual bool      IsBatchable() = 0;
+	virtual void      QueueCall(std::vector<PValue>& args) = 0;
+	// One result for each queued call. If a call fails and that is an error, the results
+	// of the calls before it are returned before the exception is thrown.
+	virtual void      CallBatch(std::vector<PValue>& results) = 0;
 };
 
 typedef std::shared_ptr<ExternalFunctionRec> PExternalFunctionRec;
@@ -3,6 +3,9 @@
 #include <sstream>
 #include <stdexcept>
 #include <locale>
+#include <memory>
+#include <unordered_map>
+#include <string.h>
 #include <stdlib.h> // defines setenv
 #include "utils/ErrorReporting.h"
 #include "platform.h"  // For put_time and get_time vs strftime and strptime
@@ -21,96 +24,525 @@ clockValue specTimeGetTOD()
 }
 
 
-PSpecString specTimeConvertToPrintable(int64_t sinceEpoch, std::string format)
+/*
+ * A format is compiled into a list of items. The numeric fields and the
+ * literal text are formatted and parsed directly; anything that depends on
+ * the locale, such as month names, is formatted with put_time one conversion
+ * at a time.
+ *
+ * Parsing uses the fixed items only if all of them are fixed, and only if the
+ * input has exactly the layout that formatting would produce. Any other input
+ * is parsed with get_time, which is more lenient.
+ */
+timeFormat::timeFormat(const std::string& format)
 {
-	SClock::duration dur = std::chrono::microseconds(sinceEpoch);
-	STimePoint tp(dur);
-	auto tmc = SClock::to_time_t(tp);
-	std::tm bt = *std::localtime(&tmc);
-	unsigned int fractionalSecond = (unsigned int)(sinceEpoch % MICROSECONDS_PER_SECOND);
-	std::ostringstream oss;
-	unsigned char fractionalSecondLength = 0;
-
-	if (format.length() >= 3) {
-		auto l = format.length();
-		if (format[l-3]=='%' && format[l-1]=='f' &&
-				format[l-2]>='0' && format[l-2]<='6') {
-			fractionalSecondLength = format[l-2] - '0';
-			format = format.substr(0,l-3);
+	m_fractionLength = 0;
+	m_bFixedParse = true;
+	unsigned int fieldsSet = 0;
+
+	m_format = format;
+	auto l = m_format.length();
+	if (l >= 3 && m_format[l-3]=='%' && m_format[l-1]=='f' &&
+			m_format[l-2]>='0' && m_format[l-2]<='6') {
+		m_fractionLength = m_format[l-2] - '0';
+		m_format = m_format.substr(0,l-3);
+	}
+
+	auto addLiteral = [this](char c) {
+		if (m_items.empty() || m_items.back().type != timeItem__literal) {
+			m_items.push_back({timeItem__literal, std::string()});
+		}
+		m_items.back().text += c;
+	};
+
+	for (size_t i = 0; i < m_format.length(); i++) {
+		if (m_format[i] != '%') {
+			addLiteral(m_format[i]);
+			continue;
+		}
+		if (i + 1 == m_format.length()) {
+			m_items.push_back({timeItem__locale, "%"});
+			m_bFixedParse = false;
+			break;
+		}
+		char c = m_format[++i];
+		switch (c) {
+		case '%': addLiteral('%'); break;
+		case 'Y': m_items.push_back({timeItem__year, ""}); break;
+		case 'y': m_items.push_back({timeItem__year2, ""}); break;
+		case 'm': m_items.push_back({timeItem__month, ""}); break;
+		case 'd': m_items.push_back({timeItem__day, ""}); break;
+		case 'H': m_items.push_back({timeItem__hour, ""}); break;
+		case 'M': m_items.push_back({timeItem__minute, ""}); break;
+		case 'S': m_items.push_back({timeItem__second, ""}); break;
+		case 'e':
+			m_items.push_back({timeItem__daySpace, ""});
+			m_bFixedParse = false;
+			break;
+		case 'j':
+			m_items.push_back({timeItem__dayOfYear, ""});
+			m_bFixedParse = false;
+			break;
+		case 'D':   // %m/%d/%y
+			m_items.push_back({timeItem__month, ""});
+			addLiteral('/');
+			m_items.push_back({timeItem__day, ""});
+			addLiteral('/');
+			m_items.push_back({timeItem__year2, ""});
+			break;
+		case 'R':   // %H:%M
+		case 'T':   // %H:%M:%S
+			m_items.push_back({timeItem__hour, ""});
+			addLiteral(':');
+			m_items.push_back({timeItem__minute, ""});
+			if (c=='T') {
+				addLiteral(':');
+				m_items.push_back({timeItem__second, ""});
+			}
+			break;
+		case 'E':
+		case 'O':   // modifiers for the alternative representation
+			if (i + 1 < m_format.length()) {
+				m_items.push_back({timeItem__locale, m_format.substr(i-1, 3)});
+				i++;
+			} else {
+				m_items.push_back({timeItem__locale, m_format.substr(i-1, 2)});
+			}
+			m_bFixedParse = false;
+			break;
+		default:
+			m_items.push_back({timeItem__locale, m_format.substr(i-1, 2)});
+			m_bFixedParse = false;
+		}
+	}
+
+	for (auto& it : m_items) {
+		switch (it.type) {
+		case timeItem__year:   fieldsSet |= 1; break;
+		case timeItem__year2:  fieldsSet |= 1; break;
+		case timeItem__month:  fieldsSet |= 2; break;
+		case timeItem__day:    fieldsSet |= 4; break;
+		case timeItem__hour:   fieldsSet |= 8; break;
+		case timeItem__minute: fieldsSet |= 16; break;
+		case timeItem__second: fieldsSet |= 32; break;
+		default: break;
+		}
+	}
+	m_bSetsAllFields = (fieldsSet == 63);
+}
+
+/*
+ * The offset of the local time from UTC is cached for each UTC day. A day
+ * without a transition has a single offset; a day with one also has the second
+ * at which it happens and the offset that follows. With that, converting a
+ * time in either direction is arithmetic, and localtime_r is called only to
+ * fill the cache.
+ *
+ * A day that the cache cannot describe exactly - one with two transitions, or
+ * in a zone with leap seconds - is converted by the C library. So are local
+ * times within two days of a transition, where a local time may be ambiguous
+ * or may not exist, and mktime decides.
+ *
+ * The cache is per thread, and is discarded when the time zone changes.
+ */
+#define TZ_CACHE_SIZE      1024
+#define SECONDS_PER_DAY    86400
+
+static unsigned int g_timeZoneGeneration = 0;
+
+#ifndef WIN64
+struct tzOffset {
+	long         gmtoff;
+	int          isdst;
+	const char*  zone;
+	bool operator==(const tzOffset& other) const {
+		return gmtoff == other.gmtoff && isdst == other.isdst
+				&& (zone == other.zone || (zone && other.zone && 0 == strcmp(zone, other.zone)));
+	}
+	bool operator!=(const tzOffset& other) const { return !(*this == other); }
+};
+
+struct tzDay {
+	int64_t      day;          // days since the epoch
+	int64_t      transition;   // the first second that has the offset `after`
+	tzOffset     before;
+	tzOffset     after;
+	bool         bTransition;
+	bool         bDirect;      // use the C library for this day
+};
+
+static inline int64_t floorDiv(int64_t a, int64_t b)
+{
+	int64_t q = a / b;
+	return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+// Howard Hinnant's algorithms for the proleptic Gregorian calendar
+static int64_t daysFromCivil(int64_t y, unsigned int m, unsigned int d)
+{
+	y -= (m <= 2);
+	int64_t era = floorDiv(y, 400);
+	unsigned int yoe = unsigned(y - era * 400);
+	unsigned int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + int64_t(doe) - 719468;
+}
+
+static void civilFromDays(int64_t z, int64_t& y, unsigned int& m, unsigned int& d)
+{
+	z += 719468;
+	int64_t era = floorDiv(z, 146097);
+	unsigned int doe = unsigned(z - era * 146097);
+	unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	unsigned int mp = (5 * doy + 2) / 153;
+	d = doy - (153 * mp + 2) / 5 + 1;
+	m = mp < 10 ? mp + 3 : mp - 9;
+	y = int64_t(yoe) + era * 400 + (m <= 2);
+}
+
+static void breakDown(int64_t t, const tzOffset& offset, std::tm& ret)
+{
+	int64_t local = t + offset.gmtoff;
+	int64_t days = floorDiv(local, SECONDS_PER_DAY);
+	int secs = int(local - days * SECONDS_PER_DAY);
+	int64_t y;
+	unsigned int m, d;
+	civilFromDays(days, y, m, d);
+
+	memset(&ret, 0, sizeof(ret));
+	ret.tm_year = int(y - 1900);
+	ret.tm_mon = int(m) - 1;
+	ret.tm_mday = int(d);
+	ret.tm_hour = secs / 3600;
+	ret.tm_min = (secs / 60) % 60;
+	ret.tm_sec = secs % 60;
+	ret.tm_wday = int(((days + 4) % 7 + 7) % 7);   // 1970-01-01 was a Thursday
+	ret.tm_yday = int(days - daysFromCivil(y, 1, 1));
+	ret.tm_isdst = offset.isdst;
+	ret.tm_gmtoff = offset.gmtoff;
+	ret.tm_zone = offset.zone;
+}
+
+// Gets the offset at time t, and checks that breakDown agrees with the C library
+static bool libraryOffset(int64_t t, tzOffset& offset)
+{
+	std::time_t tt = std::time_t(t);
+	std::tm lib, ours;
+	if (!localtime_r(&tt, &lib)) return false;
+	offset = {lib.tm_gmtoff, lib.tm_isdst, lib.tm_zone};
+	breakDown(t, offset, ours);
+	return lib.tm_year == ours.tm_year && lib.tm_mon == ours.tm_mon && lib.tm_mday == ours.tm_mday
+			&& lib.tm_hour == ours.tm_hour && lib.tm_min == ours.tm_min && lib.tm_sec == ours.tm_sec
+			&& lib.tm_wday == ours.tm_wday && lib.tm_yday == ours.tm_yday;
+}
+
+static void fillDay(int64_t day, tzDay& entry)
+{
+	entry.day = day;
+	entry.bTransition = false;
+	entry.bDirect = true;
+
+	int64_t lo = day * SECONDS_PER_DAY;
+	int64_t hi = lo + SECONDS_PER_DAY;
+	tzOffset endOffset;
+	if (!libraryOffset(lo, entry.before) || !libraryOffset(hi, endOffset)) return;
+	entry.after = entry.before;
+
+	if (entry.before != endOffset) {
+		// find the transition: the offset at lo is `before` and the offset at hi is not
+		while (hi - lo > 1) {
+			int64_t mid = lo + (hi - lo) / 2;
+			tzOffset midOffset;
+			if (!libraryOffset(mid, midOffset)) return;
+			if (midOffset == entry.before) {
+				lo = mid;
+			} else {
+				hi = mid;
+			}
+		}
+		if (!libraryOffset(hi, entry.after) || entry.after != endOffset) return;
+		entry.transition = hi;
+		entry.bTransition = true;
+	}
+
+	entry.bDirect = false;
+}
+
+static const tzDay& getDay(int64_t day)
+{
+	thread_local std::vector<tzDay> cache;
+	thread_local unsigned int cacheGeneration = 0;
+	if (cache.empty() || cacheGeneration != g_timeZoneGeneration) {
+		cache.assign(TZ_CACHE_SIZE, tzDay());
+		for (auto& entry : cache) {
+			entry.day = INT64_MIN;
 		}
+		cacheGeneration = g_timeZoneGeneration;
+	}
+
+	tzDay& entry = cache[size_t(day) & (TZ_CACHE_SIZE - 1)];
+	if (entry.day != day) {
+		fillDay(day, entry);
 	}
+	return entry;
+}
+#endif
+
+static void specTimeLocalTime(std::time_t t, std::tm& ret)
+{
+#ifndef WIN64
+	const tzDay& entry = getDay(floorDiv(int64_t(t), SECONDS_PER_DAY));
+	if (!entry.bDirect) {
+		breakDown(int64_t(t), (entry.bTransition && int64_t(t) >= entry.transition) ? entry.after : entry.before, ret);
+		return;
+	}
+#endif
+	ret = *std::localtime(&t);
+}
+
+// Like mktime with tm_isdst set to -1
+static std::time_t specTimeMakeTime(std::tm& t)
+{
+#ifndef WIN64
+	thread_local int64_t lastLocal = 0;
+	thread_local bool bLibraryBehind = false;
+
+	auto offsetAt = [](int64_t when, long& gmtoff) {
+		const tzDay& entry = getDay(floorDiv(when, SECONDS_PER_DAY));
+		if (entry.bDirect) return false;
+		gmtoff = (entry.bTransition && when >= entry.transition) ? entry.after.gmtoff : entry.before.gmtoff;
+		return true;
+	};
 
+	int64_t year = int64_t(t.tm_year) + 1900 + floorDiv(t.tm_mon, 12);
+	unsigned int month = unsigned(t.tm_mon - floorDiv(t.tm_mon, 12) * 12) + 1;
+	int64_t local = (daysFromCivil(year, month, 1) + t.tm_mday - 1) * SECONDS_PER_DAY
+			+ int64_t(t.tm_hour) * 3600 + int64_t(t.tm_min) * 60 + t.tm_sec;
+
+	long guess, gmtoff;
+	if (offsetAt(local, guess) && offsetAt(local - guess, gmtoff)) {
+		int64_t ret = local - gmtoff;
+		long check;
+		if (gmtoff == guess || (offsetAt(ret, check) && check == gmtoff)) {
+			int64_t day = floorDiv(ret, SECONDS_PER_DAY);
+			bool bNearTransition = false;
+			for (int64_t d = day - 2; d <= day + 2 && !bNearTransition; d++) {
+				const tzDay& entry = getDay(d);
+				bNearTransition = entry.bDirect || entry.bTransition;
+			}
+			if (!bNearTransition) {
+				lastLocal = local;
+				bLibraryBehind = true;
+				return std::time_t(ret);
+			}
+		}
+	}
+
+	/*
+	 * glibc's mktime resolves an ambiguous local time using the offset of the
+	 * previous call's result. Replay the last conversion that skipped it, so
+	 * that it makes the same choice as if it had seen every conversion.
+	 */
+	if (bLibraryBehind) {
+		std::tm previous;
+		breakDown(lastLocal, {0, 0, nullptr}, previous);
+		previous.tm_isdst = -1;
+		std::mktime(&previous);
+		bLibraryBehind = false;
+	}
+#endif
+	t.tm_isdst = -1;
+	return std::mktime(&t);
+}
+
+static void appendNumber(std::string& out, long value, unsigned int width, char pad = '0')
+{
+	char buf[24];
+	char* p = buf + sizeof(buf);
+	bool bNegative = value < 0;
+	unsigned long v = bNegative ? 0UL - (unsigned long)(value) : (unsigned long)(value);
+	do {
+		*--p = char('0' + v % 10);
+		v /= 10;
+	} while (v);
+	if (bNegative) *--p = '-';
+	for (size_t len = buf + sizeof(buf) - p; len < width; len++) {
+		out += pad;
+	}
+	out.append(p, buf + sizeof(buf) - p);
+}
+
+static unsigned int g_localeGeneration = 0;
+
+void timeFormat::format(int64_t sinceEpoch, std::string& out) const
+{
+	SClock::duration dur = std::chrono::microseconds(sinceEpoch);
+	STimePoint tp(dur);
+	auto tmc = SClock::to_time_t(tp);
+	std::tm bt;
+	specTimeLocalTime(tmc, bt);
+
+	for (auto& it : m_items) {
+		switch (it.type) {
+		case timeItem__literal:   out += it.text; break;
+		case timeItem__year:      appendNumber(out, long(bt.tm_year) + 1900, 0); break;
+		case timeItem__year2:     appendNumber(out, ((bt.tm_year % 100) + 100) % 100, 2); break;
+		case timeItem__month:     appendNumber(out, bt.tm_mon + 1, 2); break;
+		case timeItem__day:       appendNumber(out, bt.tm_mday, 2); break;
+		case timeItem__daySpace:  appendNumber(out, bt.tm_mday, 2, ' '); break;
+		case timeItem__dayOfYear: appendNumber(out, bt.tm_yday + 1, 3); break;
+		case timeItem__hour:      appendNumber(out, bt.tm_hour, 2); break;
+		case timeItem__minute:    appendNumber(out, bt.tm_min, 2); break;
+		case timeItem__second:    appendNumber(out, bt.tm_sec, 2); break;
+		case timeItem__locale: {
 #ifdef PUT_TIME__SUPPORTED
-	oss.imbue(g_locale);
-	oss << std::put_time(&bt, format.c_str());
+			static std::ostringstream oss;
+			static unsigned int imbuedGeneration = unsigned(-1);
+			if (imbuedGeneration != g_localeGeneration) {
+				oss.imbue(g_locale);
+				imbuedGeneration = g_localeGeneration;
+			}
+			oss.str("");
+			oss << std::put_time(&bt, it.text.c_str());
+			out += oss.str();
 #else
-	char timeFormatterString[256];
-	strftime(timeFormatterString, 255, format.c_str(), &bt);
-	oss << timeFormatterString;
+			char timeFormatterString[256];
+			size_t len = strftime(timeFormatterString, 255, it.text.c_str(), &bt);
+			out.append(timeFormatterString, len);
 #endif
-	if (fractionalSecondLength) {
-		oss << std::setw(fractionalSecondLength) << std::setfill('0');
-		while (fractionalSecondLength < 6) {
-			fractionalSecondLength++;
+			break;
+		}
+		}
+	}
+
+	if (m_fractionLength) {
+		unsigned int fractionalSecond = (unsigned int)(sinceEpoch % MICROSECONDS_PER_SECOND);
+		for (unsigned char len = m_fractionLength; len < 6; len++) {
 			fractionalSecond /= 10;
 		}
-		oss << fractionalSecond;
+		appendNumber(out, long(fractionalSecond), m_fractionLength);
 	}
-	std::string ret = oss.str();
-	return std::make_shared<std::string>(ret);
 }
 
-int64_t specTimeConvertFromPrintable(std::string printable, std::string format)
+static bool parseDigits(const std::string& s, size_t& pos, unsigned int count, int minValue, int maxValue, int& ret)
+{
+	if (pos + count > s.length()) return false;
+	int value = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		char c = s[pos + i];
+		if (c < '0' || c > '9') return false;
+		value = value * 10 + (c - '0');
+	}
+	if (value < minValue || value > maxValue) return false;
+	pos += count;
+	ret = value;
+	return true;
+}
+
+// Parses input in exactly the layout of the format. Returns false for anything else.
+bool timeFormat::parseFixed(const std::string& printable, std::tm& t, size_t& pos) const
+{
+	pos = 0;
+	for (auto& it : m_items) {
+		int value;
+		switch (it.type) {
+		case timeItem__literal:
+			if (0 != printable.compare(pos, it.text.length(), it.text)) return false;
+			pos += it.text.length();
+			break;
+		case timeItem__year:
+			if (!parseDigits(printable, pos, 4, 0, 9999, value)) return false;
+			t.tm_year = value - 1900;
+			break;
+		case timeItem__year2:
+			if (!parseDigits(printable, pos, 2, 0, 99, value)) return false;
+			t.tm_year = (value < 69) ? value + 100 : value;
+			break;
+		case timeItem__month:
+			if (!parseDigits(printable, pos, 2, 1, 12, value)) return false;
+			t.tm_mon = value - 1;
+			break;
+		case timeItem__day:
+			if (!parseDigits(printable, pos, 2, 1, 31, value)) return false;
+			t.tm_mday = value;
+			break;
+		case timeItem__hour:
+			if (!parseDigits(printable, pos, 2, 0, 23, value)) return false;
+			t.tm_hour = value;
+			break;
+		case timeItem__minute:
+			if (!parseDigits(printable, pos, 2, 0, 59, value)) return false;
+			t.tm_min = value;
+			break;
+		case timeItem__second:
+			if (!parseDigits(printable, pos, 2, 0, 60, value)) return false;
+			t.tm_sec = value;
+			break;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+int64_t timeFormat::parse(const std::string& printable) const
 {
 	// initialize t in case of missing fields
-	std::time_t now = std::time(nullptr);
-	std::tm t = *(std::localtime(&now));
+	std::tm t;
+	if (m_bSetsAllFields) {
+		memset(&t, 0, sizeof(t));
+	} else {
+		specTimeLocalTime(std::time(nullptr), t);
+	}
 
-	unsigned int fractionalSeconds = 0;
-	unsigned char fractionalSecondLength = 0;
 	std::string fractionalPart;
+	size_t pos;
 
-	if (format.length() >= 3) {
-		auto l = format.length();
-		if (format[l-3]=='%' && format[l-1]=='f' &&
-				format[l-2]>='0' && format[l-2]<='6') {
-			fractionalSecondLength = format[l-2] - '0';
-			format = format.substr(0,l-3);
+	if (m_bFixedParse && parseFixed(printable, t, pos)) {
+		if (m_fractionLength > 0) {
+			fractionalPart = printable.substr(pos);
+			if (fractionalPart.length() != m_fractionLength) {
+				fractionalPart.resize(m_fractionLength, '0');
+			}
 		}
-	}
-
+	} else {
+		// parseFixed may have set some of the fields
+		specTimeLocalTime(std::time(nullptr), t);
 #ifdef PUT_TIME__SUPPORTED
-	std::istringstream ss(printable);
-	ss.imbue(g_locale);
-	ss >> std::get_time(&t, format.c_str());
-	if (ss.fail()) {
-		return 0;
-	}
-	if (fractionalSecondLength > 0) {
-		std::getline(ss, fractionalPart);
-		if (fractionalPart.length() != fractionalSecondLength) {
-			fractionalPart.resize(fractionalSecondLength, '0');
+		std::istringstream ss(printable);
+		ss.imbue(g_locale);
+		ss >> std::get_time(&t, m_format.c_str());
+		if (ss.fail()) {
+			return 0;
+		}
+		if (m_fractionLength > 0) {
+			std::getline(ss, fractionalPart);
+			if (fractionalPart.length() != m_fractionLength) {
+				fractionalPart.resize(m_fractionLength, '0');
+			}
 		}
-	}
 #else
-	char* fractionalPartPtr = strptime(printable.c_str(), format.c_str(), &t);
-	if (!fractionalPartPtr) {
-		return 0;
-	}
-	if (fractionalSecondLength > 0) {
-		fractionalPart = fractionalPartPtr;
-		if (fractionalPart.length() != fractionalSecondLength) {
-			fractionalPart.resize(fractionalSecondLength, '0');
+		char* fractionalPartPtr = strptime(printable.c_str(), m_format.c_str(), &t);
+		if (!fractionalPartPtr) {
+			return 0;
+		}
+		if (m_fractionLength > 0) {
+			fractionalPart = fractionalPartPtr;
+			if (fractionalPart.length() != m_fractionLength) {
+				fractionalPart.resize(m_fractionLength, '0');
+			}
 		}
-	}
 #endif
+	}
 
 	// automatic detection of DST - Issue #2
 	t.tm_isdst = -1;
-	std::time_t secondsSinceEpoch = std::mktime(&t);
+	std::time_t secondsSinceEpoch = specTimeMakeTime(t);
 
 	// take care of microseconds
-	if (fractionalSecondLength > 0) {
+	unsigned int fractionalSeconds = 0;
+	if (m_fractionLength > 0) {
 		try {
 			int extraZeros = 6 - int(fractionalPart.length());
 			fractionalSeconds = std::stoi(fractionalPart);
@@ -128,16 +560,59 @@ int64_t specTimeConvertFromPrintable(std::string printable, std::string format)
 	return ret;
 }
 
+#define TIME_FORMAT_CACHE_SIZE 1024
+
+const timeFormat& specTimeGetFormat(const std::string& format)
+{
+	static std::unordered_map<std::string, std::unique_ptr<timeFormat>> formats;
+	static std::string lastFormat;
+	static const timeFormat* pLast = nullptr;
+
+	if (pLast && format == lastFormat) {
+		return *pLast;
+	}
+
+	auto it = formats.find(format);
+	if (it == formats.end()) {
+		// Formats computed per record could fill the cache
+		if (formats.size() >= TIME_FORMAT_CACHE_SIZE) {
+			formats.clear();
+		}
+		it = formats.emplace(format, std::make_unique<timeFormat>(format)).first;
+	}
+
+	lastFormat = format;
+	pLast = it->second.get();
+	return *pLast;
+}
+
+PSpecString specTimeConvertToPrintable(int64_t sinceEpoch, std::string format)
+{
+	auto ret = std::make_shared<std::string>();
+	specTimeGetFormat(format).format(sinceEpoch, *ret);
+	return ret;
+}
+
+int64_t specTimeConvertFromPrintable(std::string printable, std::string format)
+{
+	return specTimeGetFormat(format).parse(printable);
+}
+
 void specTimeSetTimeZone(const std::string& tzname)
 {
 	static const char sTZ[] = "TZ";
 	setenv(sTZ, tzname.data(), 1);
+#ifndef WIN64
+	tzset();   // localtime_r does not read TZ again by itself
+#endif
+	g_timeZoneGeneration++;
 }
 
 void specTimeSetLocale(const std::string& _locale, bool throwIfInvalid)
 {
 	try {
 		g_locale = std::locale(_locale);
+		g_localeGeneration++;
 	} catch(std::runtime_error& e) {
 		std::string err = "Invalid locale <" + _locale + ">";
 		if (throwIfInvalid) {
@@ -206,6 +681,61 @@ void classifyingTimer::dump(std::string title)
 	std::cerr << oss.str();
 }
 
+startupTimer g_startupTimer;
+
+startupTimer::startupTimer()
+{
+	m_currentPhase = nullptr;
+}
+
+void startupTimer::start()
+{
+	m_lastTimePoint = HClock::now();
+	m_currentPhase = "Parsing switches";
+}
+
+const char* startupTimer::changePhase(const char* phase)
+{
+	const char* prev = m_currentPhase;
+	if (!prev || !phase || prev == phase) return prev;
+	auto now = HClock::now();
+	uint64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(now-m_lastTimePoint).count();
+	auto it = m_phases.begin();
+	while (it != m_phases.end() && 0 != strcmp(it->first, prev)) it++;
+	if (it == m_phases.end()) {
+		m_phases.push_back(std::make_pair(prev, duration));
+	} else {
+		it->second += duration;
+	}
+	m_currentPhase = phase;
+	m_lastTimePoint = now;
+	return prev;
+}
+
+void startupTimer::stop()
+{
+	changePhase("");
+	m_currentPhase = nullptr;
+}
+
+void startupTimer::dump()
+{
+	uint64_t totalDuration = 0;
+	for (auto& phase : m_phases) {
+		totalDuration += phase.second;
+	}
+	if (0 == totalDuration) return;
+
+	std::ostringstream oss;
+	oss.setf( std::ios::fixed, std:: ios::floatfield );
+	oss.precision(0);
+	oss << "Startup: " << (double(totalDuration) / NANOSECONDS_PER_MICROSECOND) << " us\n";
+	for (auto& phase : m_phases) {
+		oss << "\t" << phase.first << ": " << (double(phase.second) / NANOSECONDS_PER_MICROSECOND) << " us\n";
+	}
+	std::cerr << oss.str();
+}
+
 queueTimer::queueTimer()
 {
 	m_lastIncDec = m_lastTimePoint = HClock::now();
@@ -4,6 +4,8 @@
 #include <cstdint>
 #include <string>
 #include <chrono>
+#include <ctime>
+#include <vector>
 #include "utils/SpecString.h"
 
 #define MICROSECONDS_PER_SECOND 1000000
@@ -20,6 +22,45 @@ typedef int64_t clockValue;
 
 clockValue specTimeGetTOD();
 
+/*
+ * A strftime-style format, compiled once. Besides the strftime conversions,
+ * the format may end with %nf for n (0-6) digits of fractions of a second.
+ */
+class timeFormat {
+public:
+	explicit timeFormat(const std::string& format);
+	void             format(int64_t sinceEpoch, std::string& out) const;   // appends to out
+	int64_t          parse(const std::string& printable) const;
+private:
+	enum timeItemType {
+		timeItem__literal,
+		timeItem__year,
+		timeItem__year2,
+		timeItem__month,
+		timeItem__day,
+		timeItem__daySpace,
+		timeItem__dayOfYear,
+		timeItem__hour,
+		timeItem__minute,
+		timeItem__second,
+		timeItem__locale,      // a conversion that is passed to put_time
+	};
+	struct timeItem {
+		timeItemType  type;
+		std::string   text;    // for literal and locale items
+	};
+	bool             parseFixed(const std::string& printable, std::tm& t, size_t& pos) const;
+
+	std::vector<timeItem> m_items;
+	std::string      m_format;           // without the trailing %nf
+	unsigned char    m_fractionLength;
+	bool             m_bFixedParse;      // all the items can be parsed without get_time
+	bool             m_bSetsAllFields;   // year, month, day, hour, minute, and second
+};
+
+// Returns the compiled format, compiling it on first use
+const timeFormat& specTimeGetFormat(const std::string& format);
+
 PSpecString specTimeConvertToPrintable(int64_t sinceEpoch, std::string format);
 
 int64_t specTimeConvertFromPrintable(std::string printable, std::string format);
@@ -53,6 +94,27 @@ private:
 	double   getMicroSeconds(timeClasses _class) { return double(m_nanoseconds[_class]) / NANOSECONDS_PER_MICROSECOND; }
 };
 
+/*
+ * Times the phases of the startup, which matter for short runs. A phase lasts
+ * until the next one begins, and a phase that begins in the middle of another
+ * should restore the previous one when it ends. The timer does nothing once
+ * it is stopped.
+ */
+class startupTimer {
+public:
+	startupTimer();
+	void        start();
+	const char* changePhase(const char* phase);   // returns the previous phase
+	void        stop();
+	void        dump();
+private:
+	std::chrono::time_point<HClock> m_lastTimePoint;
+	const char* m_currentPhase;
+	std::vector<std::pair<const char*, uint64_t>> m_phases;   // nanoseconds, in the order of first use
+};
+
+extern startupTimer g_startupTimer;
+
 enum queueTimeClasses {
 	queueTimeClassEmpty,
 	queueTimeClassOther,
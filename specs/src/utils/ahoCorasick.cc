@@ -0,0 +1,127 @@
+#include <queue>
+#include <string.h>
+#include "utils/ahoCorasick.h"
+
+ahoCorasick::ahoCorasick()
+{
+	m_bBuilt = false;
+	m_classCount = 1;
+	memset(m_byteClass, 0, sizeof(m_byteClass));
+	m_scanGen = 0;
+}
+
+size_t ahoCorasick::addPattern(std::string_view pattern)
+{
+	std::string sPattern(pattern);
+	auto it = m_patternIds.find(sPattern);
+	if (it != m_patternIds.end()) {
+		return it->second;
+	}
+
+	size_t id = m_patterns.size();
+	m_patterns.push_back(sPattern);
+	m_patternIds[sPattern] = id;
+	m_foundGen.push_back(0);
+	if (pattern.empty()) {
+		m_emptyPatterns.push_back(id);
+	}
+	m_bBuilt = false;
+	return id;
+}
+
+void ahoCorasick::build()
+{
+	// Byte classes: class 0 is for bytes that are in no pattern
+	memset(m_byteClass, 0, sizeof(m_byteClass));
+	m_classCount = 1;
+	for (auto& p : m_patterns) {
+		for (unsigned char c : p) {
+			if (0 == m_byteClass[c]) {
+				m_byteClass[c] = (unsigned char)(m_classCount++);
+			}
+		}
+	}
+
+	// The trie
+	m_delta.assign(m_classCount, -1);
+	m_terminal.assign(1, -1);
+	for (size_t id = 0; id < m_patterns.size(); id++) {
+		int state = 0;
+		for (unsigned char c : m_patterns[id]) {
+			int& next = m_delta[state * m_classCount + m_byteClass[c]];
+			if (next < 0) {
+				next = int(m_terminal.size());
+				m_terminal.push_back(-1);
+				m_delta.resize(m_delta.size() + m_classCount, -1);
+			}
+			state = m_delta[state * m_classCount + m_byteClass[c]];
+		}
+		if (state > 0) {
+			m_terminal[state] = int(id);
+		}
+	}
+
+	// Failure links, breadth first. Missing transitions are filled in from the
+	// failure state, turning the trie into a DFA.
+	std::vector<int> fail(m_terminal.size(), 0);
+	m_outLink.assign(m_terminal.size(), 0);
+	std::queue<int> q;
+	for (size_t c = 0; c < m_classCount; c++) {
+		int& next = m_delta[c];
+		if (next < 0) {
+			next = 0;
+		} else {
+			q.push(next);
+		}
+	}
+	while (!q.empty()) {
+		int state = q.front();
+		q.pop();
+		for (size_t c = 0; c < m_classCount; c++) {
+			int next = m_delta[state * m_classCount + c];
+			int fallback = m_delta[fail[state] * m_classCount + c];
+			if (next < 0) {
+				m_delta[state * m_classCount + c] = fallback;
+			} else {
+				fail[next] = fallback;
+				m_outLink[next] = (m_terminal[fallback] >= 0) ? fallback : m_outLink[fallback];
+				q.push(next);
+			}
+		}
+	}
+
+	m_bBuilt = true;
+}
+
+void ahoCorasick::mark(size_t id)
+{
+	m_foundGen[id] = m_scanGen;
+	m_lastFound.push_back(id);
+}
+
+void ahoCorasick::scan(std::string_view text)
+{
+	if (!m_bBuilt) {
+		build();
+	}
+
+	m_scanGen++;
+	m_lastFound.clear();
+
+	// An empty pattern is found in any text
+	for (size_t id : m_emptyPatterns) {
+		mark(id);
+	}
+
+	const int* delta = m_delta.data();
+	int state = 0;
+	for (unsigned char c : text) {
+		state = delta[state * m_classCount + m_byteClass[c]];
+		int out = (m_terminal[state] >= 0) ? state : m_outLink[state];
+		// Once a pattern is marked, so is everything down its output chain
+		while (out > 0 && !found(size_t(m_terminal[out]))) {
+			mark(size_t(m_terminal[out]));
+			out = m_outLink[out];
+		}
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef SPECS2016__UTILS__AHO_CORASICK__H
+#define SPECS2016__UTILS__AHO_CORASICK__H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * An Aho-Corasick automaton that finds which of a set of literal strings occur
+ * in a text, scanning the text once regardless of the number of strings.
+ *
+ * The automaton is a DFA over byte classes: bytes that appear in no pattern
+ * share one class, so the transition table stays small. It is rebuilt on the
+ * next scan after patterns are added.
+ */
+class ahoCorasick {
+public:
+	ahoCorasick();
+	size_t           addPattern(std::string_view pattern);   // returns the pattern's number
+	size_t           patternCount() const   { return m_patterns.size(); }
+	const std::string& pattern(size_t id) const  { return m_patterns[id]; }
+
+	// Finds the patterns that occur in the text. Afterwards, found() tells whether
+	// a pattern occurred, and lastFound() lists those that did in order of discovery.
+	void             scan(std::string_view text);
+	bool             found(size_t id) const  { return m_foundGen[id] == m_scanGen; }
+	const std::vector<size_t>& lastFound() const  { return m_lastFound; }
+private:
+	void             build();
+	void             mark(size_t id);
+
+	std::vector<std::string>                     m_patterns;
+	std::unordered_map<std::string, size_t>      m_patternIds;
+	std::vector<size_t>                          m_emptyPatterns;
+	bool                                         m_bBuilt;
+
+	unsigned char                                m_byteClass[256];
+	size_t                                       m_classCount;
+	std::vector<int>                             m_delta;     // state * m_classCount + class
+	std::vector<int>                             m_terminal;  // pattern ending at this state, or -1
+	std::vector<int>                             m_outLink;   // nearest suffix state that is terminal, or 0
+
+	std::vector<uint64_t>                        m_foundGen;
+	uint64_t                                     m_scanGen;
+	std::vector<size_t>                          m_lastFound;
+};
+
+#endif
@@ -9,13 +9,17 @@
 
 #include <sstream>
 #include <cmath>
+#include <cerrno>
+#include <cstdlib>
 #include <stack>
 #include <algorithm>
 #include <iomanip>
+#include <unordered_map>
 #include "ErrorReporting.h"
 #include "alu.h"
 #include "aluFunctions.h"
 #include "processing/Config.h"  // for configured literals
+#include "TimeUtils.h"
 
 extern stateQueryAgent* g_pStateQueryAgent;
 
@@ -128,15 +132,14 @@ bool ALUValue::isNumeric() const
 	case counterType__Int:
 	case counterType__Float:
 		return true;
-	default: try {
-		std::size_t pos;
-		long double discardedRetValue = std::stold(m_value, &pos);
+	default: {
+		// Like std::stold, but most strings are not numbers and an exception is expensive
+		const char* pStart = m_value.c_str();
+		char* pEnd;
+		errno = 0;
+		long double discardedRetValue = strtold(pStart, &pEnd);
 		SUPPRESS_UNUSED_WARNING(discardedRetValue);
-		return m_value.length() == pos;
-	} catch (std::out_of_range& e) {
-		return false;
-	} catch (std::invalid_argument& e) {
-		return false;
+		return pEnd != pStart && errno != ERANGE && m_value.length() == size_t(pEnd - pStart);
 	}
 	}
 }
@@ -195,6 +198,13 @@ PValue AluUnit::compute(PValue op1, PValue op2, PValue op3, PValue op4, PValue o
 }
 
 
+// Numerical literals have their type divined once, rather than on every evaluation
+AluUnitLiteral::AluUnitLiteral(std::string& s, bool hintNumerical)
+	:m_literal(s),m_hintNumerical(hintNumerical)
+{
+	if (m_hintNumerical) m_literal.divineType();
+}
+
 void AluUnitLiteral::_serialize(std::ostream& os) const
 {
 	os << '(' << m_literal.getFloat() << ')';
@@ -211,9 +221,21 @@ std::string AluUnitLiteral::_identify()
 
 PValue AluUnitLiteral::evaluate()
 {
-	PValue ret = mkValue(m_literal);
-	if (m_hintNumerical) ret->divineType();
-	return ret;
+	return mkValue(m_literal);
+}
+
+AluStaticType AluUnitLiteral::staticType()
+{
+	switch (m_literal.getType()) {
+	case counterType__Int:
+		return AST_Int;
+	case counterType__Float:
+		return AST_Float;
+	case counterType__Str:
+		return m_literal.isNumeric() ? AST_Unknown : AST_Str;
+	default:
+		return AST_Unknown;
+	}
 }
 
 void AluUnitNull::_serialize(std::ostream& os) const
@@ -341,6 +363,16 @@ PValue		AluUnitUnaryOperator::compute(PValue operand)
 
 #define RETURN_COND(cond) { if ((cond)) { RETURN_TRUE; } else { RETURN_FALSE; } }
 
+AluStaticType AluUnitUnaryOperator::inferType(AluStaticType operandType)
+{
+	switch (m_op) {
+	case UnaryOp__Not:
+		return AST_Int;
+	default:
+		return (AST_Int==operandType || AST_Float==operandType) ? operandType : AST_Numeric;
+	}
+}
+
 PValue 	AluUnitUnaryOperator::computeNot(PValue operand)
 {
 	RETURN_COND(false==operand->getBool());
@@ -395,12 +427,14 @@ void AluBinaryOperator::setOpByName(std::string& s)
 AluBinaryOperator::AluBinaryOperator(std::string& s)
 {
 	setOpByName(s);
+	m_fastPath = AluFastPath__None;
 }
 
 AluBinaryOperator::AluBinaryOperator(const char* str)
 {
 	std::string s(str);
 	setOpByName(s);
+	m_fastPath = AluFastPath__None;
 }
 
 #define X(nm,st,prio)	case BinaryOp__##nm: os << st; break;
@@ -434,6 +468,17 @@ PValue		AluBinaryOperator::compute(PValue op1, PValue op2)
 		return mkValue0();
 	}
 
+	switch (m_fastPath) {
+	case AluFastPath__IntInt:
+		return computeIntInt(op1, op2);
+	case AluFastPath__FloatFloat:
+		return computeFloatFloat(op1, op2);
+	case AluFastPath__StrStr:
+		return computeStrStr(op1, op2);
+	default:
+		break;
+	}
+
 	switch (m_op) {
 	ALU_BOP_LIST
 	default:
@@ -442,6 +487,159 @@ PValue		AluBinaryOperator::compute(PValue op1, PValue op2)
 }
 #undef X
 
+static bool isNumericStaticType(AluStaticType t)
+{
+	return (AST_Int==t || AST_Float==t || AST_Numeric==t);
+}
+
+/*
+ * Selects a fast path according to the static types of the operands and
+ * returns the static type of the result. A fast path is selected only where
+ * it yields exactly the same result as the generic compute functions below.
+ */
+AluStaticType AluBinaryOperator::inferType(AluStaticType op1Type, AluStaticType op2Type)
+{
+	bool bBothInt = (AST_Int==op1Type && AST_Int==op2Type);
+	bool bAnyFloat = (AST_Float==op1Type || AST_Float==op2Type);
+	bool bAnyNumeric = isNumericStaticType(op1Type) || isNumericStaticType(op2Type);
+	bool bBothStr = (AST_Str==op1Type && AST_Str==op2Type);
+
+	m_fastPath = AluFastPath__None;
+
+	switch (m_op) {
+	case BinaryOp__Add:
+	case BinaryOp__Sub:
+	case BinaryOp__Mult:
+		if (bBothInt) {
+			m_fastPath = AluFastPath__IntInt;
+			return AST_Int;
+		}
+		if (bAnyFloat) {
+			m_fastPath = AluFastPath__FloatFloat;
+			return AST_Float;
+		}
+		return AST_Numeric;
+	case BinaryOp__Div:
+		if (bBothInt) {
+			m_fastPath = AluFastPath__IntInt;
+		} else if (bAnyFloat) {
+			m_fastPath = AluFastPath__FloatFloat;
+			return AST_Float;
+		}
+		return AST_Numeric;
+	case BinaryOp__IntDiv:
+	case BinaryOp__RemDiv:
+		return AST_Int;
+	case BinaryOp__Appnd:
+		return AST_Unknown;
+	case BinaryOp__LT:
+	case BinaryOp__LE:
+	case BinaryOp__GT:
+	case BinaryOp__GE:
+	case BinaryOp__EQ:
+	case BinaryOp__NE:
+		if (bBothInt) {
+			m_fastPath = AluFastPath__IntInt;
+		} else if (bAnyNumeric) {
+			m_fastPath = AluFastPath__FloatFloat;
+		} else if (bBothStr) {
+			m_fastPath = AluFastPath__StrStr;
+		}
+		return AST_Int;
+	default:
+		return AST_Int;
+	}
+}
+
+// Both operands are Int
+PValue		AluBinaryOperator::computeIntInt(PValue op1, PValue op2)
+{
+	switch (m_op) {
+	case BinaryOp__Add:
+		return mkValue(op1->getInt() + op2->getInt());
+	case BinaryOp__Sub:
+		return mkValue(op1->getInt() - op2->getInt());
+	case BinaryOp__Mult:
+		return mkValue(op1->getInt() * op2->getInt());
+	case BinaryOp__Div: {
+		ALUInt divisor = op2->getInt();
+		if (0==divisor) {
+			return mkValue0();
+		}
+		ALUInt dividend = op1->getInt();
+		if (0==(dividend % divisor)) {
+			return mkValue(dividend / divisor);
+		}
+		return mkValue(op1->getFloat() / op2->getFloat());
+	}
+	case BinaryOp__LT:
+	case BinaryOp__LE:
+	case BinaryOp__GT:
+	case BinaryOp__GE:
+	case BinaryOp__EQ:
+	case BinaryOp__NE:
+		return computeFloatFloat(op1, op2);
+	default:
+		MYTHROW("Invalid operator for the Int-Int fast path");
+	}
+}
+
+// Both operands are numeric, and arithmetic is done in floating point
+PValue		AluBinaryOperator::computeFloatFloat(PValue op1, PValue op2)
+{
+	switch (m_op) {
+	case BinaryOp__Add:
+		return mkValue(op1->getFloat() + op2->getFloat());
+	case BinaryOp__Sub:
+		return mkValue(op1->getFloat() - op2->getFloat());
+	case BinaryOp__Mult:
+		return mkValue(op1->getFloat() * op2->getFloat());
+	case BinaryOp__Div: {
+		ALUFloat divisor = op2->getFloat();
+		if (0.0==divisor) {
+			return mkValue0();
+		}
+		return mkValue(op1->getFloat() / divisor);
+	}
+	case BinaryOp__LT:
+		RETURN_COND(op1->getFloat() < op2->getFloat());
+	case BinaryOp__LE:
+		RETURN_COND(op1->getFloat() <= op2->getFloat());
+	case BinaryOp__GT:
+		RETURN_COND(op1->getFloat() > op2->getFloat());
+	case BinaryOp__GE:
+		RETURN_COND(op1->getFloat() >= op2->getFloat());
+	case BinaryOp__EQ:
+		RETURN_COND(op1->getFloat() == op2->getFloat());
+	case BinaryOp__NE:
+		RETURN_COND(op1->getFloat() != op2->getFloat());
+	default:
+		MYTHROW("Invalid operator for the Float-Float fast path");
+	}
+}
+
+// Both operands are non-numeric strings
+PValue		AluBinaryOperator::computeStrStr(PValue op1, PValue op2)
+{
+	int cmp = op1->getStrPtr()->compare(*op2->getStrPtr());
+	switch (m_op) {
+	case BinaryOp__LT:
+		RETURN_COND(cmp < 0);
+	case BinaryOp__LE:
+		RETURN_COND(cmp <= 0);
+	case BinaryOp__GT:
+		RETURN_COND(cmp > 0);
+	case BinaryOp__GE:
+		RETURN_COND(cmp >= 0);
+	case BinaryOp__EQ:
+		RETURN_COND(cmp == 0);
+	case BinaryOp__NE:
+		RETURN_COND(cmp != 0);
+	default:
+		MYTHROW("Invalid operator for the Str-Str fast path");
+	}
+}
+
 // Simple floating point or integer addition
 PValue		AluBinaryOperator::computeAdd(PValue op1, PValue op2)
 {
@@ -647,6 +845,36 @@ PValue		AluBinaryOperator::computeSLTE(PValue op1, PValue op2)
 	RETURN_COND(op1->getStr().compare(op2->getStr()) <= 0);
 }
 
+void AluShortCircuit::_serialize(std::ostream& os) const
+{
+	os << ((m_op==BinaryOp__AND) ? "&?" : "|?");
+}
+
+std::string AluShortCircuit::_identify()
+{
+	return std::string("JMP(") + ((m_op==BinaryOp__AND) ? "&" : "|") + "," + std::to_string(m_target) + ")";
+}
+
+// NaN does not decide anything, so that it remains contagious as with the
+// binary operator itself
+bool AluShortCircuit::decides(PValue leftOperand)
+{
+	if (counterType__None==leftOperand->getType()) {
+		return false;
+	}
+	return (m_op==BinaryOp__AND) ? !leftOperand->getBool() : leftOperand->getBool();
+}
+
+// The result of the operator when the right-hand operand has been skipped
+PValue AluShortCircuit::evaluate()
+{
+	if (m_op==BinaryOp__AND) {
+		RETURN_FALSE;
+	} else {
+		RETURN_TRUE;
+	}
+}
+
 
 
 #define X(nm,st)	if (s==st) {m_op = AssnOp__##nm; return;}
@@ -838,13 +1066,17 @@ void AluInputRecord::_serialize(std::ostream& os) const
 
 PValue AluInputRecord::evaluate()
 {
+	PValue ret = g_pStateQueryAgent->recordCacheGet(recordCacheFunc__InputRecord, 0, 0);
+	if (ret) {
+		return ret;
+	}
 	PSpecString ps = g_pStateQueryAgent->getFromTo(1,-1);
-	PValue ret;
 	if (ps) {
 		ret = mkValue2(ps->data(), int(ps->length()));
 	} else {
 		ret = mkValue("");
 	}
+	g_pStateQueryAgent->recordCacheSet(recordCacheFunc__InputRecord, 0, 0, ret);
 	return ret;
 }
 
@@ -899,6 +1131,7 @@ AluFunction::AluFunction(std::string& _s)
 
 	mp_Func = nullptr;
 	m_pExternalFunc = nullptr;
+	m_countoccNeedle = -1;
 
 	ALU_FUNCTION_LIST
 #ifdef DEBUG
@@ -909,12 +1142,14 @@ AluFunction::AluFunction(std::string& _s)
 	// Internal function not found - try external unless they're disabled
 	if (EXTERNAL_FUNC_OFF != g_pythonFuncs) {
 		if (!p_gExternalFunctions->IsInitialized()) {
+			const char* prevPhase = g_startupTimer.changePhase("Loading Python functions");
 			try {
 				p_gExternalFunctions->Initialize(getFullSpecPath());
 			} catch (const SpecsException& e) {
 				std::cerr << "Python Interface: " << e.what(!g_bVerbose) << "\n";
 				exit(0);
 			}
+			g_startupTimer.changePhase(prevPhase);
 		}
 		MYASSERT(p_gExternalFunctions->IsInitialized());
 		m_pExternalFunc = p_gExternalFunctions->GetFunctionByName(_s);
@@ -939,6 +1174,42 @@ void AluFunction::_serialize(std::ostream& os) const
 	os << m_FuncName;
 }
 
+bool AluFunction::takesRegexPattern()
+{
+	return mp_Func == (void*)AluFunc_rmatch
+		|| mp_Func == (void*)AluFunc_rsearch
+		|| mp_Func == (void*)AluFunc_rreplace;
+}
+
+void AluFunction::bindRegexPattern(std::string& sExp)
+{
+	MYASSERT(takesRegexPattern());
+	m_pRegex = regexPrecompile(sExp);
+}
+
+bool AluFunction::countsOccurrences()
+{
+	return mp_Func == (void*)AluFunc_countocc;
+}
+
+void AluFunction::bindCountoccNeedle(std::string& sNeedle)
+{
+	MYASSERT(countsOccurrences());
+	m_countoccNeedle = int(countoccRegisterNeedle(sNeedle));
+}
+
+AluStaticType AluFunction::staticType()
+{
+	if (nullptr != m_pExternalFunc) return AST_Unknown;
+#define X(nm) if (#nm==m_FuncName) return AST_Int;
+	ALU_INT_RESULT_FUNCTION_LIST
+#undef X
+#define X(nm) if (#nm==m_FuncName) return AST_Float;
+	ALU_FLOAT_RESULT_FUNCTION_LIST
+#undef X
+	return AST_Unknown;
+}
+
 PValue AluFunction::evaluate()
 {
 	if (0 != countOperands()) return AluUnit::evaluate();
@@ -969,12 +1240,21 @@ PValue AluFunction::compute(PValue op1, PValue op2)
 		m_pExternalFunc->setArgValue(1,op2);
 		return m_pExternalFunc->Call();
 	}
+	if (m_countoccNeedle >= 0) {
+		return AluFunc_countocc_precompiled(op1,size_t(m_countoccNeedle));
+	}
 	return (AluFunc2(mp_Func))(op1,op2);
 }
 
 PValue AluFunction::compute(PValue op1, PValue op2, PValue op3)
 {
 	if (3 != countOperands()) return AluUnit::compute(op1,op2,op3);
+	if (m_pRegex) {
+		if (mp_Func == (void*)AluFunc_rmatch) {
+			return AluFunc_rmatch_precompiled(op1,m_pRegex,op3);
+		}
+		return AluFunc_rsearch_precompiled(op1,m_pRegex,op3);
+	}
 	if (nullptr != m_pExternalFunc) {
 		m_pExternalFunc->ResetArgs();
 		m_pExternalFunc->setArgValue(0,op1);
@@ -988,6 +1268,9 @@ PValue AluFunction::compute(PValue op1, PValue op2, PValue op3)
 PValue AluFunction::compute(PValue op1, PValue op2, PValue op3, PValue op4)
 {
 	if (4 != countOperands()) return AluUnit::compute(op1,op2,op3,op4);
+	if (m_pRegex) {
+		return AluFunc_rreplace_precompiled(op1,m_pRegex,op3,op4);
+	}
 	if (nullptr != m_pExternalFunc) {
 		m_pExternalFunc->ResetArgs();
 		m_pExternalFunc->setArgValue(0,op1);
@@ -1534,6 +1817,158 @@ bool isPseudoFunctionName(std::string& fn)
 	return false;
 }
 
+/*
+ * Function: addShortCircuitJumps
+ * Inserts an AluShortCircuit unit before the right-hand operand of every
+ * & and | operator in an RPN expression, so that evaluateExpression can
+ * skip that operand when the left-hand operand already decides the result.
+ */
+static void addShortCircuitJumps(AluVec& rpn)
+{
+	// First pass: find where each sub-expression begins. For every & and |
+	// note the index of the operator at the start of its right-hand operand.
+	// An operator is never at index zero, so zero means no jump there.
+	std::vector<size_t> operandStarts;
+	std::vector<size_t> jumpOperators(rpn.size(), 0);
+	size_t countJumps = 0;
+	for (size_t i=0; i<rpn.size(); i++) {
+		PUnit pUnit = rpn[i];
+		unsigned int countOperands = pUnit->countOperands();
+		MYASSERT_WITH_MSG(countOperands <= operandStarts.size(), "Not enough operands for operator (5)");
+		if (UT_BinaryOp==pUnit->type()) {
+			auto pBop = std::dynamic_pointer_cast<AluBinaryOperator>(pUnit);
+			if (pBop->isShortCircuit()) {
+				jumpOperators[operandStarts.back()] = i;
+				countJumps++;
+			}
+		}
+		size_t start = i;
+		for (unsigned int j=0; j<countOperands; j++) {
+			start = operandStarts.back();
+			operandStarts.pop_back();
+		}
+		operandStarts.push_back(start);
+	}
+
+	if (0==countJumps) return;
+
+	// Second pass: figure out where each original unit ends up once the jumps
+	// have been inserted, and then build the new expression
+	std::vector<size_t> newIndex(rpn.size());
+	size_t countInserted = 0;
+	for (size_t i=0; i<rpn.size(); i++) {
+		if (jumpOperators[i]) countInserted++;
+		newIndex[i] = i + countInserted;
+	}
+
+	AluVec result;
+	result.reserve(rpn.size() + countJumps);
+	for (size_t i=0; i<rpn.size(); i++) {
+		if (jumpOperators[i]) {
+			size_t opIndex = jumpOperators[i];
+			auto pBop = std::dynamic_pointer_cast<AluBinaryOperator>(rpn[opIndex]);
+			result.push_back(std::make_shared<AluShortCircuit>(pBop->getOp(), newIndex[opIndex]+1));
+		}
+		result.push_back(rpn[i]);
+	}
+	rpn.swap(result);
+}
+
+/*
+ * Function: inferStaticTypes
+ * Follows the RPN expression with a stack of static types, so that the
+ * operators can select a fast path where the types of their operands are
+ * known at compile time.
+ */
+static void inferStaticTypes(AluVec& rpn)
+{
+	std::stack<AluStaticType> typeStack;
+	for (PUnit pUnit : rpn) {
+		switch (pUnit->type()) {
+		case UT_ShortCircuit:
+			// Leaves the left-hand operand, or puts the result of the operator in its place
+			break;
+		case UT_UnaryOp: {
+			MYASSERT(typeStack.size()>=1);
+			auto pUop = std::dynamic_pointer_cast<AluUnitUnaryOperator>(pUnit);
+			AluStaticType t = typeStack.top();
+			typeStack.pop();
+			typeStack.push(pUop->inferType(t));
+			break;
+		}
+		case UT_BinaryOp: {
+			MYASSERT(typeStack.size()>=2);
+			auto pBop = std::dynamic_pointer_cast<AluBinaryOperator>(pUnit);
+			AluStaticType t2 = typeStack.top();
+			typeStack.pop();
+			AluStaticType t1 = typeStack.top();
+			typeStack.pop();
+			typeStack.push(pBop->inferType(t1, t2));
+			break;
+		}
+		default:
+			MYASSERT(typeStack.size() >= pUnit->countOperands());
+			for (unsigned int i=0; i<pUnit->countOperands(); i++) {
+				typeStack.pop();
+			}
+			typeStack.push(pUnit->staticType());
+		}
+	}
+}
+
+/*
+ * When the pattern argument of rmatch, rsearch or rreplace is a literal,
+ * compile it now and bind it to the function rather than looking it up
+ * in the regex cache on every call.
+ *
+ * Likewise, literal needles of countocc on the input record are collected
+ * into one automaton, so the record is scanned once for all of them.
+ */
+static void bindLiteralArguments(AluVec& rpn)
+{
+	std::vector<PUnit> producers;   // the literal or null that pushed each stack entry, or nullptr
+	for (PUnit pUnit : rpn) {
+		switch (pUnit->type()) {
+		case UT_ShortCircuit:
+			break;
+		case UT_UnaryOp:
+			MYASSERT(producers.size()>=1);
+			producers.back() = nullptr;
+			break;
+		case UT_BinaryOp:
+			MYASSERT(producers.size()>=2);
+			producers.pop_back();
+			producers.back() = nullptr;
+			break;
+		default: {
+			unsigned int argc = pUnit->countOperands();
+			MYASSERT(producers.size() >= argc);
+			if (pUnit->type()==UT_Identifier) {
+				auto pFunc = std::dynamic_pointer_cast<AluFunction>(pUnit);
+				if (pFunc && pFunc->takesRegexPattern()) {
+					PUnit pPattern = producers[producers.size() - argc + 1];
+					if (pPattern && pPattern->type()==UT_LiteralNumber) {
+						std::string sExp = pPattern->evaluate()->getStr();
+						pFunc->bindRegexPattern(sExp);
+					}
+				}
+				if (pFunc && pFunc->countsOccurrences() && 2==argc) {
+					PUnit pNeedle = producers[producers.size() - 2];
+					PUnit pHaystack = producers[producers.size() - 1];
+					if (pNeedle && pNeedle->type()==UT_LiteralNumber && pHaystack && pHaystack->type()==UT_Null) {
+						std::string sNeedle = pNeedle->evaluate()->getStr();
+						pFunc->bindCountoccNeedle(sNeedle);
+					}
+				}
+			}
+			producers.resize(producers.size() - argc);
+			bool bTracked = (pUnit->type()==UT_LiteralNumber) || (pUnit->type()==UT_Null);
+			producers.push_back(bTracked ? pUnit : nullptr);
+		}
+		}
+	}
+}
+
 /*
  * Function: convertAluVecToPostfix
  * Implements the Shunting-Yard algorithm to convert an infix expression
@@ -1640,6 +2075,7 @@ bool convertAluVecToPostfix(AluVec& source, AluVec& dest, bool clearSource)
 		case UT_None:
 		case UT_Invalid:
 		case UT_Null:
+		case UT_ShortCircuit:
 			MYTHROW("None or Invalid - internal logic error");
 		case UT_LiteralNumber:
 		case UT_Counter:
@@ -1731,6 +2167,10 @@ bool convertAluVecToPostfix(AluVec& source, AluVec& dest, bool clearSource)
 		dest.push_back(pTopUnit);
 	}
 
+	addShortCircuitJumps(dest);
+	inferStaticTypes(dest);
+	bindLiteralArguments(dest);
+
 	if (clearSource) {
 		while (!source.empty()) {
 			source.erase(source.begin());
@@ -1744,9 +2184,305 @@ bool convertAluVecToPostfix(AluVec& source, AluVec& dest, bool clearSource)
 	return true;
 }
 
-PValue evaluateExpression(AluVec& expr, ALUCounters* pctrs)
+/*
+ * Compiled expressions
+ *
+ * An expression compiled to RPN has one vector for each comma-separated part,
+ * and for an assignment, the counter and the assignment operator. While the
+ * compiled specification cache is being filled, each one is recorded in its
+ * compact form, keyed by its kind and its text. When a cached specification is
+ * loaded, the same map is filled from the cache and the expressions are
+ * rebuilt from it rather than parsed again.
+ */
+struct aluCompiledExpression {
+	aluCompiledExpression() : isAssignment(false), key(0) {}
+	bool                 isAssignment;
+	ALUCounterKey        key;
+	POperator            pAssnOp;
+	std::vector<AluVec>  parts;
+};
+
+#define ALU_COMPILED_EXPRESSION   'E'
+#define ALU_COMPILED_ASSIGNABLE   'A'
+#define ALU_COMPILED_STATEMENT    'S'
+#define ALU_COMPILED_LIST         'L'
+
+static std::unordered_map<std::string,std::string> g_compiledExpressions;
+static bool g_bRecordCompiledExpressions = false;
+
+static std::string aluUnitText(PUnit pUnit)
+{
+	std::ostringstream os;
+	pUnit->_serialize(os);
+	return os.str();
+}
+
+static void writeAluVec(serialWriter& w, AluVec& rpn)
+{
+	w.putInt(rpn.size());
+	for (PUnit pUnit : rpn) {
+		AluUnitType t = pUnit->type();
+		w.putInt(uint64_t(t));
+		switch (t) {
+		case UT_LiteralNumber: {
+			auto pLiteral = std::dynamic_pointer_cast<AluUnitLiteral>(pUnit);
+			w.putString(pLiteral->getLiteral());
+			w.putBool(pLiteral->isNumericHint());
+			break;
+		}
+		case UT_Counter:
+			w.putInt(std::dynamic_pointer_cast<AluUnitCounter>(pUnit)->getKey());
+			break;
+		case UT_FieldIdentifier: {
+			auto pFI = std::dynamic_pointer_cast<AluUnitFieldIdentifier>(pUnit);
+			w.putInt((unsigned char)(pFI->getId()));
+			w.putBool(pFI->evaluatesToName());
+			break;
+		}
+		case UT_UnaryOp:
+		case UT_BinaryOp:
+			w.putString(aluUnitText(pUnit));
+			break;
+		case UT_ShortCircuit: {
+			auto pJump = std::dynamic_pointer_cast<AluShortCircuit>(pUnit);
+			w.putInt(uint64_t(pJump->getOp()));
+			w.putInt(pJump->target());
+			break;
+		}
+		case UT_Identifier: {
+			auto pFunc = std::dynamic_pointer_cast<AluFunction>(pUnit);
+			w.putString(pFunc->getName());
+			w.putInt(pFunc->countOperands());
+			break;
+		}
+		case UT_Null:
+		case UT_InputRecord:
+			break;
+		default:
+			MYTHROW("Unexpected unit in an RPN expression");
+		}
+	}
+}
+
+// Returns false if the saved expression can't be used, for example because a
+// Python function now takes a different number of arguments
+static bool readAluVec(serialReader& r, AluVec& rpn)
+{
+	uint64_t count;
+	if (!r.getInt(count)) return false;
+	for (uint64_t i = 0 ; i < count ; i++) {
+		uint64_t t;
+		if (!r.getInt(t)) return false;
+		switch (AluUnitType(t)) {
+		case UT_LiteralNumber: {
+			std::string s;
+			bool bNumeric;
+			if (!r.getString(s) || !r.getBool(bNumeric)) return false;
+			rpn.push_back(std::make_shared<AluUnitLiteral>(s, bNumeric));
+			break;
+		}
+		case UT_Counter: {
+			uint64_t key;
+			if (!r.getInt(key)) return false;
+			rpn.push_back(std::make_shared<AluUnitCounter>(ALUCounterKey(key)));
+			break;
+		}
+		case UT_FieldIdentifier: {
+			uint64_t id;
+			bool bByName;
+			if (!r.getInt(id) || !r.getBool(bByName)) return false;
+			auto pFI = std::make_shared<AluUnitFieldIdentifier>(char(id));
+			if (bByName) pFI->setEvaluateToName();
+			rpn.push_back(pFI);
+			break;
+		}
+		case UT_UnaryOp:
+		case UT_BinaryOp: {
+			std::string op;
+			if (!r.getString(op)) return false;
+			if (UT_UnaryOp==AluUnitType(t)) {
+				rpn.push_back(std::make_shared<AluUnitUnaryOperator>(op));
+			} else {
+				rpn.push_back(std::make_shared<AluBinaryOperator>(op));
+			}
+			break;
+		}
+		case UT_ShortCircuit: {
+			uint64_t op, target;
+			if (!r.getInt(op) || !r.getInt(target)) return false;
+			rpn.push_back(std::make_shared<AluShortCircuit>(ALU_BinaryOperator(op), size_t(target)));
+			break;
+		}
+		case UT_Identifier: {
+			std::string name;
+			uint64_t argCount;
+			if (!r.getString(name) || !r.getInt(argCount)) return false;
+			auto pFunc = std::make_shared<AluFunction>(name);
+			if (pFunc->countOperands() != argCount) return false;
+			rpn.push_back(pFunc);
+			break;
+		}
+		case UT_Null:
+			rpn.push_back(std::make_shared<AluUnitNull>());
+			break;
+		case UT_InputRecord:
+			rpn.push_back(std::make_shared<AluInputRecord>());
+			break;
+		default:
+			return false;
+		}
+	}
+
+	// The static types select fast paths and literal arguments are bound to
+	// their functions - neither is saved
+	inferStaticTypes(rpn);
+	bindLiteralArguments(rpn);
+	return true;
+}
+
+static bool loadCompiledExpression(char kind, std::string& s, aluCompiledExpression& c)
+{
+	if (g_compiledExpressions.empty()) return false;
+	auto it = g_compiledExpressions.find(kind + s);
+	if (it == g_compiledExpressions.end()) return false;
+
+	serialReader r(it->second);
+	uint64_t key, countParts;
+	if (!r.getBool(c.isAssignment) || !r.getInt(key) || !r.getInt(countParts)) return false;
+	c.key = ALUCounterKey(key);
+	if (c.isAssignment) {
+		std::string op;
+		if (!r.getString(op)) return false;
+		c.pAssnOp = std::make_shared<AluAssnOperator>(op);
+	}
+	c.parts.resize(size_t(countParts));
+	for (AluVec& part : c.parts) {
+		if (!readAluVec(r, part)) return false;
+	}
+	return true;
+}
+
+static void recordCompiledExpression(char kind, std::string& s, aluCompiledExpression& c)
+{
+	if (!g_bRecordCompiledExpressions) return;
+
+	serialWriter w;
+	w.putBool(c.isAssignment);
+	w.putInt(c.key);
+	w.putInt(c.parts.size());
+	if (c.isAssignment) {
+		w.putString(aluUnitText(c.pAssnOp));
+	}
+	for (AluVec& part : c.parts) {
+		writeAluVec(w, part);
+	}
+	g_compiledExpressions[kind + s].swap(w.data());
+}
+
+bool compileAluExpression(std::string& s, AluVec& rpn, ALUCounterKey* pKey, POperator* ppAssnOp)
+{
+	char kind = pKey ? ALU_COMPILED_ASSIGNABLE : ALU_COMPILED_EXPRESSION;
+	aluCompiledExpression c;
+	if (!loadCompiledExpression(kind, s, c)) {
+		c = aluCompiledExpression();
+		AluVec expr;
+		MYASSERT(parseAluExpression(s, expr));
+		if (pKey && expressionIsAssignment(expr)) {
+			auto pCounterUnit = std::dynamic_pointer_cast<AluUnitCounter>(expr[0]);
+			MYASSERT(nullptr != pCounterUnit);
+			c.key = pCounterUnit->getKey();
+			c.pAssnOp = std::dynamic_pointer_cast<AluAssnOperator>(expr[1]);
+			MYASSERT(nullptr != c.pAssnOp);
+			expr.erase(expr.begin(), expr.begin()+2);
+			c.isAssignment = true;
+		}
+		c.parts.resize(1);
+		MYASSERT(convertAluVecToPostfix(expr, c.parts[0], true));
+		recordCompiledExpression(kind, s, c);
+	}
+
+	rpn.swap(c.parts[0]);
+	if (c.isAssignment) {
+		*pKey = c.key;
+		*ppAssnOp = c.pAssnOp;
+	}
+	return c.isAssignment;
+}
+
+void compileAluStatement(std::string& s, ALUCounterKey& k, AluAssnOperator* pAss, AluVec& rpn)
+{
+	aluCompiledExpression c;
+	if (!loadCompiledExpression(ALU_COMPILED_STATEMENT, s, c)) {
+		c = aluCompiledExpression();
+		AluVec expr;
+		AluAssnOperator assnOp;
+		MYASSERT(parseAluStatement(s, c.key, &assnOp, expr));
+		c.pAssnOp = std::make_shared<AluAssnOperator>(assnOp);
+		c.isAssignment = true;
+		c.parts.resize(1);
+		MYASSERT(convertAluVecToPostfix(expr, c.parts[0], true));
+		recordCompiledExpression(ALU_COMPILED_STATEMENT, s, c);
+	}
+
+	k = c.key;
+	*pAss = *c.pAssnOp;
+	rpn.swap(c.parts[0]);
+}
+
+size_t compileAluExpressionList(std::string& s, AluVec** ppRpns, size_t maxParts)
+{
+	aluCompiledExpression c;
+	if (!loadCompiledExpression(ALU_COMPILED_LIST, s, c)) {
+		c = aluCompiledExpression();
+		AluVec expr;
+		MYASSERT(parseAluExpression(s, expr));
+		do {
+			AluVec infixExpression;
+			MYASSERT(c.parts.size() < maxParts);
+			MYASSERT(breakAluVecByComma(expr, infixExpression));
+			c.parts.resize(c.parts.size() + 1);
+			MYASSERT(convertAluVecToPostfix(infixExpression, c.parts.back(), true));
+		} while (!expr.empty());
+		recordCompiledExpression(ALU_COMPILED_LIST, s, c);
+	}
+
+	for (size_t i = 0 ; i < c.parts.size() ; i++) {
+		ppRpns[i]->swap(c.parts[i]);
+	}
+	return c.parts.size();
+}
+
+void aluRecordCompiledExpressions()
+{
+	g_bRecordCompiledExpressions = true;
+}
+
+void aluSaveCompiledExpressions(serialWriter& w)
+{
+	w.putInt(g_compiledExpressions.size());
+	for (auto& entry : g_compiledExpressions) {
+		w.putString(entry.first);
+		w.putString(entry.second);
+	}
+}
+
+bool aluLoadCompiledExpressions(serialReader& r)
+{
+	uint64_t count;
+	if (!r.getInt(count)) return false;
+	std::unordered_map<std::string,std::string> expressions;
+	for (uint64_t i = 0 ; i < count ; i++) {
+		std::string key, value;
+		if (!r.getString(key) || !r.getString(value)) return false;
+		expressions[key].swap(value);
+	}
+	g_compiledExpressions.swap(expressions);
+	return true;
+}
+
+// Runs the units of an RPN expression up to (not including) index end
+static void runExpression(AluVec& expr, size_t end, ALUCounters* pctrs, std::stack<PValue>& computeStack)
 {
-	std::stack<PValue> computeStack;
 	PValue arg1;
 	PValue arg2;
 	PValue arg3;
@@ -1757,19 +2493,30 @@ PValue evaluateExpression(AluVec& expr, ALUCounters* pctrs)
 	if (g_bDebugAluRun) {
 		std::cerr << "\n============= " << __FUNCTION__ << " ==============\n";
 	}
-	int index = 0;
 #endif
 
-	for (PUnit pUnit : expr) {
+	size_t index = 0;
+	while (index < end) {
+		PUnit pUnit = expr[index];
 #ifdef ALU_DUMP
 		if (g_bDebugAluRun) {
-			dumpAluVec("Expression Progress", expr, index);
+			dumpAluVec("Expression Progress", expr, int(index));
 			dumpAluStack("Execution Stack", computeStack);
 			std::cerr << std::endl << std::endl;
 		}
-		index++;
 #endif
+		index++;
 		switch (pUnit->type()) {
+		case UT_ShortCircuit: {
+			MYASSERT(computeStack.size()>=1);
+			auto pJump = std::dynamic_pointer_cast<AluShortCircuit>(pUnit);
+			if (pJump->decides(computeStack.top())) {
+				computeStack.pop();
+				computeStack.push(pJump->evaluate());
+				index = pJump->target();
+			}
+			break;
+		}
 		case UT_LiteralNumber:
 		case UT_FieldIdentifier:
 		case UT_InputRecord:
@@ -1873,6 +2620,12 @@ PValue evaluateExpression(AluVec& expr, ALUCounters* pctrs)
 			}
 		}
 	}
+}
+
+PValue evaluateExpression(AluVec& expr, ALUCounters* pctrs)
+{
+	std::stack<PValue> computeStack;
+	runExpression(expr, expr.size(), pctrs, computeStack);
 
 	MYASSERT(computeStack.size() == 1);
 #ifdef ALU_DUMP
@@ -1885,6 +2638,32 @@ PValue evaluateExpression(AluVec& expr, ALUCounters* pctrs)
 	return ret;
 }
 
+PExternalFunctionRec expressionExternalCall(AluVec& expr)
+{
+	if (expr.empty() || UT_Identifier != expr.back()->type()) {
+		return nullptr;
+	}
+	auto pFunc = std::dynamic_pointer_cast<AluFunction>(expr.back());
+	if (!pFunc) {
+		return nullptr;
+	}
+	return pFunc->getExternalFunction();
+}
+
+void evaluateCallArguments(AluVec& expr, ALUCounters* pctrs, std::vector<PValue>& args)
+{
+	MYASSERT(!expr.empty());
+	std::stack<PValue> computeStack;
+	runExpression(expr, expr.size() - 1, pctrs, computeStack);
+
+	MYASSERT(computeStack.size() == expr.back()->countOperands());
+	args.resize(computeStack.size());
+	for (size_t i = args.size() ; i > 0 ; i--) {
+		args[i-1] = computeStack.top();
+		computeStack.pop();
+	}
+}
+
 void ALUPerformAssignment(ALUCounterKey& k, POperator pAss, AluVec& expr, ALUCounters* pctrs)
 {
 	PValue exprResult = evaluateExpression(expr, pctrs);
@@ -1932,6 +2711,9 @@ void AluValueStats::initialize()
 	m_maxFloat = 0.0;
 	m_runningAverage = 0.0;
 	m_runningSn = 0.0;
+	if (ALUFUNC_QUANTILE & AluFunction::functionTypes()) {
+		m_pDigest = std::make_shared<tDigest>();
+	}
 }
 
 AluValueStats::AluValueStats()
@@ -1979,6 +2761,10 @@ void AluValueStats::AddValue(char id)
 			m_runningSn += (diffFromPreviousAverage * (value - m_runningAverage));
 		}
 
+		if (m_pDigest) {
+			m_pDigest->add(double(value));
+		}
+
 		if (type != counterType__Float) break;
 		m_floatCount++;
 		if (1 == m_floatCount) {
@@ -2115,6 +2901,15 @@ PValue AluValueStats::stderrmean()
 	return mkValue(std::sqrt(m_runningSn / m_totalCount) / (m_totalCount-1));
 }
 
+PValue AluValueStats::quantile(ALUFloat q)
+{
+	if (m_totalCount==0 || !m_pDigest) {
+		return mkValue0(); /* returns NaN */
+	}
+
+	return mkValue(ALUFloat(m_pDigest->quantile(double(q))));
+}
+
 std::ostream& operator<< (std::ostream& os, const ALUValue &c)
 {
 	os << c.getStr();
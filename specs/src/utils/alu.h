@@ -9,6 +9,9 @@
 #include "utils/platform.h"
 #include "utils/PythonIntf.h"
 #include "utils/aluValue.h"
+#include "utils/aluRegex.h"
+#include "utils/tDigest.h"
+#include "utils/serialBuffer.h"
 
 std::ostream& operator<< (std::ostream& os, const ALUValue &c);
 
@@ -35,6 +38,7 @@ public:
 	bool         	isWholeNumber(ALUCounterKey i) {return m_map[i].isWholeNumber();}
 	bool          	isNumeric(ALUCounterKey i) {return m_map[i].isNumeric();}
 	void            clearAll() { m_map.clear(); }
+	void            swap(ALUCounters& other) { m_map.swap(other.m_map); }
 private:
 	std::map<ALUCounterKey, ALUValue> m_map;
 };
@@ -93,10 +97,30 @@ enum AluUnitType {
 	UT_AssignmentOp,
 	UT_InputRecord,
 	UT_Null,
+	UT_ShortCircuit,
 };
 
 unsigned int getCountOperands(AluUnitType t);
 
+// What is known at compile time about the type of a value on the ALU stack.
+// Regardless of the static type, a value may always turn out to be NaN.
+enum AluStaticType {
+	AST_Unknown,
+	AST_Int,        // counterType__Int
+	AST_Float,      // counterType__Float
+	AST_Numeric,    // either counterType__Int or counterType__Float
+	AST_Str,        // counterType__Str with a non-numeric value
+};
+
+// Specialized variants of the binary operators, selected at compile time
+// according to the static types of the operands
+enum AluFastPath {
+	AluFastPath__None,
+	AluFastPath__IntInt,
+	AluFastPath__FloatFloat,
+	AluFastPath__StrStr,
+};
+
 // This abstract class represents anything in an expression - a number, a counter,
 // a field identifier, an operation
 class AluUnit {
@@ -114,18 +138,22 @@ public:
 	virtual PValue		compute(PValue op1, PValue op2, PValue op3, PValue op4);
 	virtual PValue		compute(PValue op1, PValue op2, PValue op3, PValue op4, PValue op5);
 	virtual bool            requiresRead() {return false;} // true if this unit requires lines to be read
+	virtual AluStaticType   staticType() {return AST_Unknown;}
 };
 
 typedef std::shared_ptr<AluUnit> PUnit;
 
 class AluUnitLiteral : public AluUnit {
 public:
-	AluUnitLiteral(std::string& s, bool hintNumerical=false):m_literal(s),m_hintNumerical(hintNumerical)	{}
+	AluUnitLiteral(std::string& s, bool hintNumerical=false);
 	virtual ~AluUnitLiteral()					{}
 	virtual void				_serialize(std::ostream& os) const;
 	virtual std::string			_identify();
 	virtual AluUnitType			type()			{return UT_LiteralNumber;}
 	virtual PValue			evaluate();
+	virtual AluStaticType		staticType();
+	std::string					getLiteral() const	{return m_literal.getStr();}
+	bool						isNumericHint() const	{return m_hintNumerical;}
 private:
 	ALUValue	m_literal;
 	bool        m_hintNumerical;
@@ -172,6 +200,8 @@ public:
 	virtual AluUnitType			type()			{return UT_FieldIdentifier;}
 	virtual PValue			evaluate();
 	void                        setEvaluateToName()  {m_ReturnIdentifier = true;}
+	char                        getId()              {return m_id;}
+	bool                        evaluatesToName()    {return m_ReturnIdentifier;}
 private:
 	char         m_id;
 	bool         m_ReturnIdentifier;
@@ -194,6 +224,7 @@ public:
 	virtual std::string		_identify();
 	virtual AluUnitType		type()			{return UT_UnaryOp;}
 	virtual PValue		compute(PValue operand);
+	AluStaticType			inferType(AluStaticType operandType);
 private:
 	void               setOpByName(std::string& s);
 	ALU_UOP_LIST
@@ -219,14 +250,40 @@ public:
 	virtual AluUnitType		type()			{return UT_BinaryOp;}
 	virtual PValue		compute(PValue op1, PValue op2);
 	unsigned int			priority()	{return m_priority;}
+	bool					isShortCircuit() {return m_op==BinaryOp__AND || m_op==BinaryOp__OR;}
+	ALU_BinaryOperator		getOp()		{return m_op;}
+	AluStaticType			inferType(AluStaticType op1Type, AluStaticType op2Type);
 private:
 	void				setOpByName(std::string& s);
+	PValue				computeIntInt(PValue op1, PValue op2);
+	PValue				computeFloatFloat(PValue op1, PValue op2);
+	PValue				computeStrStr(PValue op1, PValue op2);
 	unsigned int		m_priority;
 	ALU_BOP_LIST
 	ALU_BinaryOperator  m_op;
+	AluFastPath         m_fastPath;
 };
 #undef X
 
+// A conditional jump that precedes the right-hand operand of the & and |
+// operators in an RPN expression. When the left-hand operand already decides
+// the result, evaluation continues at m_target, just past the operator.
+class AluShortCircuit : public AluUnit {
+public:
+	AluShortCircuit(ALU_BinaryOperator op, size_t target):m_op(op),m_target(target) {}
+	virtual ~AluShortCircuit()			{}
+	virtual void			_serialize(std::ostream& os) const;
+	virtual std::string		_identify();
+	virtual AluUnitType		type()			{return UT_ShortCircuit;}
+	virtual PValue		evaluate();
+	bool					decides(PValue leftOperand);
+	ALU_BinaryOperator		getOp()			{return m_op;}
+	size_t					target()		{return m_target;}
+private:
+	ALU_BinaryOperator  m_op;
+	size_t              m_target;
+};
+
 #define X(nm,str) AssnOp__##nm,
 enum ALU_AssignmentOperator {
 	ALU_ASSOP_LIST
@@ -269,8 +326,14 @@ public:
 	virtual PValue			compute(PValue op1, PValue op2, PValue op3, PValue op4);
 	virtual PValue			compute(PValue op1, PValue op2, PValue op3, PValue op4, PValue op5);
 	virtual bool                requiresRead()  { return m_reliesOnInput; }
+	virtual AluStaticType       staticType();
 	std::string&                getName()       { return m_FuncName; }
+	PExternalFunctionRec        getExternalFunction() { return m_pExternalFunc; }
 	static unsigned char        functionTypes() { return m_flags; }
+	bool                        takesRegexPattern();
+	void                        bindRegexPattern(std::string& sExp);
+	bool                        countsOccurrences();
+	void                        bindCountoccNeedle(std::string& sNeedle);
 private:
 	// m_flags is static because it's a bitstring that describes all of the functions
 	// used in a particular specification.
@@ -280,6 +343,8 @@ private:
 	unsigned int	     m_ArgCount;
 	bool                 m_reliesOnInput;
 	PExternalFunctionRec m_pExternalFunc;
+	PPrecompiledRegex    m_pRegex;   // for a regex function whose pattern is a literal
+	int                  m_countoccNeedle;  // for countocc with a literal needle in the input record
 };
 
 class AluInputRecord : public AluUnit {
@@ -326,6 +391,7 @@ public:
 	PValue    variance();
 	PValue    stddev();
 	PValue    stderrmean();
+	PValue    quantile(ALUFloat q);
 
 private:
 	void         initialize();
@@ -340,6 +406,7 @@ private:
 	ALUFloat     m_maxFloat;
 	ALUFloat     m_runningAverage;
 	ALUFloat     m_runningSn;  // Sn is the variance multiplied by n
+	PTDigest     m_pDigest;    // only if quantiles are requested
 };
 
 typedef std::shared_ptr<AluValueStats> PAluValueStats;
@@ -364,8 +431,32 @@ bool convertAluVecToPostfix(AluVec& source, AluVec& dest, bool clearSource);
 
 bool breakAluVecByComma(AluVec& source, AluVec& dest);
 
+// Parses an expression and converts it to RPN. If pKey is set and the expression
+// begins with an assignment to a counter, the counter and the assignment operator
+// are returned separately, and so is true.
+bool compileAluExpression(std::string& s, AluVec& rpn, ALUCounterKey* pKey = nullptr, POperator* ppAssnOp = nullptr);
+
+// The same for a statement, which must be an assignment to a counter
+void compileAluStatement(std::string& s, ALUCounterKey& k, AluAssnOperator* pAss, AluVec& rpn);
+
+// Up to maxParts comma-separated expressions, each converted to RPN into *ppRpns[i].
+// Returns the number of parts.
+size_t compileAluExpressionList(std::string& s, AluVec** ppRpns, size_t maxParts);
+
+// The compiled specification cache saves the expressions that were compiled, and
+// loads them so that the same text is not parsed again
+void aluRecordCompiledExpressions();
+void aluSaveCompiledExpressions(serialWriter& w);
+bool aluLoadCompiledExpressions(serialReader& r);
+
 PValue evaluateExpression(AluVec& expr, ALUCounters* pctrs);
 
+// For an expression that is a single call to an external function: the function, or nullptr
+PExternalFunctionRec expressionExternalCall(AluVec& expr);
+
+// Evaluates the arguments of that call without making it
+void evaluateCallArguments(AluVec& expr, ALUCounters* pctrs, std::vector<PValue>& args);
+
 void ALUPerformAssignment(ALUCounterKey& k, POperator pAss, AluVec& expr, ALUCounters* pctrs);
 
 bool AluExpressionReadsLines(AluVec& vec);
@@ -3,6 +3,8 @@
 #include "utils/TimeUtils.h"
 #include "utils/aluRand.h"
 #include "utils/aluRegex.h"
+#include "utils/ahoCorasick.h"
+#include "utils/lookupTable.h"
 #include "processing/Config.h"
 #include "processing/persistent.h"
 #include "processing/ProcessingState.h"
@@ -10,6 +12,8 @@
 #include <cmath>
 #include <functional>
 #include <set>
+#include <map>
+#include <fstream>
 #include <sstream>
 #include <iomanip>
 #include <algorithm> // for std::reverse
@@ -67,8 +71,14 @@ static void throw_argument_issue(const char* _funcName, unsigned int argIdx, con
 {
 	std::string err(_funcName);
 
-	// Remove the AluFunc_ prefix
-	err = err.substr(8) + ": " + message;
+	// Remove the AluFunc_ prefix, and the suffix of the precompiled variants
+	err = err.substr(8);
+	static const std::string precompiledSuffix = "_precompiled";
+	if (err.length() > precompiledSuffix.length() &&
+			0==err.compare(err.length()-precompiledSuffix.length(), std::string::npos, precompiledSuffix)) {
+		err.erase(err.length()-precompiledSuffix.length());
+	}
+	err = err + ": " + message;
 
 	if (argIdx>0) {
 		err += ": #" + std::to_string(argIdx);
@@ -91,6 +101,19 @@ static void throw_argument_issue(const char* _funcName, unsigned int argIdx, con
 #define THROW_ARG_ISSUE(idx,name,msg)       \
 		throw_argument_issue(__func__,idx,#name,msg.c_str());
 
+/*
+ * Per-record memoization: the first call for a given (function, args) stores
+ * its result with the state query agent, which drops it when the record changes.
+ */
+#define RETURN_IF_RECORD_CACHED(func,arg1,arg2)    \
+	PValue pCached = g_pStateQueryAgent->recordCacheGet(recordCacheFunc__##func, arg1, arg2); \
+	if (pCached) return pCached;
+
+#define RETURN_AND_RECORD_CACHE(func,arg1,arg2,val)    \
+	PValue pRet = (val);   \
+	g_pStateQueryAgent->recordCacheSet(recordCacheFunc__##func, arg1, arg2, pRet); \
+	return pRet;
+
 #define ARG_INT_WITH_DEFAULT(arg,def)       \
 		((nullptr == (arg)) ? def : (arg)->getInt())
 
@@ -406,7 +429,8 @@ PValue AluFunc_wordcount(PValue pStr, PValue pSep)
 	ASSERT_ARG_OR_RECORD(pStr,1,string);
 
 	if (!pStr && !pSep) {
-		return mkValue(ALUInt(g_pStateQueryAgent->getWordCount()));
+		RETURN_IF_RECORD_CACHED(WordCount, 0, 0);
+		RETURN_AND_RECORD_CACHE(WordCount, 0, 0, mkValue(ALUInt(g_pStateQueryAgent->getWordCount())));
 	}
 
 	std::string sep;
@@ -435,7 +459,8 @@ PValue AluFunc_fieldcount(PValue pStr, PValue pSep)
 	ASSERT_ARG_OR_RECORD(pStr,1,string);
 
 	if (!pStr && !pSep) {
-		return mkValue(ALUInt(g_pStateQueryAgent->getFieldCount()));
+		RETURN_IF_RECORD_CACHED(FieldCount, 0, 0);
+		RETURN_AND_RECORD_CACHE(FieldCount, 0, 0, mkValue(ALUInt(g_pStateQueryAgent->getFieldCount())));
 	}
 
 	std::string sep;
@@ -473,50 +498,56 @@ static PValue AluFunc_range(ALUInt start, ALUInt end)
 
 PValue AluFunc_record()
 {
-	return AluFunc_range(1,-1);
+	RETURN_IF_RECORD_CACHED(Range, 1, -1);
+	RETURN_AND_RECORD_CACHE(Range, 1, -1, AluFunc_range(1,-1));
 }
 
 PValue AluFunc_range(PValue pStart, PValue pEnd)
 {
 	ALUInt start = ARG_INT_WITH_DEFAULT(pStart,1);
 	ALUInt end = ARG_INT_WITH_DEFAULT(pEnd, -1);
-	return AluFunc_range(start, end);
+	RETURN_IF_RECORD_CACHED(Range, start, end);
+	RETURN_AND_RECORD_CACHE(Range, start, end, AluFunc_range(start, end));
 }
 
 PValue AluFunc_word(PValue pIdx)
 {
 	ASSERT_NOT_ELIDED(pIdx,1,index);
 	ALUInt idx = pIdx->getInt();
+	RETURN_IF_RECORD_CACHED(Word, idx, 0);
 	ALUInt start = g_pStateQueryAgent->getWordStart(idx);
 	ALUInt end = g_pStateQueryAgent->getWordEnd(idx);
-	return AluFunc_range(start, end);
+	RETURN_AND_RECORD_CACHE(Word, idx, 0, AluFunc_range(start, end));
 }
 
 PValue AluFunc_field(PValue pIdx)
 {
 	ASSERT_NOT_ELIDED(pIdx,1,index);
 	ALUInt idx = pIdx->getInt();
+	RETURN_IF_RECORD_CACHED(Field, idx, 0);
 	ALUInt start = g_pStateQueryAgent->getFieldStart(idx);
 	ALUInt end = g_pStateQueryAgent->getFieldEnd(idx);
-	return AluFunc_range(start, end);
+	RETURN_AND_RECORD_CACHE(Field, idx, 0, AluFunc_range(start, end));
 }
 
 PValue AluFunc_wordrange(PValue pStart, PValue pEnd)
 {
 	ALUInt startIdx = ARG_INT_WITH_DEFAULT(pStart, 1);
 	ALUInt endIdx = ARG_INT_WITH_DEFAULT(pEnd, -1);
+	RETURN_IF_RECORD_CACHED(WordRange, startIdx, endIdx);
 	ALUInt start = g_pStateQueryAgent->getWordStart(startIdx);
 	ALUInt end = g_pStateQueryAgent->getWordEnd(endIdx);
-	return AluFunc_range(start, end);
+	RETURN_AND_RECORD_CACHE(WordRange, startIdx, endIdx, AluFunc_range(start, end));
 }
 
 PValue AluFunc_fieldrange(PValue pStart, PValue pEnd)
 {
 	ALUInt startIdx = ARG_INT_WITH_DEFAULT(pStart, 1);
 	ALUInt endIdx = ARG_INT_WITH_DEFAULT(pEnd, -1);
+	RETURN_IF_RECORD_CACHED(FieldRange, startIdx, endIdx);
 	ALUInt start = g_pStateQueryAgent->getFieldStart(startIdx);
 	ALUInt end = g_pStateQueryAgent->getFieldEnd(endIdx);
-	return AluFunc_range(start, end);
+	RETURN_AND_RECORD_CACHE(FieldRange, startIdx, endIdx, AluFunc_range(start, end));
 }
 
 PValue AluFunc_fieldindex(PValue pIdx)
@@ -563,7 +594,7 @@ PValue AluFunc_tf2mcs(PValue pTimeFormatted, PValue pFormat)
 {
 	ASSERT_NOT_ELIDED(pTimeFormatted,1,formatted_time);
 	ASSERT_NOT_ELIDED(pFormat,2,format);
-	int64_t tm = specTimeConvertFromPrintable(pTimeFormatted->getStr(), pFormat->getStr());
+	int64_t tm = specTimeGetFormat(pFormat->getStr()).parse(pTimeFormatted->getStr());
 	return mkValue(ALUInt(tm));
 }
 
@@ -572,16 +603,16 @@ PValue AluFunc_mcs2tf(PValue pValue, PValue pFormat)
 	ASSERT_NOT_ELIDED(pValue,1,time_value);
 	ASSERT_NOT_ELIDED(pFormat,2,format);
 	int64_t microseconds = pValue->getInt();
-	PSpecString printable = specTimeConvertToPrintable(microseconds, pFormat->getStr());
-	PValue ret = mkValue2(printable->data(), int(printable->length()));
-	return ret;
+	std::string printable;
+	specTimeGetFormat(pFormat->getStr()).format(microseconds, printable);
+	return mkValue(printable);
 }
 
 PValue AluFunc_tf2s(PValue pTimeFormatted, PValue pFormat)
 {
 	ASSERT_NOT_ELIDED(pTimeFormatted,1,formatted_time);
 	ASSERT_NOT_ELIDED(pFormat,2,format);
-	int64_t tm = specTimeConvertFromPrintable(pTimeFormatted->getStr(), pFormat->getStr());
+	int64_t tm = specTimeGetFormat(pFormat->getStr()).parse(pTimeFormatted->getStr());
         ALUFloat seconds = (tm/MICROSECONDS_PER_SECOND);
         ALUFloat microseconds = (ALUFloat)(tm%MICROSECONDS_PER_SECOND)/MICROSECONDS_PER_SECOND;
         return mkValue(ALUFloat(seconds+microseconds));
@@ -593,9 +624,9 @@ PValue AluFunc_s2tf(PValue pValue, PValue pFormat)
 	ASSERT_NOT_ELIDED(pFormat,2,format);
         ALUFloat seconds = pValue->getFloat();
         int64_t microseconds = seconds * MICROSECONDS_PER_SECOND;
-	PSpecString printable = specTimeConvertToPrintable(microseconds, pFormat->getStr());
-	PValue ret = mkValue2(printable->data(), int(printable->length()));
-	return ret;
+	std::string printable;
+	specTimeGetFormat(pFormat->getStr()).format(microseconds, printable);
+	return mkValue(printable);
 }
 
 
@@ -875,6 +906,17 @@ PValue AluFunc_rmatch(PValue _pHaystack, PValue _pExp, PValue _pFlags)
 	return mkValue(ALUInt(regexMatch(pHaystack, _pExp)));
 }
 
+PValue AluFunc_rmatch_precompiled(PValue _pHaystack, PPrecompiledRegex pExp, PValue _pFlags)
+{
+	ASSERT_ARG_OR_RECORD(_pHaystack,1,haystack);
+	std::string* pHaystack = (_pHaystack) ? _pHaystack->getStrPtr() : g_pStateQueryAgent->currRecord().get();
+
+	if (_pFlags) {
+		return mkValue(ALUInt(regexMatch(pHaystack, pExp, _pFlags->getStrPtr())));
+	}
+	return mkValue(ALUInt(regexMatch(pHaystack, pExp)));
+}
+
 PValue AluFunc_rsearch(PValue _pHaystack, PValue _pExp, PValue _pFlags)
 {
 	ASSERT_NOT_ELIDED(_pExp,2,regExp);
@@ -887,6 +929,17 @@ PValue AluFunc_rsearch(PValue _pHaystack, PValue _pExp, PValue _pFlags)
 	return mkValue(ALUInt(regexSearch(pHaystack, _pExp)));
 }
 
+PValue AluFunc_rsearch_precompiled(PValue _pHaystack, PPrecompiledRegex pExp, PValue _pFlags)
+{
+	ASSERT_ARG_OR_RECORD(_pHaystack,1,haystack);
+	std::string* pHaystack = (_pHaystack) ? _pHaystack->getStrPtr() : g_pStateQueryAgent->currRecord().get();
+
+	if (_pFlags) {
+		return mkValue(ALUInt(regexSearch(pHaystack, pExp, _pFlags->getStrPtr())));
+	}
+	return mkValue(ALUInt(regexSearch(pHaystack, pExp)));
+}
+
 PValue AluFunc_rreplace(PValue _pHaystack, PValue _pExp, PValue _pFmt, PValue _pFlags)
 {
 	ASSERT_ARG_OR_RECORD(_pHaystack,1,haystack);	
@@ -902,6 +955,20 @@ PValue AluFunc_rreplace(PValue _pHaystack, PValue _pExp, PValue _pFmt, PValue _p
 	return mkValue(regexReplace(pHaystack, _pExp, sFmt));
 }
 
+PValue AluFunc_rreplace_precompiled(PValue _pHaystack, PPrecompiledRegex pExp, PValue _pFmt, PValue _pFlags)
+{
+	ASSERT_ARG_OR_RECORD(_pHaystack,1,haystack);
+	ASSERT_NOT_ELIDED(_pFmt,3,format);
+
+	std::string* pHaystack = (_pHaystack) ? _pHaystack->getStrPtr() : g_pStateQueryAgent->currRecord().get();
+	std::string sFmt = _pFmt->getStr();
+
+	if (_pFlags) {
+		return mkValue(regexReplace(pHaystack, pExp, sFmt, _pFlags->getStrPtr()));
+	}
+	return mkValue(regexReplace(pHaystack, pExp, sFmt));
+}
+
 PValue AluFunc_conf(PValue _pKey, PValue _pDefault)
 {
 	ASSERT_NOT_ELIDED(_pKey,1,key);
@@ -1085,6 +1152,30 @@ PValue AluFunc_stderrmean(PValue _pFieldIdentifier)
 	return pVStats->stderrmean();
 }
 
+PValue AluFunc_median(PValue _pFieldIdentifier)
+{
+	ASSERT_NOT_ELIDED(_pFieldIdentifier,1,fieldIdentifier);
+	char fId = (char)(_pFieldIdentifier->getInt());
+	PAluValueStats pVStats = g_pStateQueryAgent->valueStatistics(fId);
+	MYASSERT_WITH_MSG(pVStats!=nullptr, "MEDIAN requested for undefined field identifier")
+	return pVStats->quantile(0.5);
+}
+
+PValue AluFunc_percentile(PValue _pFieldIdentifier, PValue pPct)
+{
+	ASSERT_NOT_ELIDED(_pFieldIdentifier,1,fieldIdentifier);
+	ASSERT_NOT_ELIDED(pPct,2,p);
+	char fId = (char)(_pFieldIdentifier->getInt());
+	PAluValueStats pVStats = g_pStateQueryAgent->valueStatistics(fId);
+	MYASSERT_WITH_MSG(pVStats!=nullptr, "PERCENTILE requested for undefined field identifier")
+	ALUFloat pct = pPct->getFloat();
+	if (pct < 0 || pct > PERCENTS) {
+		std::string err = "Invalid percentile: " + pPct->getStr() + ". Must be between 0 and 100.";
+		MYTHROW(err);
+	}
+	return pVStats->quantile(pct / PERCENTS);
+}
+
 PValue AluFunc_rand(PValue pLimit)
 {
 	if (pLimit) {
@@ -1274,25 +1365,23 @@ PValue AluFunc_permutations(PValue pN, PValue pK)
  * FREQUENCY MAP - CLASS AND ALU FUNCTIONS
  */
 
-static std::string quotedString(const std::string& s)
+static void appendQuoted(std::string& out, std::string_view s)
 {
-	std::string ret = "\"";
+	out += '"';
 	for (auto& c : s) {
 		switch (c) {
-		case '"': ret += '"';  // double the double-quote
+		case '"': out += '"';  // double the double-quote
 		// intentional fall-through
 		default:
-			ret += c;
+			out += c;
 		}
 	}
-	ret += '"';
-
-	return ret;
+	out += '"';
 }
 
-static std::string convertToCsv(const std::string& s)
+static void appendCsv(std::string& out, std::string_view s)
 {
-	/* if s contains neither a comma nor a double-quote nor a non-printable, just return s */
+	/* if s contains neither a comma nor a double-quote nor a non-printable, just append s */
 	bool bNeedsQuoting = false;
 	for (auto& c : s) {
 		if (c==',' || c=='"' || (c<' ' && c>0)) {
@@ -1301,84 +1390,213 @@ static std::string convertToCsv(const std::string& s)
 		}
 	}
 
-	if (!bNeedsQuoting) return s;
+	if (!bNeedsQuoting) {
+		out.append(s.data(), s.size());
+		return;
+	}
 
 	/* OK, we need to quote this... */
-	return quotedString(s);
+	appendQuoted(out, s);
 }
 
-void frequencyMap::note(std::string& s)
+// Appends s padded with blanks to the width, like std::setw
+static void appendPadded(std::string& out, std::string_view s, int width, bool bLeft)
 {
-	map[s]++;
+	size_t pad = (int(s.size()) < width) ? size_t(width) - s.size() : 0;
+	if (!bLeft) out.append(pad, ' ');
+	out.append(s.data(), s.size());
+	if (bLeft) out.append(pad, ' ');
+}
+
+static void appendFloat(std::string& out, const char* fmt, ALUFloat f)
+{
+	char buf[128];
+	int len = snprintf(buf, sizeof(buf), fmt, f);
+	if (len > 0) {
+		out.append(buf, std::min(size_t(len), sizeof(buf)-1));
+	}
+}
+
+frequencyMap::frequencyMap(size_t approxCapacity)
+{
+	counter = 0;
+	pDistinct = std::unique_ptr<hyperLogLog>(new hyperLogLog());
+	pTop = std::unique_ptr<spaceSaving>(new spaceSaving(approxCapacity));
+}
+
+void frequencyMap::note(std::string_view s)
+{
+	if (pTop) {
+		pDistinct->add(std::hash<std::string_view>{}(s));
+		pTop->add(s);
+	} else {
+		map.add(s);
+	}
 	counter++;
 }
 
+ALUInt frequencyMap::nelem()
+{
+	return pDistinct ? pDistinct->estimate() : ALUInt(map.distinct());
+}
+
+ALUInt frequencyMap::operator[](std::string_view s)
+{
+	if (pTop) {
+		const spaceSaving::counter* pCounter = pTop->find(s);
+		return pCounter ? pCounter->count : 0;
+	}
+	return map.countOf(s);
+}
+
 std::string frequencyMap::mostCommon()
 {
 	ALUInt max = 0;
-	std::string ret = "";
-	for (freqMapPair& kv : map) {
-		if (kv.second > max) {
-			ret = kv.first;
-			max = kv.second;
+	std::string_view ret = "";
+	if (pTop) {
+		for (auto& c : pTop->counters()) {
+			if (c.count > max) {
+				ret = c.key;
+				max = c.count;
+			}
 		}
+		return std::string(ret);
 	}
-	return ret;
+	std::string sRet;
+	map.forEach([&](std::string_view key, ALUInt count) {
+		if (count > max) {
+			sRet.assign(key.data(), key.size());
+			max = count;
+		}
+		return true;
+	});
+	return sRet;
 }
 
 std::string frequencyMap::leastCommon()
 {
+	if (pTop) {
+		MYTHROW("The rarest value is not available for an approximate frequency map");
+	}
+
 	ALUInt min = 0;
-	std::string ret = "";
-	for (freqMapPair& kv : map) {
-		if ((min == 0) || (kv.second < min)) {
-			ret = kv.first;
-			if (kv.second == 1) { // it doesn't get any rarer that this
-				return ret;
+	std::string ret;
+	map.forEach([&](std::string_view key, ALUInt count) {
+		if ((min == 0) || (count < min)) {
+			ret.assign(key.data(), key.size());
+			if (count == 1) { // it doesn't get any rarer that this
+				return false;
 			}
-			min = kv.second;
+			min = count;
 		}
-	}
+		return true;
+	});
 	return ret;
 }
 
-std::string frequencyMap::dump(fmap_format f, fmap_sortOrder o, bool includePercentage)
+/*
+ * Sorts the entries, or with a limit selects and sorts only the first ones.
+ * The comparator is a template parameter so that it can be inlined.
+ */
+template <class Comparator>
+static void sortFrequencies(std::vector<freqMapPair>& v, size_t limit, Comparator comp)
 {
-	typedef std::function<bool(freqMapPair, freqMapPair)> Comparator;
+	if (limit > 0 && limit < v.size()) {
+		std::partial_sort(v.begin(), v.begin() + limit, v.end(), comp);
+		v.resize(limit);
+	} else {
+		std::sort(v.begin(), v.end(), comp);
+	}
+}
 
-	Comparator compFunctor;
+// Sorts the entries in the requested order, keeping only the first 'limit' if it's not zero
+static void selectFrequencies(std::vector<freqMapPair>& v, size_t limit, fmap_sortOrder o)
+{
 	switch (o) {
 	case fmap_sortOrder__byStringAscending:
-		compFunctor = [](freqMapPair e1, freqMapPair e2) {
+		sortFrequencies(v, limit, [](const freqMapPair& e1, const freqMapPair& e2) {
 			return e1.first < e2.first;
-		};
+		});
 		break;
 	case fmap_sortOrder__byStringDescending:
-		compFunctor = [](freqMapPair e1, freqMapPair e2) {
+		sortFrequencies(v, limit, [](const freqMapPair& e1, const freqMapPair& e2) {
 			return e1.first > e2.first;
-		};
+		});
 		break;
 	case fmap_sortOrder__byCountAscending:
-		compFunctor = [](freqMapPair e1, freqMapPair e2) {
+		sortFrequencies(v, limit, [](const freqMapPair& e1, const freqMapPair& e2) {
 			return (e1.second == e2.second)
 					? e1.first < e2.first
 					: e1.second < e2.second;
-		};
+		});
 		break;
 	case fmap_sortOrder__byCountDescending:
-		compFunctor = [](freqMapPair e1, freqMapPair e2) {
+		sortFrequencies(v, limit, [](const freqMapPair& e1, const freqMapPair& e2) {
 			return (e1.second == e2.second)
 					? e1.first > e2.first
 					: e1.second > e2.second;
-		};
+		});
 		break;
 	}
+}
+
+std::string frequencyMap::dump(fmap_format f, fmap_sortOrder o, bool includePercentage, size_t limit)
+{
+	// Handle empty dataset
+	if (0 == counter) {
+		static std::string varname("EmptyFrequencyMapMessage");
+
+		if (configSpecLiteralExists(varname)) {
+			return configSpecLiteralGet(varname);
+		} else {
+			return std::string();
+		}
+	}
+
+	// The keys are unique, so sorting a vector of views gives the same order as a set
+	std::vector<freqMapPair> setOfFreqs;
+	countTable kept;
+	ALUInt sumFreq = 0;
+	if (pTop) {
+		setOfFreqs.reserve(pTop->counters().size());
+		for (auto& c : pTop->counters()) {
+			setOfFreqs.push_back(freqMapPair(c.key, c.count));
+		}
+		// The tracked values of an approximate map are only part of the samples
+		sumFreq = counter;
+	} else if (!map.spilled()) {
+		setOfFreqs.reserve(map.size());
+		for (auto& kv : map) {
+			setOfFreqs.push_back(freqMapPair(kv.view(), kv.count));
+			sumFreq += kv.count;
+		}
+	} else {
+		// A spilled map is merged one partition at a time. The entries that may be
+		// displayed are copied to a table that owns their keys.
+		std::vector<freqMapPair> partEntries;
+		map.forEach([&](std::string_view key, ALUInt count) {
+			partEntries.push_back(freqMapPair(key, count));
+			sumFreq += count;
+			return true;
+		}, [&]() {
+			if (limit > 0) {
+				selectFrequencies(partEntries, limit, o);
+			}
+			for (auto& kv : partEntries) {
+				kept[kv.first] = kv.second;
+			}
+			partEntries.clear();
+		});
+		setOfFreqs.reserve(kept.size());
+		for (auto& kv : kept) {
+			setOfFreqs.push_back(freqMapPair(kv.view(), kv.count));
+		}
+	}
 
-	std::set<freqMapPair, Comparator> setOfFreqs(map.begin(), map.end(), compFunctor);
+	selectFrequencies(setOfFreqs, limit, o);
 
 	int width = 0;
 	ALUInt maxFreq = 0;
-	ALUInt sumFreq = 0;
 	for (auto& kv : setOfFreqs) {
 		if (int(kv.first.size()) > width) {
 			width = int(kv.first.size());
@@ -1386,7 +1604,6 @@ std::string frequencyMap::dump(fmap_format f, fmap_sortOrder o, bool includePerc
 		if (kv.second > maxFreq) {
 			maxFreq = kv.second;
 		}
-		sumFreq += kv.second;
 	}
 
 	int freqWidth = int(std::to_string(maxFreq).size());
@@ -1395,73 +1612,141 @@ std::string frequencyMap::dump(fmap_format f, fmap_sortOrder o, bool includePerc
 		width = int(f);
 	}
 
-	// Handle empty dataset
-	if (0 == counter) {
-		static std::string varname("EmptyFrequencyMapMessage");
-
-		if (configSpecLiteralExists(varname)) {
-			return configSpecLiteralGet(varname);
-		} else {
-			return std::string();
-		}
-	}
-
-	std::ostringstream oss;
+	std::string out;
+	out.reserve(setOfFreqs.size() * (width + freqWidth + (includePercentage ? 16 : 4)));
 
 	// preamble
 
+	std::string separatorLine;
 	if (fmap_format__textualJustifiedLines == f) {
-		oss << "+" << std::setw(width+3) << std::setfill('-') << "+"
-				<< std::setw(freqWidth+3) << std::setfill('-') << "+";
-		if (includePercentage) oss << "--------+";
-		oss << '\n';
+		separatorLine = "+" + std::string(width+2, '-') + "+" + std::string(freqWidth+2, '-') + "+";
+		if (includePercentage) separatorLine += "--------+";
+		separatorLine += '\n';
+		out += separatorLine;
 	} else if (fmap_format__json == f) {
-		oss << "\"frequencyMap\": {\n\t\"Entries\": [\n";
+		out += "\"frequencyMap\": {\n\t\"Entries\": [\n";
 	}
 
 	for (auto& kv : setOfFreqs) {
+		std::string sCount = std::to_string(kv.second);
 		if (fmap_format__textualJustifiedLines > f) {
-			oss << std::setw(width) << std::setfill(' ') << std::left << kv.first;
-			oss << std::setw(freqWidth+1) << std::setfill(' ') << std::right << kv.second;
+			appendPadded(out, kv.first, width, true);
+			appendPadded(out, sCount, freqWidth+1, false);
 			if (includePercentage) {
-				oss << std::fixed << std::setw(7) << std::setprecision(2) << ALUFloat(kv.second) * 100.0 / ALUFloat(sumFreq) << "%";
+				appendFloat(out, "%7.2Lf", ALUFloat(kv.second) * 100.0 / ALUFloat(sumFreq));
+				out += '%';
 			}
 		}
 		else if (fmap_format__textualJustifiedLines == f) {
-			oss << "| " << std::setw(width) << std::setfill(' ') << std::left << kv.first;
-			oss << " | " << std::setw(freqWidth) << std::setfill(' ') << std::right << kv.second << " |";
+			out += "| ";
+			appendPadded(out, kv.first, width, true);
+			out += " | ";
+			appendPadded(out, sCount, freqWidth, false);
+			out += " |";
 			if (includePercentage) {
-				oss << std::fixed <<std::setw(6) << std::setprecision(2) <<
-						ALUFloat(kv.second) * 100.0 / ALUFloat(sumFreq) << "% |";
+				appendFloat(out, "%6.2Lf", ALUFloat(kv.second) * 100.0 / ALUFloat(sumFreq));
+				out += "% |";
 			}
 		} else if (fmap_format__csv == f) {
-			oss << convertToCsv(kv.first) << "," << kv.second;
-			if (includePercentage) oss << "." << std::fixed << std::setprecision(6) << ALUFloat(kv.second) / ALUFloat(sumFreq);
+			appendCsv(out, kv.first);
+			out += ',';
+			out += sCount;
+			if (includePercentage) {
+				out += '.';
+				appendFloat(out, "%.6Lf", ALUFloat(kv.second) / ALUFloat(sumFreq));
+			}
+			if (pTop) {
+				out += ',';
+				out += std::to_string(pTop->find(kv.first)->error);
+			}
 		} else if (fmap_format__json == f) {
-			oss << "\t\t{ \"Key\":" << quotedString(kv.first) << ", \"Samples\":\"" << kv.second << "\"";
-			if (includePercentage) oss << ", \"fraction\":\"" << std::fixed << std::setprecision(6) << ALUFloat(kv.second) / ALUFloat(sumFreq) << "\"";
-			oss << " }";
+			out += "\t\t{ \"Key\":";
+			appendQuoted(out, kv.first);
+			out += ", \"Samples\":\"" + sCount + "\"";
+			if (includePercentage) {
+				out += ", \"fraction\":\"";
+				appendFloat(out, "%.6Lf", ALUFloat(kv.second) / ALUFloat(sumFreq));
+				out += '"';
+			}
+			if (pTop) out += ", \"MaxError\":\"" + std::to_string(pTop->find(kv.first)->error) + "\"";
+			out += " }";
 		} else {
 			MYASSERT ("Invalid format.");
 		}
 
-		oss << '\n';
+		out += '\n';
 	}
 
 	// postamble
 
 	if (fmap_format__textualJustifiedLines == f) {
-		oss << "+" << std::setw(width+3) << std::setfill('-') << "+"
-				<< std::setw(freqWidth+3) << std::setfill('-') << "+";
-		if (includePercentage) oss << "--------+";
-		oss << '\n';
+		out += separatorLine;
 	} else if (fmap_format__json == f) {
-		oss << "\t]\n}\n";
+		out += "\t]";
+		if (pTop) {
+			out += ",\n\t\"Approximate\": { \"DistinctValues\":\"" + std::to_string(pDistinct->estimate())
+					+ "\", \"DistinctStdError\":\"";
+			appendFloat(out, "%.6Lf", ALUFloat(pDistinct->standardError()));
+			out += "\", \"TrackedValues\":\"" + std::to_string(pTop->capacity())
+					+ "\", \"MaxUntrackedCount\":\"" + std::to_string(pTop->minCount()) + "\" }";
+		}
+		out += "\n}\n";
+	}
+
+	// Error bounds of an approximate map. CSV has them in a third column.
+	if (pTop && fmap_format__csv != f && fmap_format__json != f) {
+		out += "Approximate: about " + std::to_string(pDistinct->estimate()) + " distinct values (standard error ";
+		appendFloat(out, "%.2Lf", ALUFloat(pDistinct->standardError() * 100.0));
+		out += "%). Top " + std::to_string(pTop->capacity()) + " values tracked; counts may be too high by up to "
+				+ std::to_string(pTop->minCount()) + "\n";
 	}
 
-	return oss.str();
+	return out;
 }
 
+#define APPROX_FREQUENCY_MAP_DEFAULT_CAPACITY 1000
+
+/*
+ * The configured string ApproximateFrequencyMaps lists the field identifiers
+ * whose frequency maps are approximate, optionally with the number of values
+ * to track, for example "u:100,h"
+ */
+PFrequencyMap makeFrequencyMap(char id)
+{
+	static bool bParsed = false;
+	static size_t capacities[256];
+
+	if (!bParsed) {
+		static std::string varname("ApproximateFrequencyMaps");
+		memset(capacities, 0, sizeof(capacities));
+		bParsed = true;
+		if (configSpecLiteralExists(varname)) {
+			std::istringstream iss(configSpecLiteralGet(varname));
+			std::string item;
+			while (std::getline(iss, item, ',')) {
+				if (item.empty()) continue;
+				size_t capacity = APPROX_FREQUENCY_MAP_DEFAULT_CAPACITY;
+				if (item.length() > 2 && item[1]==':') {
+					try {
+						capacity = std::stoul(item.substr(2));
+					} catch (std::exception& e) {
+						capacity = 0;
+					}
+				} else if (item.length() != 1) {
+					capacity = 0;
+				}
+				if (!isalpha(item[0]) || 0 == capacity) {
+					std::string err = "Invalid entry in ApproximateFrequencyMaps: " + item;
+					MYTHROW(err);
+				}
+				capacities[(unsigned char)(item[0])] = capacity;
+			}
+		}
+	}
+
+	size_t capacity = capacities[(unsigned char)(id)];
+	return capacity ? std::make_shared<frequencyMap>(capacity) : std::make_shared<frequencyMap>();
+}
 
 PValue AluFunc_fmap_nelem(PValue _pFieldIdentifier)
 {
@@ -1538,7 +1823,7 @@ PValue AluFunc_fmap_sample(PValue _pFieldIdentifier, PValue pVal)
 	return mkValue((*pfMap)[s]);
 }
 
-PValue AluFunc_fmap_dump(PValue _pFieldIdentifier, PValue pFormat, PValue pOrder, PValue pPct)
+PValue AluFunc_fmap_dump(PValue _pFieldIdentifier, PValue pFormat, PValue pOrder, PValue pPct, PValue pLimit)
 {
 	ASSERT_NOT_ELIDED(_pFieldIdentifier,1,fieldIdentifier);
 	std::string s;
@@ -1572,7 +1857,13 @@ PValue AluFunc_fmap_dump(PValue _pFieldIdentifier, PValue pFormat, PValue pOrder
 
 	bool includePercentage = pPct ? pPct->getBool() : false;
 
-	return mkValue(pfMap->dump(f, o, includePercentage));
+	ALUInt limit = ARG_INT_WITH_DEFAULT(pLimit, 0);
+	if (limit < 0) {
+		std::string err = "Invalid frequency map dump limit: " + std::to_string(limit);
+		MYTHROW(err);
+	}
+
+	return mkValue(pfMap->dump(f, o, includePercentage, size_t(limit)));
 }
 
 
@@ -2785,7 +3076,8 @@ PValue AluFunc_countocc(PValue _pNeedle, PValue _pHaystack)
 	ASSERT_NOT_ELIDED(_pNeedle, 1, needle);
 	ASSERT_ARG_OR_RECORD(_pHaystack,2,haystack);
 	std::string* pHaystack = (_pHaystack) ? _pHaystack->getStrPtr() : g_pStateQueryAgent->currRecord().get();
-	std::string needle = _pNeedle->getStr();
+	std::string* pNeedle = _pNeedle->getStrPtr();
+	std::string_view needle = pNeedle ? std::string_view(*pNeedle) : std::string_view("NaN");
 
 	if (std::string::npos != pHaystack->find(needle)) {
 		g_OccuranceMap.note(needle);
@@ -2794,6 +3086,67 @@ PValue AluFunc_countocc(PValue _pNeedle, PValue _pHaystack)
 	return mkValue(g_OccuranceMap[needle]);
 }
 
+/*
+ * Literal needles of countocc calls on the input record. The record is scanned
+ * for all of them on the first such call, and the others use the result.
+ */
+static ahoCorasick g_countoccNeedles;
+
+size_t countoccRegisterNeedle(std::string& sNeedle)
+{
+	return g_countoccNeedles.addPattern(sNeedle);
+}
+
+PValue AluFunc_countocc_precompiled(PValue _pNeedle, size_t needleId)
+{
+	ASSERT_NOT_ELIDED(_pNeedle, 1, needle);
+	ASSERT_ARG_OR_RECORD(nullptr,2,haystack);
+
+	if (!g_pStateQueryAgent->recordCacheGet(recordCacheFunc__CountoccScan, 0, 0)) {
+		g_countoccNeedles.scan(*g_pStateQueryAgent->currRecord());
+		g_pStateQueryAgent->recordCacheSet(recordCacheFunc__CountoccScan, 0, 0, mkValue(ALUInt(1)));
+	}
+
+	const std::string& needle = g_countoccNeedles.pattern(needleId);
+	if (g_countoccNeedles.found(needleId)) {
+		g_OccuranceMap.note(needle);
+	}
+
+	return mkValue(g_OccuranceMap[needle]);
+}
+
+PValue AluFunc_countocc_list(PValue pFileName, PValue _pHaystack)
+{
+	static std::map<std::string, std::shared_ptr<ahoCorasick>> needleLists;
+
+	ASSERT_NOT_ELIDED(pFileName, 1, filename);
+	ASSERT_ARG_OR_RECORD(_pHaystack,2,haystack);
+	std::string* pHaystack = (_pHaystack) ? _pHaystack->getStrPtr() : g_pStateQueryAgent->currRecord().get();
+	std::string fileName = pFileName->getStr();
+
+	std::shared_ptr<ahoCorasick>& pNeedles = needleLists[fileName];
+	if (!pNeedles) {
+		std::ifstream needleFile(fileName);
+		if (!needleFile.is_open()) {
+			std::string err = "countocc_list: Cannot open needle file <" + fileName + ">";
+			MYTHROW(err);
+		}
+		pNeedles = std::make_shared<ahoCorasick>();
+		std::string line;
+		while (std::getline(needleFile, line)) {
+			if (!line.empty() && line.back()=='\r') line.pop_back();
+			if (!line.empty()) pNeedles->addPattern(line);
+		}
+	}
+
+	pNeedles->scan(pHaystack ? std::string_view(*pHaystack) : std::string_view("NaN"));
+	for (size_t id : pNeedles->lastFound()) {
+		g_OccuranceMap.note(pNeedles->pattern(id));
+	}
+
+	return mkValue(ALUInt(pNeedles->lastFound().size()));
+}
+
 PValue AluFunc_countocc_get(PValue _pNeedle)
 {
 	ASSERT_NOT_ELIDED(_pNeedle, 1, needle);
@@ -2802,7 +3155,7 @@ PValue AluFunc_countocc_get(PValue _pNeedle)
 	return mkValue(g_OccuranceMap[needle]);
 }
 
-PValue AluFunc_countocc_dump(PValue pFormat, PValue pOrder, PValue pPct)
+PValue AluFunc_countocc_dump(PValue pFormat, PValue pOrder, PValue pPct, PValue pLimit)
 {
 	std::string s;
 
@@ -2833,7 +3186,13 @@ PValue AluFunc_countocc_dump(PValue pFormat, PValue pOrder, PValue pPct)
 
 	bool includePercentage = pPct ? pPct->getBool() : false;
 
-	return mkValue(g_OccuranceMap.dump(f, o, includePercentage));
+	ALUInt limit = ARG_INT_WITH_DEFAULT(pLimit, 0);
+	if (limit < 0) {
+		std::string err = "Invalid frequency map dump limit: " + std::to_string(limit);
+		MYTHROW(err);
+	}
+
+	return mkValue(g_OccuranceMap.dump(f, o, includePercentage, size_t(limit)));
 }
 
 
@@ -2906,6 +3265,75 @@ PValue AluFunc_getenv(PValue pName)
 	}
 }
 
+static lookupTable& getLookupTable(const std::string& tableName)
+{
+	static std::map<std::string, std::unique_ptr<lookupTable>> tables;
+	static bool bParsed = false;
+	static char separator = '\t';
+	static size_t keyField = 1;
+	static bool bCacheIndex = false;
+
+	if (!bParsed) {
+		static std::string sepName("LookupSeparator");
+		static std::string keyName("LookupKeyField");
+		static std::string cacheName("LookupIndexCache");
+		bParsed = true;
+		if (configSpecLiteralExists(sepName)) {
+			std::string& sep = configSpecLiteralGet(sepName);
+			if (sep.length() != 1) {
+				std::string err = "Invalid LookupSeparator: <" + sep + ">. It must be a single character";
+				MYTHROW(err);
+			}
+			separator = sep[0];
+		}
+		if (configSpecLiteralExists(keyName)) {
+			std::string& key = configSpecLiteralGet(keyName);
+			long long field = 0;
+			try {
+				field = std::stoll(key);
+			} catch (std::exception& e) {
+				field = 0;
+			}
+			if (field <= 0) {
+				std::string err = "Invalid LookupKeyField: " + key;
+				MYTHROW(err);
+			}
+			keyField = size_t(field);
+		}
+		if (configSpecLiteralExists(cacheName)) {
+			bCacheIndex = ("0" != configSpecLiteralGet(cacheName));
+		}
+	}
+
+	std::unique_ptr<lookupTable>& pTable = tables[tableName];
+	if (!pTable) {
+		std::string fileName = tableName;
+		if (configSpecLiteralExists(fileName)) {
+			fileName = configSpecLiteralGet(fileName);
+		}
+		pTable = std::make_unique<lookupTable>(fileName, separator, keyField, bCacheIndex);
+	}
+	return *pTable;
+}
+
+PValue AluFunc_lookup(PValue pTable, PValue pKey, PValue pColumn, PValue pDefault)
+{
+	ASSERT_NOT_ELIDED(pTable,1,table);
+	ASSERT_NOT_ELIDED(pKey,2,key);
+	auto column = ARG_INT_WITH_DEFAULT(pColumn,0);
+	if (pColumn && column <= 0) {
+		std::string err = "Invalid lookup column: " + pColumn->getStr();
+		MYTHROW(err);
+	}
+
+	lookupTable& table = getLookupTable(pTable->getStr());
+	std::string_view line;
+	if (table.find(pKey->getStr(), line) && (0 == column || table.field(line, size_t(column), line))) {
+		return mkValue2(line.data(), int(line.size()));
+	}
+	return pDefault ? pDefault : mkValue0();
+}
+
 PValue AluFunc_split(PValue pSep, PValue pHdr, PValue pFtr)
 {
 	auto hdr = ARG_INT_WITH_DEFAULT(pHdr,0);
@@ -5,10 +5,13 @@
 #include <memory>
 #include "utils/SpecString.h"
 #include "utils/alu.h"
+#include "utils/countTable.h"
+#include "utils/frequencySketch.h"
 
 #define ALUFUNC_REGULAR      0x00
 #define ALUFUNC_STATISTICAL  0x01
 #define ALUFUNC_FREQUENCY    0x02
+#define ALUFUNC_QUANTILE     0x04
 #define ALUFUNC_EXTERNAL     0x80
 
 // function name, number of arguments, whether it needs lines from input
@@ -178,6 +181,10 @@
 			"(fid) - Returns the standard deviation of all values of field identifier 'fid' that have been seen so far.","'fid' is used as a random variable.\nOnly provides information relevant to the entire data set during the run-out cycle.") \
 	X(stderrmean,     1, ALUFUNC_STATISTICAL, false,  \
 			"(fid) - Returns the standard error of all values of field identifier 'fid' that have been seen so far.","'fid' is used as a random variable.\nOnly provides information relevant to the entire data set during the run-out cycle.") \
+	X(median,         1, ALUFUNC_STATISTICAL | ALUFUNC_QUANTILE, false,  \
+			"(fid) - Returns the estimated median of all values of field identifier 'fid' that have been seen so far.","The estimate uses a t-digest, so it takes a fixed amount of memory.\nIt is exact for up to 100 values.\nOnly provides information relevant to the entire data set during the run-out cycle.") \
+	X(percentile,     2, ALUFUNC_STATISTICAL | ALUFUNC_QUANTILE, false,  \
+			"(fid,p) - Returns the estimated p-th percentile of all values of field identifier 'fid' that have been seen so far.","'p' is between 0 and 100. For example, percentile(a,99) is the value that 99% of the values of 'a' do not exceed.\nThe estimate uses a t-digest, which is more accurate near the extremes than near the median.\nOnly provides information relevant to the entire data set during the run-out cycle.") \
 	X(present,        1, ALUFUNC_REGULAR,     false,  \
 			"(fid) - Returns TRUE (1) if the field identifier 'fid' is set, or FALSE (0) otherwise.","All field identifiers are reset at every run of the specification. This function will\nreturn FALSE until the field identifier has been set within this run.") \
 	X(fmap_nelem,     1, ALUFUNC_FREQUENCY,   false,  \
@@ -196,8 +203,8 @@
 			"(fid) - Returns the least common value of field identifier 'fid'.","Only provides information relevant to the entire data set during the run-out cycle.") \
 	X(fmap_sample,    2, ALUFUNC_FREQUENCY,   false,  \
 			"(fid,elem) - Notes an occurence of the value in 'elem' for field identifier 'fid', and returns the number of occurences so far.","This is the only one of the fmap_* functions that modifies the frequency map.\nIt also affects the other statistics functions.") \
-	X(fmap_dump,      4, ALUFUNC_FREQUENCY,   false,  \
-			"(fid,fmt,order,pct) - Returns a multi-line string with the frequency map of field identifier 'fid'.","Only provides information relevant to the entire data set during the run-out cycle.\nFormat can be 'txt' or '0' for a textual table; 'lin' for a table with lines, and 'csv' or 'json' for those formats.\nOrder is 's'/'sa' to sort by ascending value, or 'sd' for descending, 'c'/'ca' for sorting by ascending count, or 'cd' for descending.\n'pct' adds a percentage column if true.") \
+	X(fmap_dump,      5, ALUFUNC_FREQUENCY,   false,  \
+			"(fid,fmt,order,pct,limit) - Returns a multi-line string with the frequency map of field identifier 'fid'.","Only provides information relevant to the entire data set during the run-out cycle.\nFormat can be 'txt' or '0' for a textual table; 'lin' for a table with lines, and 'csv' or 'json' for those formats.\nOrder is 's'/'sa' to sort by ascending value, or 'sd' for descending, 'c'/'ca' for sorting by ascending count, or 'cd' for descending.\n'pct' adds a percentage column if true.\nIf 'limit' is given, only the first 'limit' entries in the sort order are returned.") \
 	H(Advanced Math Functions,20) \
 	X(rand,           1, ALUFUNC_REGULAR,     false,  \
 			"([limit]) - Returns a random integer up to (but not including) 'limit'.","If 'limit' is omitted, returns a floating point number between 0 and 1.") \
@@ -290,11 +297,13 @@
 			"() - Returns the number of columns from the current position to the end of the line.","") \
 	X(countocc,       2, ALUFUNC_REGULAR,     true,   \
 			"(needle,[haystack]) - Returns the number of times since the start of this run that this particular needle has been found in haystacks.", "The counter is incremented if the needle is found in 'haystack'.\nIf 'haystack' is omitted, it defaults to the input line.") \
+	X(countocc_list,  2, ALUFUNC_REGULAR,     true,   \
+			"(filename,[haystack]) - Counts every needle listed in a file that is found in haystack, and returns how many were found.", "The file has one needle per line, and all of them are found in a single pass over 'haystack'.\nEach needle found is counted as if by 'countocc', so 'countocc_get' and 'countocc_dump' include them.\nIf 'haystack' is omitted, it defaults to the input line.") \
 	X(countocc_get,   1, ALUFUNC_REGULAR,     false,  \
 			"(needle) - Returns the number of times since the start of this run that this particular needle has been found in haystacks.", "") \
-	X(countocc_dump,  3, ALUFUNC_REGULAR,     false,  \
-			"(fmt,sOrder,showPct) - Returns a multi-line string with the dump of occurrences found through 'countocc'.","Only provides information relevant to the entire data set during the run-out cycle.\nFormat can be 'txt' or '0' for a textual table; 'lin' for a table with lines, and 'csv' or 'json' for those formats.\nOrder is 's'/'sa' to sort by ascending value, or 'sd' for descending, 'c'/'ca' for sorting by ascending count, or 'cd' for descending.\n'pct' adds a percentage column if true.") \
-	H(Misc Functions,28) \
+	X(countocc_dump,  4, ALUFUNC_REGULAR,     false,  \
+			"(fmt,sOrder,showPct,limit) - Returns a multi-line string with the dump of occurrences found through 'countocc'.","Only provides information relevant to the entire data set during the run-out cycle.\nFormat can be 'txt' or '0' for a textual table; 'lin' for a table with lines, and 'csv' or 'json' for those formats.\nOrder is 's'/'sa' to sort by ascending value, or 'sd' for descending, 'c'/'ca' for sorting by ascending count, or 'cd' for descending.\n'pct' adds a percentage column if true.\nIf 'limit' is given, only the first 'limit' entries in the sort order are returned.") \
+	H(Misc Functions,37) \
 	X(conf,           2, ALUFUNC_REGULAR,     false,  \
 			"(key,[default]) - Returns the configuration string for 'key'.","If the string is not defined, returns the default value.\nIf that is not defined, returns NaN.") \
 	X(defined,        1, ALUFUNC_REGULAR,     false,  \
@@ -309,6 +318,8 @@
 			"(key) - Clears the persistent variable 'key' and returns its old value if defined, or NaN otherwise.","") \
 	X(getenv,         1, ALUFUNC_REGULAR,     false,  \
 			"(name) - Returns the content of the environment variable 'name' or NaN if not defined.", "") \
+	X(lookup,         4, ALUFUNC_REGULAR,     false,  \
+			"(table,key,[column],[default]) - Returns the line whose key is 'key' in a keyed reference file, or field 'column' of that line.","'table' is the name of a configured string that holds the file name, or else the file name itself.\nThe file is loaded and indexed on the first call.\nFields are separated by a tab character, or by the configured string LookupSeparator.\nThe key is the first field, or the field whose number is in the configured string LookupKeyField.\nIf the key is not found, or the line has no such column, returns the default value.\nIf that is not defined, returns NaN.") \
 	X(split,          3, ALUFUNC_REGULAR,     true,   \
 			"([sep], [hdr], [ftr]) - Returns on multiple lines the fields (separated by the 'sep' character), discarding the first 'hdr' and last 'ftr' records.","The separator defaults to the current field separator.\n'hdr' and 'ftr' both default to zero.") \
 	X(splitw,         3, ALUFUNC_REGULAR,     true,   \
@@ -327,6 +338,8 @@
 	X(variance)                      \
 	X(stddev)                        \
 	X(stderrmean)                    \
+	X(median)                        \
+	X(percentile)                    \
 	X(present)                       \
 	X(fmap_nelem)                    \
 	X(fmap_nsamples)                 \
@@ -338,6 +351,42 @@
 	X(fmap_sample)                   \
 	X(fmap_dump)                     \
 
+// Functions that always return an Int or NaN. Used for compile-time type inference
+#define ALU_INT_RESULT_FUNCTION_LIST \
+	X(first)                         \
+	X(recno)                         \
+	X(number)                        \
+	X(eof)                           \
+	X(length)                        \
+	X(wordcount)                     \
+	X(wordstart)                     \
+	X(wordlen)                       \
+	X(wordend)                       \
+	X(fieldcount)                    \
+	X(fieldindex)                    \
+	X(fieldlength)                   \
+	X(fieldend)                      \
+	X(pos)                           \
+	X(lastpos)                       \
+	X(includes)                      \
+	X(includesall)                   \
+	X(rmatch)                        \
+	X(rsearch)                       \
+	X(c2u)                           \
+	X(frombin)                       \
+	X(index)                         \
+	X(find)                          \
+	X(wordpos)                       \
+	X(present)                       \
+	X(defined)                       \
+	X(pdefined)                      \
+
+// Functions that always return a Float or NaN
+#define ALU_FLOAT_RESULT_FUNCTION_LIST \
+	X(sqrt)                          \
+	X(floor)                         \
+	X(ceil)                          \
+
 #define ALUFUNC0(nm)	PValue AluFunc_##nm();
 #define ALUFUNC1(nm)	PValue AluFunc_##nm(PValue);
 #define ALUFUNC2(nm)	PValue AluFunc_##nm(PValue, PValue);
@@ -354,6 +403,15 @@ ALU_DEBUG_FUNCTION_LIST
 #undef X
 #undef H
 
+// The regular expression functions, with the pattern compiled in advance
+PValue AluFunc_rmatch_precompiled(PValue _pHaystack, PPrecompiledRegex pExp, PValue _pFlags);
+PValue AluFunc_rsearch_precompiled(PValue _pHaystack, PPrecompiledRegex pExp, PValue _pFlags);
+PValue AluFunc_rreplace_precompiled(PValue _pHaystack, PPrecompiledRegex pExp, PValue _pFmt, PValue _pFlags);
+
+// countocc with a literal needle and the input record as the haystack
+size_t countoccRegisterNeedle(std::string& sNeedle);
+PValue AluFunc_countocc_precompiled(PValue _pNeedle, size_t needleId);
+
 typedef PValue (*AluFunc0)();
 typedef PValue (*AluFunc1)(PValue op1);
 typedef PValue (*AluFunc2)(PValue op1, PValue op2);
@@ -378,25 +436,50 @@ enum fmap_sortOrder {
 	fmap_sortOrder__byCountDescending,
 };
 
-typedef std::unordered_map<std::string, ALUInt> freqMapImpl;
+typedef countTable freqMapImpl;
 
-typedef std::pair<const std::string, ALUInt> freqMapPair;
+typedef std::pair<std::string_view, ALUInt> freqMapPair;
 
+/*
+ * An approximate frequency map keeps a fixed number of the most common values
+ * and an estimate of the number of distinct values, instead of every value.
+ */
 class frequencyMap {
 public:
-	void             note(std::string& s);
-	ALUInt           nelem()     { return map.size(); }
-	ALUInt           operator[](std::string& s) {return map[s];}
+	frequencyMap() : counter(0) {}
+	frequencyMap(size_t approxCapacity);
+	void             note(std::string_view s);
+	ALUInt           nelem();
+	ALUInt           operator[](std::string_view s);
 	ALUInt           count()     { return counter; }
 	std::string      mostCommon();
 	std::string      leastCommon();
-	std::string      dump(fmap_format f, fmap_sortOrder o, bool includePercentage);
+	std::string      dump(fmap_format f, fmap_sortOrder o, bool includePercentage, size_t limit = 0);
+	bool             isApproximate()  { return pTop != nullptr; }
 private:
 	freqMapImpl      map;
 	ALUInt           counter;
+	std::unique_ptr<hyperLogLog> pDistinct;
+	std::unique_ptr<spaceSaving> pTop;
 };
 typedef std::shared_ptr<frequencyMap> PFrequencyMap;
 
+PFrequencyMap makeFrequencyMap(char id);
+
+// Builtins whose result depends only on the current record and their arguments.
+// Their results are memoized per record by the state query agent.
+enum recordCacheFunc {
+	recordCacheFunc__InputRecord,
+	recordCacheFunc__Range,
+	recordCacheFunc__Word,
+	recordCacheFunc__Field,
+	recordCacheFunc__WordRange,
+	recordCacheFunc__FieldRange,
+	recordCacheFunc__WordCount,
+	recordCacheFunc__FieldCount,
+	recordCacheFunc__CountoccScan
+};
+
 class stateQueryAgent {
 public:
 	virtual unsigned int getWordCount() = 0;
@@ -434,6 +517,10 @@ public:
 	virtual PAluValueStats valueStatistics(char id) = 0;
 	virtual PFrequencyMap  getFrequencyMap(char id) = 0;
 	virtual bool    fieldIdentifierIsSet(char id) = 0;
+	virtual PValue  recordCacheGet(recordCacheFunc func, ALUInt arg1, ALUInt arg2) {
+		return nullptr;
+	}
+	virtual void    recordCacheSet(recordCacheFunc func, ALUInt arg1, ALUInt arg2, PValue val) {}
 };
 
 class positionGetter {
@@ -2,30 +2,319 @@
 #include <iostream>
 #include <sstream>
 #include <regex>
+#include <vector>
 #include <string.h>
 #include "utils/platform.h"
 #include "utils/aluRegex.h"
 #include "utils/lruCache.h"
+#ifdef REGEX_BACKEND_RE2
+#include <re2/re2.h>
+#endif
 
 uint64_t regexCacheSearches = 0;
 uint64_t regexCacheSets = 0;
+uint64_t regexFallbacks = 0;
+uint64_t regexPrecompiled = 0;
+uint64_t regexPrecompiledCalls = 0;
+uint64_t regexTypeGeneration = 0;
 uint64_t matchFlagsCacheSets = 0;
 bool     g_RegexCacheDisabled = false;
 bool     g_bWarnAboutGrammars = true;
 
-typedef std::shared_ptr<std::regex> PRegEx;
-
 static std::regex_constants::syntax_option_type g_regexType = std::regex_constants::ECMAScript;
 static std::string gs_regexType = "";
 
-lruCache<std::string, std::regex> g_regexCache(100,150);
+/*
+ * A compiled regular expression. std::regex is always available and supports
+ * every grammar and flag. If setup.py found a faster engine, patterns are
+ * compiled with it first, and anything it cannot do exactly like std::regex
+ * is handed over to a std::regex compiled from the same pattern.
+ */
+class regexBackend {
+public:
+	virtual ~regexBackend() {}
+	virtual bool        match(std::string& s, std::regex_constants::match_flag_type flags) = 0;
+	virtual bool        search(std::string& s, std::regex_constants::match_flag_type flags) = 0;
+	virtual std::string replace(std::string& s, std::string& fmt, std::regex_constants::match_flag_type flags) = 0;
+};
+
+typedef std::shared_ptr<regexBackend> PRegEx;
+
+class stdRegexBackend : public regexBackend {
+public:
+	stdRegexBackend(std::string& s) : m_re(s, g_regexType) {}
+	virtual bool match(std::string& s, std::regex_constants::match_flag_type flags) {
+		return std::regex_match(s, m_re, flags);
+	}
+	virtual bool search(std::string& s, std::regex_constants::match_flag_type flags) {
+		return std::regex_search(s, m_re, flags);
+	}
+	virtual std::string replace(std::string& s, std::string& fmt, std::regex_constants::match_flag_type flags) {
+		return std::regex_replace(s, m_re, fmt, flags);
+	}
+private:
+	std::regex m_re;
+};
+
+#ifdef REGEX_BACKEND_RE2
+
+#define RegexEngine "RE2"
+
+#define RE2_WHITESPACE "\\t\\n\\x0B\\f\\r "
+
+/*
+ * Translate an ECMAScript pattern into the RE2 dialect. Returns false if the
+ * pattern uses something RE2 does not support or treats differently.
+ */
+static bool ecmaScriptToRE2(const std::string& in, std::string& out)
+{
+	bool bInClass = false;
+	size_t len = in.length();
+	out.clear();
+	for (size_t i=0 ; i<len ; i++) {
+		char c = in[i];
+		if (c=='\\') {
+			if (++i==len) return false;
+			c = in[i];
+			if (c=='x') {
+				// Only the two-digit form is common to both dialects
+				if (i+2>=len || !isxdigit(in[i+1]) || !isxdigit(in[i+2])) return false;
+				out += in.substr(i-1, 4);
+				i += 2;
+				continue;
+			}
+			// Back-references, \c, \u and the Perl-only escapes like \A or \Q
+			if (isalnum(c) && nullptr==strchr("dDwWsSbBnrtfv", c)) return false;
+			if (bInClass) {
+				if (c=='s') {
+					out += RE2_WHITESPACE;
+					continue;
+				}
+				if (c=='S' || c=='b' || c=='B') return false;
+			} else {
+				if (c=='s') {
+					out += "[" RE2_WHITESPACE "]";
+					continue;
+				}
+				if (c=='S') {
+					out += "[^" RE2_WHITESPACE "]";
+					continue;
+				}
+			}
+			out += '\\';
+			out += c;
+			continue;
+		}
+		if (bInClass) {
+			if (c=='[' && i+1<len) {
+				char d = in[i+1];
+				if (d=='.' || d=='=') return false;   // collating elements and equivalence classes
+				if (d==':') {
+					size_t end = in.find(":]", i+2);
+					if (end==std::string::npos) return false;
+					out += in.substr(i, end+2-i);
+					i = end+1;
+					continue;
+				}
+			}
+			if (c==']') bInClass = false;
+			out += c;
+			continue;
+		}
+		switch (c) {
+		case '[':
+			// ECMAScript allows the empty classes [] and [^]; RE2 reads a leading ] as a literal
+			if (i+1<len && in[i+1]==']') return false;
+			if (i+2<len && in[i+1]=='^' && in[i+2]==']') return false;
+			bInClass = true;
+			out += c;
+			if (i+1<len && in[i+1]=='^') {
+				out += '^';
+				i++;
+			}
+			break;
+		case '.':
+			out += "[^\\n\\r]";
+			break;
+		case '(':
+			// Only non-capturing groups are common to both dialects
+			if (i+1<len && in[i+1]=='?' && (i+2>=len || in[i+2]!=':')) return false;
+			out += c;
+			break;
+		case '{': {
+			// std::regex rejects a brace that does not start a valid repetition; RE2 takes it literally
+			size_t j = i+1;
+			while (j<len && isdigit(in[j])) j++;
+			if (j==i+1) return false;
+			if (j<len && in[j]==',') {
+				j++;
+				while (j<len && isdigit(in[j])) j++;
+			}
+			if (j>=len || in[j]!='}') return false;
+			out += in.substr(i, j+1-i);
+			i = j;
+			break;
+		}
+		default:
+			out += c;
+		}
+	}
+	return !bInClass;
+}
+
+class re2RegexBackend : public regexBackend {
+public:
+	re2RegexBackend(std::string& s, std::string& translated, const RE2::Options& options)
+		: m_pattern(s), m_re(translated, options) {}
+	bool ok() { return m_re.ok(); }
+	virtual bool match(std::string& s, std::regex_constants::match_flag_type flags) {
+		if (flags!=std::regex_constants::match_default) {
+			return fallback()->match(s, flags);
+		}
+		return RE2::FullMatch(s, m_re);
+	}
+	virtual bool search(std::string& s, std::regex_constants::match_flag_type flags) {
+		if (flags!=std::regex_constants::match_default) {
+			return fallback()->search(s, flags);
+		}
+		return RE2::PartialMatch(s, m_re);
+	}
+	virtual std::string replace(std::string& s, std::string& fmt, std::regex_constants::match_flag_type flags);
+private:
+	PRegEx fallback() {
+		if (!m_pFallback) {
+			m_pFallback = std::make_shared<stdRegexBackend>(m_pattern);
+		}
+		return m_pFallback;
+	}
+	void format(std::string& ret, std::string& fmt, re2::StringPiece* groups, int nGroups,
+			re2::StringPiece prefix, re2::StringPiece suffix);
+	std::string m_pattern;
+	RE2         m_re;
+	PRegEx      m_pFallback;
+};
+
+// Expands $&, $`, $', $$ and $n / $nn the way std::regex_replace does with the default format
+void re2RegexBackend::format(std::string& ret, std::string& fmt, re2::StringPiece* groups, int nGroups,
+		re2::StringPiece prefix, re2::StringPiece suffix)
+{
+	size_t len = fmt.length();
+	for (size_t i=0 ; i<len ; i++) {
+		if (fmt[i]!='$' || i+1==len) {
+			ret += fmt[i];
+			continue;
+		}
+		char c = fmt[i+1];
+		if (c=='$') {
+			ret += '$';
+			i++;
+		} else if (c=='&') {
+			ret.append(groups[0].data(), groups[0].size());
+			i++;
+		} else if (c=='`') {
+			ret.append(prefix.data(), prefix.size());
+			i++;
+		} else if (c=='\'') {
+			ret.append(suffix.data(), suffix.size());
+			i++;
+		} else if (isdigit(c)) {
+			int num = c - '0';
+			i++;
+			if (i+1<len && isdigit(fmt[i+1])) {
+				num = num * 10 + (fmt[i+1] - '0');
+				i++;
+			}
+			if (num < nGroups && groups[num].data()) {
+				ret.append(groups[num].data(), groups[num].size());
+			}
+		} else {
+			ret += '$';
+		}
+	}
+}
+
+std::string re2RegexBackend::replace(std::string& s, std::string& fmt, std::regex_constants::match_flag_type flags)
+{
+	static const std::regex_constants::match_flag_type supportedFlags =
+			std::regex_constants::format_first_only | std::regex_constants::format_no_copy;
+	if (flags & ~supportedFlags) {
+		return fallback()->replace(s, fmt, flags);
+	}
+
+	bool bCopy = !(flags & std::regex_constants::format_no_copy);
+	int nGroups = 1 + m_re.NumberOfCapturingGroups();
+	std::vector<re2::StringPiece> groups(nGroups);
+	re2::StringPiece text(s);
+	size_t pos = 0;
+	std::string ret;
+	while (pos <= s.length() && m_re.Match(text, pos, s.length(), RE2::UNANCHORED, groups.data(), nGroups)) {
+		size_t matchStart = groups[0].data() - s.data();
+		size_t matchEnd = matchStart + groups[0].size();
+		// std::regex retries empty matches with different flags; leave that to it
+		if (matchStart==matchEnd) {
+			return fallback()->replace(s, fmt, flags);
+		}
+		if (bCopy) {
+			ret.append(s, pos, matchStart - pos);
+		}
+		format(ret, fmt, groups.data(), nGroups, text.substr(pos, matchStart - pos), text.substr(matchEnd));
+		pos = matchEnd;
+		if (flags & std::regex_constants::format_first_only) {
+			break;
+		}
+	}
+	if (bCopy) {
+		ret.append(s, pos, std::string::npos);
+	}
+	return ret;
+}
+
+static PRegEx makeFastRegex(std::string& s)
+{
+	std::regex_constants::syntax_option_type grammar = g_regexType &
+			~(std::regex_constants::icase | std::regex_constants::nosubs |
+			  std::regex_constants::optimize | std::regex_constants::collate);
+	if (grammar!=std::regex_constants::ECMAScript) {
+		return nullptr;
+	}
+
+	std::string translated;
+	if (!ecmaScriptToRE2(s, translated)) {
+		return nullptr;
+	}
+
+	RE2::Options options;
+	options.set_log_errors(false);
+	options.set_encoding(RE2::Options::EncodingLatin1);   // std::regex works on bytes
+	options.set_case_sensitive(0 == (g_regexType & std::regex_constants::icase));
+	options.set_never_capture(0 != (g_regexType & std::regex_constants::nosubs));
+
+	auto pRet = std::make_shared<re2RegexBackend>(s, translated, options);
+	if (!pRet->ok()) {
+		return nullptr;
+	}
+	return pRet;
+}
+
+#else
+
+#define RegexEngine "std::regex"
+
+static PRegEx makeFastRegex(std::string& s)
+{
+	return nullptr;
+}
+
+#endif
+
+lruCache<std::string, regexBackend> g_regexCache(100,150);
 
 void disableRegexCache() {
 	g_RegexCacheDisabled = true;
 }
 
 void dumpRegexStats() {
-	if (regexCacheSearches > 0) {
+	if (regexCacheSearches + regexPrecompiledCalls > 0) {
 		std::ostringstream oss;
 		oss.setf( std::ios::fixed, std:: ios::floatfield );
 		oss.precision(3);
@@ -33,20 +322,39 @@ void dumpRegexStats() {
 		oss << "Regular Expression stats:\n";
 
 		// Total number of searches
-		oss << "\tRegular Expression calls: " << regexCacheSearches << "\n";
+		oss << "\tRegular Expression calls: " << regexCacheSearches + regexPrecompiledCalls << "\n";
 
-		// regex cache hits
-		double percentage = double(100.0) - (double(100 * regexCacheSets) / double(regexCacheSearches));
-		oss << "\tRegex Cache Hits: " << percentage << "%\n";
+		// Literal patterns are compiled with the expression and skip the cache
+		oss << "\t\tWith precompiled literal patterns: " << regexPrecompiledCalls
+				<< " (" << regexPrecompiled << " patterns)\n";
+		oss << "\t\tWith dynamic patterns: " << regexCacheSearches << "\n";
 
-		// match flag cache hits
-		percentage = double(100.0) - (double(100 * matchFlagsCacheSets) / double(regexCacheSearches));
-		oss << "\tMatch Flags Cache Hits: " << percentage << "%\n";
+		if (regexCacheSearches > 0) {
+			// regex cache hits
+			double percentage = double(100.0) - (double(100 * regexCacheSets) / double(regexCacheSearches));
+			oss << "\tRegex Cache Hits: " << percentage << "%\n";
+
+			// match flag cache hits
+			percentage = double(100.0) - (double(100 * matchFlagsCacheSets) / double(regexCacheSearches));
+			oss << "\tMatch Flags Cache Hits: " << percentage << "%\n";
+		}
+
+		// which engine compiled the expressions
+		oss << "\tRegex engine: " << RegexEngine;
+#ifdef REGEX_BACKEND_RE2
+		oss << " (" << regexFallbacks << " compilations fell back to std::regex)";
+#endif
+		oss << "\n";
 
 		std::cerr << oss.str();
 	}
 }
 
+const char* regexEngineName()
+{
+	return RegexEngine;
+}
+
 #ifdef REGEX_GRAMMARS
 #define OTHER_GRAMMAR_UNSUPPORTED false
 #else
@@ -55,6 +363,7 @@ void dumpRegexStats() {
 
 void setRegexType(std::string& s) {
 	bool bWarnUnsupportedGrammarOption = false;
+	regexTypeGeneration++;   // invalidates precompiled expressions
 	g_regexType = std::regex_constants::ECMAScript;
 	gs_regexType = s;
 	char* st = strdup(s.c_str());
@@ -98,17 +407,28 @@ void setRegexType(std::string& s) {
 	free(st);
 }
 
+static PRegEx regexCompile(std::string& s)
+{
+	PRegEx pRet;
+	try {
+		pRet = makeFastRegex(s);
+		if (!pRet) {
+			pRet = std::make_shared<stdRegexBackend>(s);
+			regexFallbacks++;
+		}
+	} catch (std::regex_error& e) {
+		std::string err = "Invalid regular expression <" + s + "> : " + e.what();
+		MYTHROW(err);
+	}
+	return pRet;
+}
+
 PRegEx regexCalculator(std::string& s)
 {
 	regexCacheSearches++;
 	PRegEx pRet = g_RegexCacheDisabled ? nullptr : g_regexCache.get(s);
 	if (!pRet) {
-		try {
-			pRet = std::make_shared<std::regex>(s,g_regexType);
-		} catch (std::regex_error& e) {
-			std::string err = "Invalid regular expression <" + s + "> : " + e.what();
-			MYTHROW(err);
-		}
+		pRet = regexCompile(s);
 		if (!g_RegexCacheDisabled) {
 			g_regexCache.set(s,pRet);
 			regexCacheSets++;
@@ -174,13 +494,58 @@ std::regex_constants::match_flag_type getMatchFlags(std::string* sFlags)
 	}
 }
 
-bool regexMatch(std::string* pStr, PValue pExp, std::string* pFlags)
+class precompiledRegex {
+public:
+	precompiledRegex(std::string& s) : m_pattern(s), m_pRE(regexCompile(s)), m_generation(regexTypeGeneration) {
+		m_bFlagsSet = false;
+		m_flagsValue = std::regex_constants::match_default;
+	}
+	PRegEx get() {
+		// A later --regexType change makes this compilation stale
+		if (m_generation != regexTypeGeneration) {
+			return regexCalculator(m_pattern);
+		}
+		regexPrecompiledCalls++;
+		return m_pRE;
+	}
+	std::string& pattern() { return m_pattern; }
+	std::regex_constants::match_flag_type matchFlags(std::string* pFlags) {
+		if (!pFlags || pFlags->empty()) {
+			return std::regex_constants::match_default;
+		}
+		if (!m_bFlagsSet || *pFlags != m_flags) {
+			m_flagsValue = getMatchFlags(pFlags);
+			m_flags = *pFlags;
+			m_bFlagsSet = true;
+		}
+		return m_flagsValue;
+	}
+private:
+	std::string m_pattern;
+	PRegEx      m_pRE;
+	uint64_t    m_generation;
+	bool        m_bFlagsSet;
+	std::string m_flags;
+	std::regex_constants::match_flag_type m_flagsValue;
+};
+
+PPrecompiledRegex regexPrecompile(std::string& sExp)
 {
-	std::string sExp = pExp->getStr();
-	PRegEx pRE = regexCalculator(sExp);
+	try {
+		auto pRet = std::make_shared<precompiledRegex>(sExp);
+		regexPrecompiled++;
+		return pRet;
+	} catch (SpecsException& e) {
+		// An invalid literal is reported if and when the function is called
+		return nullptr;
+	}
+}
 
+static bool regexMatch(std::string* pStr, PRegEx pRE, std::regex_constants::match_flag_type flags,
+		std::string& sExp, std::string* pFlags)
+{
 	try {
-		bool bRet = std::regex_match(*pStr, *pRE, getMatchFlags(pFlags));
+		bool bRet = pRE->match(*pStr, flags);
 		return bRet;
 	} catch (std::regex_error& e) {
 		auto err = std::string("Error running regular expression match : ") + e.what()
@@ -190,12 +555,11 @@ bool regexMatch(std::string* pStr, PValue pExp, std::string* pFlags)
 	}
 }
 
-bool regexSearch(std::string* pStr, PValue pExp, std::string* pFlags)
+static bool regexSearch(std::string* pStr, PRegEx pRE, std::regex_constants::match_flag_type flags,
+		std::string& sExp, std::string* pFlags)
 {
-	std::string sExp = pExp->getStr();
-	PRegEx pRE = regexCalculator(sExp);
 	try {
-		bool bRet = std::regex_search(*pStr, *pRE, getMatchFlags(pFlags));
+		bool bRet = pRE->search(*pStr, flags);
 		return bRet;
 	} catch (std::regex_error& e) {
 		auto err = std::string("Error running regular expression search : ") + e.what()
@@ -203,15 +567,13 @@ bool regexSearch(std::string* pStr, PValue pExp, std::string* pFlags)
 		if (pFlags) err += "\nFlags: " + *pFlags;
 		MYTHROW(err);
 	}
-
 }
 
-std::string regexReplace(std::string* pStr, PValue pExp, std::string& fmt, std::string* pFlags)
+static std::string regexReplace(std::string* pStr, PRegEx pRE, std::string& fmt,
+		std::regex_constants::match_flag_type flags, std::string& sExp, std::string* pFlags)
 {
-	std::string sExp = pExp->getStr();
-	PRegEx pRE = regexCalculator(sExp);
 	try {
-		std::string sRet = std::regex_replace(*pStr, *pRE, fmt, getMatchFlags(pFlags));
+		std::string sRet = pRE->replace(*pStr, fmt, flags);
 		return sRet;
 	} catch (std::regex_error& e) {
 		auto err = std::string("Error running regular expression replace : ") + e.what()
@@ -219,6 +581,40 @@ std::string regexReplace(std::string* pStr, PValue pExp, std::string& fmt, std::
 		if (pFlags) err += "\nFlags: " + *pFlags;
 		MYTHROW(err);
 	}
+}
+
+bool regexMatch(std::string* pStr, PValue pExp, std::string* pFlags)
+{
+	std::string sExp = pExp->getStr();
+	PRegEx pRE = regexCalculator(sExp);
+	return regexMatch(pStr, pRE, getMatchFlags(pFlags), sExp, pFlags);
+}
+
+bool regexSearch(std::string* pStr, PValue pExp, std::string* pFlags)
+{
+	std::string sExp = pExp->getStr();
+	PRegEx pRE = regexCalculator(sExp);
+	return regexSearch(pStr, pRE, getMatchFlags(pFlags), sExp, pFlags);
+}
 
+std::string regexReplace(std::string* pStr, PValue pExp, std::string& fmt, std::string* pFlags)
+{
+	std::string sExp = pExp->getStr();
+	PRegEx pRE = regexCalculator(sExp);
+	return regexReplace(pStr, pRE, fmt, getMatchFlags(pFlags), sExp, pFlags);
+}
+
+bool regexMatch(std::string* pStr, PPrecompiledRegex pExp, std::string* pFlags)
+{
+	return regexMatch(pStr, pExp->get(), pExp->matchFlags(pFlags), pExp->pattern(), pFlags);
+}
 
+bool regexSearch(std::string* pStr, PPrecompiledRegex pExp, std::string* pFlags)
+{
+	return regexSearch(pStr, pExp->get(), pExp->matchFlags(pFlags), pExp->pattern(), pFlags);
+}
+
+std::string regexReplace(std::string* pStr, PPrecompiledRegex pExp, std::string& fmt, std::string* pFlags)
+{
+	return regexReplace(pStr, pExp->get(), fmt, pExp->matchFlags(pFlags), pExp->pattern(), pFlags);
 }
@@ -6,6 +6,8 @@
 
 void dumpRegexStats();
 
+const char* regexEngineName();
+
 void disableRegexCache();
 
 void setRegexType(std::string& s);
@@ -16,4 +18,19 @@ bool regexSearch(std::string* pStr, PValue pExp, std::string* pFlags = nullptr);
 
 std::string regexReplace(std::string* pStr, PValue pExp, std::string& fmt, std::string* pFlags = nullptr);
 
+/*
+ * Patterns that are literals in the specification are compiled once, when the
+ * expression is compiled, and bypass the regex cache.
+ */
+class precompiledRegex;
+typedef std::shared_ptr<precompiledRegex> PPrecompiledRegex;
+
+PPrecompiledRegex regexPrecompile(std::string& sExp);
+
+bool regexMatch(std::string* pStr, PPrecompiledRegex pExp, std::string* pFlags = nullptr);
+
+bool regexSearch(std::string* pStr, PPrecompiledRegex pExp, std::string* pFlags = nullptr);
+
+std::string regexReplace(std::string* pStr, PPrecompiledRegex pExp, std::string& fmt, std::string* pFlags = nullptr);
+
 #endif
@@ -0,0 +1,441 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <unistd.h>
+#include <unordered_set>
+#include "utils/ErrorReporting.h"
+#include "utils/countTable.h"
+#include "processing/Config.h"
+
+#define COUNT_TABLE_INITIAL_SLOTS   16
+// The first arena chunk of a table is small, and each one after it is twice
+// the size of the previous one, up to COUNT_TABLE_CHUNK_SIZE
+#define COUNT_TABLE_FIRST_CHUNK     256
+#define COUNT_TABLE_CHUNK_SIZE      (64*1024)
+// keys longer than this get a chunk of their own
+#define COUNT_TABLE_LARGE_KEY       (COUNT_TABLE_CHUNK_SIZE/16)
+// tables with fewer entries are not spilled, because they would soon be as large again
+#define COUNT_TABLE_MIN_SPILL       4096
+// smaller limits are raised to this, or a table would spill on every insert
+#define COUNT_TABLE_MIN_MEMORY      (4*COUNT_TABLE_CHUNK_SIZE)
+
+static uint64_t countTablesUsed = 0;
+static uint64_t countTableEntries = 0;
+static uint64_t countTableBytes = 0;
+static uint64_t countTablePeakBytes = 0;
+static uint64_t countTableSpills = 0;
+static uint64_t countTableCheckBytes = 0;   // the memory use at which the limit is checked again
+static uint64_t countTableSpilledEntries = 0;
+static uint64_t countTableSpilledBytes = 0;
+static uint64_t countTableMergedPartitions = 0;
+
+// The tables that may be spilled. A function-local static, because there are
+// global tables whose constructors may run before this file's globals.
+static std::unordered_set<countTable*>& spillableTables()
+{
+	static std::unordered_set<countTable*> tables;
+	return tables;
+}
+
+// The memory limit in bytes from FrequencyMapMemoryLimit, such as 512M, or zero for none
+static size_t countTableMemoryLimit()
+{
+	static bool bParsed = false;
+	static size_t limit = 0;
+	if (!bParsed) {
+		static std::string varname("FrequencyMapMemoryLimit");
+		bParsed = true;
+		if (configSpecLiteralExists(varname)) {
+			std::string& val = configSpecLiteralGet(varname);
+			size_t pos = 0;
+			try {
+				limit = std::stoul(val, &pos);
+			} catch (std::exception& e) {
+				pos = 0;
+			}
+			if (pos > 0 && pos + 1 == val.length()) {
+				switch (val[pos]) {
+				case 'k': case 'K': limit <<= 10; pos++; break;
+				case 'm': case 'M': limit <<= 20; pos++; break;
+				case 'g': case 'G': limit <<= 30; pos++; break;
+				default: break;
+				}
+			}
+			if (0 == pos || pos != val.length()) {
+				std::string err = "Invalid FrequencyMapMemoryLimit: " + val;
+				MYTHROW(err);
+			}
+			if (limit > 0 && limit < COUNT_TABLE_MIN_MEMORY) {
+				if (g_bVerbose) {
+					std::cerr << "FrequencyMapMemoryLimit " << val << " is raised to the minimum of "
+							<< (COUNT_TABLE_MIN_MEMORY >> 10) << "K\n";
+				}
+				limit = COUNT_TABLE_MIN_MEMORY;
+			}
+		}
+	}
+	return limit;
+}
+
+// The temporary files, one per partition, are shared by all tables. They are
+// unlinked as soon as they are created, so they go away when specs exits.
+static FILE* spillFile(size_t part)
+{
+	static FILE* files[COUNT_TABLE_SPILL_PARTITIONS] = {nullptr};
+	if (!files[part]) {
+		const char* dir = std::getenv("TMPDIR");
+		std::string path = std::string((dir && *dir) ? dir : "/tmp") + "/specs-spill-XXXXXX";
+		int fd = mkstemp(&path[0]);
+		if (fd < 0) {
+			std::string err = "Cannot create a temporary file for spilling a frequency map: " + path;
+			MYTHROW(err);
+		}
+		unlink(path.c_str());
+		files[part] = fdopen(fd, "w+b");
+		MYASSERT(files[part] != nullptr);
+	}
+	return files[part];
+}
+
+static inline size_t spillPartition(uint32_t hash)
+{
+	return size_t(hash >> 26) % COUNT_TABLE_SPILL_PARTITIONS;
+}
+
+static inline uint32_t countTableHash(std::string_view key)
+{
+	size_t h = std::hash<std::string_view>{}(key);
+	return uint32_t(h ^ (uint64_t(h) >> 32));
+}
+
+countTable::countTable()
+{
+	m_mask = 0;
+	m_chunkPos = nullptr;
+	m_chunkLeft = 0;
+	m_nextChunkSize = COUNT_TABLE_FIRST_CHUNK;
+	m_arenaBytes = 0;
+	m_reportedBytes = 0;
+	m_bSpillable = true;
+	m_bRegistered = false;
+	m_spillCount = 0;
+	m_distinctCache = 0;
+	m_distinctCacheSpills = size_t(-1);
+	m_distinctCacheSize = 0;
+}
+
+countTable::~countTable()
+{
+	countTableEntries -= m_entries.size();
+	countTableBytes -= m_reportedBytes;
+	if (m_bRegistered) {
+		spillableTables().erase(this);
+	}
+}
+
+size_t countTable::memoryUsage() const
+{
+	return m_arenaBytes
+			+ m_entries.capacity() * sizeof(entry)
+			+ m_slots.capacity() * sizeof(slot)
+			+ m_chunks.capacity() * sizeof(std::unique_ptr<char[]>);
+}
+
+// Returns the slot holding the key, or the empty slot where it would go
+int64_t countTable::lookup(std::string_view key, uint32_t hash) const
+{
+	size_t pos = hash & m_mask;
+	while (true) {
+		const slot& s = m_slots[pos];
+		if (0 == s.idx) {
+			return int64_t(pos);
+		}
+		if (s.hash == hash) {
+			const entry& e = m_entries[s.idx - 1];
+			if (e.len == key.size() && 0 == memcmp(e.key, key.data(), key.size())) {
+				return int64_t(pos);
+			}
+		}
+		pos = (pos + 1) & m_mask;
+	}
+}
+
+const countTable::entry* countTable::find(std::string_view key) const
+{
+	if (m_slots.empty()) return nullptr;
+	const slot& s = m_slots[lookup(key, countTableHash(key))];
+	return (0 == s.idx) ? nullptr : &m_entries[s.idx - 1];
+}
+
+ALUInt& countTable::operator[](std::string_view key)
+{
+	if (m_slots.empty()) {
+		rehash(COUNT_TABLE_INITIAL_SLOTS);
+	}
+
+	uint32_t hash = countTableHash(key);
+	int64_t pos = lookup(key, hash);
+	if (m_slots[pos].idx) {
+		return m_entries[m_slots[pos].idx - 1].count;
+	}
+
+	MYASSERT(m_entries.size() < UINT32_MAX - 1);
+	MYASSERT(key.size() <= UINT32_MAX);
+	m_entries.push_back({intern(key), uint32_t(key.size()), 0});
+	m_slots[pos] = {uint32_t(m_entries.size()), hash};
+	countTableEntries++;
+
+	// keep the load factor at 3/4 or less
+	if (m_entries.size() * 4 > m_slots.size() * 3) {
+		rehash(m_slots.size() * 2);
+	}
+
+	updateMemoryUsage();
+
+	return m_entries.back().count;
+}
+
+void countTable::updateMemoryUsage()
+{
+	size_t bytes = memoryUsage();
+	if (bytes != m_reportedBytes) {
+		countTableBytes += bytes - m_reportedBytes;
+		m_reportedBytes = bytes;
+		if (countTableBytes > countTablePeakBytes) {
+			countTablePeakBytes = countTableBytes;
+		}
+	}
+}
+
+void countTable::add(std::string_view key, ALUInt n)
+{
+	if (m_slots.empty() && !spilled()) {
+		countTablesUsed++;
+	}
+	(*this)[key] += n;
+
+	size_t limit = countTableMemoryLimit();
+	if (limit > 0 && m_bSpillable) {
+		if (!m_bRegistered) {
+			spillableTables().insert(this);
+			m_bRegistered = true;
+		}
+		if (countTableBytes > limit && countTableBytes >= countTableCheckBytes) {
+			enforceMemoryLimit();
+		}
+	}
+}
+
+/*
+ * Spills the largest tables until half the memory limit is used. Small tables
+ * are not spilled, so if they alone are over the limit, it is checked again
+ * only after the tables have grown by another eighth of it.
+ */
+void countTable::enforceMemoryLimit()
+{
+	size_t limit = countTableMemoryLimit();
+	std::vector<countTable*> tables(spillableTables().begin(), spillableTables().end());
+	std::sort(tables.begin(), tables.end(), [](const countTable* t1, const countTable* t2) {
+		return t1->memoryUsage() > t2->memoryUsage();
+	});
+	for (countTable* t : tables) {
+		if (countTableBytes <= limit / 2) {
+			break;
+		}
+		if (t->m_entries.size() >= COUNT_TABLE_MIN_SPILL) {
+			t->spill();
+		}
+	}
+	countTableCheckBytes = countTableBytes + limit / 8;
+}
+
+/*
+ * Writes the entries to the end of the temporary files, each to the file of its
+ * partition, and empties the table. Each record is the length of the key, the
+ * count, and the key.
+ */
+void countTable::spill()
+{
+	std::vector<std::string> buffers(COUNT_TABLE_SPILL_PARTITIONS);
+	for (auto& e : m_entries) {
+		std::string& buf = buffers[spillPartition(countTableHash(e.view()))];
+		buf.append((const char*)(&e.len), sizeof(e.len));
+		buf.append((const char*)(&e.count), sizeof(e.count));
+		buf.append(e.key, e.len);
+	}
+
+	for (size_t part = 0; part < COUNT_TABLE_SPILL_PARTITIONS; part++) {
+		std::string& buf = buffers[part];
+		if (buf.empty()) continue;
+		FILE* f = spillFile(part);
+		fseeko(f, 0, SEEK_END);
+		int64_t offset = int64_t(ftello(f));
+		if (buf.size() != fwrite(buf.data(), 1, buf.size(), f)) {
+			MYTHROW("Failed to write a frequency map to a temporary file");
+		}
+		m_spillBlocks.push_back({part, offset, buf.size()});
+		countTableSpilledBytes += buf.size();
+	}
+
+	countTableSpills++;
+	countTableSpilledEntries += m_entries.size();
+	countTableEntries -= m_entries.size();
+	m_spillCount++;
+
+	std::vector<entry>().swap(m_entries);
+	std::vector<slot>().swap(m_slots);
+	std::vector<std::unique_ptr<char[]>>().swap(m_chunks);
+	m_mask = 0;
+	m_chunkPos = nullptr;
+	m_chunkLeft = 0;
+	m_nextChunkSize = COUNT_TABLE_FIRST_CHUNK;
+	m_arenaBytes = 0;
+	updateMemoryUsage();
+}
+
+// Calls f(key, count) for each record in the spilled blocks of a partition
+template <class Func>
+static void readSpilledPartition(const std::vector<countTable::spillBlock>& blocks, size_t part, Func f)
+{
+	std::string buf;
+	for (auto& blk : blocks) {
+		if (blk.part != part) continue;
+		FILE* fl = spillFile(part);
+		buf.resize(blk.length);
+		fflush(fl);
+		fseeko(fl, off_t(blk.offset), SEEK_SET);
+		if (blk.length != fread(&buf[0], 1, blk.length, fl)) {
+			MYTHROW("Failed to read a frequency map from a temporary file");
+		}
+		size_t pos = 0;
+		while (pos < buf.size()) {
+			uint32_t len;
+			ALUInt count;
+			memcpy(&len, &buf[pos], sizeof(len));
+			pos += sizeof(len);
+			memcpy(&count, &buf[pos], sizeof(count));
+			pos += sizeof(count);
+			f(std::string_view(buf.data() + pos, len), count);
+			pos += len;
+		}
+	}
+}
+
+ALUInt countTable::spilledCount(std::string_view key, uint32_t hash)
+{
+	ALUInt ret = 0;
+	readSpilledPartition(m_spillBlocks, spillPartition(hash), [&](std::string_view k, ALUInt count) {
+		if (k == key) ret += count;
+	});
+	return ret;
+}
+
+void countTable::mergePartition(size_t part, countTable& into)
+{
+	readSpilledPartition(m_spillBlocks, part, [&](std::string_view k, ALUInt count) {
+		into[k] += count;
+	});
+	for (auto& e : m_entries) {
+		if (spillPartition(countTableHash(e.view())) == part) {
+			into[e.view()] += e.count;
+		}
+	}
+	countTableMergedPartitions++;
+}
+
+ALUInt countTable::countOf(std::string_view key)
+{
+	ALUInt ret = (*this)[key];
+	if (spilled()) {
+		ret += spilledCount(key, countTableHash(key));
+	}
+	return ret;
+}
+
+size_t countTable::distinct()
+{
+	if (!spilled()) {
+		return m_entries.size();
+	}
+	if (m_distinctCacheSpills != m_spillCount || m_distinctCacheSize != m_entries.size()) {
+		size_t count = 0;
+		forEach([&](std::string_view, ALUInt) { count++; return true; });
+		m_distinctCache = count;
+		m_distinctCacheSpills = m_spillCount;
+		m_distinctCacheSize = m_entries.size();
+	}
+	return m_distinctCache;
+}
+
+const char* countTable::intern(std::string_view key)
+{
+	if (key.empty()) return "";
+
+	if (key.size() > COUNT_TABLE_LARGE_KEY) {
+		m_chunks.push_back(std::unique_ptr<char[]>(new char[key.size()]));
+		m_arenaBytes += key.size();
+		memcpy(m_chunks.back().get(), key.data(), key.size());
+		return m_chunks.back().get();
+	}
+
+	if (key.size() > m_chunkLeft) {
+		size_t chunkSize = std::max(m_nextChunkSize, key.size());
+		m_chunks.push_back(std::unique_ptr<char[]>(new char[chunkSize]));
+		m_arenaBytes += chunkSize;
+		m_chunkPos = m_chunks.back().get();
+		m_chunkLeft = chunkSize;
+		m_nextChunkSize = std::min(m_nextChunkSize * 2, size_t(COUNT_TABLE_CHUNK_SIZE));
+	}
+
+	char* ret = m_chunkPos;
+	memcpy(ret, key.data(), key.size());
+	m_chunkPos += key.size();
+	m_chunkLeft -= key.size();
+	return ret;
+}
+
+void countTable::rehash(size_t newSize)
+{
+	std::vector<slot> oldSlots;
+	oldSlots.swap(m_slots);
+	m_slots.resize(newSize, {0,0});
+	m_mask = newSize - 1;
+
+	for (slot& s : oldSlots) {
+		if (0 == s.idx) continue;
+		size_t pos = s.hash & m_mask;
+		while (m_slots[pos].idx) {
+			pos = (pos + 1) & m_mask;
+		}
+		m_slots[pos] = s;
+	}
+}
+
+void dumpCountTableStats()
+{
+	if (countTablesUsed > 0) {
+		std::ostringstream oss;
+		oss.setf( std::ios::fixed, std:: ios::floatfield );
+		oss.precision(1);
+
+		oss << "Frequency Map stats:\n";
+		oss << "\tMaps in use: " << countTablesUsed << "\n";
+		oss << "\tDistinct keys: " << countTableEntries << "\n";
+		oss << "\tMemory: " << countTableBytes << " bytes (peak " << countTablePeakBytes << ")";
+		if (countTableEntries > 0) {
+			oss << "; " << double(countTableBytes) / double(countTableEntries) << " bytes per key";
+		}
+		oss << "\n";
+		if (countTableSpills > 0) {
+			oss << "\tSpilled: " << countTableSpills << " times, " << countTableSpilledEntries << " entries, "
+					<< countTableSpilledBytes << " bytes to temporary files; "
+					<< countTableMergedPartitions << " partitions merged\n";
+		}
+
+		std::cerr << oss.str();
+	}
+}
@@ -0,0 +1,129 @@
+#ifndef SPECS2016__UTILS__COUNT_TABLE__H
+#define SPECS2016__UTILS__COUNT_TABLE__H
+
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "utils/aluValue.h"
+
+#define COUNT_TABLE_SPILL_PARTITIONS  64
+
+void dumpCountTableStats();
+
+/*
+ * A string-to-counter hash table for frequency maps with many distinct keys.
+ *
+ * Keys are copied once, on insertion, into arena chunks that start small and
+ * double in size, so that a table with few keys stays small. The entries are
+ * kept in insertion order in a single vector, and the open-addressed index holds
+ * only the entry number and the hash, so there is no per-key allocation.
+ * Lookups take a string_view, so the caller does not need to build a std::string.
+ *
+ * When the tables together use more memory than the configured string
+ * FrequencyMapMemoryLimit allows, the largest ones are spilled: their entries are
+ * hash-partitioned into temporary files and the table starts over empty. Tables
+ * with only a few thousand keys are not spilled. Queries on a spilled table merge
+ * one partition at a time, so that only a fraction of the keys is in memory at
+ * once.
+ */
+class countTable {
+public:
+	struct entry {
+		const char*   key;
+		uint32_t      len;
+		ALUInt        count;
+		std::string_view  view() const { return std::string_view(key, len); }
+	};
+	struct spillBlock {          // entries of one partition in a temporary file
+		size_t        part;
+		int64_t       offset;
+		size_t        length;
+	};
+
+	countTable();
+	~countTable();
+	countTable(const countTable&) = delete;
+	countTable& operator=(const countTable&) = delete;
+
+	// Returns the counter for the key, adding it with a count of zero if missing
+	ALUInt&          operator[](std::string_view key);
+	const entry*     find(std::string_view key) const;
+	size_t           size() const  { return m_entries.size(); }
+	size_t           memoryUsage() const;
+
+	// Adds to the counter of a key. Unlike operator[], this may spill the table.
+	void             add(std::string_view key, ALUInt n = 1);
+	bool             spilled() const  { return !m_spillBlocks.empty(); }
+
+	// These include the spilled entries
+	ALUInt           countOf(std::string_view key);  // adds the key with a count of zero if missing
+	size_t           distinct();
+
+	/*
+	 * Calls visit(key, count) for each key, including the spilled ones. The key is
+	 * only valid during the call. If visit returns false, the iteration stops.
+	 * A spilled table is merged and visited one partition at a time, and then
+	 * partDone() is called after each partition.
+	 */
+	template <class Visitor, class PartDone>
+	void             forEach(Visitor visit, PartDone partDone);
+	template <class Visitor>
+	void             forEach(Visitor visit)  { forEach(visit, [](){}); }
+
+	std::vector<entry>::const_iterator begin() const { return m_entries.begin(); }
+	std::vector<entry>::const_iterator end() const   { return m_entries.end(); }
+private:
+	struct slot {
+		uint32_t      idx;     // entry number plus one; zero is an empty slot
+		uint32_t      hash;
+	};
+	int64_t          lookup(std::string_view key, uint32_t hash) const;
+	const char*      intern(std::string_view key);
+	void             rehash(size_t newSize);
+	void             updateMemoryUsage();
+	void             spill();
+	ALUInt           spilledCount(std::string_view key, uint32_t hash);
+	void             mergePartition(size_t part, countTable& into);
+	static void      enforceMemoryLimit();
+
+	std::vector<entry>                   m_entries;
+	std::vector<slot>                    m_slots;
+	size_t                               m_mask;
+	std::vector<std::unique_ptr<char[]>> m_chunks;
+	char*                                m_chunkPos;
+	size_t                               m_chunkLeft;
+	size_t                               m_nextChunkSize;
+	size_t                               m_arenaBytes;
+	size_t                               m_reportedBytes;
+	bool                                 m_bSpillable;
+	bool                                 m_bRegistered;
+	std::vector<spillBlock>              m_spillBlocks;  // in the temporary files shared by all tables
+	size_t                               m_spillCount;
+	size_t                               m_distinctCache;   // valid while the spill count and size are as recorded
+	size_t                               m_distinctCacheSpills;
+	size_t                               m_distinctCacheSize;
+};
+
+template <class Visitor, class PartDone>
+void countTable::forEach(Visitor visit, PartDone partDone)
+{
+	if (!spilled()) {
+		for (auto& e : m_entries) {
+			if (!visit(e.view(), e.count)) return;
+		}
+		partDone();
+		return;
+	}
+
+	for (size_t part = 0; part < COUNT_TABLE_SPILL_PARTITIONS; part++) {
+		countTable merged;
+		merged.m_bSpillable = false;
+		mergePartition(part, merged);
+		for (auto& e : merged.m_entries) {
+			if (!visit(e.view(), e.count)) return;
+		}
+		partDone();
+	}
+}
+
+#endif
@@ -0,0 +1,150 @@
+#include <cmath>
+#include "utils/ErrorReporting.h"
+#include "utils/frequencySketch.h"
+
+// 2^14 one-byte registers give a standard error of 0.8%
+#define HLL_PRECISION    14
+#define HLL_REGISTERS    (1 << HLL_PRECISION)
+
+hyperLogLog::hyperLogLog()
+	: m_registers(HLL_REGISTERS, 0)
+{
+}
+
+void hyperLogLog::add(uint64_t hash)
+{
+	size_t idx = size_t(hash >> (64 - HLL_PRECISION));
+	uint64_t rest = (hash << HLL_PRECISION) | (uint64_t(1) << (HLL_PRECISION - 1));
+	uint8_t rank = 1;
+	while (0 == (rest & (uint64_t(1) << 63))) {
+		rank++;
+		rest <<= 1;
+	}
+	if (rank > m_registers[idx]) {
+		m_registers[idx] = rank;
+	}
+}
+
+ALUInt hyperLogLog::estimate() const
+{
+	const double m = double(HLL_REGISTERS);
+	double sum = 0.0;
+	size_t zeros = 0;
+	for (uint8_t r : m_registers) {
+		sum += std::ldexp(1.0, -int(r));
+		if (0 == r) zeros++;
+	}
+
+	double alpha = 0.7213 / (1.0 + 1.079 / m);
+	double est = alpha * m * m / sum;
+
+	// small range correction: linear counting
+	if (est <= 2.5 * m && zeros > 0) {
+		est = m * std::log(m / double(zeros));
+	}
+
+	return ALUInt(std::llround(est));
+}
+
+double hyperLogLog::standardError() const
+{
+	return 1.04 / std::sqrt(double(HLL_REGISTERS));
+}
+
+spaceSaving::spaceSaving(size_t capacity)
+{
+	MYASSERT(capacity > 0);
+	m_capacity = capacity;
+	m_counters.reserve(capacity);
+	m_heap.reserve(capacity);
+	m_index.reserve(capacity);
+}
+
+ALUInt spaceSaving::add(std::string_view key)
+{
+	auto it = m_index.find(key);
+	if (it != m_index.end()) {
+		counter& c = m_counters[it->second];
+		c.count++;
+		siftDown(c.heapPos);
+		return c.count;
+	}
+
+	if (m_counters.size() < m_capacity) {
+		size_t idx = m_counters.size();
+		m_counters.push_back({std::string(key), 1, 0, m_heap.size()});
+		m_heap.push_back(idx);
+		m_index[std::string_view(m_counters[idx].key)] = idx;
+		siftUp(m_counters[idx].heapPos);
+		return 1;
+	}
+
+	// Replace the value with the lowest count
+	size_t idx = m_heap[0];
+	counter& c = m_counters[idx];
+	m_index.erase(std::string_view(c.key));
+	c.key.assign(key.data(), key.size());
+	c.error = c.count;
+	c.count++;
+	m_index[std::string_view(c.key)] = idx;
+	siftDown(0);
+	return c.count;
+}
+
+const spaceSaving::counter* spaceSaving::find(std::string_view key) const
+{
+	auto it = m_index.find(key);
+	return (it == m_index.end()) ? nullptr : &m_counters[it->second];
+}
+
+ALUInt spaceSaving::minCount() const
+{
+	// Values that are not tracked occurred at most this many times
+	return (m_counters.size() < m_capacity) ? 0 : m_counters[m_heap[0]].count;
+}
+
+size_t spaceSaving::memoryUsage() const
+{
+	size_t ret = m_counters.capacity() * sizeof(counter)
+			+ m_heap.capacity() * sizeof(size_t)
+			+ m_index.bucket_count() * sizeof(void*)
+			+ m_index.size() * (sizeof(std::string_view) + sizeof(size_t) + 2 * sizeof(void*));
+	for (auto& c : m_counters) {
+		if (c.key.capacity() > sizeof(std::string)) {
+			ret += c.key.capacity();
+		}
+	}
+	return ret;
+}
+
+void spaceSaving::swapHeap(size_t p1, size_t p2)
+{
+	std::swap(m_heap[p1], m_heap[p2]);
+	m_counters[m_heap[p1]].heapPos = p1;
+	m_counters[m_heap[p2]].heapPos = p2;
+}
+
+void spaceSaving::siftUp(size_t pos)
+{
+	while (pos > 0) {
+		size_t parent = (pos - 1) / 2;
+		if (m_counters[m_heap[parent]].count <= m_counters[m_heap[pos]].count) break;
+		swapHeap(pos, parent);
+		pos = parent;
+	}
+}
+
+void spaceSaving::siftDown(size_t pos)
+{
+	size_t n = m_heap.size();
+	while (true) {
+		size_t smallest = pos;
+		size_t left = 2 * pos + 1;
+		size_t right = left + 1;
+		if (left < n && m_counters[m_heap[left]].count < m_counters[m_heap[smallest]].count) smallest = left;
+		if (right < n && m_counters[m_heap[right]].count < m_counters[m_heap[smallest]].count) smallest = right;
+		if (smallest == pos) break;
+		swapHeap(pos, smallest);
+		pos = smallest;
+	}
+}
@@ -0,0 +1,61 @@
+#ifndef SPECS2016__UTILS__FREQUENCY_SKETCH__H
+#define SPECS2016__UTILS__FREQUENCY_SKETCH__H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "utils/aluValue.h"
+
+/*
+ * Fixed-memory summaries for frequency maps with too many distinct values to
+ * keep in memory.
+ */
+
+// HyperLogLog estimate of the number of distinct values
+class hyperLogLog {
+public:
+	hyperLogLog();
+	void             add(uint64_t hash);
+	ALUInt           estimate() const;
+	double           standardError() const;
+	size_t           memoryUsage() const  { return m_registers.size(); }
+private:
+	std::vector<uint8_t> m_registers;
+};
+
+/*
+ * Space-Saving heavy hitters: tracks at most `capacity` values. When a new value
+ * arrives and the table is full, it replaces the value with the lowest count and
+ * inherits that count as its error. A reported count is never lower than the true
+ * count and is higher by at most the error. Any value that occurs in more than
+ * 1/capacity of the samples is guaranteed to be tracked.
+ */
+class spaceSaving {
+public:
+	struct counter {
+		std::string  key;
+		ALUInt       count;
+		ALUInt       error;
+		size_t       heapPos;
+	};
+
+	spaceSaving(size_t capacity);
+	ALUInt           add(std::string_view key);
+	const counter*   find(std::string_view key) const;
+	size_t           capacity() const  { return m_capacity; }
+	ALUInt           minCount() const;
+	const std::vector<counter>& counters() const  { return m_counters; }
+	size_t           memoryUsage() const;
+private:
+	void             siftUp(size_t pos);
+	void             siftDown(size_t pos);
+	void             swapHeap(size_t p1, size_t p2);
+
+	size_t                                       m_capacity;
+	std::vector<counter>                         m_counters;  // never reallocated, so the index can point at the keys
+	std::vector<size_t>                          m_heap;      // min-heap of counter numbers by count
+	std::unordered_map<std::string_view, size_t> m_index;
+};
+
+#endif
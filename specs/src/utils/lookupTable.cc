@@ -0,0 +1,289 @@
+#include <string.h>
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <sys/stat.h>
+#ifdef WIN64
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#include "utils/ErrorReporting.h"
+#include "utils/lookupTable.h"
+
+#define LOOKUP_TABLE_INDEX_MAGIC       "SPECSLI1"
+#define LOOKUP_TABLE_INDEX_SUFFIX      ".specsidx"
+#define LOOKUP_TABLE_BYTES_PER_THREAD  (4 * 1024 * 1024)
+#define LOOKUP_TABLE_MAX_THREADS       16
+
+struct lookupIndexHeader {
+	char      magic[8];
+	uint64_t  fileSize;
+	int64_t   fileTime;
+	uint32_t  hashCheck;    // the hash of a fixed string, in case the hash function changes
+	uint32_t  separator;
+	uint64_t  keyField;
+	uint64_t  entryCount;
+	uint64_t  slotCount;
+};
+
+static inline uint32_t lookupTableHash(std::string_view key)
+{
+	size_t h = std::hash<std::string_view>{}(key);
+	return uint32_t(h ^ (uint64_t(h) >> 32));
+}
+
+lookupTable::lookupTable(const std::string& fileName, char separator, size_t keyField, bool bCacheIndex)
+{
+	m_fileName = fileName;
+	m_indexFileName = fileName + LOOKUP_TABLE_INDEX_SUFFIX;
+	m_separator = separator;
+	m_keyField = keyField;
+	m_mask = 0;
+
+	struct stat st;
+	if (0 != stat(fileName.c_str(), &st) || !m_file.open(fileName)) {
+		std::string err = "lookup: Cannot open lookup file <" + fileName + ">";
+		MYTHROW(err);
+	}
+	m_fileTime = int64_t(st.st_mtime);
+
+	if (bCacheIndex && loadIndex()) {
+		return;
+	}
+
+	buildIndex();
+
+	if (bCacheIndex) {
+		saveIndex();
+	}
+}
+
+/*
+ * Indexes the lines that start in the range [from,to). Returns false if a
+ * line is too long to index.
+ */
+bool lookupTable::index(size_t from, size_t to, std::vector<entry>& entries) const
+{
+	const char* pData = m_file.data();
+	const size_t size = m_file.size();
+	size_t pos = from;
+	while (pos < to) {
+		const char* pEnd = (const char*)memchr(pData + pos, '\n', size - pos);
+		size_t lineEnd = pEnd ? size_t(pEnd - pData) : size;
+		size_t next = pEnd ? lineEnd + 1 : size;
+		if (lineEnd > pos && pData[lineEnd - 1] == '\r') {
+			lineEnd--;
+		}
+		std::string_view line(pData + pos, lineEnd - pos);
+		if (line.size() > UINT32_MAX) {
+			return false;
+		}
+
+		std::string_view key;
+		if (!line.empty() && field(line, m_keyField, key)) {
+			entries.push_back({uint64_t(pos), uint32_t(line.size()), uint32_t(key.data() - line.data()),
+					uint32_t(key.size()), lookupTableHash(key)});
+		}
+		pos = next;
+	}
+	return true;
+}
+
+void lookupTable::buildIndex()
+{
+	const char* pData = m_file.data();
+	const size_t size = m_file.size();
+
+	size_t threadCount = std::min(size_t(std::thread::hardware_concurrency()), size / LOOKUP_TABLE_BYTES_PER_THREAD);
+	threadCount = std::max(size_t(1), std::min(threadCount, size_t(LOOKUP_TABLE_MAX_THREADS)));
+
+	// Each thread gets the lines that start in its share of the file
+	std::vector<size_t> bounds(threadCount + 1, size);
+	bounds[0] = 0;
+	for (size_t i = 1; i < threadCount; i++) {
+		size_t pos = std::max(bounds[i-1], i * (size / threadCount));
+		const char* pEnd = (pos > 0 && pos < size) ? (const char*)memchr(pData + pos - 1, '\n', size - pos + 1) : nullptr;
+		bounds[i] = pEnd ? size_t(pEnd - pData) + 1 : size;
+	}
+
+	std::vector<std::vector<entry>> parts(threadCount);
+	std::vector<char> results(threadCount, 0);
+	if (1 == threadCount) {
+		results[0] = index(0, size, parts[0]);
+	} else {
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < threadCount; i++) {
+			threads.emplace_back([this, &bounds, &parts, &results, i]() {
+				results[i] = index(bounds[i], bounds[i+1], parts[i]);
+			});
+		}
+		for (auto& t : threads) {
+			t.join();
+		}
+	}
+
+	size_t total = 0;
+	for (size_t i = 0; i < threadCount; i++) {
+		if (!results[i]) {
+			std::string err = "lookup: Lookup file <" + m_fileName + "> has a line that is too long";
+			MYTHROW(err);
+		}
+		total += parts[i].size();
+	}
+	m_entries.clear();
+	m_entries.reserve(total);
+	for (auto& part : parts) {
+		m_entries.insert(m_entries.end(), part.begin(), part.end());
+		std::vector<entry>().swap(part);
+	}
+
+	buildSlots();
+}
+
+void lookupTable::buildSlots()
+{
+	MYASSERT(m_entries.size() < UINT32_MAX - 1);
+
+	// keep the load factor at 3/4 or less
+	size_t slotCount = 16;
+	while (slotCount * 3 < m_entries.size() * 4) {
+		slotCount *= 2;
+	}
+	m_slots.assign(slotCount, {0, 0});
+	m_mask = slotCount - 1;
+
+	for (size_t i = 0; i < m_entries.size(); i++) {
+		const entry& e = m_entries[i];
+		size_t pos = e.hash & m_mask;
+		while (true) {
+			slot& s = m_slots[pos];
+			if (0 == s.idx) {
+				s = {uint32_t(i + 1), e.hash};
+				break;
+			}
+			if (s.hash == e.hash && key(m_entries[s.idx - 1]) == key(e)) {
+				break;   // the first line with this key wins
+			}
+			pos = (pos + 1) & m_mask;
+		}
+	}
+}
+
+bool lookupTable::find(std::string_view k, std::string_view& line) const
+{
+	uint32_t hash = lookupTableHash(k);
+	size_t pos = hash & m_mask;
+	// A loaded index may have no empty slot, so stop after visiting them all
+	for (size_t probes = 0; probes < m_slots.size(); probes++) {
+		const slot& s = m_slots[pos];
+		if (0 == s.idx) {
+			return false;
+		}
+		if (s.hash == hash) {
+			const entry& e = m_entries[s.idx - 1];
+			if (key(e) == k) {
+				line = std::string_view(m_file.data() + e.lineOffset, e.lineLength);
+				return true;
+			}
+		}
+		pos = (pos + 1) & m_mask;
+	}
+	return false;
+}
+
+bool lookupTable::field(std::string_view line, size_t fieldNum, std::string_view& ret) const
+{
+	size_t start = 0;
+	for (size_t i = 1; i < fieldNum; i++) {
+		size_t sep = line.find(m_separator, start);
+		if (sep == std::string_view::npos) {
+			return false;
+		}
+		start = sep + 1;
+	}
+	size_t end = line.find(m_separator, start);
+	ret = line.substr(start, (end == std::string_view::npos) ? std::string_view::npos : end - start);
+	return true;
+}
+
+/*
+ * Reads the saved index if it was made for this version of the file with the
+ * same separator and key field. Returns false if it can't be used.
+ */
+bool lookupTable::loadIndex()
+{
+	FILE* f = fopen(m_indexFileName.c_str(), "rb");
+	if (!f) return false;
+
+	lookupIndexHeader hdr;
+	bool bValid = (1 == fread(&hdr, sizeof(hdr), 1, f))
+			&& 0 == memcmp(hdr.magic, LOOKUP_TABLE_INDEX_MAGIC, sizeof(hdr.magic))
+			&& hdr.fileSize == m_file.size()
+			&& hdr.fileTime == m_fileTime
+			&& hdr.hashCheck == lookupTableHash(LOOKUP_TABLE_INDEX_MAGIC)
+			&& hdr.separator == uint32_t((unsigned char)m_separator)
+			&& hdr.keyField == m_keyField
+			&& hdr.entryCount < UINT32_MAX - 1
+			&& hdr.slotCount >= 16 && 0 == (hdr.slotCount & (hdr.slotCount - 1))
+			&& hdr.slotCount * 3 >= hdr.entryCount * 4;
+
+	if (bValid) {
+		m_entries.resize(size_t(hdr.entryCount));
+		m_slots.resize(size_t(hdr.slotCount));
+		bValid = m_entries.size() == fread(m_entries.data(), sizeof(entry), m_entries.size(), f)
+				&& m_slots.size() == fread(m_slots.data(), sizeof(slot), m_slots.size(), f);
+	}
+	fclose(f);
+
+	// Don't trust the offsets in the index before checking them against the file
+	for (size_t i = 0; bValid && i < m_entries.size(); i++) {
+		const entry& e = m_entries[i];
+		bValid = e.lineOffset + e.lineLength <= m_file.size()
+				&& uint64_t(e.keyOffset) + e.keyLength <= e.lineLength;
+	}
+	for (size_t i = 0; bValid && i < m_slots.size(); i++) {
+		bValid = m_slots[i].idx <= m_entries.size();
+	}
+
+	if (!bValid) {
+		m_entries.clear();
+		m_slots.clear();
+		return false;
+	}
+
+	m_mask = m_slots.size() - 1;
+	return true;
+}
+
+// Saving the index is only an optimization, so failing to do so is not an error
+void lookupTable::saveIndex()
+{
+	lookupIndexHeader hdr;
+	memcpy(hdr.magic, LOOKUP_TABLE_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.fileSize = m_file.size();
+	hdr.fileTime = m_fileTime;
+	hdr.hashCheck = lookupTableHash(LOOKUP_TABLE_INDEX_MAGIC);
+	hdr.separator = uint32_t((unsigned char)m_separator);
+	hdr.keyField = m_keyField;
+	hdr.entryCount = m_entries.size();
+	hdr.slotCount = m_slots.size();
+
+#ifdef WIN64
+	std::string tempFileName = m_indexFileName + ".tmp" + std::to_string(_getpid());
+#else
+	std::string tempFileName = m_indexFileName + ".tmp" + std::to_string(getpid());
+#endif
+	FILE* f = fopen(tempFileName.c_str(), "wb");
+	if (!f) return;
+	bool bWritten = 1 == fwrite(&hdr, sizeof(hdr), 1, f)
+			&& m_entries.size() == fwrite(m_entries.data(), sizeof(entry), m_entries.size(), f)
+			&& m_slots.size() == fwrite(m_slots.data(), sizeof(slot), m_slots.size(), f);
+	bWritten = (0 == fclose(f)) && bWritten;
+#ifdef WIN64
+	if (bWritten) remove(m_indexFileName.c_str());
+#endif
+	if (!bWritten || 0 != rename(tempFileName.c_str(), m_indexFileName.c_str())) {
+		remove(tempFileName.c_str());
+	}
+}
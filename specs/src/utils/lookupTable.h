@@ -0,0 +1,61 @@
+#ifndef SPECS2016__UTILS__LOOKUP_TABLE__H
+#define SPECS2016__UTILS__LOOKUP_TABLE__H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "utils/mappedFile.h"
+
+/*
+ * A keyed reference file for joins. Each line of the file is a record; the
+ * fields are separated by a single character, and one of them is the key.
+ *
+ * The file is mapped into memory and indexed once: the index holds only the
+ * position of each line and of its key, and the lines themselves are never
+ * copied. Large files are indexed by several threads, each taking a range of
+ * lines. The index can be saved next to the file, and is then reused as long
+ * as the file does not change.
+ *
+ * When a key appears in more than one line, the first one is found.
+ */
+class lookupTable {
+public:
+	lookupTable(const std::string& fileName, char separator, size_t keyField, bool bCacheIndex);
+	lookupTable(const lookupTable&) = delete;
+	lookupTable& operator=(const lookupTable&) = delete;
+
+	bool             find(std::string_view key, std::string_view& line) const;
+	// Returns field number `field` (1-based) of the line, or false if the line has fewer fields
+	bool             field(std::string_view line, size_t field, std::string_view& ret) const;
+	size_t           size() const  { return m_entries.size(); }
+private:
+	struct entry {
+		uint64_t      lineOffset;
+		uint32_t      lineLength;
+		uint32_t      keyOffset;     // from the start of the line
+		uint32_t      keyLength;
+		uint32_t      hash;
+	};
+	struct slot {
+		uint32_t      idx;     // entry number plus one; zero is an empty slot
+		uint32_t      hash;
+	};
+	bool             index(size_t from, size_t to, std::vector<entry>& entries) const;
+	void             buildIndex();
+	void             buildSlots();
+	bool             loadIndex();
+	void             saveIndex();
+	std::string_view key(const entry& e) const  { return std::string_view(m_file.data() + e.lineOffset + e.keyOffset, e.keyLength); }
+
+	std::string          m_fileName;
+	std::string          m_indexFileName;
+	char                 m_separator;
+	size_t               m_keyField;
+	mappedFile           m_file;
+	int64_t              m_fileTime;
+	std::vector<entry>   m_entries;
+	std::vector<slot>    m_slots;
+	size_t               m_mask;
+};
+
+#endif
@@ -41,6 +41,7 @@ template <class S, class T>
 class lruCache {
 public:
 	lruCache(size_t lowWM, size_t highWM) {
+		MYASSERT(lowWM > 0 && lowWM < highWM);
 		m_highWM = highWM;
 		m_lowWM = lowWM;
 		m_counter = 0;
@@ -89,7 +90,8 @@ private:
 			return p1->getLRU() > p2->getLRU();
 		});
 
-		uint64_t cutoff = vec[m_lowWM]->getLRU();
+		// Keep the m_lowWM most recently used
+		uint64_t cutoff = vec[m_lowWM-1]->getLRU();
 
 		for (auto it = m_map.begin() ; it != m_map.end() ; ) {
 			if (it->second->getLRU() < cutoff) {
@@ -0,0 +1,53 @@
+#include <fstream>
+#include <iterator>
+#ifndef WIN64
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "utils/mappedFile.h"
+
+bool mappedFile::open(const std::string& fileName)
+{
+	close();
+
+#ifndef WIN64
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	bool bStat = (0 == fstat(fd, &st));
+	bool bEmpty = bStat && 0 == st.st_size;
+	if (bStat && !bEmpty) {
+		void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED) {
+			m_pData = (const char*)p;
+			m_size = size_t(st.st_size);
+			m_bMapped = true;
+		}
+	}
+	::close(fd);
+	if (m_bMapped || bEmpty) return true;
+#endif
+
+	// Not mappable - read it
+	std::ifstream f(fileName, std::ios::binary);
+	if (!f.is_open()) return false;
+	m_buffer.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+	m_pData = m_buffer.data();
+	m_size = m_buffer.size();
+	return true;
+}
+
+void mappedFile::close()
+{
+#ifndef WIN64
+	if (m_bMapped) {
+		munmap((void*)m_pData, m_size);
+	}
+#endif
+	m_pData = nullptr;
+	m_size = 0;
+	m_bMapped = false;
+	m_buffer.clear();
+}
@@ -0,0 +1,31 @@
+#ifndef SPECS2016__UTILS__MAPPED_FILE__H
+#define SPECS2016__UTILS__MAPPED_FILE__H
+
+#include <string>
+#include <string_view>
+
+/*
+ * A read-only view of an entire file. On POSIX systems the file is mapped into
+ * memory, so only the pages that are actually read are loaded. Elsewhere the
+ * file is read into a buffer.
+ */
+class mappedFile {
+public:
+	mappedFile()   { m_pData = nullptr; m_size = 0; m_bMapped = false; }
+	~mappedFile()  { close(); }
+	mappedFile(const mappedFile&) = delete;
+	mappedFile& operator=(const mappedFile&) = delete;
+
+	bool             open(const std::string& fileName);   // false if the file cannot be opened
+	void             close();
+	const char*      data() const  { return m_pData; }
+	size_t           size() const  { return m_size; }
+	std::string_view view() const  { return std::string_view(m_pData, m_size); }
+private:
+	const char*      m_pData;
+	size_t           m_size;
+	bool             m_bMapped;
+	std::string      m_buffer;
+};
+
+#endif
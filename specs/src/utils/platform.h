@@ -83,6 +83,21 @@ int setenv(const char *name, const char *value, int overwrite);
   #error "No random number generator defined"
 #endif
 
+// The string conversions have SSSE3 and AVX2 kernels, chosen at run time
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONVERSION_KERNELS_X86
+#endif
+
+// Python functions can run in a pool of forked worker processes
+#ifndef WIN64
+#define PYTHON_WORKER_POOL
+#endif
+
+// specs can run as a server that forks a process for each request
+#ifndef WIN64
+#define SPECS_SERVER
+#endif
+
 #ifdef DEBUG
 #define QUEUE_HIGH_WM 10
 #define QUEUE_LOW_WM  8
@@ -0,0 +1,58 @@
+#ifndef SPECS2016__UTILS__SERIAL_BUFFER__H
+#define SPECS2016__UTILS__SERIAL_BUFFER__H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/*
+ * A simple binary encoding for data that specs saves for its own later use,
+ * such as the compiled specification cache. Integers are written as eight
+ * bytes in the native byte order, because the data is never read by another
+ * build, and strings as their length followed by their bytes.
+ *
+ * The reader returns false rather than throw when the data runs out, so that
+ * a truncated or damaged file is simply not used.
+ */
+class serialWriter {
+public:
+	void               putInt(uint64_t i)   { m_data.append((const char*)(&i), sizeof(i)); }
+	void               putBool(bool b)      { m_data += (b ? '\1' : '\0'); }
+	void               putString(const std::string& s) {
+		putInt(s.length());
+		m_data.append(s);
+	}
+	std::string&       data()               { return m_data; }
+private:
+	std::string m_data;
+};
+
+class serialReader {
+public:
+	serialReader(std::string_view data) : m_data(data) {}
+	bool               getInt(uint64_t& i) {
+		if (m_data.length() < sizeof(i)) return false;
+		memcpy(&i, m_data.data(), sizeof(i));
+		m_data.remove_prefix(sizeof(i));
+		return true;
+	}
+	bool               getBool(bool& b) {
+		if (m_data.empty()) return false;
+		b = (m_data[0] != '\0');
+		m_data.remove_prefix(1);
+		return true;
+	}
+	bool               getString(std::string& s) {
+		uint64_t len;
+		if (!getInt(len) || m_data.length() < len) return false;
+		s.assign(m_data.data(), size_t(len));
+		m_data.remove_prefix(size_t(len));
+		return true;
+	}
+	bool               atEnd()              { return m_data.empty(); }
+private:
+	std::string_view m_data;
+};
+
+#endif
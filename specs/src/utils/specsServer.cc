@@ -0,0 +1,332 @@
+#include "utils/specsServer.h"
+
+#ifdef SPECS_SERVER
+
+#include <map>
+#include <iostream>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "utils/ErrorReporting.h"
+#include "utils/PythonIntf.h"
+#include "utils/serialBuffer.h"
+#include "processing/Config.h"
+
+#define SPECS_SERVER_MAX_REQUEST   (64 << 20)
+
+extern char** environ;
+
+static int g_wakeUpPipe[2] = {-1, -1};
+static volatile sig_atomic_t g_bStopServer = 0;
+
+// The signal handlers only wake up the main loop, which does the actual work
+static void wakeUp()
+{
+	int savedErrno = errno;
+	char c = 0;
+	if (write(g_wakeUpPipe[1], &c, 1) < 0) {
+		// The pipe is full, so the main loop will wake up anyway
+	}
+	errno = savedErrno;
+}
+
+static void onChildExit(int)
+{
+	wakeUp();
+}
+
+static void onStopSignal(int)
+{
+	g_bStopServer = 1;
+	wakeUp();
+}
+
+static void setSignalHandler(int sig, void (*handler)(int), int flags)
+{
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handler;
+	sa.sa_flags = flags;
+	sigemptyset(&sa.sa_mask);
+	sigaction(sig, &sa, nullptr);
+}
+
+static bool sendAll(int fd, const char* p, size_t len)
+{
+	while (len > 0) {
+		ssize_t written = write(fd, p, len);
+		if (written < 0 && errno == EINTR) continue;
+		if (written <= 0) return false;
+		p += written;
+		len -= size_t(written);
+	}
+	return true;
+}
+
+static bool receiveAll(int fd, char* p, size_t len)
+{
+	while (len > 0) {
+		ssize_t got = read(fd, p, len);
+		if (got < 0 && errno == EINTR) continue;
+		if (got <= 0) return false;
+		p += got;
+		len -= size_t(got);
+	}
+	return true;
+}
+
+static int listenOnSocket(const std::string& path)
+{
+	struct sockaddr_un addr;
+	if (path.length() >= sizeof(addr.sun_path)) {
+		std::string err = "The path of the server socket is too long: " + path;
+		MYTHROW(err);
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path.c_str(), path.length());
+
+	// A socket that is left over from a server that did not stop cleanly is replaced
+	struct stat st;
+	if (0 == stat(path.c_str(), &st) && S_ISSOCK(st.st_mode)) {
+		int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		bool bInUse = probe >= 0 && 0 == connect(probe, (struct sockaddr*)&addr, sizeof(addr));
+		if (probe >= 0) {
+			close(probe);
+		}
+		if (bInUse) {
+			std::string err = "A specs server is already listening on " + path;
+			MYTHROW(err);
+		}
+		unlink(path.c_str());
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		std::string err = std::string("Cannot create the server socket: ") + strerror(errno);
+		MYTHROW(err);
+	}
+
+	// Only this user may send requests
+	mode_t prevMask = umask(0077);
+	int rc = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+	umask(prevMask);
+	if (0 != rc || 0 != listen(fd, SOMAXCONN)) {
+		std::string err = "Cannot listen on " + path + ": " + strerror(errno);
+		close(fd);
+		MYTHROW(err);
+	}
+	return fd;
+}
+
+static bool readRequest(int conn, int fds[], std::string& cwd, uint64_t& mask,
+		std::vector<std::string>& args, std::vector<std::string>& env)
+{
+	uint64_t len;
+	struct iovec iov;
+	iov.iov_base = &len;
+	iov.iov_len = sizeof(len);
+	union {
+		struct cmsghdr hdr;
+		char           buf[CMSG_SPACE(sizeof(int) * SPECS_SERVER_FD_COUNT)];
+	} control;
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	ssize_t got;
+	do {
+		got = recvmsg(conn, &msg, 0);
+	} while (got < 0 && errno == EINTR);
+	if (got != ssize_t(sizeof(len)) || len > SPECS_SERVER_MAX_REQUEST) return false;
+
+	struct cmsghdr* pHdr = CMSG_FIRSTHDR(&msg);
+	if (!pHdr || pHdr->cmsg_level != SOL_SOCKET || pHdr->cmsg_type != SCM_RIGHTS ||
+			pHdr->cmsg_len != CMSG_LEN(sizeof(int) * SPECS_SERVER_FD_COUNT)) {
+		return false;
+	}
+	memcpy(fds, CMSG_DATA(pHdr), sizeof(int) * SPECS_SERVER_FD_COUNT);
+
+	std::string data(size_t(len), '\0');
+	if (!receiveAll(conn, &data[0], data.length())) return false;
+
+	serialReader rd(data);
+	std::string magic;
+	uint64_t count;
+	if (!rd.getString(magic) || magic != SPECS_SERVER_MAGIC || !rd.getString(cwd) || !rd.getInt(mask)) {
+		return false;
+	}
+	if (!rd.getInt(count)) return false;
+	for (uint64_t i = 0 ; i < count ; i++) {
+		std::string s;
+		if (!rd.getString(s)) return false;
+		args.push_back(s);
+	}
+	if (!rd.getInt(count)) return false;
+	for (uint64_t i = 0 ; i < count ; i++) {
+		std::string s;
+		if (!rd.getString(s)) return false;
+		env.push_back(s);
+	}
+	return rd.atEnd() && !args.empty();
+}
+
+// Runs in the process forked for a request
+static bool becomeRequest(int conn, std::vector<std::string>& args)
+{
+	int fds[SPECS_SERVER_FD_COUNT];
+	std::string cwd;
+	uint64_t mask;
+	std::vector<std::string> env;
+	bool bValid = readRequest(conn, fds, cwd, mask, args, env);
+	close(conn);
+	if (!bValid) {
+		std::cerr << "specs server: Received an invalid request\n";
+		return false;
+	}
+
+	for (int i = 0 ; i < SPECS_SERVER_FD_COUNT ; i++) {
+		dup2(fds[i], i);
+	}
+	for (int i = 0 ; i < SPECS_SERVER_FD_COUNT ; i++) {
+		if (fds[i] >= SPECS_SERVER_FD_COUNT) {
+			close(fds[i]);
+		}
+	}
+
+	if (0 != chdir(cwd.c_str())) {
+		std::cerr << "Error: Cannot change to directory " << cwd << ": " << strerror(errno) << "\n";
+		return false;
+	}
+	umask(mode_t(mask));
+
+	std::vector<std::string> names;
+	for (char** ppVar = environ ; *ppVar ; ppVar++) {
+		const char* pEquals = strchr(*ppVar, '=');
+		names.emplace_back(*ppVar, pEquals ? size_t(pEquals - *ppVar) : strlen(*ppVar));
+	}
+	for (auto& name : names) {
+		unsetenv(name.c_str());
+	}
+	for (auto& var : env) {
+		auto equalsPos = var.find('=');
+		if (std::string::npos == equalsPos || 0 == equalsPos) continue;
+		setenv(var.substr(0, equalsPos).c_str(), var.substr(equalsPos + 1).c_str(), 1);
+	}
+	tzset();
+
+	return true;
+}
+
+// Tells the clients of the requests that have ended how they ended
+static void reapRequests(std::map<pid_t,int>& requests, bool bWait)
+{
+	int status;
+	pid_t pid;
+	while (!requests.empty() && (pid = waitpid(-1, &status, bWait ? 0 : WNOHANG)) != 0) {
+		if (pid < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		auto it = requests.find(pid);
+		if (it == requests.end()) continue;
+		uint64_t rc = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+		sendAll(it->second, (const char*)(&rc), sizeof(rc));  // the client may be gone
+		close(it->second);
+		requests.erase(it);
+	}
+}
+
+bool specsServerListen(const std::string& path, std::vector<std::string>& args)
+{
+	int listenFd = listenOnSocket(path);
+	if (0 != pipe(g_wakeUpPipe)) {
+		std::string err = std::string("Cannot create a pipe for the server: ") + strerror(errno);
+		close(listenFd);
+		MYTHROW(err);
+	}
+	fcntl(g_wakeUpPipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(g_wakeUpPipe[1], F_SETFL, O_NONBLOCK);
+
+	setSignalHandler(SIGCHLD, onChildExit, SA_NOCLDSTOP);
+	setSignalHandler(SIGINT, onStopSignal, 0);
+	setSignalHandler(SIGTERM, onStopSignal, 0);
+	setSignalHandler(SIGPIPE, SIG_IGN, 0);
+
+	if (g_bVerbose) {
+		std::cerr << "specs server: Listening on " << path << std::endl;
+	}
+
+	std::map<pid_t,int> requests;   // the process of each request, and the connection to its client
+	while (!g_bStopServer) {
+		struct pollfd pfds[2];
+		pfds[0].fd = listenFd;
+		pfds[0].events = POLLIN;
+		pfds[1].fd = g_wakeUpPipe[0];
+		pfds[1].events = POLLIN;
+		if (poll(pfds, 2, -1) < 0) {
+			if (errno == EINTR) continue;
+			std::cerr << "specs server: " << strerror(errno) << "\n";
+			break;
+		}
+
+		if (pfds[1].revents & POLLIN) {
+			char buf[64];
+			while (read(g_wakeUpPipe[0], buf, sizeof(buf)) > 0) {}
+			reapRequests(requests, false);
+		}
+
+		if (!(pfds[0].revents & POLLIN)) continue;
+		int conn = accept(listenFd, nullptr, nullptr);
+		if (conn < 0) continue;
+
+		pid_t pid = pid_t(pythonAwareFork());
+		if (0 == pid) {
+			setSignalHandler(SIGCHLD, SIG_DFL, 0);
+			setSignalHandler(SIGINT, SIG_DFL, 0);
+			setSignalHandler(SIGTERM, SIG_DFL, 0);
+			setSignalHandler(SIGPIPE, SIG_DFL, 0);
+			close(listenFd);
+			close(g_wakeUpPipe[0]);
+			close(g_wakeUpPipe[1]);
+			for (auto& request : requests) {
+				close(request.second);
+			}
+			if (!becomeRequest(conn, args)) {
+				exit(-4);
+			}
+			return true;
+		}
+		if (pid < 0) {
+			close(conn);   // the client sees that the request has failed
+			continue;
+		}
+		requests[pid] = conn;
+	}
+
+	// Requests that are still running are allowed to finish
+	close(listenFd);
+	unlink(path.c_str());
+	reapRequests(requests, true);
+	close(g_wakeUpPipe[0]);
+	close(g_wakeUpPipe[1]);
+
+	if (g_bVerbose) {
+		std::cerr << "specs server: Stopped" << std::endl;
+	}
+	return false;
+}
+
+#endif
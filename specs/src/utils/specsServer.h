@@ -0,0 +1,41 @@
+#ifndef SPECS2016__UTILS__SPECS_SERVER__H
+#define SPECS2016__UTILS__SPECS_SERVER__H
+
+#include <string>
+#include <vector>
+#include "utils/platform.h"
+
+#ifdef SPECS_SERVER
+
+/*
+ * specs --server PATH listens on a Unix socket and runs each request in a
+ * process forked from the server, so every request starts from the same fresh
+ * state as a direct run, while the work the server did before listening (such
+ * as starting Python) is already done. The specs-client program sends the
+ * requests.
+ *
+ * A request is an eight-byte length followed by a serialWriter buffer of that
+ * length. The client's standard input, output and error are passed along with
+ * the length. The buffer holds:
+ *   - SPECS_SERVER_MAGIC
+ *   - the client's working directory
+ *   - the client's umask
+ *   - the number of arguments, and then the arguments including argv[0]
+ *   - the number of environment variables, and then each one as NAME=VALUE
+ * When the request ends, the server replies with its exit status as eight bytes.
+ */
+#define SPECS_SERVER_MAGIC        "SPECSRQ1"
+#define SPECS_SERVER_ENV_VAR      "SPECS_SERVER"
+#define SPECS_SERVER_FD_COUNT     3
+
+/*
+ * Listens on the socket until the server is stopped with SIGINT or SIGTERM,
+ * and then returns false. In the process forked for a request it returns true,
+ * after taking on the client's standard streams, working directory, umask and
+ * environment, with the request's arguments in args.
+ */
+bool specsServerListen(const std::string& path, std::vector<std::string>& args);
+
+#endif
+
+#endif
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "utils/tDigest.h"
+
+tDigest::tDigest(double compression)
+{
+	m_compression = compression;
+	m_bufferLimit = size_t(5 * compression);
+	m_buffer.reserve(m_bufferLimit);
+	m_totalCount = 0;
+	m_min = std::numeric_limits<double>::infinity();
+	m_max = -std::numeric_limits<double>::infinity();
+}
+
+void tDigest::add(double value)
+{
+	if (std::isnan(value)) return;
+	if (value < m_min) m_min = value;
+	if (value > m_max) m_max = value;
+	m_buffer.push_back(value);
+	m_totalCount++;
+	if (m_buffer.size() >= m_bufferLimit) {
+		merge();
+	}
+}
+
+void tDigest::merge()
+{
+	if (m_buffer.empty()) return;
+
+	std::vector<centroid> all;
+	all.reserve(m_centroids.size() + m_buffer.size());
+	all.insert(all.end(), m_centroids.begin(), m_centroids.end());
+	for (double v : m_buffer) {
+		all.push_back({v, 1.0});
+	}
+	m_buffer.clear();
+	std::sort(all.begin(), all.end(), [](const centroid& c1, const centroid& c2) {
+		return c1.mean < c2.mean;
+	});
+
+	// A centroid covering quantiles q0..q1 may weigh at most 4*N*q*(1-q)/compression
+	// at both ends, so the tails stay close to singletons
+	const double total = double(m_totalCount);
+	m_centroids.clear();
+	centroid cur = all[0];
+	double weightSoFar = 0.0;
+	for (size_t i = 1; i < all.size(); i++) {
+		double proposed = cur.weight + all[i].weight;
+		double q0 = weightSoFar / total;
+		double q1 = (weightSoFar + proposed) / total;
+		double limit = 4.0 * total * std::min(q0 * (1 - q0), q1 * (1 - q1)) / m_compression;
+		if (proposed <= limit) {
+			cur.mean += (all[i].mean - cur.mean) * all[i].weight / proposed;
+			cur.weight = proposed;
+		} else {
+			weightSoFar += cur.weight;
+			m_centroids.push_back(cur);
+			cur = all[i];
+		}
+	}
+	m_centroids.push_back(cur);
+}
+
+double tDigest::quantile(double q)
+{
+	merge();
+	if (m_centroids.empty()) {
+		return std::numeric_limits<double>::quiet_NaN();
+	}
+	if (q <= 0.0) return m_min;
+	if (q >= 1.0) return m_max;
+	if (m_centroids.size() == 1) return m_centroids[0].mean;
+
+	const double total = double(m_totalCount);
+	const double index = q * total;
+
+	// Before the center of the first centroid or after that of the last, interpolate to the extremes
+	const centroid& first = m_centroids.front();
+	if (index < first.weight / 2) {
+		return m_min + (first.mean - m_min) * index / (first.weight / 2);
+	}
+	const centroid& last = m_centroids.back();
+	if (index > total - last.weight / 2) {
+		return m_max - (m_max - last.mean) * (total - index) / (last.weight / 2);
+	}
+
+	// Otherwise interpolate between the centers of the two neighboring centroids
+	double center = first.weight / 2;
+	for (size_t i = 1; i < m_centroids.size(); i++) {
+		const centroid& prev = m_centroids[i-1];
+		const centroid& next = m_centroids[i];
+		double nextCenter = center + (prev.weight + next.weight) / 2;
+		if (index <= nextCenter) {
+			return prev.mean + (next.mean - prev.mean) * (index - center) / (nextCenter - center);
+		}
+		center = nextCenter;
+	}
+
+	return m_max;
+}
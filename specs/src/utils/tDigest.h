@@ -0,0 +1,39 @@
+#ifndef SPECS2016__UTILS__T_DIGEST__H
+#define SPECS2016__UTILS__T_DIGEST__H
+
+#include <memory>
+#include <vector>
+
+/*
+ * A merging t-digest (Dunning & Ertl) for streaming quantile estimates.
+ *
+ * Values are buffered and periodically merged into a sorted list of centroids.
+ * Centroids near the tails are kept small, so extreme quantiles such as the
+ * 99th percentile are more accurate than the median. Memory is bounded by the
+ * compression parameter, not by the number of values.
+ */
+class tDigest {
+public:
+	tDigest(double compression = 100.0);
+	void             add(double value);
+	double           quantile(double q);   // q is in the range 0..1
+	size_t           count() const  { return m_totalCount; }
+private:
+	struct centroid {
+		double    mean;
+		double    weight;
+	};
+	void             merge();
+
+	double                 m_compression;
+	std::vector<centroid>  m_centroids;
+	std::vector<double>    m_buffer;
+	size_t                 m_bufferLimit;
+	size_t                 m_totalCount;
+	double                 m_min;
+	double                 m_max;
+};
+
+typedef std::shared_ptr<tDigest> PTDigest;
+
+#endif
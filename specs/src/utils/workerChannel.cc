@@ -0,0 +1,159 @@
+#include "utils/workerChannel.h"
+
+#ifdef PYTHON_WORKER_POOL
+
+#include <algorithm>
+#include <cstdint>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include "utils/ErrorReporting.h"
+
+#define WORKER_CHANNEL_INITIAL_SIZE  (1 << 20)
+
+#ifdef MSG_NOSIGNAL
+#define WORKER_CHANNEL_SEND_FLAGS    MSG_NOSIGNAL    // a worker that died is an error, not a signal
+#else
+#define WORKER_CHANNEL_SEND_FLAGS    0
+#endif
+
+workerChannel::workerChannel()
+{
+	m_shmFd = m_parentFd = m_workerFd = -1;
+	m_pData = nullptr;
+	m_mappedSize = 0;
+}
+
+void workerChannel::create()
+{
+#ifdef __linux__
+	m_shmFd = memfd_create("specs-worker", MFD_CLOEXEC);
+#else
+	std::string name = "/specs-worker-" + std::to_string(getpid()) + "-" + std::to_string(uintptr_t(this));
+	m_shmFd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (m_shmFd >= 0) {
+		shm_unlink(name.c_str());
+	}
+#endif
+	if (m_shmFd < 0) {
+		std::string err = std::string("Cannot create shared memory for a worker process: ") + strerror(errno);
+		MYTHROW(err);
+	}
+	if (0 != ftruncate(m_shmFd, WORKER_CHANNEL_INITIAL_SIZE)) {
+		std::string err = std::string("Cannot size shared memory for a worker process: ") + strerror(errno);
+		MYTHROW(err);
+	}
+	map(WORKER_CHANNEL_INITIAL_SIZE);
+
+	int fds[2];
+	if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+		std::string err = std::string("Cannot create a socket for a worker process: ") + strerror(errno);
+		MYTHROW(err);
+	}
+	m_parentFd = fds[0];
+	m_workerFd = fds[1];
+}
+
+void workerChannel::becomeParent()
+{
+	::close(m_workerFd);
+	m_workerFd = -1;
+}
+
+void workerChannel::becomeWorker()
+{
+	::close(m_parentFd);
+	m_parentFd = m_workerFd;
+	m_workerFd = -1;
+}
+
+void workerChannel::close()
+{
+	if (m_pData) {
+		munmap(m_pData, m_mappedSize);
+		m_pData = nullptr;
+		m_mappedSize = 0;
+	}
+	if (m_shmFd >= 0) {
+		::close(m_shmFd);
+		m_shmFd = -1;
+	}
+	if (m_parentFd >= 0) {
+		::close(m_parentFd);
+		m_parentFd = -1;
+	}
+	if (m_workerFd >= 0) {
+		::close(m_workerFd);
+		m_workerFd = -1;
+	}
+}
+
+void workerChannel::map(size_t size)
+{
+	if (m_pData) {
+		munmap(m_pData, m_mappedSize);
+	}
+	void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_shmFd, 0);
+	if (p == MAP_FAILED) {
+		m_pData = nullptr;
+		m_mappedSize = 0;
+		std::string err = std::string("Cannot map shared memory for a worker process: ") + strerror(errno);
+		MYTHROW(err);
+	}
+	m_pData = (char*)p;
+	m_mappedSize = size;
+}
+
+void workerChannel::send(const std::string& msg)
+{
+	uint64_t len = msg.length();
+	if (len > m_mappedSize) {
+		size_t newSize = std::max(size_t(len), 2 * m_mappedSize);
+		if (0 != ftruncate(m_shmFd, off_t(newSize))) {
+			std::string err = std::string("Cannot grow shared memory for a worker process: ") + strerror(errno);
+			MYTHROW(err);
+		}
+		map(newSize);
+	}
+	memcpy(m_pData, msg.data(), len);
+
+	const char* p = (const char*)(&len);
+	size_t remaining = sizeof(len);
+	while (remaining > 0) {
+		ssize_t written = ::send(m_parentFd, p, remaining, WORKER_CHANNEL_SEND_FLAGS);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			MYTHROW("A Python worker process has ended unexpectedly");
+		}
+		p += written;
+		remaining -= size_t(written);
+	}
+}
+
+bool workerChannel::receive(std::string_view& msg)
+{
+	uint64_t len;
+	char* p = (char*)(&len);
+	size_t remaining = sizeof(len);
+	while (remaining > 0) {
+		ssize_t got = ::recv(m_parentFd, p, remaining, 0);
+		if (got < 0 && errno == EINTR) continue;
+		if (got <= 0) return false;
+		p += got;
+		remaining -= size_t(got);
+	}
+
+	if (len > m_mappedSize) {
+		struct stat st;
+		MYASSERT(0 == fstat(m_shmFd, &st) && uint64_t(st.st_size) >= len);
+		map(size_t(st.st_size));
+	}
+	msg = std::string_view(m_pData, size_t(len));
+	return true;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef SPECS2016__UTILS__WORKER_CHANNEL__H
+#define SPECS2016__UTILS__WORKER_CHANNEL__H
+
+#include <string>
+#include <string_view>
+#include "utils/platform.h"
+
+#ifdef PYTHON_WORKER_POOL
+
+/*
+ * A two-way channel between specs and one of its worker processes. Messages
+ * are written into a buffer in shared memory, and a socket carries only their
+ * length. The two sides take turns, so the buffer is never written by both at
+ * once. It grows when a message does not fit, and the other side maps it
+ * again when it gets a message that is longer than its mapping.
+ *
+ * The channel is created before fork(). Afterwards each process calls
+ * either becomeParent() or becomeWorker() to keep its end of the socket.
+ */
+class workerChannel {
+public:
+	workerChannel();
+	~workerChannel()  { close(); }
+	workerChannel(const workerChannel&) = delete;
+	workerChannel& operator=(const workerChannel&) = delete;
+
+	void   create();
+	void   becomeParent();
+	void   becomeWorker();
+	void   close();
+
+	void   send(const std::string& msg);
+	// Returns false when the other side has closed the channel. The message
+	// is valid until the next call to send or receive.
+	bool   receive(std::string_view& msg);
+private:
+	void   map(size_t size);
+
+	int    m_shmFd;
+	int    m_parentFd;
+	int    m_workerFd;
+	char*  m_pData;
+	size_t m_mappedSize;
+};
+
+#endif
+
+#endif
@@ -69,7 +69,7 @@ def cleanup():
 def cleanup_valgrind():
     os.system("/bin/rm valgrind.out* 2> /dev/null")
 
-def leak_check_specs(spec, inp, testid, confFile, inp2=None):
+def leak_check_specs(spec, inp, testid, confFile, inp2=None, prog="../exe/specs"):
     global keep_specs_output
     if keep_specs_output:
     	specfile = "thespec."+str(testid)
@@ -99,8 +99,8 @@ def leak_check_specs(spec, inp, testid, confFile, inp2=None):
     		i.write(inp2)
     		
     if inp2 is None:
-    	cmd = "../exe/specs -c {} -f {} -i {} -o {}".format(conffile, specfile,inpfile,outfile)
+    	cmd = "{} -c {} -f {} -i {} -o {}".format(prog, conffile, specfile,inpfile,outfile)
     else:
-    	cmd = "../exe/specs -c {} -f {} -i {} --is2 {} -o {}".format(conffile, specfile,inpfile,inp2file,outfile)
+    	cmd = "{} -c {} -f {} -i {} --is2 {} -o {}".format(prog, conffile, specfile,inpfile,inp2file,outfile)
     return leak_check(cmd,str(testid))
 
@@ -1,10 +1,10 @@
-import os,sys
+import os,sys,subprocess,time
 
 def run_cmd(spec, force=False):
 	if force:
-		cmd = "../exe/specs --pythonFuncs on --set SPECSPATH=/tmp -o theout " + spec + "&> theerr"
+		cmd = "../exe/specs --pythonFuncs on --set SPECSPATH=/tmp -o theout " + spec + " > theerr 2>&1 < /dev/null"
 	else:
-		cmd = "../exe/specs --set SPECSPATH=/tmp -o theout " + spec + "&> theerr"
+		cmd = "../exe/specs --set SPECSPATH=/tmp -o theout " + spec + " > theerr 2>&1 < /dev/null"
 	rc = os.system(cmd)
 	if rc!=0 and rc!=2048:
 		ret = "RC="+str(rc)
@@ -113,7 +113,7 @@ else:
 # string parameter - should abend
 sys.stdout.write("Test 08 (bad parameter; should abend) -- ")
 ret = run_cmd('print "plus1(\'hello\')" 1')
-if ret=="Runtime error. Error in external function":
+if ret.startswith("TypeError"):
 	sys.stdout.write("OK\n")
 else:
 	sys.stdout.write("Not OK: <"+ret+">\n")
@@ -149,3 +149,241 @@ if ret=="120":
 	sys.stdout.write("OK\n")
 else:
 	sys.stdout.write("Not OK: <"+ret+">\n")
+
+# A function with a batch form
+lff = '''
+def plus1(a):
+	return int(a)+1
+
+batch_count = 0
+def _plus1_batch(calls):
+	global batch_count
+	batch_count = batch_count + 1
+	return [int(a)+1 for (a,) in calls]
+
+plus1.specs_batch = _plus1_batch
+
+def how_many_batches():
+	return batch_count
+'''
+set_localfuncs(lff)
+with open("/tmp/pytest_input", "w") as in_file:
+	in_file.write("1\n2\n3\n4\n5\n")
+
+sys.stdout.write("Test 13 (batch form) -- ")
+ret = run_cmd('--set pythonBatch=2 -i /tmp/pytest_input w1 1 print "plus1(word(1))" nw')
+if ret=="1 2\n2 3\n3 4\n4 5\n5 6":
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret+">\n")
+
+sys.stdout.write("Test 14 (records are held until the batch returns) -- ")
+ret = run_cmd('--set pythonBatch=2 -i /tmp/pytest_input print "how_many_batches()" 1 print "plus1(word(1))" nw')
+if ret=="0 2\n0 3\n1 4\n1 5\n2 6":
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret+">\n")
+
+sys.stdout.write("Test 15 (no batching when the call is not the last item) -- ")
+ret = run_cmd('--set pythonBatch=2 -i /tmp/pytest_input print "plus1(word(1))" 1 print "how_many_batches()" nw')
+if ret=="2 0\n3 0\n4 0\n5 0\n6 0":
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret+">\n")
+
+os.system("/bin/rm /tmp/pytest_input")
+
+# A pure function
+lff = '''
+calls = 0
+
+@specs_pure
+def square(a):
+	global calls
+	calls = calls + 1
+	return int(a) * int(a)
+
+def how_many_calls():
+	return calls
+'''
+set_localfuncs(lff)
+with open("/tmp/pytest_input", "w") as in_file:
+	in_file.write("3\n4\n3\n3\n4\n")
+
+sys.stdout.write("Test 16 (pure function) -- ")
+ret = run_cmd('-i /tmp/pytest_input print "square(word(1))" 1 print "how_many_calls()" nw')
+if ret=="9 1\n16 2\n9 2\n9 2\n16 2":
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret+">\n")
+
+sys.stdout.write("Test 17 (pure function without the cache) -- ")
+ret = run_cmd('--set pythonPureCache=0 -i /tmp/pytest_input print "square(word(1))" 1 print "how_many_calls()" nw')
+if ret=="9 1\n16 2\n9 3\n9 4\n16 5":
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret+">\n")
+
+sys.stdout.write("Test 18 (pure function in worker processes) -- ")
+ret = run_cmd('--pythonWorkers 2 -i /tmp/pytest_input print "how_many_calls()" 1 print "square(word(1))" nw')
+if ret=="0 9\n0 16\n0 9\n0 9\n0 16":
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret+">\n")
+
+sys.stdout.write("Test 19 (saved function table) -- ")
+ret = run_cmd('-i /tmp/pytest_input print "square(word(1))" 1')
+if ret=="9\n16\n9\n9\n16" and os.path.exists("/tmp/localfuncs.py.specsfuncs"):
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret+">\n")
+
+# Same size, and probably the same time, as the previous localfuncs.py
+set_localfuncs(lff.replace("int(a) * int(a)", "int(a) + int(a)"))
+sys.stdout.write("Test 20 (changed functions are loaded again) -- ")
+ret = run_cmd('-i /tmp/pytest_input print "square(word(1))" 1')
+if ret=="6\n8\n6\n6\n8":
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret+">\n")
+
+os.system("/bin/rm /tmp/pytest_input /tmp/localfuncs.py.specsfuncs")
+
+# Functions that tell whether they ran in a worker process. The workers are
+# forked after localfuncs.py is loaded, so they see the parent's pid.
+lff = '''
+import os
+parent = os.getpid()
+
+def where(a):
+	return "worker" if os.getpid() != parent else "parent"
+
+def _where_batch(calls):
+	return [where(a) for (a,) in calls]
+
+where.specs_batch = _where_batch
+
+@specs_pure
+def where_pure(a):
+	return where(a)
+
+@specs_pure
+def divide6(a):
+	return 6 // (3 - int(a))
+
+@specs_pure
+def big(a):
+	return a * (3 << 19)
+'''
+set_localfuncs(lff)
+with open("/tmp/pytest_input", "w") as in_file:
+	in_file.write("1\n2\n3\n4\n5\n")
+
+sys.stdout.write("Test 21 (batch form in worker processes) -- ")
+ret = run_cmd('--pythonWorkers 2 -i /tmp/pytest_input print "where(word(1))" 1')
+if ret=="worker\nworker\nworker\nworker\nworker":
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret+">\n")
+
+sys.stdout.write("Test 22 (pure function runs in worker processes) -- ")
+ret = run_cmd('--pythonWorkers 2 -i /tmp/pytest_input print "where_pure(word(1))" 1')
+if ret=="worker\nworker\nworker\nworker\nworker":
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret+">\n")
+
+# The third call fails, in the second worker
+sys.stdout.write("Test 23 (error in a worker process; earlier records are written) -- ")
+run_cmd('--pythonWorkers 2 --pythonErr throw --set pythonBatch=4 -i /tmp/pytest_input w1 1 print "divide6(word(1))" nw')
+out = err = ""
+if os.path.exists("theout"):
+	with open("theout","r") as out_file:
+		out = out_file.read().strip()
+	os.system("/bin/rm theout")
+if os.path.exists("theerr"):
+	with open("theerr","r") as err_file:
+		err = err_file.read().strip()
+	os.system("/bin/rm theerr")
+if err.endswith("ZeroDivisionError: integer division or modulo by zero") and out=="1 3\n2 6":
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+err+"> <"+out+">\n")
+
+sys.stdout.write("Test 24 (error value from a worker process) -- ")
+ret = run_cmd('--pythonWorkers 2 --pythonErr nan --set pythonBatch=4 -i /tmp/pytest_input w1 1 print "divide6(word(1))" nw')
+if ret=="1 3\n2 6\n3 NaN\n4 -6\n5 -3":
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret+">\n")
+
+# Each reply is larger than the initial size of the channel between the processes
+sys.stdout.write("Test 25 (large results from worker processes) -- ")
+ret = run_cmd('--pythonWorkers 2 -i /tmp/pytest_input print "big(word(1))" 1')
+if ret=="\n".join([str(i) * (3 << 19) for i in range(1,6)]):
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret[:80]+"...>\n")
+
+# The second run reads the functions from the saved table, and loads them again when called
+sys.stdout.write("Test 26 (pure functions are counted once) -- ")
+run_cmd('--stats -i /tmp/pytest_input print "where_pure(word(1))" 1')
+run_cmd('--stats -i /tmp/pytest_input print "where_pure(word(1))" 1')
+err = ""
+if os.path.exists("theerr"):
+	with open("theerr","r") as err_file:
+		err = err_file.read()
+	os.system("/bin/rm theerr")
+if "Calls to pure functions: 5 (3 functions)" in err:
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+err+">\n")
+
+os.system("/bin/rm /tmp/pytest_input /tmp/localfuncs.py.specsfuncs")
+
+# The specs server loads the local functions ahead of the requests. A request
+# loads them again if localfuncs.py has changed, or if it uses another SPECSPATH.
+def run_client(args, env):
+	p = subprocess.run(["../exe/specs-client"] + args, stdin=subprocess.DEVNULL,
+			stdout=subprocess.PIPE, stderr=subprocess.STDOUT, env=env)
+	return p.stdout.decode().strip()
+
+set_localfuncs("def ver():\n\treturn 'v1'\n")
+os.makedirs("/tmp/pytest_other", exist_ok=True)
+with open("/tmp/pytest_other/localfuncs.py", "w") as lf_file:
+	lf_file.write("def ver():\n\treturn 'other'\n")
+server_env = dict(os.environ, SPECSPATH="/tmp")
+server = subprocess.Popen(["../exe/specs", "--server", "thepysocket", "--pythonFuncs", "on"], env=server_env)
+for attempt in range(50):
+	if os.path.exists("thepysocket"):
+		break
+	time.sleep(0.1)
+client_env = dict(server_env, SPECS_SERVER="thepysocket")
+
+sys.stdout.write("Test 27 (functions preloaded by the specs server) -- ")
+ret = run_client(["--pythonFuncs", "on", "print", "ver()", "1"], client_env)
+if ret=="v1":
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret+">\n")
+
+set_localfuncs("def ver():\n\treturn 'v2 edited'\n")
+sys.stdout.write("Test 28 (changed functions are loaded again by a request) -- ")
+ret = run_client(["--pythonFuncs", "on", "print", "ver()", "1"], client_env)
+if ret=="v2 edited":
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret+">\n")
+
+del client_env["SPECSPATH"]
+sys.stdout.write("Test 29 (a request with another SPECSPATH) -- ")
+ret = run_client(["--pythonFuncs", "on", "--set", "SPECSPATH=/tmp/pytest_other", "print", "ver()", "1"], client_env)
+if ret=="other":
+	sys.stdout.write("OK\n")
+else:
+	sys.stdout.write("Not OK: <"+ret+">\n")
+
+server.terminate()
+server.wait()
+set_localfuncs(None)
+os.system("/bin/rm -rf /tmp/pytest_other /tmp/localfuncs.py.specsfuncs thepysocket")
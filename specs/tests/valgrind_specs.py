@@ -1,15 +1,15 @@
-import memcheck,input_samples,sys,argparse
+import memcheck,input_samples,sys,argparse,os,subprocess,time,atexit,tempfile,shutil,random
 
 case_counter = 0
 
 tests_to_run = None
 
-def run_case(spec, input, description, expected_rc=memcheck.RetCode_SUCCESS, conf="", inp2=None):
+def run_case(spec, input, description, expected_rc=memcheck.RetCode_SUCCESS, conf="", inp2=None, prog="../exe/specs"):
     global case_counter, tests_to_run
     case_counter = case_counter + 1
     if tests_to_run is not None and str(case_counter) not in tests_to_run:
     	return
-    (rc,info) = memcheck.leak_check_specs(spec,input,case_counter,conf,inp2)
+    (rc,info) = memcheck.leak_check_specs(spec,input,case_counter,conf,inp2,prog)
     sys.stdout.write("Test case #{} - {} - ".format(case_counter,description))
     if rc!=expected_rc:
         sys.stdout.write("Failed. RC={}; info={}; expected: {}\n".format(memcheck.RetCode_strings[rc],info,memcheck.RetCode_strings[expected_rc]))
@@ -17,6 +17,50 @@ def run_case(spec, input, description, expected_rc=memcheck.RetCode_SUCCESS, con
     else:
         sys.stdout.write("No leaks\n")
         
+# Removes files and directories that the cases create, also when a case fails
+def remove_at_exit(*paths):
+    def remove():
+        for path in paths:
+            if os.path.isdir(path):
+                shutil.rmtree(path, True)
+            elif os.path.exists(path):
+                os.remove(path)
+    atexit.register(remove)
+
+# Runs a program without valgrind, and returns its standard output
+def run_output(argv, input, env=None):
+    p = subprocess.run(argv, input=input, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True, env=env)
+    return p.stdout
+
+# Runs specs with --stats, and returns the first number after the label, or 0 if it is missing
+def stats_value(argv, input, label):
+    p = subprocess.run(argv[:1] + ["--stats"] + argv[1:], input=input, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, universal_newlines=True)
+    for line in p.stderr.split("\n"):
+        if line.strip().startswith(label):
+            return int(line.strip()[len(label):].split()[0])
+    return 0
+
+# How many times the frequency maps were spilled
+def spill_count(argv, input):
+    return stats_value(argv, input, "Spilled:")
+
+# Runs a program without valgrind, and returns its standard error
+def run_stderr(argv, input, env=None):
+    p = subprocess.run(argv, input=input, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, universal_newlines=True, env=env)
+    return p.stderr
+
+def check_output(description, got, expected):
+    global case_counter, tests_to_run
+    case_counter = case_counter + 1
+    if tests_to_run is not None and str(case_counter) not in tests_to_run:
+    	return
+    sys.stdout.write("Test case #{} - {} - ".format(case_counter,description))
+    if got!=expected:
+        sys.stdout.write("Failed. Got:\n{}\nExpected:\n{}\n".format(got,expected))
+        exit(4)
+    else:
+        sys.stdout.write("Output OK\n")
+
 # Parse the one command line options
 parser = argparse.ArgumentParser()
 parser.add_argument("--no_valgrind", dest="nvg", action="store_true", default=None,
@@ -165,6 +209,109 @@ Motto: "memento mori"
 '''
 run_case(s,i,"Fun with configured values",conf=c)
 
+s = "a: w1 . EOF print 'fmap_nelem(a)' 1 print 'fmap_common(a)' nw print 'fmap_dump(a,json,cd,1)' 1"
+i = "5\n7\n3\n7\n7\n5\n1\n9"
+c = \
+'''
+ApproximateFrequencyMaps: a:3
+'''
+run_case(s,i,"Approximate frequency map",conf=c)
+
+# Five values that are each more than 1/20 of the samples, among 20000 that appear once
+rng = random.Random(1)
+heavy = {"h{}".format(k) : 2000 + 100 * k for k in range(5)}
+vals = [v for v in heavy for n in range(heavy[v])] + ["n{}".format(n) for n in range(20000)]
+rng.shuffle(vals)
+i = "".join(v + "\n" for v in vals)
+s = "a: w1 . EOF print 'fmap_common(a)' 1 print 'fmap_dump(a,csv,cd,0,5)' nw"
+lines = run_output(["../exe/specs", "-s", "ApproximateFrequencyMaps=a:20", s], i).split("\n")
+common, first = lines[0].split(" ", 1)
+top = [first.split(",")] + [l.split(",") for l in lines[1:5]]
+check_output("Approximate frequency map tracks the most common values", " ".join(sorted(v for v, count, err in top)), " ".join(sorted(heavy)))
+check_output("Approximate frequency map counts are never too low", str(all(int(count) >= heavy[v] for v, count, err in top)), "True")
+check_output("Approximate frequency map common value", str(common in heavy), "True")
+
+# The distinct count is within three standard errors (3 x 0.81%)
+distinct = 100000
+i = "".join("u{}\n".format(n) for n in range(distinct))
+s = "a: w1 . EOF print 'fmap_nelem(a)' 1"
+estimate = int(run_output(["../exe/specs", "-s", "ApproximateFrequencyMaps=a", s], i))
+check_output("Approximate distinct count is within its error bound", str(abs(estimate - distinct) <= distinct * 3 * 0.0081), "True")
+
+s = "groupby k k: w1 . v: w2 . set '#0+=v' EOF id k 1 print 'sum(v)' nw print '#0' nw print 'fmap_nelem(v)' nw"
+i = "b 1\na 2\nb 3\nc 4\na 2"
+run_case(s,i,"Hashed group-by")
+
+# 30000 distinct values, each twice: enough to spill even at the minimum limit
+s = "a: w1 . EOF print 'fmap_nelem(a)' 1 print 'fmap_count(a,7)' nw print 'fmap_count(a,\"v17\")' nw print 'fmap_dump(a,csv,cd,1,3)' nw print 'fmap_dump(a,txt,sa,0,5)' nw"
+i = "".join("v{}\n".format(n * 7919 % 30000) for n in range(60000))
+c = \
+'''
+FrequencyMapMemoryLimit: 1K
+'''
+run_case(s,i,"Spilled frequency map",conf=c)
+check_output("Spilled frequency map matches the in-memory one",
+	run_output(["../exe/specs", "-s", "FrequencyMapMemoryLimit=1K", s], i), run_output(["../exe/specs", s], i))
+
+# Many small per-group maps must not be spilled over and over
+rng = random.Random(2)
+s = "groupby g g: w1 . v: w2 . EOF ID g 1 print 'fmap_nelem(v)' nw print 'fmap_count(v,\"k7\")' nw"
+for (groups, keys, records, limit) in [(1000, 51, 300000, "1M"), (4, 100000, 200000, "300K")]:
+	i = "".join("g{} k{}\n".format(rng.randrange(groups), rng.randrange(keys)) for n in range(records))
+	argv = ["../exe/specs", "-s", "FrequencyMapMemoryLimit=" + limit, s]
+	check_output("Spilling {} group maps with a {} limit".format(groups, limit), run_output(argv, i), run_output(["../exe/specs", s], i))
+	spills = spill_count(argv, i)
+	check_output("Spilling {} group maps only a few times ({})".format(groups, spills), str(spills < 100), "True")
+
+# Output fields that nobody else holds are converted and resized without a copy
+s = "w1 ucase 1 w2 1.10 right"
+i = "hello world\nfoo bar\n"
+argv = ["../exe/specs", s]
+check_output("Converting in place", str(stats_value(argv, i, "Converted or resized in place:")) + " " +
+	str(stats_value(argv, i, "Copied to be converted or resized:")), "4 0")
+s = "a: w1 ucase 1 print 'a' nw"
+argv = ["../exe/specs", s]
+check_output("Converting a field identifier's value", run_output(argv, i), "HELLO hello\nFOO foo\n")
+check_output("Copying a field identifier's value to convert it", str(stats_value(argv, i, "Copied to be converted or resized:")), "2")
+
+remove_at_exit("thelookup", "thelookup.specsidx")
+with open("thelookup", "w") as lk:
+	lk.write("b\tBravo\t2\na\tAlpha\t1\nc\tCharlie\t3\na\tAgain\t4\n")
+s = "w1 1 print 'lookup(\"refTable\",@@)' nw print 'lookup(\"refTable\",@@,2,\"none\")' nw"
+i = "a\nc\nd\nb"
+c = \
+'''
+refTable: thelookup
+'''
+run_case(s,i,"Lookup table",conf=c)
+
+s = "w1 1 print 'lookup(\"refTable\",@@)' nw print 'lookup(\"refTable\",@@,2,\"none\")' nw print 'lookup(\"refTable\",@@,3)' nw"
+expected = "a a\tAlpha\t1 Alpha 1\nc c\tCharlie\t3 Charlie 3\nd NaN none NaN\nb b\tBravo\t2 Bravo 2\n"
+argv = ["../exe/specs", "-s", "refTable=thelookup", "-s", "LookupIndexCache=1", s]
+if os.path.exists("thelookup.specsidx"):
+	os.remove("thelookup.specsidx")
+check_output("Lookup table hits and misses", run_output(argv, i), expected)
+check_output("Lookup table from a saved index", str(os.path.exists("thelookup.specsidx")) + " " + run_output(argv, i), "True " + expected)
+
+# An index whose slots are all taken must not make lookups loop forever
+with open("thelookup.specsidx", "r+b") as idx:
+	idx.seek(-16 * 8, os.SEEK_END)
+	idx.write(b"\x01\x00\x00\x00\x00\x00\x00\x00" * 16)
+check_output("Lookup table with a full index", run_output(argv, "d\n"), "d NaN none NaN\n")
+
+shutil.rmtree("thecache", True)   # specs creates the directory
+remove_at_exit("thecache")
+s = "a: w1 . set '#0+=a' print 'a*2' 1 print '#0' nw EOF print '#0' 1"
+i = "5\n7\n3"
+c = \
+'''
+specCache: thecache
+'''
+run_case(s,i,"Compiling into the specification cache",conf=c)
+check_output("Creating the specification cache directory",
+	str(os.path.isdir("thecache") and len(os.listdir("thecache"))), "1")
+run_case(s,i,"Running from the specification cache",conf=c)
+
 s = "print '@version' 1 print '@@' nw"
 i = "cat"
 run_case(s,i,"entire line and version")
@@ -735,3 +882,77 @@ s = \
 """
 run_case(s,i,"inline variable")
 
+# --fast-start applies the settings in the configuration file at startup
+remove_at_exit("thefastconf")
+with open("thefastconf", "w") as f:
+	f.write("timezone: Asia/Kolkata\ngreeting: Hello\n")
+s = ["-c", "thefastconf", "w1 s2tf '%H:%M' 1"]
+i = "0\n3600\n"
+check_output("Configuration settings with --fast-start", run_output(["../exe/specs", "--fast-start"]+s, i), run_output(["../exe/specs"]+s, i))
+s = ["-c", "thefastconf", "w1 s2tf '%H:%M' 1 @greeting nw"]
+check_output("Configured literals with --fast-start", run_output(["../exe/specs", "--fast-start"]+s, i), "05:30 Hello\n06:30 Hello\n")
+with open("thefastconf", "a") as f:
+	f.write("badline\n")
+check_output("An invalid configuration line with --fast-start",
+	str(run_stderr(["../exe/specs", "--fast-start"]+s, i).count("Invalid configuration file line")), "1")
+
+# Persistent variables, in a home directory of their own
+home = tempfile.mkdtemp(prefix="specs-home-")
+atexit.register(shutil.rmtree, home, True)
+env = dict(os.environ, HOME=home)
+pfile = os.path.join(home, ".specs_persistent")
+
+s = "print \"pset('x','hello')\" 1 print \"pset('y',42)\" nw print \"pset('z',7)\" nw"
+run_output(["../exe/specs", s], "a\n", env)
+s = "print \"pclear('z')\" 1"
+check_output("Clearing a persistent variable", run_output(["../exe/specs", s], "a\n", env), "7\n")
+s = "print \"pget('x')\" 1 print \"pget('y')\" nw print \"pdefined('z')\" nw print \"pget('z','none')\" nw"
+check_output("Persistent variables in a later run", run_output(["../exe/specs", s], "a\n", env), "hello 42 0 none\n")
+
+# A file in the older text format is read, and converted when a variable changes
+with open(pfile, "w") as f:
+	f.write("b\nBravo\na\nAlpha\n")
+os.chmod(pfile, 0o640)
+s = "print \"pget('a')\" 1 print \"pget('b')\" nw print \"pset('c','Charlie')\" nw"
+check_output("Reading a text persistence file", run_output(["../exe/specs", s], "a\n", env), "Alpha Bravo Charlie\n")
+with open(pfile, "rb") as f:
+	converted = f.read(8) == b"SPECSPV1"
+check_output("Converting a text persistence file", str(converted), "True")
+check_output("Keeping the permissions of the persistence file", oct(os.stat(pfile).st_mode & 0o777), oct(0o640))
+s = "print \"pget('a')\" 1 print \"pget('b')\" nw print \"pget('c')\" nw"
+check_output("Reading a converted persistence file", run_output(["../exe/specs", s], "a\n", env), "Alpha Bravo Charlie\n")
+
+# Writers that end at the same time keep each other's changes
+writers = []
+for n in range(8):
+	s = "print \"pset('w{0}',{0})\" 1".format(n)
+	writers.append(subprocess.Popen(["../exe/specs", s], stdin=subprocess.PIPE, stdout=subprocess.DEVNULL, env=env))
+for w in writers:
+	w.communicate(b"".join(b"r\n" for r in range(2000)))
+s = " ".join("print \"pget('w{0}')\" nw".format(n) for n in range(8)) + " print \"pget('a')\" nw"
+check_output("Concurrent writers of persistent variables", run_output(["../exe/specs", s], "a\n", env), "0 1 2 3 4 5 6 7 Alpha\n")
+
+# The server's switches must not change the output of the requests
+server = subprocess.Popen(["../exe/specs", "--server", "thesocket", "--timezone", "Asia/Kolkata"])
+atexit.register(server.terminate)   # also when a case fails
+for attempt in range(50):
+	if os.path.exists("thesocket"):
+		break
+	time.sleep(0.1)
+os.environ["SPECS_SERVER"] = "thesocket"
+
+s = "a: w1 . set '#0+=a' w2 1 print '#0' nw"
+i = "5 five\n7 seven\n3 three"
+run_case(s,i,"Through the specs server",prog="../exe/specs-client")
+
+s = "w1 1 w2 d2x nw"
+i = "5 five"
+run_case(s,i,"Failure through the specs server",expected_rc=memcheck.RetCode_COMMAND_FAILED,prog="../exe/specs-client")
+
+s = ["w1", "s2tf", "%H:%M", "1"]
+i = "0\n"
+check_output("Same output through the specs server", run_output(["../exe/specs-client"]+s, i), run_output(["../exe/specs"]+s, i))
+s = ["--timezone", "Asia/Kolkata", "w1", "s2tf", "%H:%M", "1"]
+check_output("Same output through the specs server with a switch", run_output(["../exe/specs-client"]+s, i), run_output(["../exe/specs"]+s, i))
+
+del os.environ["SPECS_SERVER"]